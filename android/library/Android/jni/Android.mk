@@ -112,8 +112,8 @@ AA_SRC_DIR = $(BASE_DIR)/common/local_libs/aaplus
 LOCAL_SRC_FILES += $(AA_SRC_FILES:%=$(AA_SRC_DIR)/%)
 
 MAPLY_CORE_SRC_FILES := BaseInfo.cpp BasicDrawable.cpp BasicDrawableInstance.cpp BigDrawable.cpp BillboardDrawable.cpp BillboardManager.cpp \
-					CoordSystem.cpp Cullable.cpp DefaultShaderPrograms.cpp Dictionary.cpp Drawable.cpp DynamicDrawableAtlas.cpp \
-                    			DynamicTextureAtlas.cpp FlatMath.cpp FontTextureManager.cpp \
+					ChangeQueue.cpp ClusterHierarchy.cpp CoordSystem.cpp CoordSystemConverter.cpp Cullable.cpp DefaultShaderPrograms.cpp Dictionary.cpp Drawable.cpp DynamicDrawableAtlas.cpp \
+                    			DynamicTextureAtlas.cpp FlatCullTree.cpp FlatMath.cpp FontTextureManager.cpp FrameProfiler.cpp FrustumBatch.cpp \
 					GLUtils.cpp Generator.cpp GlobeMath.cpp GlobeScene.cpp GlobeView.cpp GlobeViewState.cpp GeometryManager.cpp GridClipper.cpp \
 					Identifiable.cpp IntersectionManager.cpp LabelManager.cpp LabelRenderer.cpp LayoutManager.cpp LoadedTile.cpp Lighting.cpp \
 					MapboxVectorTileParser.cpp MaplyFlatView.cpp MaplyScene.cpp MaplyView.cpp MaplyViewState.cpp MarkerManager.cpp Moon.cpp \
@@ -121,9 +121,9 @@ MAPLY_CORE_SRC_FILES := BaseInfo.cpp BasicDrawable.cpp BasicDrawableInstance.cpp
 					ParticleSystemManager.cpp ParticleSystemDrawable.cpp PerformanceTimer.cpp Proj4CoordSystem.cpp \
 					QuadDisplayController.cpp Quadtree.cpp QuadTracker.cpp RawData.cpp \
 					Scene.cpp SceneRendererES.cpp SceneRendererES2.cpp ScreenImportance.cpp ScreenObject.cpp ScreenSpaceBuilder.cpp \
-					ScreenSpaceDrawable.cpp ShapeDrawableBuilder.cpp ShapeManager.cpp Sun.cpp \
-					SelectionManager.cpp ShapeReader.cpp SphericalEarthChunkManager.cpp SphericalMercator.cpp \
-					Tesselator.cpp Texture.cpp TextureAtlas.cpp TileQuadLoader.cpp TileQuadOfflineRenderer.cpp \
+					ScratchArena.cpp ScreenSpaceDrawable.cpp ShapeDrawableBuilder.cpp ShapeManager.cpp Sun.cpp \
+					SelectionIndex.cpp SelectionManager.cpp ShapeReader.cpp SphericalEarthChunkManager.cpp SphericalMercator.cpp \
+					TaskScheduler.cpp Tesselator.cpp Texture.cpp TextureAtlas.cpp TileQuadLoader.cpp TileQuadOfflineRenderer.cpp \
 					VectorData.cpp vector_tile.pb.cpp VectorManager.cpp VectorObject.cpp ViewState.cpp \
 					WideVectorDrawable.cpp WideVectorManager.cpp WhirlyGeometry.cpp WhirlyKitView.cpp WhirlyVector.cpp \
 					GeoJSONSource.cpp
@@ -475,9 +475,13 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_LAZQuadReader_processTileNative
         long long which = 0;
         double minZ=MAXFLOAT,maxZ=-MAXFLOAT;
         int pointStart = 0;
+        // Read all the points first so we can convert them in one batch
+        Point3dVector coords(count);
+        std::vector<Vector4f,Eigen::aligned_allocator<Vector4f> > colors;
+        if (hasColors)
+            colors.resize(count);
         while (which < count)
         {
-            // Get the point and convert to geocentric
             laszip_seek_point(thisReader,(which+pointStart));
             laszip_read_point(thisReader);
             laszip_point_struct *p;
@@ -485,7 +489,7 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_LAZQuadReader_processTileNative
             //                double x,y,z;
             //                x = p.GetX(), y = p.GetY(); z = p.GetZ();
             //                trans->TransformEx(1, &x, &y, &z);
-            Point3d coord;
+            Point3d &coord = coords[which];
             coord.x() = p->X * header->x_scale_factor + header->x_offset;
             coord.y() = p->Y * header->y_scale_factor + header->y_offset;
             coord.z() = p->Z * header->z_scale_factor + header->z_offset;
@@ -494,33 +498,39 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_LAZQuadReader_processTileNative
             minZ = std::min(coord.z(),minZ);
             maxZ = std::max(coord.z(),maxZ);
             
-            Point3d loc3d = CoordSystemConvert3d(lazReader->coordSys, coordAdapter->getCoordSystem(), coord);
-            Point3d dispCoord = coordAdapter->localToDisplay(loc3d);
-            Point3d dispCoordCenter = dispCoord - *tileCenterDisp;
-
-//            __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "LIDAR Point: (%f,%f,%f)",dispCoordCenter.x(),dispCoordCenter.y(),dispCoordCenter.z());
-
-            float red = 1.0,green = 1.0, blue = 1.0;
-            if (hasColors)
-            {
-                red = p->rgb[0] / (float)lazReader->colorScale;
-                green = p->rgb[1] / (float)lazReader->colorScale;
-                blue = p->rgb[2] / (float)lazReader->colorScale;
-            }
-            
-            points->addPoint(vertIdx,dispCoordCenter);
             if (hasColors)
             {
-//              __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "LIDAR color: (%f,%f,%f), (%d,%d,%d), (%d)",red,green,blue,p->rgb[0],p->rgb[1],p->rgb[2],lazReader->colorScale);
-                points->addPoint(colorIdx,Vector4f(red,green,blue,1.0));
+                float red = p->rgb[0] / (float)lazReader->colorScale;
+                float green = p->rgb[1] / (float)lazReader->colorScale;
+                float blue = p->rgb[2] / (float)lazReader->colorScale;
+                colors[which] = Vector4f(red,green,blue,1.0);
             }
-            points->addValue(elevIdx,(float)coord.z());
             
 //            meshBuilder.addPoint(Point3d(coord.x,coord.y,coord.z));
             
             which++;
         }
         
+        // Convert to display coordinates in one go, rather than two virtual calls per point
+        Point3dVector dispCoords(count);
+        if (count > 0)
+        {
+            CoordSystemConvert3dBatch(lazReader->coordSys, coordAdapter->getCoordSystem(), &coords[0], &dispCoords[0], count);
+            coordAdapter->localToDisplay(&dispCoords[0], &dispCoords[0], count);
+        }
+        
+        for (int ii=0;ii<count;ii++)
+        {
+            Point3d dispCoordCenter = dispCoords[ii] - *tileCenterDisp;
+
+//            __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "LIDAR Point: (%f,%f,%f)",dispCoordCenter.x(),dispCoordCenter.y(),dispCoordCenter.z());
+
+            points->addPoint(vertIdx,dispCoordCenter);
+            if (hasColors)
+                points->addPoint(colorIdx,colors[ii]);
+            points->addValue(elevIdx,(float)coords[ii].z());
+        }
+        
         // Keep track of tile size
         if (minZ == maxZ)
             maxZ += 1.0;
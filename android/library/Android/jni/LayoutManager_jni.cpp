@@ -292,6 +292,60 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setMaxDisplayObjec
     }
 }
 
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setIncrementalLayout
+  (JNIEnv *env, jobject obj, jboolean incremental, jfloat moveThreshold)
+{
+    try
+    {
+        LayoutManagerWrapperClassInfo *classInfo = LayoutManagerWrapperClassInfo::getClassInfo();
+        LayoutManagerWrapper *wrap = classInfo->getObject(env, obj);
+        if (!wrap)
+            return;
+
+        wrap->layoutManager->setIncrementalLayout(incremental,moveThreshold);
+    }
+    catch (...)
+    {
+        __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in LayoutManager::setIncrementalLayout()");
+    }
+}
+
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setParallelLayout
+  (JNIEnv *env, jobject obj, jboolean parallel)
+{
+    try
+    {
+        LayoutManagerWrapperClassInfo *classInfo = LayoutManagerWrapperClassInfo::getClassInfo();
+        LayoutManagerWrapper *wrap = classInfo->getObject(env, obj);
+        if (!wrap)
+            return;
+
+        wrap->layoutManager->setParallelLayout(parallel);
+    }
+    catch (...)
+    {
+        __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in LayoutManager::setParallelLayout()");
+    }
+}
+
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setHierarchicalClustering
+  (JNIEnv *env, jobject obj, jboolean hierarchical)
+{
+    try
+    {
+        LayoutManagerWrapperClassInfo *classInfo = LayoutManagerWrapperClassInfo::getClassInfo();
+        LayoutManagerWrapper *wrap = classInfo->getObject(env, obj);
+        if (!wrap)
+            return;
+
+        wrap->layoutManager->setHierarchicalClustering(hierarchical);
+    }
+    catch (...)
+    {
+        __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in LayoutManager::setHierarchicalClustering()");
+    }
+}
+
 JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_updateLayout
   (JNIEnv *env, jobject obj, jobject viewStateObj, jobject changeSetObj)
 {
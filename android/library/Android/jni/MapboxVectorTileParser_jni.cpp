@@ -74,7 +74,7 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_dispose
 }
 
 JNIEXPORT jobjectArray JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_parseDataNative
-(JNIEnv *env, jobject obj, jbyteArray data, jdouble minX, jdouble minY, jdouble maxX, jdouble maxY)
+(JNIEnv *env, jobject obj, jbyteArray data, jdouble minX, jdouble minY, jdouble maxX, jdouble maxY, jlong controllerID, jint x, jint y, jint level)
 {
     try
     {
@@ -87,33 +87,49 @@ JNIEXPORT jobjectArray JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_p
         mbr.addPoint(Point2f(minX,minY));
         mbr.addPoint(Point2f(maxX,maxY));
         
+        // Tiles being paged in are decoded as part of the tile's task group
+        TaskScheduler *scheduler = TaskScheduler::getScheduler();
+        TaskGroupRef group;
+        if (controllerID != EmptyIdentity)
+        {
+            group = scheduler->findTileGroup(controllerID,Quadtree::Identifier(x,y,level));
+            // The controller is no longer interested in this tile
+            if (!group)
+                return NULL;
+        } else
+            group = TaskGroupRef(new TaskGroup(scheduler,0.0));
+        
         // Parse vector tile and create vector objects
         jbyte *bytes = env->GetByteArrayElements(data,NULL);
         RawDataWrapper rawData(bytes,env->GetArrayLength(data),false);
         std::vector<VectorObject *> vecObjs;
-        bool ret = inst->parseVectorTile(&rawData,vecObjs,mbr);
+        bool ret = inst->parseVectorTile(&rawData,vecObjs,mbr,&inst->filter,group.get());
         env->ReleaseByteArrayElements(data,bytes, 0);
         
-        if (vecObjs.empty())
+        // The controller let go of the tile partway through.  Null tells the caller not to report it.
+        if (group->isCancelled())
         {
+            for (VectorObject *vecObj : vecObjs)
+                delete vecObj;
             return NULL;
-        } else {
-            VectorObjectClassInfo *vecClassInfo = VectorObjectClassInfo::getClassInfo();
-            if (!vecClassInfo)
-                vecClassInfo = VectorObjectClassInfo::getClassInfo(env,"com/mousebird/maply/VectorObject");
-            jobjectArray retArr = env->NewObjectArray(vecObjs.size(), vecClassInfo->getClass(), NULL);
+        }
+        
+        // An empty tile comes back as an empty array
+        VectorObjectClassInfo *vecClassInfo = VectorObjectClassInfo::getClassInfo();
+        if (!vecClassInfo)
+            vecClassInfo = VectorObjectClassInfo::getClassInfo(env,"com/mousebird/maply/VectorObject");
+        jobjectArray retArr = env->NewObjectArray(vecObjs.size(), vecClassInfo->getClass(), NULL);
 
-            int which = 0;
-            for (VectorObject *vecObj : vecObjs)
-            {
-                jobject vecObjObj = MakeVectorObject(env,vecObj);
-                env->SetObjectArrayElement( retArr, which, vecObjObj);
-                env->DeleteLocalRef( vecObjObj);
-                which++;
-            }
-            
-            return retArr;
+        int which = 0;
+        for (VectorObject *vecObj : vecObjs)
+        {
+            jobject vecObjObj = MakeVectorObject(env,vecObj);
+            env->SetObjectArrayElement( retArr, which, vecObjObj);
+            env->DeleteLocalRef( vecObjObj);
+            which++;
         }
+        
+        return retArr;
     }
     catch (...)
     {
@@ -122,3 +138,47 @@ JNIEXPORT jobjectArray JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_p
     
     return NULL;
 }
+
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_addLayerFilter
+(JNIEnv *env, jobject obj, jstring layerNameStr, jobjectArray attrNameArr, jintArray geomTypeArr)
+{
+    try
+    {
+        MapboxVectorTileParserClassInfo *classInfo = MapboxVectorTileParserClassInfo::getClassInfo();
+        MapboxVectorTileParser *inst = classInfo->getObject(env,obj);
+        if (!inst || !layerNameStr)
+            return;
+        
+        MapboxVectorTileFilter::LayerFilter layerFilter;
+        if (attrNameArr)
+        {
+            layerFilter.allAttrs = false;
+            int attrCount = env->GetArrayLength(attrNameArr);
+            for (int ii=0;ii<attrCount;ii++)
+            {
+                jstring attrNameStr = (jstring)env->GetObjectArrayElement(attrNameArr,ii);
+                if (attrNameStr)
+                {
+                    JavaString attrName(env,attrNameStr);
+                    layerFilter.attrNames.insert(attrName.cStr);
+                }
+                env->DeleteLocalRef(attrNameStr);
+            }
+        }
+        if (geomTypeArr)
+        {
+            std::vector<int> geomTypes;
+            ConvertIntArray(env,geomTypeArr,geomTypes);
+            for (int geomType : geomTypes)
+                if (geomType >= GeomTypePoint && geomType <= GeomTypePolygon)
+                    layerFilter.geomTypes |= 1 << geomType;
+        }
+        
+        JavaString layerName(env,layerNameStr);
+        inst->filter.addLayer(layerName.cStr,layerFilter);
+    }
+    catch (...)
+    {
+        __android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in MapboxVectorTileParser::addLayerFilter()");
+    }
+}
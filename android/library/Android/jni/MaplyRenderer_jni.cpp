@@ -194,6 +194,70 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_setPerfInterval
 	}
 }
 
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_setFrameProfilerEnable
+  (JNIEnv *env, jobject obj, jboolean enable)
+{
+	try
+	{
+		MaplySceneRendererInfo *classInfo = MaplySceneRendererInfo::getClassInfo();
+		MaplySceneRenderer *renderer = classInfo->getObject(env,obj);
+		if (!renderer || !renderer->getScene())
+			return;
+
+		renderer->getScene()->getProfiler()->setEnable(enable);
+	}
+	catch (...)
+	{
+		__android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in MaplyRenderer::setFrameProfilerEnable()");
+	}
+}
+
+JNIEXPORT jboolean JNICALL Java_com_mousebird_maply_MaplyRenderer_writeFrameProfile
+  (JNIEnv *env, jobject obj, jstring fileNameStr)
+{
+	try
+	{
+		MaplySceneRendererInfo *classInfo = MaplySceneRendererInfo::getClassInfo();
+		MaplySceneRenderer *renderer = classInfo->getObject(env,obj);
+		if (!renderer || !renderer->getScene())
+			return false;
+
+		const char *cStr = env->GetStringUTFChars(fileNameStr,0);
+		if (!cStr)
+			return false;
+		std::string fileName(cStr);
+		env->ReleaseStringUTFChars(fileNameStr, cStr);
+
+		return renderer->getScene()->getProfiler()->writeChromeTrace(fileName);
+	}
+	catch (...)
+	{
+		__android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in MaplyRenderer::writeFrameProfile()");
+	}
+
+	return false;
+}
+
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_trimGLMemory
+  (JNIEnv *env, jobject obj, jboolean all)
+{
+	try
+	{
+		MaplySceneRendererInfo *classInfo = MaplySceneRendererInfo::getClassInfo();
+		MaplySceneRenderer *renderer = classInfo->getObject(env,obj);
+		if (!renderer || !renderer->getScene())
+			return;
+
+		// The free buffers go on the next frame, since that's when we have a context
+		OpenGLMemManager *memManager = renderer->getScene()->getMemManager();
+		memManager->requestTrim(all ? 0 : memManager->getMaxPooledBytes()/2);
+	}
+	catch (...)
+	{
+		__android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in MaplyRenderer::trimGLMemory()");
+	}
+}
+
 JNIEXPORT jboolean JNICALL Java_com_mousebird_maply_MaplyRenderer_teardown
   (JNIEnv *, jobject)
 {
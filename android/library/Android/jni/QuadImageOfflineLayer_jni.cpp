@@ -252,6 +252,35 @@ public:
         return import;
     }
     
+    /// Bound the importance for a tile we've looked at before
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs,double &minImport,double &maxImport)
+    {
+        if (ident.level == 0)
+        {
+            minImport = maxImport = MAXFLOAT;
+            return true;
+        }
+        
+        // Only the screen importance is cached
+        if (canShortCircuitImportance && maxShortCircuitLevel != -1)
+            return false;
+        
+        // Note: Invalid tiles never get as far as caching a display solid, so we needn't ask Java again
+        if (!ScreenImportanceBounds(viewState, frameSize, tileSize, attrs, minImport, maxImport))
+            return false;
+        minImport *= importanceScale;
+        maxImport *= importanceScale;
+        
+        return true;
+    }
+
+    /// Settle the tiles that are off screen in one batch
+    virtual void tilesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,ViewState *viewState,const Point2f &frameSize,std::vector<bool> &offScreen)
+    {
+        // The top level is always important
+        TilesOffScreen(viewState, nodes, 1, offScreen);
+    }
+    
     // Calculate a target zoom level for display
     int targetZoomLevel(ViewState *viewState)
     {
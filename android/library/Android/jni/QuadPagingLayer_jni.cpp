@@ -218,6 +218,35 @@ public:
         
         return import;
     }
+    
+    /// Bound the importance for a tile we've looked at before
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs,double &minImport,double &maxImport)
+    {
+        if (ident.level <= 1)
+        {
+            minImport = maxImport = MAXFLOAT;
+            return true;
+        }
+        
+        // Only the screen importance is cached
+        if (canShortCircuitImportance && maxShortCircuitLevel != -1)
+            return false;
+        
+        if (!ScreenImportanceBounds(viewState, frameSize, 1, attrs, minImport, maxImport))
+            return false;
+        double div = useParentTileBounds ? 4.0 : 1.0;
+        minImport /= div;
+        maxImport /= div;
+        
+        return true;
+    }
+
+    /// Settle the tiles that are off screen in one batch
+    virtual void tilesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,ViewState *viewState,const Point2f &frameSize,std::vector<bool> &offScreen)
+    {
+        // The top two levels are always important
+        TilesOffScreen(viewState, nodes, 2, offScreen);
+    }
 
     // Calculate a target zoom level for display
     int targetZoomLevel(ViewState *viewState)
@@ -805,3 +834,21 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_QuadPagingLayer_nativeTileDidNot
 	}
 }
 
+JNIEXPORT jlong JNICALL Java_com_mousebird_maply_QuadPagingLayer_nativeGetControllerID
+  (JNIEnv *env, jobject obj)
+{
+	try
+	{
+		QuadPagingLayerAdapter *adapter = QPLAdapterClassInfo::getClassInfo()->getObject(env,obj);
+		if (!adapter || !adapter->getController())
+			return EmptyIdentity;
+
+		return adapter->getController()->getId();
+	}
+	catch (...)
+	{
+		__android_log_print(ANDROID_LOG_VERBOSE, "Maply", "Crash in QuadPagingLayer::nativeGetControllerID()");
+	}
+
+	return EmptyIdentity;
+}
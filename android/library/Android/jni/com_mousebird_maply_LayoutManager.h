@@ -15,6 +15,30 @@ extern "C" {
 JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setMaxDisplayObjects
   (JNIEnv *, jobject, jint);
 
+/*
+ * Class:     com_mousebird_maply_LayoutManager
+ * Method:    setIncrementalLayout
+ * Signature: (ZF)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setIncrementalLayout
+  (JNIEnv *, jobject, jboolean, jfloat);
+
+/*
+ * Class:     com_mousebird_maply_LayoutManager
+ * Method:    setParallelLayout
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setParallelLayout
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     com_mousebird_maply_LayoutManager
+ * Method:    setHierarchicalClustering
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_LayoutManager_setHierarchicalClustering
+  (JNIEnv *, jobject, jboolean);
+
 /*
  * Class:     com_mousebird_maply_LayoutManager
  * Method:    updateLayout
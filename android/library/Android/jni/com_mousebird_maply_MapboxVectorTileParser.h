@@ -18,10 +18,18 @@ extern "C" {
 /*
  * Class:     com_mousebird_maply_MapboxVectorTileParser
  * Method:    parseDataNative
- * Signature: ([BDDDD)[Lcom/mousebird/maply/VectorObject;
+ * Signature: ([BDDDDJIII)[Lcom/mousebird/maply/VectorObject;
  */
 JNIEXPORT jobjectArray JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_parseDataNative
-  (JNIEnv *, jobject, jbyteArray, jdouble, jdouble, jdouble, jdouble);
+  (JNIEnv *, jobject, jbyteArray, jdouble, jdouble, jdouble, jdouble, jlong, jint, jint, jint);
+
+/*
+ * Class:     com_mousebird_maply_MapboxVectorTileParser
+ * Method:    addLayerFilter
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[I)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MapboxVectorTileParser_addLayerFilter
+  (JNIEnv *, jobject, jstring, jobjectArray, jintArray);
 
 /*
  * Class:     com_mousebird_maply_MapboxVectorTileParser
@@ -71,6 +71,30 @@ JNIEXPORT jboolean JNICALL Java_com_mousebird_maply_MaplyRenderer_hasChanges
 JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_setPerfInterval
   (JNIEnv *, jobject, jint);
 
+/*
+ * Class:     com_mousebird_maply_MaplyRenderer
+ * Method:    setFrameProfilerEnable
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_setFrameProfilerEnable
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     com_mousebird_maply_MaplyRenderer
+ * Method:    writeFrameProfile
+ * Signature: (Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_mousebird_maply_MaplyRenderer_writeFrameProfile
+  (JNIEnv *, jobject, jstring);
+
+/*
+ * Class:     com_mousebird_maply_MaplyRenderer
+ * Method:    trimGLMemory
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_mousebird_maply_MaplyRenderer_trimGLMemory
+  (JNIEnv *, jobject, jboolean);
+
 /*
  * Class:     com_mousebird_maply_MaplyRenderer
  * Method:    addLight
@@ -159,6 +159,14 @@ JNIEXPORT void JNICALL Java_com_mousebird_maply_QuadPagingLayer_nativeTileDidLoa
 JNIEXPORT void JNICALL Java_com_mousebird_maply_QuadPagingLayer_nativeTileDidNotLoad
   (JNIEnv *, jobject, jint, jint, jint);
 
+/*
+ * Class:     com_mousebird_maply_QuadPagingLayer
+ * Method:    nativeGetControllerID
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_mousebird_maply_QuadPagingLayer_nativeGetControllerID
+  (JNIEnv *, jobject);
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,37 @@ class LayoutManager
 	 * @param numObjects Maximum number of objects to display.
 	 */
 	public native void setMaxDisplayObjects(int numObjects);
+
+	/**
+	 * Keep the last pass's placements from one layout to the next.
+	 * Objects that were showing are checked in their old spots first
+	 * and hidden objects that haven't moved are only retried when
+	 * something near them goes away.
+	 *
+	 * @param incremental Turn incremental layout on or off.
+	 * @param moveThreshold How far (in pixels) an object can move before it's laid out from scratch.
+	 */
+	public native void setIncrementalLayout(boolean incremental,float moveThreshold);
+
+	/**
+	 * Lay out different parts of the screen in parallel.  Labels
+	 * that could land in more than one part are placed afterward,
+	 * so the result can differ a little from the normal layout.
+	 * Incremental layout and a maximum object count turn this off.
+	 *
+	 * @param parallel Turn parallel layout on or off.
+	 */
+	public native void setParallelLayout(boolean parallel);
+
+	/**
+	 * Cluster markers from a hierarchy of clusters for every zoom
+	 * level, built once in the background, rather than working the
+	 * clusters out on screen every time.  Markers added after a build
+	 * show up on their own until the next build is ready.
+	 *
+	 * @param hierarchical Turn hierarchical clustering on or off.
+	 */
+	public native void setHierarchicalClustering(boolean hierarchical);
 	
 	/**
 	 * Run the layout logic on the currently active objects.  Any
@@ -57,12 +57,46 @@ public class MapboxVectorTileParser
     public DataReturn parseData(byte[] data,Mbr mbr)
     {
         DataReturn dataReturn = new DataReturn();
-        dataReturn.vectorObjects = parseDataNative(data,mbr.ll.getX(),mbr.ll.getY(),mbr.ur.getX(),mbr.ur.getY());
+        dataReturn.vectorObjects = parseDataNative(data,mbr.ll.getX(),mbr.ll.getY(),mbr.ur.getX(),mbr.ur.getY(),0,-1,-1,-1);
 
         return dataReturn;
     }
 
-    native VectorObject[] parseDataNative(byte[] data,double minX,double minY,double maxX,double maxY);
+    /**
+     * Parse the data for a tile being paged in by the given layer.
+     * The layers in the tile are decoded in parallel on the native task scheduler at the tile's
+     * importance.  If the layer unloads the tile partway through, parsing stops and you'll get
+     * back null.  The layer isn't waiting on the tile any more, so there's nothing to report.
+     *
+     * @param data The input data to parse.  You should have fetched this on your own.
+     * @param mbr Bounding box for the tile in spherical mercator.
+     * @param layer The paging layer that asked for the tile.
+     * @param tileID Which tile this is.
+     * @return Returns null if the layer let go of the tile.
+     */
+    public DataReturn parseData(byte[] data,Mbr mbr,QuadPagingLayer layer,MaplyTileID tileID)
+    {
+        DataReturn dataReturn = new DataReturn();
+        dataReturn.vectorObjects = parseDataNative(data,mbr.ll.getX(),mbr.ll.getY(),mbr.ur.getX(),mbr.ur.getY(),
+                layer.getControllerID(),tileID.x,tileID.y,tileID.level);
+        if (dataReturn.vectorObjects == null)
+            return null;
+
+        return dataReturn;
+    }
+
+    native VectorObject[] parseDataNative(byte[] data,double minX,double minY,double maxX,double maxY,long controllerID,int x,int y,int level);
+
+    /**
+     * Only build objects for the given layer, and only with the given attributes and geometry types.
+     * Once you add a layer, any layer you haven't added is skipped.  Add nothing and you get everything.
+     * Set this up before you start parsing.
+     *
+     * @param layerName Name of the layer to keep.
+     * @param attrNames Attributes to keep.  Pass null to keep them all.
+     * @param geomTypes Geometry types to keep (GeomTypePoint and so on).  Pass null to keep them all.
+     */
+    public native void addLayerFilter(String layerName,String[] attrNames,int[] geomTypes);
 
     public void finalize()
     {
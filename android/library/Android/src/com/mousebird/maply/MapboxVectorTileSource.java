@@ -99,7 +99,8 @@ public class MapboxVectorTileSource implements QuadPagingLayer.PagingInterface
         return newPt;
     }
 
-    // Process data returned from an MBTiles file or network request
+    // Process data returned from an MBTiles file or network request.
+    // Returns false if the tile was dropped without being reported, because the layer let go of it or we're shutting down.
     boolean processData(final QuadPagingLayer layer,final MaplyTileID tileID,byte[] tileData)
     {
         ArrayList<ComponentObject> tileCompObjs = new ArrayList<ComponentObject>();
@@ -132,8 +133,9 @@ public class MapboxVectorTileSource implements QuadPagingLayer.PagingInterface
             if (ourTileParser == null)
                 return false;
 
-            MapboxVectorTileParser.DataReturn dataObjs = ourTileParser.parseData(tileData, mbr);
+            MapboxVectorTileParser.DataReturn dataObjs = ourTileParser.parseData(tileData, mbr, layer, tileID);
 
+            // The layer unloaded the tile while we were parsing it
             if (dataObjs == null)
                 return false;
 
@@ -182,7 +184,7 @@ public class MapboxVectorTileSource implements QuadPagingLayer.PagingInterface
             layer.tileDidLoad(tileID);
 
             // Explicitly dispose of vector objects for efficiency
-            if (disposeAfterRemoval)
+            if (disposeAfterRemoval && dataObjs.vectorObjects != null)
             {
                 for (VectorObject vecObj : dataObjs.vectorObjects)
                     vecObj.dispose();
@@ -402,6 +404,10 @@ public class MapboxVectorTileSource implements QuadPagingLayer.PagingInterface
                         fOut.write(tileData);
                         fOut.close();
                     }
+                } else {
+                    // Nobody's waiting on this one any more
+                    clear();
+                    return;
                 }
 
                 if (debugOutput) {
@@ -2,6 +2,7 @@ package com.mousebird.maply;
 
 import android.app.Activity;
 import android.app.ActivityManager;
+import android.content.ComponentCallbacks2;
 import android.content.Context;
 import android.content.pm.ConfigurationInfo;
 import android.graphics.Bitmap;
@@ -750,6 +751,8 @@ public class MaplyBaseController
 
 			// Debugging output
 			renderWrapper.maplyRender.setPerfInterval(perfInterval);
+			if (frameProfilerEnable)
+				renderWrapper.maplyRender.setFrameProfilerEnable(true);
 
 			// Kick off the layout layer
 			layoutLayer = new LayoutLayer(this, layoutManager);
@@ -964,6 +967,45 @@ public class MaplyBaseController
 			renderWrapper.maplyRender.setPerfInterval(perfInterval);
 	}
 
+	boolean frameProfilerEnable = false;
+	/**
+	 * Record per-frame timings and counters in a ring buffer.
+	 * This is cheap enough to leave on in the field.  Use writeFrameProfile() to get at them.
+	 * @param enable Turn recording on or off.  Turning it on starts from scratch.
+	 */
+	public void setFrameProfilerEnable(boolean enable)
+	{
+		frameProfilerEnable = enable;
+		if (renderWrapper != null && renderWrapper.maplyRender != null)
+			renderWrapper.maplyRender.setFrameProfilerEnable(frameProfilerEnable);
+	}
+
+	/**
+	 * Write out the recent frames the profiler has recorded in Chrome trace event format.
+	 * Load the file in chrome://tracing to look at it.
+	 * @param fileName Where to write the JSON.
+	 * @return Returns false if we couldn't write the file or the renderer isn't set up yet.
+	 */
+	public boolean writeFrameProfile(String fileName)
+	{
+		if (renderWrapper == null || renderWrapper.maplyRender == null)
+			return false;
+		return renderWrapper.maplyRender.writeFrameProfile(fileName);
+	}
+
+	/**
+	 * Let go of OpenGL buffers we're keeping around for reuse.
+	 * Call this from your Activity's onTrimMemory().  The buffers are released on the next frame.
+	 * @param level The level passed to onTrimMemory().  Once the UI is hidden or memory is critical we drop them all, otherwise half.
+	 */
+	public void trimMemory(int level)
+	{
+		if (renderWrapper == null || renderWrapper.maplyRender == null)
+			return;
+		boolean all = level >= ComponentCallbacks2.TRIM_MEMORY_RUNNING_CRITICAL;
+		renderWrapper.maplyRender.trimGLMemory(all);
+	}
+
 	/** Calculate the height that corresponds to a given Mapnik-style map scale.
 	 * <br>
 	 * Figure out the viewer height that corresponds to a given scale denominator (ala Mapnik).
@@ -134,6 +134,9 @@ public class MaplyRenderer
 	protected native void render();
 	protected native boolean hasChanges();
 	public native void setPerfInterval(int perfInterval);
+	public native void setFrameProfilerEnable(boolean enable);
+	public native boolean writeFrameProfile(String fileName);
+	public native void trimGLMemory(boolean all);
 	public native void addLight(DirectionalLight light);
 	public native void replaceLights(List<DirectionalLight> lights);
 
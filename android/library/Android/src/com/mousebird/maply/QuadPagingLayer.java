@@ -794,4 +794,14 @@ public class QuadPagingLayer extends Layer implements LayerThread.ViewWatcherInt
 	native boolean nativeRefresh(ChangeSet changes);
 	native void nativeTileDidLoad(int x,int y,int level);
 	native void nativeTileDidNotLoad(int x,int y,int level);
+
+	/**
+	 * ID of the native controller doing the paging.  Native tile decoders use this
+	 * to find the work queued up for a given tile.
+	 */
+	long getControllerID()
+	{
+		return nativeGetControllerID();
+	}
+	native long nativeGetControllerID();
 }
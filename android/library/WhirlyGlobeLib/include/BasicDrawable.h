@@ -308,6 +308,8 @@ public:
     virtual void bindAdditionalRenderObjects(WhirlyKit::RendererFrameInfo *frameInfo,Scene *scene) { }
     /// Called at the end of the drawOGL2() call
     virtual void postDrawCallback(WhirlyKit::RendererFrameInfo *frameInfo,Scene *scene) { }
+    /// We sort by the first texture
+    virtual SimpleIdentity getSortTexId() const;
     
     // Attributes associated with each vertex, some standard some not
     std::vector<VertexAttribute *> vertexAttributes;
@@ -134,6 +134,10 @@ public:
     /// Return the translation matrix if there is one
     const Eigen::Matrix4d *getMatrix() const;
     
+    /// Most of the sort key can come from the master, which may change without telling us.
+    /// So we don't cache it.
+    virtual uint64_t getSortKey() const { return calcSortKey(); }
+    
     // Single geometry instance when we're doing multiple instance
     class SingleInstance
     {
@@ -154,6 +158,9 @@ public:
     void addInstances(const std::vector<SingleInstance> &insts);
     
 protected:
+    /// Sort by the master's first texture
+    virtual SimpleIdentity getSortTexId() const { return basicDraw ? basicDraw->getTexId(0) : EmptyIdentity; }
+
     Style instanceStyle;
     SimpleIdentity programID;
     bool requestZBuffer,writeZBuffer;
@@ -27,9 +27,19 @@ namespace WhirlyKit
     
 class BigDrawableSwap;
     
+/// Number of element buffer segments we cycle through when streaming
+#define BigDrawableStreamSegments 3
+    
 /** The Big Drawable is a double buffered drawable we can use to make changes
     in one thread and have them reflected in the visuals without slowing
     the renderer down.
+ 
+    With OpenGL ES 3 it can stream instead, if you ask for it with setStreaming().
+    There's one vertex buffer, written in place with unsynchronized mapped ranges,
+    and an element buffer split into a few segments.  A flush writes the elements
+    into a free segment and the renderer picks it up the next time it draws.
+    Fences keep us from reusing a segment or a cleared vertex region until the
+    GPU is done with it.  There's only waiting on a swap if every segment is busy.
   */
 class BigDrawable : public Drawable
 {
@@ -63,11 +73,11 @@ public:
 
     /// Draw priority for ordering
     unsigned int getDrawPriority() const { return drawPriority; }
-    void setDrawPriority(int newPriority) { drawPriority = newPriority; }
+    void setDrawPriority(int newPriority) { drawPriority = newPriority;  sortKeyChanged(); }
     void setFade(float newFade) { fade = newFade; }
     
     /// Set all the texture info at once
-    void setTexInfo(const std::vector<BasicDrawable::TexInfo> &newTexInfo) { texInfo = newTexInfo; }
+    void setTexInfo(const std::vector<BasicDrawable::TexInfo> &newTexInfo) { texInfo = newTexInfo;  sortKeyChanged(); }
     
     /// Set the texture ID for a given entry
     void setTexID(unsigned int which,SimpleIdentity texId);
@@ -76,7 +86,7 @@ public:
     virtual SimpleIdentity getProgram() const { return programId; }
     
     /// Set the shader program.  Empty (default) by default
-    virtual void setProgram(SimpleIdentity newProgId) { programId = newProgId; }
+    virtual void setProgram(SimpleIdentity newProgId) { programId = newProgId;  sortKeyChanged(); }
 
     /// Whether it's currently displaying
     bool isOn(WhirlyKit::RendererFrameInfo *frameInfo) const;
@@ -103,7 +113,7 @@ public:
     
     /// If set, we want to use the z buffer
     bool getRequestZBuffer() const { return requestZBuffer; }
-    void setRequestZBuffer(bool enable) { requestZBuffer = enable; }
+    void setRequestZBuffer(bool enable) { requestZBuffer = enable;  sortKeyChanged(); }
 
     /// If set, we want to write to the z buffer
     bool getWriteZbuffer() const { return writeZBuffer; }
@@ -141,6 +151,13 @@ public:
     /// Return which is the active buffer
     int getActiveBuffer() { return activeBuffer; }
     
+    /// Stream updates rather than double buffering.  Off by default.
+    /// This only takes effect with an OpenGL ES 3 context and before setupGL().
+    void setStreaming(bool newVal);
+    
+    /// True if we're using the streaming path rather than double buffering
+    bool isStreaming() { return streaming; }
+    
     // If set, we'll render this data where idrected
     void setRenderTarget(SimpleIdentity newRenderTarget) { renderTargetID = newRenderTarget; }
 
@@ -151,6 +168,9 @@ public:
     void getUtilization(int &vertSize,int &elSize);
     
 protected:
+    /// We sort by the first texture
+    SimpleIdentity getSortTexId() const { return texInfo.empty() ? EmptyIdentity : texInfo[0].texId; }
+
     bool enable;
     float fade;
     SimpleIdentity programId;
@@ -236,6 +256,47 @@ protected:
     void removeRegion(RegionSet &regions,int pos,int size);
     
     RegionSet vertexRegions;
+    
+    // Queue a change for whichever buffers we're using
+    void addChange(ChangeRef change);
+    
+    // Streaming version of executeFlush().  Returns false if there was no free segment.
+    bool streamFlush();
+    
+    // Hand cleared vertex regions back once the GPU's done with them
+    void reclaimStreamRegions();
+    
+    // Renderer side.  Switch to the most recently flushed segment.
+    void pickUpStreamSegment();
+    
+    // A segment the renderer isn't using and the GPU is done with, or -1
+    int findStreamSegment();
+    
+    // One chunk of the streaming element buffer
+    class StreamSegment
+    {
+    public:
+        StreamSegment() : numElement(0), retireFence(NULL) { }
+        // Number of elements written here
+        int numElement;
+        // Set when the renderer stops drawing this segment
+        GLsync retireFence;
+        // Vertex regions that were cleared while this segment was being drawn
+        std::vector<Region> freedRegions;
+    };
+    
+    bool streaming;
+    // Set when there's something to flush on the streaming path
+    bool streamDirty;
+    // Set when the last flush found every segment busy
+    bool streamStalled;
+    StreamSegment segments[BigDrawableStreamSegments];
+    // Segment the renderer is drawing and the one it'll switch to, or -1
+    int activeSegment,pendingSegment;
+    // Signals when the writes to the pending segment are done
+    GLsync pendingFence;
+    // Vertex regions cleared since the last flush
+    std::vector<Region> freedRegions;
 
     // A chunk of renderable element data.
     // We consolidate these during a flush to for a coherent element buffer
@@ -0,0 +1,65 @@
+/*
+ *  ChangeQueue.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <atomic>
+#import "Drawable.h"
+
+namespace WhirlyKit
+{
+
+/** Batches of change requests on their way to the renderer.
+    Any number of threads can push, but only one (the renderer) takes them off.
+    Neither side ever waits on the other.
+  */
+class ChangeQueue
+{
+public:
+    ChangeQueue();
+    /// Deletes any change requests that never got taken
+    ~ChangeQueue();
+
+    /// Add a batch of changes.  You can call this from any thread.
+    void push(const ChangeSet &changes);
+
+    /// Add a single change.  You can call this from any thread.
+    void push(ChangeRequest *change);
+
+    /// Take everything that's been pushed and add it to the end of changes.
+    /// Batches come out in the order they went in.  Only one thread should call this.
+    void popAll(ChangeSet &changes);
+
+    /// True if nothing is waiting.  You can call this from any thread.
+    bool empty() const;
+
+protected:
+    class Batch
+    {
+    public:
+        ChangeSet changes;
+        Batch *next;
+    };
+
+    void pushBatch(Batch *batch);
+
+    // Most recently pushed batch.  The list runs backward in time.
+    std::atomic<Batch *> head;
+};
+
+}
@@ -0,0 +1,145 @@
+/*
+ *  ClusterHierarchy.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <vector>
+#import <memory>
+#import <unordered_map>
+#import "WhirlyVector.h"
+
+namespace WhirlyKit
+{
+
+class LayoutObjectEntry;
+
+/** A precomputed set of clusters for every zoom level, in the style of supercluster.
+    Points live in spherical mercator scaled to [0,1] (y runs south).  At each zoom level,
+    from the bottom up, points and clusters closer than the radius (in pixels at that level)
+    are merged into a cluster at their weighted center.  Each level gets its own KD index
+    so a layout pass just asks for what's in view at its zoom level.
+
+    Building is slow, so do it off the layout thread.  The entries are only carried along
+    during the build, never looked at.
+  */
+class ClusterHierarchy
+{
+public:
+    /// A single point going in
+    class Leaf
+    {
+    public:
+        Leaf() : entry(NULL), x(0.0), y(0.0) { }
+        Leaf(LayoutObjectEntry *entry,const Point2d &pt) : entry(entry), x(pt.x()), y(pt.y()) { }
+
+        LayoutObjectEntry *entry;
+        // Location in unit mercator
+        double x,y;
+    };
+
+    /// A point or a cluster.  The first numLeaves nodes are the points.
+    class Node
+    {
+    public:
+        // Location in unit mercator.  For a cluster, this is the weighted center.
+        double x,y;
+        // Cluster this was merged into or -1
+        int parent;
+        // Leaves under this node are leafOrder[leafStart,leafStart+numLeaves)
+        int leafStart;
+        int numLeaves;
+    };
+
+    /// Cluster everything from maxZoom down to minZoom.  Radius is in pixels at 256 pixels per tile.
+    ClusterHierarchy(int minZoom,int maxZoom,double radius);
+
+    /// Build the hierarchy from scratch
+    void build(const std::vector<Leaf> &leaves);
+
+    /// Zoom levels with clusters.  Anything past maxZoom gets the individual points.
+    int getMinZoom() const { return minZoom; }
+    int getMaxZoom() const { return maxZoom; }
+    double getRadius() const { return radius; }
+
+    /// Nodes visible at the given zoom level within the given unit mercator bounds
+    void query(int zoom,double minX,double minY,double maxX,double maxY,std::vector<int> &nodeIDs) const;
+
+    /// Look at a single node
+    const Node &getNode(int nodeID) const { return nodes[nodeID]; }
+
+    /// Node for the given entry or -1 if it's not in here
+    int findEntry(LayoutObjectEntry *entry) const;
+
+    /// Entries under a node that haven't been removed
+    void getEntries(int nodeID,std::vector<LayoutObjectEntry *> &entries) const;
+
+    /// Entry for each leaf, NULL where one was removed
+    const std::vector<LayoutObjectEntry *> &getAllEntries() const { return entries; }
+
+    /// Take an entry out.  The clusters stay where they are until the next build.
+    void removeEntry(LayoutObjectEntry *entry);
+
+    /// Geographic (radians) to the unit mercator we cluster in
+    static Point2d GeoToUnit(const Point2d &geo);
+    /// And back again
+    static Point2d UnitToGeo(const Point2d &unit);
+
+protected:
+    /// Static KD index over the nodes at one zoom level (after kdbush)
+    class KDIndex
+    {
+    public:
+        /// Index the given nodes
+        void build(const std::vector<int> &nodeIDs,const std::vector<Node> &nodes);
+
+        /// Nodes within the given bounds
+        void range(double minX,double minY,double maxX,double maxY,std::vector<int> &nodeIDs) const;
+
+        /// Nodes within r of the given point
+        void within(double x,double y,double r,std::vector<int> &nodeIDs) const;
+
+    protected:
+        class Item
+        {
+        public:
+            double x,y;
+            int nodeID;
+        };
+
+        void sort(int left,int right,int axis);
+
+        std::vector<Item> items;
+    };
+
+    // Sort out the leaf ranges for a node and everything under it
+    void assignLeaves(int nodeID,const std::vector<std::vector<int> > &children);
+
+    int minZoom,maxZoom;
+    double radius;
+    std::vector<Node> nodes;
+    // Entry for each leaf or NULL if it was removed
+    std::vector<LayoutObjectEntry *> entries;
+    // Leaves in tree order, so each node's leaves are in one run
+    std::vector<int> leafOrder;
+    std::unordered_map<LayoutObjectEntry *,int> entryLeaves;
+    // One index per zoom level, minZoom through maxZoom+1
+    std::vector<KDIndex> levels;
+};
+typedef std::shared_ptr<ClusterHierarchy> ClusterHierarchyRef;
+
+}
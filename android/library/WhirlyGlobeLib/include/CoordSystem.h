@@ -71,6 +71,14 @@ public:
     virtual WhirlyKit::Point3f geocentricToLocal(WhirlyKit::Point3f) = 0;
     virtual WhirlyKit::Point3d geocentricToLocal(WhirlyKit::Point3d) = 0;
     
+    /// Convert a whole array of points from local to geocentric.
+    /// inPts and outPts may be the same array.  The default calls the single point version.
+    virtual void localToGeocentric(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts);
+
+    /// Convert a whole array of points from geocentric to local.
+    /// inPts and outPts may be the same array.  The default calls the single point version.
+    virtual void geocentricToLocal(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts);
+    
     /// Return true if the given coordinate system is the same as the one passed in
     virtual bool isSameAs(CoordSystem *coordSys) { return false; }
 };
@@ -78,6 +86,12 @@ public:
 /// Convert a point from one coordinate system to another
 Point3f CoordSystemConvert(CoordSystem *inSystem,CoordSystem *outSystem,Point3f inCoord);
 Point3d CoordSystemConvert3d(CoordSystem *inSystem,CoordSystem *outSystem,Point3d inCoord);
+/// Convert an array of points from one coordinate system to another.
+/// This makes two virtual calls total rather than two per point.  inCoords and outCoords may be the same.
+void CoordSystemConvert3dBatch(CoordSystem *inSystem,CoordSystem *outSystem,const Point3d *inCoords,Point3d *outCoords,size_t numCoords);
+/// Compute outPts[i] = inPts[i]*scale + offset, component-wise.
+/// Uses SSE2 or NEON where we have it.  inPts and outPts may be the same.
+void ScaleOffsetPoints(const Point3d *inPts,Point3d *outPts,size_t numPts,const Point3d &scale,const Point3d &offset);
     
 /** The Coordinate System Display Adapter handles the task of
     converting coordinates in the native system to data values we
@@ -115,6 +129,10 @@ public:
     virtual WhirlyKit::Point3f localToDisplay(WhirlyKit::Point3f) = 0;
     virtual WhirlyKit::Point3d localToDisplay(WhirlyKit::Point3d) = 0;
     
+    /// Convert an array of points from local to display coordinates.
+    /// inPts and outPts may be the same array.  The default calls the single point version.
+    virtual void localToDisplay(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts);
+    
     /// Convert from display coordinates to the local system's coordinates
     virtual WhirlyKit::Point3f displayToLocal(WhirlyKit::Point3f) = 0;
     virtual WhirlyKit::Point3d displayToLocal(WhirlyKit::Point3d) = 0;
@@ -159,6 +177,7 @@ public:
     /// Convert from the system's local coordinates to display coordinates
     WhirlyKit::Point3f localToDisplay(WhirlyKit::Point3f);
     WhirlyKit::Point3d localToDisplay(WhirlyKit::Point3d);
+    void localToDisplay(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts);
     
     /// Convert from display coordinates to the local system's coordinates
     WhirlyKit::Point3f displayToLocal(WhirlyKit::Point3f);
@@ -0,0 +1,71 @@
+/*
+ *  CoordSystemConverter.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <memory>
+#import "WhirlyVector.h"
+#import "CoordSystem.h"
+
+namespace WhirlyKit
+{
+
+/** A coordinate system converter goes directly from one specific coordinate
+    system to another, without the trip through geocentric that CoordSystemConvert3d
+    takes by default.
+    These are looked up once per (in, out) pair and cached.
+  */
+class CoordSystemConverter
+{
+public:
+    virtual ~CoordSystemConverter();
+
+    /// Convert a single point
+    virtual Point3d convert(const Point3d &inPt) = 0;
+
+    /// Convert an array of points.  inPts and outPts may be the same.
+    /// The default calls the single point version.
+    virtual void convert(const Point3d *inPts,Point3d *outPts,size_t numPts);
+};
+
+typedef std::shared_ptr<CoordSystemConverter> CoordSystemConverterRef;
+
+/// A factory returns a converter if it knows how to go directly between the
+///  two systems, and an empty reference otherwise.
+typedef CoordSystemConverterRef (*CoordSystemConverterFactory)(CoordSystem *inSystem,CoordSystem *outSystem);
+
+/// Add a converter factory.  Newer factories are consulted before older ones.
+/// The built in factory handles the geographic, Plate Carree, Spherical Mercator
+///  and Proj.4 systems.
+void CoordSystemAddConverterFactory(CoordSystemConverterFactory factory);
+
+/// Find (or build and cache) a direct converter for the given pair.
+/// Returns an empty reference if we need to go through geocentric instead.
+CoordSystemConverterRef CoordSystemFindConverter(CoordSystem *inSystem,CoordSystem *outSystem);
+
+/// Same as CoordSystemFindConverter, but for converting one point at a time.
+/// Each thread keeps its last few pairs, so a hit takes no lock and copies no reference.
+/// The converter is good on this thread until its next lookup.
+/// Returns NULL if we need to go through geocentric instead.
+CoordSystemConverter *CoordSystemFindConverterFast(CoordSystem *inSystem,CoordSystem *outSystem);
+
+/// Throw out any cached converters involving this coordinate system.
+/// Called when a coordinate system is deleted.
+void CoordSystemForgetConverters(CoordSystem *coordSys);
+
+}
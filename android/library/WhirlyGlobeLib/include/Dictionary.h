@@ -18,8 +18,10 @@
  *
  */
 
-#import <map>
+#import <vector>
 #import <string>
+#import <memory>
+#import <atomic>
 #import "WhirlyVector.h"
 #import "CoordSystem.h"
 #import "RawData.h"
@@ -31,10 +33,38 @@ namespace WhirlyKit
 typedef enum {DictTypeNone,DictTypeString,DictTypeInt,DictTypeDouble,DictTypeObject} DictionaryType;
 
 // Note: Need to add 64 bit SimpleIdentity
-/// The Dictionary is my cross platform replacement for NSDictionary
+/** The Dictionary is my cross platform replacement for NSDictionary.
+    Keys are interned in a table shared by all dictionaries and the values are
+    packed into a small array sorted by key ID.
+    Copies share their contents until one of them is modified.
+  */
 class Dictionary
 {
 public:
+    /** A field name that's been looked up once.
+        Hang on to these for names you use over and over, like the keys in a vector tile layer,
+        and the lookups never touch the shared key table.
+      */
+    class Key
+    {
+    public:
+        /// An empty key, which matches no field
+        Key() : id(InvalidID) { }
+        /// Look up (or add) the given name
+        explicit Key(const std::string &name);
+        
+        /// False for an empty key
+        bool isValid() const { return id != InvalidID; }
+        
+        /// The name this key was made from
+        const std::string &getName() const;
+        
+    protected:
+        friend class Dictionary;
+        static const unsigned int InvalidID = (unsigned int)-1;
+        unsigned int id;
+    };
+    
     Dictionary();
     // Construct from a raw data buffer
     Dictionary(RawData *rawData);
@@ -52,36 +82,50 @@ public:
     
     /// Returns true if the field exists
     bool hasField(const std::string &name) const;
+    bool hasField(const Key &key) const;
     
     /// Returns the field type
     DictionaryType getType(const std::string &name) const;
+    DictionaryType getType(const Key &key) const;
     
     /// Remove the given field by name
     void removeField(const std::string &name);
+    void removeField(const Key &key);
     
     /// Return an int, using the default if it's missing
     int getInt(const std::string &name,int defVal=0.0) const;
+    int getInt(const Key &key,int defVal=0) const;
     /// Interpret an int as a boolean
     bool getBool(const std::string &name,bool defVal=false) const;
+    bool getBool(const Key &key,bool defVal=false) const;
     /// Interpret an int as a RGBA color
     RGBAColor getColor(const std::string &name,const RGBAColor &defVal) const;
+    RGBAColor getColor(const Key &key,const RGBAColor &defVal) const;
     /// Return a double, using the default if it's missing
     double getDouble(const std::string &name,double defVal=0.0) const;
+    double getDouble(const Key &key,double defVal=0.0) const;
     /// Return a string, or empty if it's missing
     std::string getString(const std::string &name) const;
+    std::string getString(const Key &key) const;
     /// Return a string, using the default if it's missing
     std::string getString(const std::string &name,const std::string &defVal) const;
+    std::string getString(const Key &key,const std::string &defVal) const;
     /// Return an object pointer
     DelayedDeletableRef getObject(const std::string &name);
+    DelayedDeletableRef getObject(const Key &key);
     
     /// Set field as int
     void setInt(const std::string &name,int val);
+    void setInt(const Key &key,int val);
     /// Set field as double
     void setDouble(const std::string &name,double val);
+    void setDouble(const Key &key,double val);
     /// Set field as string
     void setString(const std::string &name,const std::string &val);
+    void setString(const Key &key,const std::string &val);
     /// Set field as pointer
     void setObject(const std::string &name,DelayedDeletableRef obj);
+    void setObject(const Key &key,DelayedDeletableRef obj);
     
     // Write data to a raw data buffer
     void asRawData(MutableRawData *rawData);
@@ -93,83 +137,66 @@ public:
     void addEntries(const Dictionary *other);
     
 protected:
-    class Value
-    {
-    public:
-        Value() { }
-        virtual ~Value() { }
-        
-        virtual DictionaryType type() = 0;
-        virtual Value *copy() = 0;
-        virtual int asInt() = 0;
-        virtual void asString(std::string &retStr) = 0;
-        virtual double asDouble() = 0;
-        virtual DelayedDeletableRef asObject() { return DelayedDeletableRef(); }
-    };
-    
-    class StringValue : public Value
-    {
-    public:
-        StringValue() { }
-        StringValue(const std::string &inVal) : val(inVal) { }
-        
-        virtual DictionaryType type() { return DictTypeString; }
-        virtual Value *copy() { return new StringValue(val); }
-        virtual int asInt();
-        virtual void asString(std::string &retStr) { retStr = val; }
-        virtual double asDouble();
-        
-        std::string val;
-    };
-    
-    class IntValue : public Value
-    {
-    public:
-        IntValue() : val(0) { }
-        IntValue(int inVal) : val(inVal) { }
-        
-        virtual DictionaryType type() { return DictTypeInt; }
-        virtual Value *copy() { return new IntValue(val); }
-        virtual int asInt() { return val; }
-        virtual void asString(std::string &retStr);
-        virtual double asDouble() { return (double)val; }
-        
-        int val;
-    };
-    
-    class DoubleValue : public Value
+    /// Interned key
+    typedef unsigned int KeyID;
+    
+    /// Look up (or add) the ID for a key
+    static KeyID internKey(const std::string &name);
+    /// Look up the ID for a key, returning false if we've never seen it.
+    /// Each thread caches what it finds, so this rarely takes the table's lock.
+    static bool findKey(const std::string &name,KeyID &key);
+    /// Return the name for a key ID
+    static const std::string &keyName(KeyID key);
+    /// Key for a name we've already seen, or an empty key.  Unlike Key(name) this never adds to the table.
+    static Key lookupKey(const std::string &name);
+    
+    /// A single field.  Strings and objects are stored on the side and referred to by index.
+    class Field
     {
     public:
-        DoubleValue() : val(0.0) { }
-        DoubleValue(double inVal) : val(inVal) { }
-        
-        virtual DictionaryType type() { return DictTypeDouble; }
-        virtual Value *copy() { return new DoubleValue(val); }
-        virtual int asInt() { return (int)val; }
-        virtual void asString(std::string &retStr);
-        virtual double asDouble() { return val; }
-        
-        double val;
+        KeyID key;
+        DictionaryType type;
+        union {
+            int intVal;
+            double doubleVal;
+            unsigned int index;
+        };
     };
     
-    class ObjectValue : public Value
+    /// The fields, shared between copies until one of them changes
+    class Contents
     {
     public:
-        ObjectValue() { }
-        ObjectValue(DelayedDeletableRef inVal) : val(inVal) { }
-        
-        virtual DictionaryType type() { return DictTypeObject; }
-        virtual Value *copy() { return new ObjectValue(val); }
-        virtual int asInt() { return 0; }
-        virtual void asString(std::string &retStr) { }
-        virtual double asDouble() { return 0.0; }
-        virtual DelayedDeletableRef asObject() { return val; }
+        Contents() : shared(false) { }
+        /// A copy starts out unshared
+        Contents(const Contents &that) : fields(that.fields), strings(that.strings), objects(that.objects), shared(false) { }
         
-        DelayedDeletableRef val;
+        /// Fields sorted by key ID
+        std::vector<Field> fields;
+        std::vector<std::string> strings;
+        std::vector<DelayedDeletableRef> objects;
+        /// Set once a second dictionary refers to these.  It's never cleared, so
+        ///  every dictionary holding these copies them before changing anything.
+        std::atomic<bool> shared;
     };
-
-    typedef std::map<std::string,Value *> FieldMap;
-    FieldMap fields;
+    typedef std::shared_ptr<Contents> ContentsRef;
+    
+    /// Point at the given contents, marking them as shared
+    void shareContents(const ContentsRef &that);
+    /// Return the field for the given key or NULL
+    const Field *findField(const Key &key) const;
+    /// Make our contents unique to us before modifying them
+    Contents *mutableContents();
+    /// Return the field for the given key, adding it if it's missing and clearing any side storage it had
+    Field *setField(KeyID key,DictionaryType type);
+    /// Remove the field at the given position in the field array
+    void removeFieldAt(size_t which);
+    
+    int fieldAsInt(const Field &field) const;
+    double fieldAsDouble(const Field &field) const;
+    void fieldAsString(const Field &field,std::string &retStr) const;
+    
+    ContentsRef contents;
 };
     
 }
@@ -22,6 +22,8 @@
 #import <vector>
 #import <set>
 #import <map>
+#import <unordered_map>
+#import <atomic>
 #import "RawData.h"
 #import "Identifiable.h"
 #import "WhirlyVector.h"
@@ -48,26 +50,62 @@ class Scene;
 class OpenGLES2Program;
 class Drawable;
 
-/// We'll only keep this many buffers or textures around for reuse
+/// We'll only keep this many textures around for reuse
 #define WhirlyKitOpenGLMemCacheMax 32
 /// Number of buffers we allocate at once
 #define WhirlyKitOpenGLMemCacheAllocUnit 32
+/// Smallest buffer size class is 2^this bytes
+#define WhirlyKitOpenGLMemMinClassShift 8
+/// Number of power of two buffer size classes.  Anything bigger than the last isn't pooled.
+#define WhirlyKitOpenGLMemNumClasses 17
+/// Default limit on the bytes of free buffers we'll keep in each pool
+#define WhirlyKitOpenGLMemPoolMaxBytes (16*1024*1024)
     
 // Maximum of 8 textures for the moment
 #define WhirlyKitMaxTextures 8
 
-/// Used to manage OpenGL buffer IDs and such.
-/// They're expensive to create and delete, so we try to do it
-///  outside the renderer.
+/// Snapshot of what the buffer pools are up to
+class OpenGLMemStats
+{
+public:
+    OpenGLMemStats();
+    
+    /// Fraction of sized buffer requests we satisfied out of a pool
+    double hitRate() const;
+    
+    /// Free buffers sitting in the pools and the bytes they hold
+    unsigned int pooledBuffers;
+    size_t pooledBytes;
+    /// Buffers handed out and not yet returned and the bytes they hold
+    unsigned int liveBuffers;
+    size_t liveBytes;
+    /// Sized requests satisfied from a pool and ones that had to allocate
+    unsigned int hits,misses;
+    /// Free buffers deleted because a pool was over its limit or we were asked to trim
+    unsigned int evictions;
+};
+
+/** Used to manage OpenGL buffer IDs and such.
+    They're expensive to create and delete, so we try to do it
+     outside the renderer.
+ 
+    Buffers with a size are rounded up to a power of two size class and
+     allocated once.  When they come back they go into a free list for their
+     class, storage intact, and the next request for that class gets one
+     without calling glBufferData again.  Callers fill them in with glBufferSubData.
+    Static and dynamic buffers are kept in separate pools since drivers
+     tend to put them in different places.
+  */
 class OpenGLMemManager
 {
 public:
     OpenGLMemManager();
     ~OpenGLMemManager();
     
-    /// Pick a buffer ID off the list or ask OpenGL for one
+    /// Pick a buffer of at least the given size out of the pool or ask OpenGL for one.
+    /// With a size of zero you get a bare buffer ID with no storage, which isn't reused.
     GLuint getBufferID(unsigned int size=0,GLenum drawType=GL_STATIC_DRAW);
-    /// Toss the given buffer ID back on the list for reuse
+    /// Toss the given buffer ID back into its pool for reuse
     void removeBufferID(GLuint bufID);
 
     /// Pick a texture ID off the list or ask OpenGL for one
@@ -81,6 +119,24 @@ public:
     /// Clear out any and all texture IDs that we have sitting around
     void clearTextureIDs();
     
+    /// Limit on the bytes of free buffers we'll keep in each pool
+    void setMaxPooledBytes(size_t maxBytes);
+    size_t getMaxPooledBytes() { return maxPooledBytes; }
+    
+    /// Delete free buffers until there are no more than keepBytes in each pool.
+    /// Needs an OpenGL context.
+    void trimBuffers(size_t keepBytes);
+    
+    /// Ask for a trim from any thread, say on a memory warning.
+    /// It happens the next time the rendering thread calls processTrimRequest().
+    void requestTrim(size_t keepBytes);
+    
+    /// Rendering thread calls this to do any trim that was asked for
+    void processTrimRequest();
+    
+    /// Statistics for the buffer pools
+    OpenGLMemStats getStats();
+    
     /// Print out stats about what's in the cache
     void dumpStats();
         
@@ -91,14 +147,51 @@ public:
     void unlock();
         
 protected:
+    /// Static buffers in one pool, dynamic and stream in the other
+    typedef enum {BufferPoolStatic,BufferPoolDynamic,BufferPoolMax} BufferPoolType;
+
+    /// What we know about a buffer we've handed out
+    class BufferInfo
+    {
+    public:
+        /// Bytes of storage, zero if the caller is managing it
+        unsigned int size;
+        /// Size class, or -1 if it's not going back into a pool
+        int sizeClass;
+        BufferPoolType pool;
+    };
+    
+    // Trim a pool down to the given size.  Lock must be held.
+    void trimPoolLocked(BufferPoolType pool,size_t keepBytes,std::vector<GLuint> &toRemove);
+    
     pthread_mutex_t idLock;
 
-    std::set<GLuint> buffIDs;
+    // Buffer names we've generated but not given storage
+    std::vector<GLuint> spareBuffIDs;
+    // Free buffers with storage, by pool and size class.  Most recently returned at the back.
+    std::vector<GLuint> freeBuffers[BufferPoolMax][WhirlyKitOpenGLMemNumClasses];
+    size_t pooledBytes[BufferPoolMax];
+    unsigned int pooledBuffers;
+    size_t maxPooledBytes;
+    // Buffers we've handed out
+    std::unordered_map<GLuint,BufferInfo> liveBuffers;
+    size_t liveBytes;
+    unsigned int hits,misses,evictions;
+    // Pending trim from requestTrim(), or -1
+    std::atomic<long long> trimRequest;
+    
     std::set<GLuint> texIDs;
 };
 
 /// Mapping from Simple ID to an int
 typedef std::map<SimpleIdentity,SimpleIdentity> TextureIDMap;
+
+/// Rough cost of a change request that just flips some state, in seconds
+static const TimeInterval ChangeBaseCost = 5e-6;
+/// Rough cost of creating or deleting an OpenGL object on the rendering thread
+static const TimeInterval ChangeGLObjectCost = 50e-6;
+/// Rough cost of copying one byte over to OpenGL
+static const TimeInterval ChangeGLByteCost = 1e-9;
 	
 /** This is the base clase for a change request.  Change requests
     are how we modify things in the scene.  The renderer is running
@@ -121,23 +214,27 @@ public:
 	/// Make a change to the scene.  For the renderer.  Never call this.
 	virtual void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view) = 0;
     
+    /// Guess at how long execute() will take on the rendering thread, in seconds.
+    /// The scene uses this to spread big batches of changes over several frames.
+    virtual TimeInterval estimateCost() { return ChangeBaseCost; }
+    
+    /// Bytes execute() will copy over to OpenGL, if we know.  Used for profiling.
+    virtual size_t uploadSize() { return 0; }
+    
     /// If non-zero we'll execute this request after the given absolute time
     TimeInterval when;
 };
     
 /// Representation of a list of changes.  Might get more complex in the future.
 typedef std::vector<ChangeRequest *> ChangeSet;
+/// Puts the earliest change at the front of a heap (see std::push_heap)
 typedef struct
 {
     bool operator () (const ChangeRequest *a,const ChangeRequest *b)
     {
-        if (a->when == b->when)
-            return a < b;
-        return a->when < b->when;
+        return a->when > b->when;
     }
-} ChangeSorter;
-/// This version is sorted by when to run it
-typedef std::set<ChangeRequest *,ChangeSorter> SortedChangeSet;
+} ChangeHeapSorter;
 
 /** Drawable tweakers are called every frame to mess with things.
     It's up to you to make the changes, just make them quick.
@@ -161,7 +258,7 @@ class Drawable : public Identifiable
 protected:
 
     /// Used in special cases
-    Drawable() { }
+    Drawable() : sortKeyValid(false) { }
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
@@ -222,11 +319,35 @@ public:
     /// Run the tweakers
     virtual void runTweakers(RendererFrameInfo *frame);
     
+    /** Draw priority, z buffer request, program and texture packed in to one number for sorting.
+        Draw priority gets the 32 bits just under the top one and the z buffer request the next one down.
+        Priorities can be negative, so they're biased by 2^31 to keep them in order and out of the top bit.
+        The program and texture get 15 bits each from the bottom of their IDs.
+        Those just keep similar drawables together, so it's fine if they collide.
+        We cache this until one of them changes.
+      */
+    virtual uint64_t getSortKey() const;
+    
 protected:
+    /// Subclasses call this when anything going in to the sort key changes
+    void sortKeyChanged() { sortKeyValid = false; }
+    
+    /// The texture we group by when sorting.  Usually the first one.
+    virtual SimpleIdentity getSortTexId() const { return EmptyIdentity; }
+    
+    /// Build the sort key from scratch
+    uint64_t calcSortKey() const;
+
     std::string name;
     DrawableTweakerRefSet tweakers;
+    mutable uint64_t sortKey;
+    mutable bool sortKeyValid;
 };
 
+/// Set in the sort key for drawables with alpha, if we're sorting them to the end.
+/// That can change every frame, so it's not part of the cached key.
+static const uint64_t DrawSortKeyAlphaBit = ((uint64_t)1) << 63;
+
 /// Reference counted Drawable pointer
 typedef std::shared_ptr<Drawable> DrawableRef;
     
@@ -61,6 +61,10 @@ public:
         
     /// Set where we'll render the output
     void setRenderTarget(SimpleIdentity renderTargetID);
+    
+    /// Have new big drawables stream their updates on OpenGL ES 3.  Off by default.
+    /// See BigDrawable::setStreaming().
+    void setStreaming(bool newVal) { streaming = newVal; }
         
     /// Used to track the remappings we need from one set of textures to another
     class DrawTexInfo
@@ -124,6 +128,7 @@ protected:
     bool enable;
     float fade;
     SimpleIdentity renderTargetID;
+    bool streaming;
     BigDrawable *(*newBigDrawable)(BasicDrawable *draw,int singleElementSize,int numVertexBytes,int numElementBytes);
     SimpleIdentity shaderId;
     OpenGLMemManager *memManager;
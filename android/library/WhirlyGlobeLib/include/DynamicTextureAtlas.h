@@ -36,7 +36,7 @@ class DynamicTexture : public TextureBase
 {
 public:
     /// Constructor for sorting
-    DynamicTexture(SimpleIdentity myId) : TextureBase(myId), layoutGrid(NULL) { }
+    DynamicTexture(SimpleIdentity myId) : TextureBase(myId), numCell(0), usedCells(0) { }
     /// Construct with a name, square texture size, cell size (in texels), and the memory format
     DynamicTexture(const std::string &name,int texSize,int cellSize,GLenum format,bool clearTextures);
     ~DynamicTexture();
@@ -46,6 +46,16 @@ public:
     {
     public:
         Region();
+        Region(int sx,int sy,int ex,int ey) : sx(sx), sy(sy), ex(ex), ey(ey) { }
+        
+        /// Size in cells
+        int width() const { return ex-sx+1; }
+        int height() const { return ey-sy+1; }
+        int area() const { return width()*height(); }
+        
+        /// True if the two regions share any cells
+        bool overlaps(const Region &that) const { return sx <= that.ex && that.sx <= ex && sy <= that.ey && that.sy <= ey; }
+
         int sx,sy,ex,ey;
     };
     
@@ -73,10 +83,13 @@ public:
     /// Set or clear a given region
     void setRegion(const Region &region,bool enable);
     
-    /// Look for an open region of the given cell extents
+    /// Look for an open region of the given cell extents.
+    /// This picks the free rectangle that leaves the smallest leftover on its shorter side.
+    /// Call setRegion() to claim it.
     bool findRegion(int cellsX,int cellsY,Region &region);
     
-    /// Return a list of released regions
+    /// Return the regions the renderer has released since the last call.
+    /// They're given back to the allocator as they're returned.
     void getReleasedRegions(std::vector<DynamicTexture::Region> &toClear);
     
     /// Add a region to the list of ones to be cleared.
@@ -92,6 +105,11 @@ public:
     /// Return texture cell utilization
     void getUtilization(int &numCell,int &usedCell);
     
+    /// Return texture cell utilization and how fragmented the free space is.
+    /// Fragmentation is 0 when all the free cells are in one rectangle and approaches 1
+    ///  as they're scattered into little pieces.
+    void getUtilization(int &numCell,int &usedCell,float &fragmentation);
+    
 protected:
     /// Used for debugging
     std::string name;
@@ -109,8 +127,15 @@ protected:
     /// Number of cells on a side
     int numCell;
     
-    // Use to track where sub textures are
-    bool *layoutGrid;
+    /// Remove the used region from the free rectangles, splitting them as needed
+    void claimRegion(const Region &region);
+    /// Hand a region back to the free rectangles, merging it with its neighbors
+    void releaseRegion(const Region &region);
+    
+    /// Free rectangles (in cells).  These never overlap.
+    std::vector<Region> freeRegions;
+    /// Number of cells in use
+    int usedCells;
     
     pthread_mutex_t regionLock;
     /// These regions have been released by the renderer
@@ -142,6 +167,12 @@ public:
     /// Add the region.  Never call this.
 	void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view);
     
+    /// Depends on how much data we're copying
+    virtual TimeInterval estimateCost() { return ChangeBaseCost + uploadSize() * ChangeGLByteCost; }
+    
+    /// All of the data goes over
+    virtual size_t uploadSize() { return data ? data->getLen() : 0; }
+    
 protected:
     SimpleIdentity texId;
     int startX,startY,width,height;
@@ -224,6 +255,10 @@ public:
     ///  change requests.
     void teardown(ChangeSet &changes);
     
+    /// Cell utilization summed over all the dynamic textures.
+    /// Fragmentation is the average over the textures, weighted by their free cells.
+    void getUtilization(int &numCell,int &usedCell,float &fragmentation);
+    
         /// Print out some utilization info
     void log();
 
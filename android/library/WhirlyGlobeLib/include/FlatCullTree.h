@@ -0,0 +1,118 @@
+/*
+ *  FlatCullTree.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <vector>
+#import <unordered_map>
+#import "Drawable.h"
+
+namespace WhirlyKit
+{
+
+/// Deepest we'll sort drawables in a flat cull tree by default
+static const int FlatCullTreeMaxDepth = 16;
+
+/** Loose quad tree of drawables for flat maps, sorted by their local MBRs.
+    Each drawable lives in exactly one node, the deepest one whose cell is at least as
+    big as the drawable and contains its center.  A node's loose bounds are its cell
+    grown by half a cell on every side, so they always hold everything in the node.
+    Drawables with a matrix or without a valid MBR can't be placed, so we return
+    those from every search.
+    Adds and removes are incremental.  Only use this on the rendering thread.
+  */
+class FlatCullTree
+{
+public:
+    /// Construct with the area we expect most drawables to fall within.
+    /// Drawables outside it still work, we just test them one by one.
+    FlatCullTree(const Mbr &mbr,int maxDepth = FlatCullTreeMaxDepth);
+    ~FlatCullTree();
+
+    /// Sort a drawable in to the tree by its local MBR
+    void addDrawable(DrawableRef draw);
+
+    /// Remove a drawable, wherever it ended up
+    void remDrawable(DrawableRef draw);
+
+    /// Find the drawables overlapping any of the given MBRs, plus the ones we couldn't place.
+    /// Each drawable comes back once.  We don't check if they're on.
+    void findDrawables(const std::vector<Mbr> &viewMbrs,std::vector<Drawable *> &found,int *drawablesConsidered);
+
+    /// True if findDrawables() would return this drawable for the given view MBRs.
+    /// It doesn't need to be in the tree yet.
+    bool isInView(Drawable *draw,const std::vector<Mbr> &viewMbrs);
+
+    /// Work out what findDrawables() would add and drop going from the old view MBRs to the new ones.
+    /// We only look at the nodes that cross the edge of either view, so this is cheap for small moves.
+    void findChanges(const std::vector<Mbr> &oldMbrs,const std::vector<Mbr> &newMbrs,std::vector<Drawable *> &entered,std::vector<Drawable *> &left,int *drawablesConsidered);
+
+    /// Number of nodes currently in the tree
+    int getNodeCount() { return numNodes; }
+
+    /// Number of drawables we're tracking
+    int getDrawableCount() { return (int)locations.size(); }
+
+protected:
+    class Item
+    {
+    public:
+        DrawableRef draw;
+        Mbr mbr;
+        // Last search that returned this one, so we only return it once
+        unsigned int lastSearch;
+    };
+
+    class Node
+    {
+    public:
+        Node(Node *parent,const Mbr &cellMbr,int level);
+        ~Node();
+
+        Node *parent;
+        Mbr cellMbr,looseMbr;
+        int level;
+        // Number of items here and below
+        int numItems;
+        Node *children[4];
+        std::vector<Item> items;
+    };
+
+    // Where a drawable lives.  No node means it's in the unplaced list.
+    class Location
+    {
+    public:
+        Node *node;
+        unsigned int which;
+    };
+
+    Node *findOrAddNode(const Point2f &center,int level);
+    void removeItem(std::vector<Item> &items,unsigned int which);
+    void findInNode(Node *node,const Mbr &viewMbr,bool allInside,std::vector<Drawable *> &found,int *drawablesConsidered);
+    void findChangesInNode(Node *node,const std::vector<Mbr> &oldMbrs,const std::vector<Mbr> &newMbrs,int oldState,int newState,std::vector<Drawable *> &entered,std::vector<Drawable *> &left,int *drawablesConsidered);
+
+    Node *top;
+    float topSize;
+    int maxDepth;
+    int numNodes;
+    unsigned int searchId;
+    std::vector<Item> unplaced;
+    std::unordered_map<SimpleIdentity,Location> locations;
+};
+
+}
@@ -48,6 +48,9 @@ public:
     /// Convert from WGS84 geocentric to local coordinates
     Point3f geocentricToLocal(Point3f);
     Point3d geocentricToLocal(Point3d);
+    /// Batch versions.  Local is already lon/lat so these go straight to Proj.4.
+    void localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    void geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts);
         
     /// Return true if the other coordinate system is also Plate Carree
     bool isSameAs(CoordSystem *coordSys);
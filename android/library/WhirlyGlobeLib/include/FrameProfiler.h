@@ -0,0 +1,182 @@
+/*
+ *  FrameProfiler.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <pthread.h>
+#import <stdint.h>
+#import <atomic>
+#import <string>
+#import <vector>
+#import "WhirlyTypes.h"
+#import "Platform.h"
+
+namespace WhirlyKit
+{
+
+/// Counters we keep for every frame
+typedef enum {
+    FrameCountDrawablesConsidered,
+    FrameCountDrawablesCulled,
+    FrameCountDrawablesDrawn,
+    FrameCountStateChanges,
+    FrameCountBytesUploaded,
+    FrameCountChangesProcessed,
+    FrameCountMax
+} FrameCounter;
+
+/// Human readable name for one of the counters
+extern const char *FrameCounterName(FrameCounter which);
+
+/// Number of frames we keep by default.  About 10s at 60fps.
+static const int FrameProfilerDefaultFrames = 600;
+/// Number of phases we keep by default, across all threads
+static const int FrameProfilerDefaultPhases = 16384;
+
+/// Totals for everything in the profiler's ring buffers
+class FrameProfilerSummary
+{
+public:
+    FrameProfilerSummary();
+
+    /// All the phases with the same name, added up
+    class PhaseTotal
+    {
+    public:
+        const char *name;
+        unsigned int count;
+        TimeInterval total,max;
+    };
+
+    /// Phase totals in the order we first saw them
+    std::vector<PhaseTotal> phases;
+    unsigned int numFrames;
+    TimeInterval frameTotal,frameMax;
+    /// Counters added up over all the frames
+    int64_t counts[FrameCountMax];
+};
+
+/** Low overhead frame profiler.
+    Phases (a name and a start and end time) and per-frame counters go in to
+    fixed size ring buffers, so it can be left on in the field.  When something
+    looks bad, dump it out as Chrome trace event JSON and load it in chrome://tracing.
+    It's off until you turn it on.  Phases can come from any thread.
+  */
+class FrameProfiler
+{
+public:
+    FrameProfiler(int maxFrames = FrameProfilerDefaultFrames,int maxPhases = FrameProfilerDefaultPhases);
+    ~FrameProfiler();
+
+    /// Turn recording on or off.  Turning it on starts from scratch.
+    void setEnable(bool newEnable);
+
+    /// True if we're recording.  This is cheap, so check it before doing any work for us.
+    bool isEnabled() const { return enable.load(std::memory_order_relaxed); }
+
+    /// Start a new frame.  Rendering thread only.
+    void startFrame();
+
+    /// Wrap up the current frame and its counters.  Rendering thread only.
+    void endFrame();
+
+    /// Record a phase that ran from start until now and return now.
+    /// The name isn't copied, so use a literal.
+    TimeInterval endPhase(const char *name,TimeInterval start);
+
+    /// Record a phase that ran from start to end.  The name isn't copied, so use a literal.
+    void addPhase(const char *name,TimeInterval start,TimeInterval end);
+
+    /// Add to one of the current frame's counters
+    void addCount(FrameCounter which,int64_t count);
+
+    /// Write what's in the ring buffers as Chrome trace event JSON
+    void writeChromeTrace(std::string &json);
+
+    /// Write the Chrome trace event JSON to a file.  Returns false if we couldn't.
+    bool writeChromeTrace(const std::string &fileName);
+
+    /// Add up what's in the ring buffers by phase name
+    void summarize(FrameProfilerSummary &summary);
+
+    /// Toss everything we've recorded
+    void clear();
+
+protected:
+    class Phase
+    {
+    public:
+        const char *name;
+        TimeInterval start,end;
+        unsigned int thread;
+    };
+
+    class Frame
+    {
+    public:
+        unsigned int frameNum;
+        TimeInterval start,end;
+        int64_t counts[FrameCountMax];
+    };
+
+    unsigned int threadIndex();
+
+    std::atomic<bool> enable;
+    pthread_mutex_t lock;
+    // Everything below is protected by the lock
+    std::vector<Phase> phases;
+    // Total number written, so the oldest is at numPhases % phases.size() once we wrap
+    unsigned int numPhases;
+    std::vector<Frame> frames;
+    unsigned int numFrames;
+    std::vector<pthread_t> threads;
+    TimeInterval baseTime;
+
+    // Counters for the frame in progress
+    std::atomic<int64_t> counts[FrameCountMax];
+    // Rendering thread only
+    unsigned int frameNum;
+    TimeInterval frameStart;
+};
+
+/// Records a phase from construction to destruction, if the profiler is on
+class FrameProfilerScope
+{
+public:
+    FrameProfilerScope(FrameProfiler *inProfiler,const char *name)
+    : profiler(NULL), name(name), start(0.0)
+    {
+        if (inProfiler && inProfiler->isEnabled())
+        {
+            profiler = inProfiler;
+            start = TimeGetCurrent();
+        }
+    }
+    ~FrameProfilerScope()
+    {
+        if (profiler)
+            profiler->endPhase(name,start);
+    }
+
+protected:
+    FrameProfiler *profiler;
+    const char *name;
+    TimeInterval start;
+};
+
+}
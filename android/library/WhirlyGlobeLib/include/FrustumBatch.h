@@ -0,0 +1,58 @@
+/*
+ *  FrustumBatch.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import "WhirlyVector.h"
+
+namespace WhirlyKit
+{
+
+/// Where a bounding sphere falls with respect to the viewing frustum
+typedef enum {FrustumOutside=0,FrustumInside,FrustumStraddles} FrustumResult;
+
+/// Test a single sphere against the frustum for the given clip matrix (projection times model).
+/// These are the same planes ClipHomogeneousPolygon uses.
+FrustumResult SphereInFrustum(const Eigen::Matrix4d &mat,const Point3d &center,double radius);
+
+/** The six frustum planes for a clip matrix, normalized and in single precision.
+    We set these up once and then run batches of spheres against them.
+  */
+class FrustumPlanes
+{
+public:
+    /// Extract the planes from projection times model
+    FrustumPlanes(const Eigen::Matrix4d &mat);
+
+    /// Plane equations in structure of arrays form
+    float a[6],b[6],c[6],d[6];
+};
+
+/// Classify a batch of spheres against the frustum, four at a time where we have SSE or NEON.
+/// Centers and radii are in structure of arrays form.  Results are FrustumResult values.
+/// Spheres too close to call in single precision come back as FrustumStraddles.
+void ClassifySpheres(const FrustumPlanes &planes,const float *x,const float *y,const float *z,const float *radius,unsigned int num,unsigned char *results);
+
+/// Project a batch of points through the clip matrix and on to the screen.
+/// Points are in structure of arrays form and should be relative to some nearby origin, with the
+///  translation to that origin folded into the matrix.  Screen positions come back relative to
+///  where the origin lands, which keeps single precision good for small things.
+/// We assume the points are all in front of the eye.
+void ProjectPoints(const Eigen::Matrix4d &mat,const Point2d &halfFrameSize,const float *x,const float *y,const float *z,unsigned int num,float *screenX,float *screenY);
+
+}
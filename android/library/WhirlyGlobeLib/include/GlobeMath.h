@@ -47,12 +47,20 @@ public:
     /// Static version for convenience
     static Point3f LocalToGeocentric(Point3f);
     static Point3d LocalToGeocentric(Point3d);
+    /// Convert an array of points in one go
+    void localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    /// Static version for convenience.  This is a single Proj.4 call for the whole array.
+    static void LocalToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts);
     /// Convert from WGS84 geocentric to local coordinates
     Point3f geocentricToLocal(Point3f);
     Point3d geocentricToLocal(Point3d);
     /// Static version for convenience
     static Point3f GeocentricToLocal(Point3f);
     static Point3d GeocentricToLocal(Point3d);
+    /// Convert an array of points in one go
+    void geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    /// Static version for convenience.  This is a single Proj.4 call for the whole array.
+    static void GeocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts);
     
     /// Convenience routine to convert a whole MBR to local coordinates
     static Mbr GeographicMbrToLocal(GeoMbr);
@@ -84,6 +92,8 @@ public:
     /// Static version
     static Point3f LocalToDisplay(Point3f);
     static Point3d LocalToDisplay(Point3d);
+    /// Convert a whole array without the virtual call per point
+    virtual void localToDisplay(const Point3d *inPts,Point3d *outPts,size_t numPts);
 
     /// Convert from fake display geocentric to geographic+height
     virtual Point3f displayToLocal(Point3f);
@@ -21,13 +21,17 @@
 #import <math.h>
 #import <set>
 #import <map>
+#import <atomic>
 #import "Identifiable.h"
 #import "BasicDrawable.h"
 #import "Scene.h"
 #import "SceneRendererES.h"
 #import "ViewState.h"
+#import "MaplyViewState.h"
 #import "ScreenSpaceBuilder.h"
 #import "SelectionManager.h"
+#import "ClusterHierarchy.h"
+#import "OverlapHelper.h"
 
 namespace WhirlyKit
 {
@@ -105,10 +109,131 @@ public:
     WhirlyKit::Point2d offset;
     // Set if we changed something during evaluation
     bool changed;
+
+    // Orientation it was placed with on the last pass or -1 if it wasn't placed
+    int placedOrient;
+    // Screen footprint it was placed with on the last pass
+    Point2dVector placedPts;
+    // Set if it was laid out on the last pass, so lastScreenPt and layoutDrift are good
+    bool hasLayoutPt;
+    // Where it was on screen on the last pass
+    Point2f lastScreenPt;
+    // How far it's moved against its neighbours since we last tried every orientation
+    float layoutDrift;
+
+    // Set if it landed on screen this pass
+    bool onScreen;
+    // Where it landed on screen this pass
+    Point2f screenPt;
+
+    // Set if it's handled by its group's cluster hierarchy
+    bool inClusterTree;
+    // Set if the cluster hierarchy showed it on its own last pass
+    bool clusterTreeShown;
+    // Layout pass the cluster hierarchy last showed it on
+    int clusterTreePass;
+    // Where it sits in unit mercator, for the cluster hierarchy
+    bool hasClusterPt;
+    Point2d clusterPt;
 };
 
 typedef std::set<LayoutObjectEntry *,IdentifiableSorter> LayoutEntrySet;
 
+/** What a layout pass needs to know to skip an object.
+    These are kept together so a pass doesn't have to visit every layout object
+    just to find out it's off screen.
+  */
+class LayoutCullEntry
+{
+public:
+    LayoutObjectEntry *entry;
+    // Copied from the layout object
+    Point3d worldLoc;
+    float minVis,maxVis;
+    int clusterGroup;
+    bool enable;
+    // Set if the entry was turned off on the last pass and has nothing left to undo
+    bool idle;
+    // Set if it's in range and facing us on this pass
+    bool use;
+    // Set if it's in use and lands on the screen on this pass
+    bool onScreen;
+    Point2f screenPt;
+    // In incremental mode, it's still off screen as long as the view hasn't moved this far since it was projected
+    double offScreenUntil;
+};
+
+/// An add, remove or enable waiting for the next layout pass
+class LayoutChange
+{
+public:
+    typedef enum {Add,Remove,Enable,Disable} ChangeType;
+
+    LayoutChange(ChangeType type,SimpleIdentity objID,LayoutObjectEntry *entry) : type(type), objID(objID), entry(entry) { }
+
+    ChangeType type;
+    SimpleIdentity objID;
+    // New entry for an Add
+    LayoutObjectEntry *entry;
+};
+
+/// An object being laid out in screen bins: what it takes to place it and where it went
+class LayoutPlacement
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    // Where it is on screen and how it's turned
+    Point2f objPt;
+    float screenRot;
+    Eigen::Matrix2d screenRotMat;
+    // Extents of its layout points
+    Point2f layoutSpan;
+    Point2d layoutOrg;
+    // Everywhere it could land
+    Mbr reach;
+    // The one bin that holds its reach or -1 if it spans more than one
+    int bin;
+    // Set if it's going to be on
+    bool isActive;
+    // Orientation it went in with or -1
+    int placedOrient;
+    Point2d objOffset;
+    Point2dVector objPts;
+};
+
+/// Finished (or not) background build of a cluster hierarchy
+class LayoutClusterTreeBuild
+{
+public:
+    LayoutClusterTreeBuild() : done(false) { }
+
+    /// Set once tree is ready to use
+    std::atomic<bool> done;
+    ClusterHierarchyRef tree;
+};
+typedef std::shared_ptr<LayoutClusterTreeBuild> LayoutClusterTreeBuildRef;
+
+/// Cluster hierarchy state for one cluster group
+class LayoutClusterTree
+{
+public:
+    LayoutClusterTree() : dirty(true) { }
+
+    /// The hierarchy we're using, once there is one
+    ClusterHierarchyRef tree;
+    /// Set if objects came or went since the last build started
+    bool dirty;
+    /// Build in progress, if there is one
+    LayoutClusterTreeBuildRef build;
+    /// Objects removed since the build in progress started
+    std::vector<LayoutObjectEntry *> removedSinceBuild;
+    /// Objects the hierarchy showed on their own last pass
+    std::vector<LayoutObjectEntry *> shown;
+    /// Nodes shown as clusters last pass and their index in the cluster list
+    std::vector<std::pair<int,int> > shownClusters;
+};
+
 /**  The cluster generator is a callback used to make the images (or whatever)
 	 for a group of objects.
   */
@@ -174,6 +299,34 @@ public:
     /// If set, the maximum number of objects to display
     void setMaxDisplayObjects(int numObjects);
     
+    /** Turn incremental layout on or off.
+        In incremental mode we keep the last pass's placements and check those first.
+        Objects that didn't fit are only tried again if they've moved more than
+        moveThreshold pixels with respect to their neighbours or something that was
+        blocking them went away.  Panning, zooming or rotating moves everything together,
+        so that alone doesn't count until it's spread things out or squeezed them together.
+        Objects well off the screen aren't projected again until the view has moved far enough to reach them.
+      */
+    void setIncrementalLayout(bool incremental,float moveThreshold);
+
+    /** Turn parallel layout on or off.
+        In parallel mode the screen is split into bins.  Objects that can only land in one bin
+        are laid out bin by bin on the task scheduler.  Objects that could land in more than one
+        are placed afterward, in importance order, around what the bins placed.
+        The result is repeatable, but it isn't always the same as laying everything out in order.
+        Incremental layout and a maximum object count both turn this off.
+      */
+    void setParallelLayout(bool parallel);
+
+    /** Turn hierarchical clustering on or off.
+        With this on, each cluster group gets a hierarchy of clusters for every zoom level,
+        built once on the task scheduler.  A layout pass just picks out the clusters for the
+        current zoom level and viewport rather than clustering on screen.
+        Objects added after a build show up on their own until the next build lands.
+        Removed objects drop out of their clusters right away.
+      */
+    void setHierarchicalClustering(bool hierarchical);
+    
     /// Add objects for layout (thread safe)
     void addLayoutObjects(const std::vector<LayoutObject> &newObjects);
     
@@ -200,18 +353,71 @@ public:
 
 protected:
 	bool calcScreenPt(Point2f &objPt, LayoutObjectEntry *layoutObj, WhirlyKit::ViewState *viewState, const Mbr &screenMbr, const Point2f &frameBufferSize);
+	bool calcScreenPt(Point2f &objPt, const Point3d &worldLoc, WhirlyKit::ViewState *viewState, const Mbr &screenMbr, const Point2f &frameBufferSize);
 
     Eigen::Matrix2d calcScreenRot(float &screenRot, WhirlyKit::ViewState *viewState, WhirlyGlobe::GlobeViewState *globeViewState ,ScreenSpaceObject *ssObj, const Point2d &objPt, const Eigen::Matrix4d &modelTrans,const Eigen::Matrix4d &normalMat, const Point2f &frameBufferSize);
 
 	bool runLayoutRules(WhirlyKit::ViewState *viewState, std::vector<ClusterEntry> &clusterEntries, std::vector<ClusterGenerator::ClusterClassParams> &clusterParams);
 
+    /// Drop an object's placement, keeping its footprint so incremental layout knows the space is free
+    void forgetPlacement(LayoutObjectEntry *entry);
+
+    /// Apply the adds, removes and enables that came in since the last pass.
+    /// Returns true if there were any.
+    bool applyPendingChanges();
+
+    /// Start cluster hierarchy builds that are needed and swap in the ones that are done
+    void updateClusterTrees();
+
+    /// Show the clusters and objects a group's hierarchy has for this view
+    bool layoutClusterTree(int clusterID,LayoutClusterTree &clusterTree,WhirlyKit::ViewState *viewState,WhirlyGlobe::GlobeViewState *globeViewState,Maply::MapViewState *mapViewState,const Mbr &screenMbr,const Point2f &frameBufferSize,const ClusterGenerator::ClusterClassParams &params,int clusterParamID,std::vector<ClusterEntry> &clusterEntries,std::vector<LayoutObjectEntry *> &clusterLayoutObjs);
+
+    /// Hierarchy state for the given cluster group or NULL
+    LayoutClusterTree *findClusterTree(int clusterID);
+
+    /// Lay out the objects in screen bins, filling in placements
+    void placeObjectsInBins(const std::vector<LayoutObjectEntry *> &layoutObjs,WhirlyKit::ViewState *viewState,WhirlyGlobe::GlobeViewState *globeViewState,const Mbr &screenMbr,const Point2f &frameBufferSize,float resScale);
+
+    /// Held for the whole of a layout pass
     pthread_mutex_t layoutLock;
+    /// Protects pendingChanges and hasUpdates.  Never held for long, so adding objects doesn't wait on layout.
+    pthread_mutex_t pendingLock;
+    /// Changes to apply at the start of the next pass
+    std::vector<LayoutChange> pendingChanges;
     /// If non-zero the maximum number of objects we'll display at once
     int maxDisplayObjects;
-    /// If there were updates since the last layout
+    /// If there were updates since the last layout.  Protected by pendingLock.
     bool hasUpdates;
     /// Objects we're controlling the placement for
     LayoutEntrySet layoutObjects;
+    /// The layout objects sorted by importance.  Rebuilt when objects come, go, or are enabled.
+    std::vector<LayoutCullEntry> sortedObjects;
+    bool sortedObjectsValid;
+    /// Objects the last layout pass looked at.  Everything else was off and stayed off.
+    std::vector<LayoutObjectEntry *> passObjects;
+    /// Objects showing after the last pass, for selection
+    std::vector<LayoutObjectEntry *> shownObjects;
+    /// If set, keep the last pass's placements and only revisit what moved
+    bool incrementalLayout;
+    /// How far (in pixels) a hidden object has to move before we try it again
+    float incrementalMoveThreshold;
+    /// Next pass has to look at everything
+    bool forceFullLayout;
+    /// If set, lay out screen bins in parallel
+    bool parallelLayout;
+    /// Results for parallel layout, one per object being laid out
+    std::vector<LayoutPlacement,Eigen::aligned_allocator<LayoutPlacement> > placements;
+    /// Screen edges and the near side as planes in display space, five per view matrix, from the last pass
+    std::vector<Eigen::Vector4d,Eigen::aligned_allocator<Eigen::Vector4d> > cullPlanes;
+    /// How far those planes have moved, added up over the incremental passes
+    double cullDrift;
+    /// Screen bounds (as of the last pass) of objects that were showing when they went away
+    std::vector<Mbr> vacatedMbrs;
+    /// What's been placed and what's been vacated on a pass.  Kept around so the grids keep their memory.
+    OverlapHelper placedOverlap,vacatedOverlap;
+    /// Frame buffer size and scale the last pass was done with
+    Point2f lastFrameBufferSize;
+    float lastResScale;
     /// Drawables created on the last round
     SimpleIDSet drawIDs;
 	/// Clusters on the current round
@@ -220,6 +426,12 @@ protected:
 	std::vector<ClusterGenerator::ClusterClassParams> clusterParams;
 	/// Cluster generators
 	ClusterGenerator *clusterGen;
+    /// If set, cluster groups use a precomputed cluster hierarchy
+    bool hierarchicalClustering;
+    /// Cluster hierarchy state for each cluster group
+    std::map<int,LayoutClusterTree> clusterTrees;
+    /// Counts layout passes
+    int layoutPass;
 };
 
 }
@@ -29,6 +29,7 @@
 #import "ElevationChunk.h"
 #import "DynamicDrawableAtlas.h"
 #import "DynamicTextureAtlas.h"
+#import "ScratchArena.h"
 
 namespace WhirlyKit
 {
@@ -131,7 +132,7 @@ public:
     void initAtlases(TileImageType imageType,GLenum interpType,int numImages,int textureAtlasSize,int sampleSizeX,int sampleSizeY);
     
     // Build the edge matching skirt
-    void buildSkirt(BasicDrawable *draw,Point3dVector &pts,std::vector<TexCoord> &texCoords,float skirtFactor,bool haveElev,const Point3d &theCenter);
+    void buildSkirt(BasicDrawable *draw,const ScratchVector<Point3d> &pts,const ScratchVector<TexCoord> &texCoords,float skirtFactor,bool haveElev,const Point3d &theCenter);
     
         // Generate drawables for a no-elevation tile
     void generateDrawables(WhirlyKit::ElevationDrawInfo *drawInfo,BasicDrawable **draw,BasicDrawable **skirtDraw,BasicDrawable **poleDraw);
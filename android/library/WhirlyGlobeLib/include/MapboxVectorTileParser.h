@@ -18,8 +18,11 @@
  *
  */
 
-#import "vector_tile.pb.h"
+#import <set>
+#import <map>
+#import "RawData.h"
 #import "VectorObject.h"
+#import "TaskScheduler.h"
 
 namespace WhirlyKit
 {
@@ -38,7 +41,53 @@ typedef enum {
     SEG_CLOSE = (0x40 | 0x0f)
 } MapnikCommandType;
 
+/** Which layers, attributes and geometry types the parser should build objects for.
+    Anything filtered out is skipped in the encoded data, so we never make a
+    Dictionary or VectorObject for it.
+    An empty filter keeps everything.
+  */
+class MapboxVectorTileFilter
+{
+public:
+    /// What to keep within a single layer
+    class LayerFilter
+    {
+    public:
+        LayerFilter() : allAttrs(true), geomTypes(0) { }
+        
+        /// True if we keep features of the given geometry type
+        bool keepGeomType(MapnikGeometryType geomType) const { return !geomTypes || (geomTypes & (1 << geomType)); }
+        
+        /// True if we keep the given attribute
+        bool keepAttr(const std::string &attrName) const { return allAttrs || attrNames.find(attrName) != attrNames.end(); }
+        
+        /// If set, we keep all the attributes and ignore attrNames
+        bool allAttrs;
+        /// Attribute keys to keep
+        std::set<std::string> attrNames;
+        /// Geometry types to keep as a mask of (1 << MapnikGeometryType).  0 keeps them all.
+        int geomTypes;
+    };
+    
+    /// Keep the given layer with everything in it
+    void addLayer(const std::string &layerName);
+    
+    /// Keep the given layer, restricted by the layer filter
+    void addLayer(const std::string &layerName,const LayerFilter &layerFilter);
+    
+    /// True if there are no layers listed, meaning we keep everything
+    bool empty() const { return layers.empty(); }
+    
+    /// Return the filter for the given layer, or NULL if we're skipping it
+    const LayerFilter *findLayer(const std::string &layerName) const;
+    
+protected:
+    std::map<std::string,LayerFilter> layers;
+};
+
 /** This object parses the data in Mapbox Vector Tile format.
+    It reads the protobuf wire format straight out of the buffer, rather than
+    building the whole message tree first.
   */
 class MapboxVectorTileParser
 {
@@ -47,8 +96,15 @@ public:
     ~MapboxVectorTileParser();
     
     // Parse the vector tile and return a list of vectors.
+    // If there's a filter, only the layers, attributes and geometry it lists are built.
+    // If there's a task group, the layers are decoded in parallel as part of it and
+    //  cancelling the group abandons the parse.
     // Returns false on failure.
-    bool parseVectorTile(RawData *rawData,std::vector<VectorObject *> &vecObjs,const Mbr &mbr);
+    bool parseVectorTile(RawData *rawData,std::vector<VectorObject *> &vecObjs,const Mbr &mbr,const MapboxVectorTileFilter *filter=NULL,TaskGroup *group=NULL);
+    
+    /// Filter applied to tiles parsed through the Java interface.
+    /// Set this up before parsing starts.
+    MapboxVectorTileFilter filter;
 };
 
 }
@@ -24,8 +24,8 @@ namespace Maply
 {
 
 /** The Map Scene is the subclass of Scene that deals with flat maps.
-    At present it's a dumb container and doesn't do culling, as the globe scene
-    does.
+    It sorts the drawables in to a flat cull tree, which the renderer
+    checks against what's on screen.
   */
 class MapScene : public WhirlyKit::Scene
 {
@@ -33,12 +33,19 @@ public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     
     MapScene(WhirlyKit::CoordSystemDisplayAdapter *coordAdapter);
+    virtual ~MapScene();
     
     /// Add a drawable
     virtual void addDrawable(WhirlyKit::DrawableRef drawable);
     
     /// Remove a drawable
     virtual void remDrawable(WhirlyKit::DrawableRef drawable);
+    
+    /// Drawables sorted by their local MBRs
+    virtual WhirlyKit::FlatCullTree *getFlatCullTree() { return flatCullTree; }
+    
+protected:
+    WhirlyKit::FlatCullTree *flatCullTree;
 };
 
 }
@@ -36,7 +36,12 @@ namespace WhirlyKit
 class LayoutObjectEntry;
 class LayoutObject;
     
-// We use this to avoid overlapping labels
+/** We use this to avoid overlapping labels.
+    Objects are sorted into a grid of cells.  Each cell keeps the bounding boxes
+    of what's in it side by side so we can test them in batches.  Most labels are
+    axis aligned and the box test is all they need.  Rotated ones get a full
+    separating axis test on their actual shape.
+  */
 class OverlapHelper
 {
 public:
@@ -44,23 +49,48 @@ public:
 
     OverlapHelper(const Mbr &mbr,int sizeX,int sizeY);
     
+    // Toss the objects and cover a new area.  The cells keep their memory for next time.
+    void reset(const Mbr &mbr);
+    
     // Try to add an object.  Might fail (kind of the whole point).
     bool addObject(const Point2dVector &pts);
     
+    // True if the object wouldn't overlap anything we've already got
+    bool checkObject(const Point2dVector &pts);
+    
+    // Add an object without checking for overlaps
+    void insertObject(const Point2dVector &pts);
+    
 protected:
+    // Cells the bounding box covers
+    void calcCells(const Mbr &objMbr,int &sx,int &sy,int &ex,int &ey);
+    
     // Object and its bounds
     class BoundedObject
     {
     public:
         ~BoundedObject() { }
         Point2dVector pts;
+        // If set, the bounding box is the object
+        bool axisAligned;
+        // Last query that looked at this object.  Keeps us from testing it once per cell.
+        unsigned int queryTag;
+    };
+    
+    // Bounding boxes of the objects in a cell, in structure of arrays form
+    class GridCell
+    {
+    public:
+        std::vector<int> ids;
+        std::vector<float> minX,minY,maxX,maxY;
     };
     
     Mbr mbr;
     std::vector<BoundedObject> objects;
     int sizeX,sizeY;
     Point2f cellSize;
-    std::vector<std::vector<int> > grid;
+    std::vector<GridCell> grid;
+    unsigned int queryTag;
 };
 
 // Used to figure out what clusters
@@ -58,12 +58,12 @@ public:
 
     /// Draw priority for ordering
     unsigned int getDrawPriority() const { return drawPriority; }
-    void setDrawPriority(int newPriority) { drawPriority = newPriority; }
+    void setDrawPriority(int newPriority) { drawPriority = newPriority;  sortKeyChanged(); }
 
     /// Program to use for rendering
     virtual SimpleIdentity getProgram() const { return programId; }
     /// Set the shader program.  Empty (default) by default
-    virtual void setProgram(SimpleIdentity newProgId) { programId = newProgId; }
+    virtual void setProgram(SimpleIdentity newProgId) { programId = newProgId;  sortKeyChanged(); }
 
     /// Whether it's currently displaying
     bool isOn(RendererFrameInfo *frameInfo) const;
@@ -84,7 +84,7 @@ public:
     void setContinuousUpdate(bool newVal) { usingContinuousRender = newVal; }
     
     /// Set all the textures at once
-    virtual void setTexIDs(const std::vector<SimpleIdentity> &inTexIDs) { texIDs = inTexIDs; }
+    virtual void setTexIDs(const std::vector<SimpleIdentity> &inTexIDs) { texIDs = inTexIDs;  sortKeyChanged(); }
     
     /// Create our buffers in GL
     void setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *memManager);
@@ -106,7 +106,7 @@ public:
 
     /// If set, we want to use the z buffer
     bool getRequestZBuffer() const { return requestZBuffer; }
-    void setRequestZBuffer(bool enable) { requestZBuffer = enable; }
+    void setRequestZBuffer(bool enable) { requestZBuffer = enable;  sortKeyChanged(); }
     
     /// If set, we want to write to the z buffer
     bool getWriteZbuffer() const { return writeZBuffer; }
@@ -132,6 +132,9 @@ public:
     void updateBatches(TimeInterval now);
 
 protected:
+    /// We sort by the first texture
+    SimpleIdentity getSortTexId() const { return texIDs.empty() ? EmptyIdentity : texIDs[0]; }
+
     bool enable;
     int numTotalPoints,batchSize;
     int vertexSize;
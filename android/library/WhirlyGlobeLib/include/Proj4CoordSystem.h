@@ -51,12 +51,22 @@ public:
     Point3f geocentricToLocal(Point3f);
     Point3d geocentricToLocal(Point3d);
     
+    /// Batch versions.  One pj_transform call for the whole array.
+    void localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    void geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    
     /// True if the other system is Spherical Mercator with the same origin
     virtual bool isSameAs(CoordSystem *coordSys);
     
     /// Check that it actually created the pj structures
     bool isValid();
     
+    /// Return the Proj.4 projection (projPJ) for direct conversions
+    void *getProj() { return pj; }
+    
+    /// Return the WGS84 lat/lon projection (projPJ) we use for geographic
+    void *getProjLatLon() { return pj_latlon; }
+    
 protected:
     void *pj;
     void *pj_latlon,*pj_geocentric;
@@ -76,6 +76,14 @@ public:
     /// Return an importance value for the given tile
     virtual double importanceForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs) = 0;
     
+    /// Bound the importance for a tile that's been evaluated before, for the new view state.
+    /// Fill this in if it's much cheaper than importanceForTile (see ScreenImportanceBounds).
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs,double &minImport,double &maxImport) { return false; }
+    
+    /// Flag the tiles that are definitely off screen, for a whole batch at once.
+    /// Fill this in if your importance is 0 off screen (see TilesOffScreen).
+    virtual void tilesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,ViewState *viewState,const Point2f &frameSize,std::vector<bool> &offScreen) { }
+    
     /// Called when the view state changes.  If you're caching info, do it here.
     virtual void newViewState(ViewState *viewState) = 0;
 
@@ -324,6 +332,8 @@ public:
     
     // Callback used by the quad tree
     virtual double importanceForTile(const Quadtree::Identifier &ident,const Mbr &theMbr,Quadtree *tree,Dictionary *attrs);
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &theMbr,Quadtree *tree,Dictionary *attrs,double &minImport,double &maxImport);
+    virtual void nodesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,Quadtree *tree,std::vector<bool> &offScreen);
 
     // Debugging output
     void dumpInfo();
@@ -331,6 +341,11 @@ public:
 protected:
     void resetEvaluation();
     
+    // Hand a tile to the loader, tracking its work with the task scheduler
+    void loadTile(const Quadtree::NodeInfo &nodeInfo,int frame);
+    // Cancel any work for a tile and have the loader unload it
+    void unloadTile(const Quadtree::NodeInfo &nodeInfo);
+    
     QuadDisplayControllerAdapter *adapter;
     QuadDataStructure *dataStructure;
     QuadLoader *loader;
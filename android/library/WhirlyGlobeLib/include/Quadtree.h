@@ -20,7 +20,7 @@
 
 #import "WhirlyVector.h"
 #import "Dictionary.h"
-#import <set>
+#import <vector>
 
 namespace WhirlyKit
 {
@@ -223,6 +223,10 @@ public:
     /// Change the minimum importance value
     void setMinImportance(float newMinImportance);
     
+    /// When reevaluating, we'll keep a node's old importance if the new one is within this
+    ///  fraction of it and can't cross the minimum importance.  0 means always recalculate.
+    void setImportanceTolerance(double newTolerance);
+    
     /// Recalculate the child coverage for a given node
     void updateParentCoverage(const Identifier &ident,std::vector<Identifier> &coveredTiles,std::vector<Identifier> &unCoveredTiles);
     
@@ -245,37 +249,12 @@ public:
     void Print();
     
 protected:
-    class Node;
-
-    // Sorter based on id
-    typedef struct
-    {
-        bool operator() (const Node *a,const Node *b)
-        {
-            return a->nodeInfo.ident < b->nodeInfo.ident;
-        }
-    } NodeIdentSorter;
-
-    // Sorter based on node importance
-    typedef struct
-    {
-        bool operator() (const Node *a,const Node *b)
-        {
-            if (a->nodeInfo.importance == b->nodeInfo.importance)
-                return a->nodeInfo.ident < b->nodeInfo.ident;
-            return a->nodeInfo.importance < b->nodeInfo.importance;
-        }
-    } NodeSizeSorter;
-
-    typedef std::set<Node *,NodeIdentSorter> NodesByIdentType;
-    typedef std::set<Node *,NodeSizeSorter> NodesBySizeType;
-
     /// Single quad tree node with pointer to parent and children
     class Node
     {
         friend class Quadtree;
     public:
-        Node(Quadtree *tree);
+        Node();
         
         NodeInfo nodeInfo;
         
@@ -289,18 +268,110 @@ protected:
         bool recalcCoverage();
  
     protected:
-        NodesByIdentType::iterator identPos;
-        NodesBySizeType::iterator sizePos;
-        NodesBySizeType::iterator evalPos;
+        // Position in the size and eval heaps, -1 if not in them
+        int sizePos;
+        int evalPos;
         Node *parent;
         Node *children[4];
         bool childOffscreen[4];
     };
+
+    /** Open addressed hash table from a packed identifier to its node.
+        Linear probing with backward shift deletion, so there are no tombstones.
+      */
+    class NodeTable
+    {
+    public:
+        NodeTable();
+        
+        /// Deepest level we can pack into a key
+        static const int MaxPackedLevel = 29;
+        
+        /// True if the identifier is one we can track: level 0 to MaxPackedLevel and x, y within the level
+        static bool canPack(const Identifier &ident);
+        
+        /// Find the node for the given identifier, or NULL
+        Node *find(const Identifier &ident) const;
+        
+        /// Add a node.  It mustn't already be there and its identifier has to pass canPack().
+        void insert(Node *node);
+        
+        /// Remove the node for the given identifier
+        void erase(const Identifier &ident);
+        
+        /// Number of nodes in the table
+        int size() const { return numNodes; }
+        bool empty() const { return numNodes == 0; }
+        
+        /// Copy out all the nodes, in no particular order
+        void getNodes(std::vector<Node *> &nodes) const;
+        
+    protected:
+        typedef struct
+        {
+            unsigned long long key;
+            Node *node;
+        } Slot;
+        
+        static bool packIdent(const Identifier &ident,unsigned long long &key);
+        static unsigned int hashKey(unsigned long long key);
+        void grow();
+        
+        std::vector<Slot> slots;
+        unsigned int mask;
+        int numNodes;
+    };
+
+    /** Binary heap of nodes ordered by importance, then identifier.
+        Each node knows where it lives in the heap, so removal and updates are O(log n).
+      */
+    class NodeHeap
+    {
+    public:
+        /// Set maxFirst to put the most important node on top
+        NodeHeap(int Node::*posField,bool maxFirst);
+        
+        /// Add a node.  Does nothing if it's already here.
+        void push(Node *node);
+        
+        /// Remove a node.  Does nothing if it isn't here.
+        void remove(Node *node);
+        
+        /// Is the node in this heap
+        bool contains(const Node *node) const { return node->*posField >= 0; }
+        
+        /// Least (or most, for maxFirst) important node
+        Node *top() const { return nodes.empty() ? NULL : nodes[0]; }
+        
+        /// Remove everything
+        void clear();
+        
+        int size() const { return (int)nodes.size(); }
+        bool empty() const { return nodes.empty(); }
+        
+        /// True if a should come out of the heap before b
+        bool before(const Node *a,const Node *b) const;
+        
+        /// Node at the given position, for walking the heap in order
+        Node *at(int which) const { return nodes[which]; }
+        
+    protected:
+        void siftUp(int which);
+        void siftDown(int which);
+        void place(Node *node,int which);
+        
+        std::vector<Node *> nodes;
+        int Node::*posField;
+        bool maxFirst;
+    };
         
     Node *getNode(const Identifier &ident);
+    Node *newNode();
     void removeNode(Node *);
     /// Recalculate child coverage for a node and its parents
     void recalcCoverage(Node *node);
+    /// Check if a node's importance can't have changed enough to bother recalculating
+    bool importanceSettled(Node *node);
     /// Add an entry for the given flag index
     void addFrameLoaded(int frame);
     /// Clear the flag counts for the given flag entries
@@ -310,17 +381,20 @@ protected:
     int minLevel,maxLevel;
     int maxNodes;
     float minImportance;
+    double importanceTolerance;
     int numPhantomNodes;
     int knownNumNodes;
     /// Used to calculate importance for a particular
     QuadTreeImportanceCalculator *importDelegate;
     
-    // All nodes, sorted by ID
-    NodesByIdentType nodesByIdent;
-    // Child nodes, sorted by importance
-    NodesBySizeType nodesBySize;
-    // Nodes we're evaluating
-    NodesBySizeType evalNodes;
+    // All nodes, by ID
+    NodeTable nodesByIdent;
+    // Nodes we might unload, least important on top
+    NodeHeap nodesBySize;
+    // Nodes we're evaluating, most important on top
+    NodeHeap evalNodes;
+    // Removed nodes, kept for reuse
+    std::vector<Node *> freeNodes;
     std::vector<int> frameLoadCounts;
 };
 
@@ -332,6 +406,13 @@ public:
     /// Return a number signifying importance.  MAXFLOAT is very important, 0 is not at all
     /// 0 also means the tile is off screen
     virtual double importanceForTile(const Quadtree::Identifier &ident,const Mbr &mbr,Quadtree *tree,Dictionary *attrs) = 0;
+    /// Bound the importance for a tile that's been evaluated before, if that's cheaper than
+    ///  calculating it.  Return false to have the quad tree call importanceForTile.
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,Quadtree *tree,Dictionary *attrs,double &minImport,double &maxImport) { return false; }
+    /// Flag the nodes that are definitely off screen, which gives them an importance of 0.
+    /// The quad tree hands over all its nodes at once when reevaluating, so this can be batched.
+    /// Leave offScreen alone for any you're not sure about.
+    virtual void nodesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,Quadtree *tree,std::vector<bool> &offScreen) { }
 };
     
 }
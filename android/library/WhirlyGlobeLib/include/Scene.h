@@ -26,6 +26,7 @@
 #import "WhirlyVector.h"
 #import "Texture.h"
 #import "Cullable.h"
+#import "FlatCullTree.h"
 #import "BasicDrawableInstance.h"
 #import "Generator.h"
 #import "FontTextureManager.h"
@@ -33,6 +34,8 @@
 //#import "ActiveModel.h"
 #import "CoordSystem.h"
 #import "OpenGLES2Program.h"
+#import "ChangeQueue.h"
+#import "FrameProfiler.h"
 
 /// How the scene refers to the default triangle shader (and how you replace it)
 #define kSceneDefaultTriShader "Default Triangle Shader"
@@ -74,6 +77,12 @@ public:
 
 	/// Add to the renderer.  Never call this.
 	void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view);
+    
+    /// Cheap if the texture was already created, otherwise depends on the size
+    virtual TimeInterval estimateCost();
+    
+    /// Pixels we'll copy in, if the texture wasn't already created
+    virtual size_t uploadSize();
 	
     /// Only use this if you've thought it out
     TextureBase *getTex() { return tex; }
@@ -93,6 +102,9 @@ public:
     
     /// Remove from the renderer.  Never call this.
 	void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view);
+    
+    /// Deletes a texture in OpenGL
+    virtual TimeInterval estimateCost() { return ChangeGLObjectCost; }
 	
 protected:
 	SimpleIdentity texture;
@@ -115,6 +127,12 @@ public:
 
 	/// Add to the renderer.  Never call this
 	void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view);	
+    
+    /// Cheap if the drawable was already set up, otherwise depends on the geometry
+    virtual TimeInterval estimateCost();
+    
+    /// Geometry we'll copy in, if the drawable wasn't already set up
+    virtual size_t uploadSize();
 	
 protected:
 	Drawable *drawable;
@@ -131,6 +149,9 @@ public:
     
     /// Remove the drawable.  Never call this
 	void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view);
+    
+    /// Deletes the drawable's buffers in OpenGL
+    virtual TimeInterval estimateCost() { return ChangeGLObjectCost; }
 	
 protected:	
 	SimpleIdentity drawable;
@@ -278,6 +299,20 @@ protected:
     SceneRendererES *renderer;
 };
 
+/// A drawable coming or going.  The renderer uses these to patch what it thinks is visible.
+class DrawableDelta
+{
+public:
+    DrawableDelta(Drawable *draw,bool added) : draw(draw), added(added) { }
+    
+    /// Only good for comparison once a removed drawable is gone
+    Drawable *draw;
+    bool added;
+};
+    
+/// Most drawable deltas we'll hang on to before we tell the renderer to start over
+static const unsigned int MaxDrawableDeltas = 4096;
+
 /** This is the top level scene object for WhirlyKit.
     It keeps track of the drawables by sorting them into
      cullables and it handles the change requests, which
@@ -302,10 +337,10 @@ public:
     /// This is not thread safe, so do this in the main thread
     SimpleIdentity getGeneratorIDByName(const std::string &name);
 
-	/// Add a single change request.  You can call this from any thread, it locks.
+	/// Add a single change request.  You can call this from any thread and it won't block.
     /// If you have more than one, don't iterate, use the other version.
 	void addChangeRequest(ChangeRequest *newChange);
-    /// Add a list of change requets.  You can call this from any thread.
+    /// Add a list of change requets.  You can call this from any thread and it won't block.
     /// This is the faster option if you have more than one change request
 	void addChangeRequests(const ChangeSet &newchanges);
 	
@@ -315,11 +350,32 @@ public:
 	
 	/// Process change requests
 	/// Only the renderer should call this in the rendering thread
+    /// If there's a change budget, whatever doesn't fit is left for the next frame, in order.
 	void processChanges(WhirlyKit::View *view,WhirlyKit::SceneRendererES *renderer,TimeInterval now);
     
-    /// True if there are pending updates
+    /// True if there are pending updates.  You can call this from any thread.
     bool hasChanges(TimeInterval now);
     
+    /// Set how long processChanges() can spend per frame, in seconds.
+    /// We always do at least one change.  Zero means no limit.
+    void setChangeBudget(TimeInterval budget) { changeBudget = budget; }
+    
+    /// Changes waiting to be processed as of the last frame
+    int getNumPendingChanges() { return numPendingChanges; }
+    
+    /// Number of changes processed in the last frame
+    int getLastChangesProcessed() { return lastChangesProcessed; }
+    
+    /// Time spent processing changes in the last frame
+    TimeInterval getLastChangeTime() { return lastChangeTime; }
+    
+    /// Bytes the last frame's changes copied over to OpenGL, as best we can tell
+    size_t getLastBytesUploaded() { return lastBytesUploaded; }
+    
+    /// Frame profiler for the renderer and anything else working on this scene.
+    /// It's off unless someone turns it on.  You can use this on any thread.
+    FrameProfiler *getProfiler() { return &profiler; }
+    
     /// Add sub texture mappings.
     /// These are mappings from images to parts of texture atlases.
     /// They're here so we can use SimpleIdentity's to point into larger
@@ -374,6 +430,10 @@ public:
     /// Return the top level cullable
     CullTree *getCullTree() { return cullTree; }
     
+    /// If the scene keeps its drawables in a flat cull tree, this is it.
+    /// Only flat maps do at the moment.
+    virtual FlatCullTree *getFlatCullTree() { return NULL; }
+    
     /// Explicitly tear everything down in OpenGL ES.
     /// We're assuming the context has been set.
     void teardownGL();
@@ -389,6 +449,11 @@ public:
 	
     // Return all the drawables in a list.  Only call this on the main thread.
     const DrawableRefSet &getDrawables();
+    
+    /// Hand over the drawables added and removed since the last call, in order.
+    /// Returns false if we lost track, in which case the caller should start from scratch.
+    /// Only call this on the rendering thread.
+    bool takeDrawableDeltas(std::vector<DrawableDelta> &deltas);
 
     /// Dump out stats on what is currently in the scene.
     /// Use this sparingly, as it writes to the log.
@@ -427,6 +492,14 @@ public:
 	
 	/// All the drawables we've been handed, sorted by ID
 	DrawableRefSet drawables;
+    
+    /// Note a drawable coming or going.  Rendering thread only.
+    void addDrawableDelta(Drawable *draw,bool added);
+    
+    /// Drawables added and removed since the renderer last looked
+    std::vector<DrawableDelta> drawableDeltas;
+    /// Set if we dropped deltas and the renderer has to start over
+    bool drawableDeltasLost;
 	
 	typedef std::set<TextureBase *,IdentifiableSorter> TextureSet;
 	/// Textures, sorted by ID
@@ -435,11 +508,26 @@ public:
     /// Mutex for accessing textures
     pthread_mutex_t textureLock;
 	
-	pthread_mutex_t changeRequestLock;
-	/// We keep a list of change requests to execute
-	/// This can be accessed in multiple threads, so we lock it
+    /// Change requests coming in from other threads
+    ChangeQueue changeQueue;
+	/// Change requests waiting to execute, in order.  Rendering thread only.
 	ChangeSet changeRequests;
-    SortedChangeSet timedChangeRequests;
+    /// Change requests waiting for their time, as a heap.  Rendering thread only.
+    ChangeSet timedChangeRequests;
+    /// Set if changeRequests has anything in it, for other threads
+    std::atomic<bool> changesWaiting;
+    /// When the next timed change is due, for other threads
+    std::atomic<TimeInterval> nextTimedChange;
+    
+    /// Time we can spend on changes per frame
+    TimeInterval changeBudget;
+    /// Counters from the last processChanges()
+    std::atomic<int> numPendingChanges,lastChangesProcessed;
+    std::atomic<TimeInterval> lastChangeTime;
+    std::atomic<size_t> lastBytesUploaded;
+    
+    /// Per-phase timings and per-frame counters, when turned on
+    FrameProfiler profiler;
     
     pthread_mutex_t subTexLock;
     typedef std::set<SubTexture> SubTextureSet;
@@ -25,6 +25,8 @@
 
 namespace WhirlyKit
 {
+class CullCache;
+
 /** Scene Renderer for OpenGL ES2.
      This implements the actual rendering.  In theory it's
      somewhat composable, but in reality not all that much.
@@ -69,7 +71,9 @@ protected:
     
     bool extraFrameDrawn;
     std::vector<WhirlyKitDirectionalLight> lights;
-
+    
+    /// What was visible last frame, so we can skip culling and sorting when nothing moved
+    CullCache *cullCache;
 };
         
 }
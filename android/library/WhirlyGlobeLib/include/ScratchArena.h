@@ -0,0 +1,140 @@
+/*
+ *  ScratchArena.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <cstddef>
+#import <new>
+#import <utility>
+#import <vector>
+
+namespace WhirlyKit
+{
+
+/** Monotonic memory for the short lived data we use while building geometry for a tile.
+    Allocation just bumps a pointer and nothing is freed individually.
+    Instead, a Scope rewinds the arena back to where it was when the scope started.
+    The blocks are kept around for the next tile.
+  */
+class ScratchArena
+{
+public:
+    /// Blocks are allocated in this size, or bigger for big requests
+    ScratchArena(size_t blockSize = 64*1024);
+    ~ScratchArena();
+
+    /// Allocate the given number of bytes, aligned as requested
+    void *allocate(size_t size,size_t align);
+
+    /// Only reclaims memory if this was the most recent allocation, which covers a vector growing
+    void deallocate(void *ptr,size_t size);
+
+    /// Throw out everything.  We keep one block's worth of memory.
+    void reset();
+
+    /// Position in the arena that we can rewind to
+    class Mark
+    {
+    public:
+        unsigned int block;
+        size_t offset;
+    };
+
+    /// Current position
+    Mark getMark() const;
+
+    /// Discard everything allocated since the mark
+    void rewind(const Mark &mark);
+
+    /// Rewinds the arena when it goes out of scope.  Scopes can nest.
+    class Scope
+    {
+    public:
+        Scope(ScratchArena &arena) : arena(arena), mark(arena.getMark()) { }
+        ~Scope() { arena.rewind(mark); }
+
+    protected:
+        ScratchArena &arena;
+        Mark mark;
+    };
+
+    /// Arena for the calling thread.  Each thread gets its own, so there's no locking.
+    static ScratchArena &getThreadArena();
+
+protected:
+    typedef struct
+    {
+        char *data;
+        size_t size;
+    } Block;
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    unsigned int curBlock;
+    size_t curOffset;
+};
+
+/** STL allocator that hands out memory from a ScratchArena.
+    With no arena it falls back to the heap.
+  */
+template<typename T>
+class ScratchAllocator
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    template<typename U> struct rebind { typedef ScratchAllocator<U> other; };
+
+    ScratchAllocator(ScratchArena *arena = NULL) : arena(arena) { }
+    template<typename U> ScratchAllocator(const ScratchAllocator<U> &that) : arena(that.arena) { }
+
+    T *allocate(size_t num,const void * = NULL)
+    {
+        if (arena)
+            return (T *)arena->allocate(num*sizeof(T),alignof(T));
+        return (T *)::operator new(num*sizeof(T));
+    }
+
+    void deallocate(T *ptr,size_t num)
+    {
+        if (arena)
+            arena->deallocate(ptr,num*sizeof(T));
+        else
+            ::operator delete(ptr);
+    }
+
+    size_t max_size() const { return ((size_t)-1) / sizeof(T); }
+
+    template<typename U,typename... Args> void construct(U *ptr,Args&&... args) { ::new((void *)ptr) U(std::forward<Args>(args)...); }
+    template<typename U> void destroy(U *ptr) { ptr->~U(); }
+
+    bool operator == (const ScratchAllocator &that) const { return arena == that.arena; }
+    bool operator != (const ScratchAllocator &that) const { return arena != that.arena; }
+
+    ScratchArena *arena;
+};
+
+/// A vector living in a ScratchArena.  Construct it with a pointer to the arena.
+template<typename T> using ScratchVector = std::vector<T,ScratchAllocator<T> >;
+
+}
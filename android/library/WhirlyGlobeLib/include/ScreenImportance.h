@@ -33,6 +33,11 @@ namespace WhirlyKit
 /// Check if any part of the given tile is on screen
 bool TileIsOnScreen(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const WhirlyKit::Mbr &nodeMbr,const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs);
     
+/// Find the tiles that are definitely off screen, in one batch.  These would get 0 from ScreenImportance.
+/// Only tiles that have a cached display solid are checked and tiles below minLevel are skipped.
+/// offScreen is set for the ones we find and left alone for the rest.
+void TilesOffScreen(WhirlyKit::ViewState *viewState,const std::vector<WhirlyKit::Quadtree::NodeInfo *> &nodes,int minLevel,std::vector<bool> &offScreen);
+    
 /// Utility function to calculate importance based on pixel screen size.
 /// This would be used by the data source as a default.
 double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,const Point3d &notUsed, int pixelsSqare,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const WhirlyKit::Mbr &nodeMbr, const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs);
@@ -41,6 +46,11 @@ double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f
 /// This version takes a min/max height and is optimized for volumes.
 double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,int pixelsSquare,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const WhirlyKit::Mbr &nodeMbr, double minZ,double maxZ, const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs);
 
+/// Bound what ScreenImportance would return for a new view state, using what was cached
+///  for the tile the last time it was evaluated.  This is much cheaper than ScreenImportance.
+/// Returns false if there's nothing cached or the tile can't be bounded (e.g. it's partly on screen).
+bool ScreenImportanceBounds(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,int pixelsSquare,Dictionary *attrs,double &minImport,double &maxImport);
+
 /// A solid volume used to describe the display space a tile takes up.
 /// We use these for screen space calculations and cache them in the tile
 ///  idents.
@@ -55,9 +65,14 @@ public:
     /// Returns true if the given point (in display space) is inside the volume
     bool isInside(const Point3d &pt);
     
-    /// Calculate the importance for this display solid given the user's eye position
+    /// Calculate the importance for this display solid given the user's eye position.
+    /// This also caches what we need to bound the importance for the next view state.
     double importanceForViewState(ViewState *viewState,const Point2f &frameSize);
     
+    /// Bound the importance for a new view state from what we saw in the last call to importanceForViewState.
+    /// Returns false if we need a full calculation.
+    bool importanceBoundsForViewState(ViewState *viewState,const Point2f &frameSize,double &minImport,double &maxImport);
+    
     /// See if this display solid is current in the viewing frustum
     bool isOnScreenForViewState(ViewState *viewState,const Point2f &frameSize);
     
@@ -70,6 +85,30 @@ public:
     std::vector<Eigen::Vector3d> normals;
     /// Normals for the surface.  We use these to make sure the solid is pointing towards us.
     std::vector<Eigen::Vector3d> surfNormals;
+    /// Bounding sphere around the polygons, in display space
+    Point3d center;
+    double radius;
+    /// Points for all the polygons, relative to the center.  polyStarts has where each polygon begins.
+    std::vector<float> ptX,ptY,ptZ;
+    std::vector<unsigned int> polyStarts;
+    
+protected:
+    // Set if the last evaluation can be used to bound the next one.
+    // That means the tile was entirely on or entirely off screen for each view offset.
+    bool lastBoundable;
+    // Frame size and eye position for the last evaluation
+    Point2f lastFrameSize;
+    Point3d lastEyePos;
+    // How far the eye can move before the inside and facing tests might change
+    double lastEyeMargin;
+    // Set if the tile faced the eye
+    bool lastFacing;
+    // Projection times model matrix for each view offset
+    std::vector<Eigen::Matrix4d> lastMatrices;
+    // Set if the tile was on screen for each view offset
+    std::vector<bool> lastOnScreen;
+    // Screen area and perimeter for each polygon, for each view offset
+    std::vector<double> lastAreas,lastPerimeters;
 };
     
 typedef std::shared_ptr<DisplaySolid> DisplaySolidRef;
@@ -0,0 +1,111 @@
+/*
+ *  SelectionIndex.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <vector>
+#import "Identifiable.h"
+#import "WhirlyVector.h"
+
+namespace WhirlyKit
+{
+
+/** Where a touch goes in display space.
+    This is a segment from the near plane to the far plane that widens with distance
+    (for a perspective view), so we can ask if anything in a box could land within
+    a given number of pixels of the touch.
+  */
+class SelectionPickRay
+{
+public:
+    SelectionPickRay();
+
+    /// Set up from a touch point (in the same units as frameSize) and the matrices used to project.
+    /// Returns false if the matrices don't make sense.
+    bool init(const Point2f &touchPt,const Point2f &frameSize,const Eigen::Matrix4d &projMat,const Eigen::Matrix4d &modelViewMat);
+
+    /// True if something in the box could be within the given number of pixels of the touch
+    bool overlaps(const Point3d &ll,const Point3d &ur,double pixels) const;
+
+    Point3d nearPt,farPt;
+    /// Display space distance a pixel covers at either end
+    double nearPixelSize,farPixelSize;
+};
+
+/** Packed R-tree over display space boxes, for picking.
+    It's built all at once from the selectables, sorted along a Morton curve.
+    Items added after that are checked one by one and removed items are left
+    in until there are enough changes to make a rebuild worth it.
+    Items only carry the select ID, so enabling and disabling doesn't change anything.
+  */
+class SelectionRTree
+{
+public:
+    /// A single selectable
+    class Item
+    {
+    public:
+        Item() : pixelRadius(0.0), selectID(EmptyIdentity) { }
+
+        // Bounds in display space
+        Point3d ll,ur;
+        // Screen space objects reach this far (in pixels) around their box
+        float pixelRadius;
+        SimpleIdentity selectID;
+    };
+
+    SelectionRTree();
+
+    /// Replace everything with the given items
+    void build(std::vector<Item> &newItems);
+
+    /// Add an item.  It's checked on its own until the next build.
+    void addItem(const Item &item);
+
+    /// Note that an item went away.  It stays in until the next build.
+    void removeItem() { numRemoved++; }
+
+    /// True if enough has changed that a build is worth it
+    bool needsRebuild() const;
+
+    /// Items that could be within maxDist pixels of any of the rays, sorted by ID
+    void findNearRays(const std::vector<SelectionPickRay> &rays,float maxDist,std::vector<SimpleIdentity> &selectIDs) const;
+
+protected:
+    class Node
+    {
+    public:
+        Point3d ll,ur;
+        float pixelRadius;
+        // Items (for the bottom level) or nodes in the level below
+        int start,num;
+    };
+
+    // Node bounding the given items
+    static void BoundItems(const Item *items,int num,Node &node);
+
+    // Items in Morton order
+    std::vector<Item> items;
+    // Nodes, a level at a time from the bottom, with the root last
+    std::vector<Node> nodes;
+    // Added since the last build
+    std::vector<Item> pending;
+    int numRemoved;
+};
+
+}
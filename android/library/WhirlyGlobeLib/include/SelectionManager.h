@@ -29,6 +29,7 @@
 #import "ViewState.h"
 #import "GlobeViewState.h"
 #import "ScreenSpaceBuilder.h"
+#import "SelectionIndex.h"
 
 namespace WhirlyKit
 {
@@ -187,7 +188,8 @@ typedef std::set<WhirlyKit::BillboardSelectable> BillboardSelectableSet;
      when the caller uses pickObject.
  
     All objects are currently being projected to the 2D screen and
-     evaluated for distance there.
+     evaluated for distance there.  Each kind of selectable is indexed in
+     display space so we only project the ones near the touch.
  
     The selection manager is entirely thread safe except for destruction.
  */
@@ -290,8 +292,10 @@ protected:
     static Eigen::Matrix2d calcScreenRot(float &screenRot,ViewState *viewState,WhirlyGlobe::GlobeViewState *globeViewState,ScreenSpaceObjectLocation *ssObj,const Point2d &objPt,const Eigen::Matrix4d &modelTrans,const Eigen::Matrix4d &normalMat,const Point2f &frameBufferSize);
     // Projects a world coordinate to one or more points on the screen (wrapping)
     void projectWorldPointToScreen(const Point3d &worldLoc,const PlacementInfo &pInfo,Point2dVector &screenPts,float scale);
-    // Convert rect selectables into more generic screen space objects
-    void getScreenSpaceObjects(const PlacementInfo &pInfo,std::vector<ScreenSpaceObjectLocation> &screenObjs,TimeInterval now);
+    // Convert rect selectables (just the given ones, for the static kind) into more generic screen space objects
+    void getScreenSpaceObjects(const PlacementInfo &pInfo,const std::vector<SimpleIdentity> &rect2DIDs,std::vector<ScreenSpaceObjectLocation> &screenObjs,TimeInterval now);
+    // Rebuild any of the indices that have gotten too far out of date
+    void updateIndices();
     // Internal object picking method
     void pickObjects(Point2f touchPt,float maxDist,View *theView,bool multi,std::vector<SelectedObject> &selObjs);
 
@@ -307,6 +311,12 @@ protected:
     WhirlyKit::MovingPolytopeSelectableSet movingPolytopeSelectables;
     WhirlyKit::LinearSelectableSet linearSelectables;
     WhirlyKit::BillboardSelectableSet billboardSelectables;
+    /// Display space indices for the ones that don't move
+    WhirlyKit::SelectionRTree rect3DIndex;
+    WhirlyKit::SelectionRTree rect2DIndex;
+    WhirlyKit::SelectionRTree polytopeIndex;
+    WhirlyKit::SelectionRTree linearIndex;
+    WhirlyKit::SelectionRTree billboardIndex;
 };
  
 }
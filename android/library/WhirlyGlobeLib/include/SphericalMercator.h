@@ -53,8 +53,16 @@ public:
     Point3f geocentricToLocal(Point3f);
     Point3d geocentricToLocal(Point3d);
     
+    /// Batch versions.  The projection math runs in a tight loop and the datum
+    ///  conversion is one Proj.4 call for the whole array.
+    void localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    void geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts);
+    
     /// True if the other system is Spherical Mercator with the same origin
     virtual bool isSameAs(CoordSystem *coordSys);
+    
+    /// Return the origin longitude in radians
+    double getOriginLon() const { return originLon; }
         
 protected:
     double originLon;
@@ -83,6 +91,7 @@ public:
     /// Convert from the system's local coordinates to display coordinates
     virtual WhirlyKit::Point3f localToDisplay(WhirlyKit::Point3f);
     virtual WhirlyKit::Point3d localToDisplay(WhirlyKit::Point3d);
+    virtual void localToDisplay(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts);
     
     /// Convert from display coordinates to the local system's coordinates
     virtual WhirlyKit::Point3f displayToLocal(WhirlyKit::Point3f);
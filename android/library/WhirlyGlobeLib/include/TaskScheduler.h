@@ -0,0 +1,210 @@
+/*
+ *  TaskScheduler.h
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <pthread.h>
+#import <memory>
+#import <functional>
+#import <atomic>
+#import <deque>
+#import <vector>
+#import <map>
+#import "Identifiable.h"
+#import "Quadtree.h"
+
+namespace WhirlyKit
+{
+
+class TaskScheduler;
+
+/// A single unit of work
+typedef std::function<void()> TaskFunc;
+
+/// Work on the indices [start,end)
+typedef std::function<void(unsigned int start,unsigned int end)> RangeFunc;
+
+/** A group of tasks working toward the same thing, usually loading one tile.
+    The tasks share an importance and can be cancelled together.
+    Always hold these in a TaskGroupRef.
+  */
+class TaskGroup : public std::enable_shared_from_this<TaskGroup>
+{
+public:
+    TaskGroup(TaskScheduler *scheduler,double importance);
+    ~TaskGroup();
+
+    /// Run the given task on one of the scheduler's threads
+    void addTask(const TaskFunc &func);
+
+    /// Wait for all the tasks added so far to finish.
+    /// The calling thread runs this group's tasks while it waits, but never anyone else's.
+    /// Returns false if the group was cancelled.
+    bool wait();
+
+    /// Drop any tasks that haven't started yet.
+    /// Long running tasks should check isCancelled() and bail out.
+    void cancel();
+
+    /// True if the group was cancelled
+    bool isCancelled() const { return cancelled; }
+
+    /// Importance given to tasks added from now on.  Bigger runs sooner.
+    double getImportance() const { return importance; }
+    void setImportance(double newImportance) { importance = newImportance; }
+
+protected:
+    friend class TaskScheduler;
+
+    /// A task that hasn't started.  The scheduler and wait() can both get at it,
+    ///  so whoever claims it first runs it.
+    class PendingTask
+    {
+    public:
+        PendingTask(const TaskFunc &func) : func(func), claimed(false) { }
+
+        /// True if we got it and should run it
+        bool claim() { return !claimed.exchange(true); }
+
+        TaskFunc func;
+        std::atomic<bool> claimed;
+    };
+    typedef std::shared_ptr<PendingTask> PendingTaskRef;
+
+    // Run a task we've claimed (or drop it if we're cancelled) and mark it done
+    void runClaimed(PendingTask *task);
+
+    // Called once a task has run (or been dropped)
+    void taskDone();
+
+    TaskScheduler *scheduler;
+    std::atomic<double> importance;
+    std::atomic<bool> cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int outstanding;
+    // Tasks that might not have started, oldest first.  Claimed ones get cleared out as we go.
+    std::deque<PendingTaskRef> pending;
+};
+typedef std::shared_ptr<TaskGroup> TaskGroupRef;
+
+/** A fixed pool of threads that runs tasks in importance order.
+    Each thread keeps its own queue and steals from the others when it runs dry.
+    There's one shared scheduler sized to the number of cores and, for paging layers,
+     a task group for each tile being loaded.
+  */
+class TaskScheduler
+{
+public:
+    /// Start the given number of worker threads
+    TaskScheduler(int numThreads);
+    ~TaskScheduler();
+
+    /// The shared scheduler, with one thread per core
+    static TaskScheduler *getScheduler();
+
+    /// Number of worker threads
+    int getNumThreads() const { return (int)workers.size(); }
+
+    /** Run func over [0,num) in chunks of chunkSize, spread over the workers and the calling thread.
+        Returns once every chunk is done.  The calling thread only ever runs these chunks,
+        so it's fine to call this with locks held.
+      */
+    void parallelFor(unsigned int num,unsigned int chunkSize,const RangeFunc &func);
+
+    /// Start tracking the work for a tile.  Importance is usually the quad tree's
+    ///  importance for the tile.  If we're already tracking the tile (e.g. for another
+    ///  frame), the existing group is returned with the new importance.
+    TaskGroupRef addTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident,double importance);
+
+    /// Return the group for a tile we're tracking, or an empty reference
+    TaskGroupRef findTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident);
+
+    /// Stop tracking a tile's group, leaving it to finish
+    void removeTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident);
+
+    /// Cancel the work for a tile and stop tracking it
+    void cancelTile(SimpleIdentity ownerID,const Quadtree::Identifier &ident);
+
+    /// Cancel all the tiles for the given owner
+    void cancelOwner(SimpleIdentity ownerID);
+
+protected:
+    friend class TaskGroup;
+
+    /// A task waiting to run
+    class Task
+    {
+    public:
+        /// Less important first, then the most recent, so the heap hands back the right one
+        bool operator < (const Task &that) const
+        {
+            if (importance == that.importance)
+                return order > that.order;
+            return importance < that.importance;
+        }
+
+        TaskGroupRef group;
+        TaskGroup::PendingTaskRef pendingTask;
+        double importance;
+        unsigned long order;
+    };
+
+    /// Tasks for a single worker, kept as a heap by importance
+    class WorkerQueue
+    {
+    public:
+        WorkerQueue();
+        ~WorkerQueue();
+
+        void push(const Task &task);
+        bool pop(Task &task);
+
+        pthread_t thread;
+        pthread_mutex_t lock;
+        std::vector<Task> tasks;
+    };
+
+    typedef std::pair<SimpleIdentity,Quadtree::Identifier> TileKey;
+    typedef std::map<TileKey,TaskGroupRef> TileGroupMap;
+
+    // Add a task to the current thread's queue or, from outside the pool, the next one in line
+    void addTask(const TaskGroupRef &group,const TaskGroup::PendingTaskRef &pendingTask);
+
+    // Run the next task, looking in our own queue first, then stealing.
+    // Pass -1 from outside the pool.
+    bool runTask(int which);
+
+    // Main loop for a worker thread
+    static void *workerMain(void *arg);
+
+    std::vector<WorkerQueue *> workers;
+
+    // Protects the counters below and lets idle workers sleep
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int numPending;
+    unsigned long nextOrder;
+    unsigned int nextWorker;
+    bool shuttingDown;
+
+    pthread_mutex_t tileLock;
+    TileGroupMap tileGroups;
+};
+
+}
@@ -24,6 +24,12 @@
 #import "WhirlyGeometry.h"
 #import "GlobeMath.h"
 #import "Quadtree.h"
+#import "TaskScheduler.h"
+#import "ScratchArena.h"
+#import "ChangeQueue.h"
+#import "FrustumBatch.h"
+#import "FlatCullTree.h"
+#import "FrameProfiler.h"
 #import "WhirlyKitView.h"
 #import "GlobeView.h"
 //#import "AnimateRotation.h"
@@ -56,6 +62,7 @@
 //#import "ParticleSystemLayer.h"
 #import "MarkerManager.h"
 //#import "LoftLayer.h"
+#import "SelectionIndex.h"
 #import "SelectionManager.h"
 #import "IntersectionManager.h"
 #import "TextureAtlas.h"
@@ -117,5 +124,6 @@
 #import "GeoJSONSource.h"
 #endif
 #import "OverlapHelper.h"
+#import "ClusterHierarchy.h"
 
 
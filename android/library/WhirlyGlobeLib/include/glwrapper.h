@@ -54,6 +54,40 @@ void glDrawArraysInstanced(	GLenum mode,
                            GLsizei count,
                            GLsizei primcount);
 
+// OpenGL ES 3 calls we look up at runtime, since we build against the ES 2 headers
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT                  0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_RANGE_BIT
+#define GL_MAP_INVALIDATE_RANGE_BIT       0x0004
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT         0x0020
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED               0x911A
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED                0x911B
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED            0x911C
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED                    0x911D
+#endif
+#ifndef GL_TIMEOUT_IGNORED
+#define GL_TIMEOUT_IGNORED                0xFFFFFFFFFFFFFFFFull
+#endif
+void *glMapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLsync glFenceSync (GLenum condition, GLbitfield flags);
+GLenum glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout);
+void glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout);
+void glDeleteSync (GLsync sync);
+
 #else
 
 // iOS
@@ -68,3 +102,5 @@ void glDrawArraysInstanced(	GLenum mode,
 
 extern bool hasVertexArraySupport;
 extern bool hasMapBufferSupport;
+/// Set if we've got an OpenGL ES 3 context with glMapBufferRange and fences
+extern bool hasMapBufferRangeSupport;
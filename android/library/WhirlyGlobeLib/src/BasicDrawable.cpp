@@ -131,6 +131,7 @@ SimpleIdentity BasicDrawable::getProgram() const
 void BasicDrawable::setProgram(SimpleIdentity progId)
 {
     programId = progId;
+    sortKeyChanged();
 }
 
 unsigned int BasicDrawable::getDrawPriority() const
@@ -245,6 +246,7 @@ void BasicDrawable::setLocalMbr(Mbr mbr)
 void BasicDrawable::setDrawPriority(unsigned int newPriority)
 {
     drawPriority = newPriority;
+    sortKeyChanged();
 }
 
 unsigned int BasicDrawable::getDrawPriority()
@@ -278,6 +280,7 @@ void BasicDrawable::setTexId(unsigned int which,SimpleIdentity inId)
 {
     setupTexCoordEntry(which, 0);
     texInfo[which].texId = inId;
+    sortKeyChanged();
 }
 
 void BasicDrawable::setTexIDs(const std::vector<SimpleIdentity> &texIDs)
@@ -287,6 +290,7 @@ void BasicDrawable::setTexIDs(const std::vector<SimpleIdentity> &texIDs)
         setupTexCoordEntry(ii, 0);
         texInfo[ii].texId = texIDs[ii];
     }
+    sortKeyChanged();
 }
 
 void BasicDrawable::setColor(RGBAColor inColor)
@@ -340,7 +344,7 @@ float BasicDrawable::getLineWidth()
 { return lineWidth; }
 
 void BasicDrawable::setRequestZBuffer(bool val)
-{ requestZBuffer = val; }
+{ requestZBuffer = val;  sortKeyChanged(); }
 
 bool BasicDrawable::getRequestZBuffer() const
 { return requestZBuffer; }
@@ -512,6 +516,11 @@ void BasicDrawable::addVertexAttributes(const SingleVertexAttributeSet &attrs)
 void BasicDrawable::addTriangle(Triangle tri)
 { tris.push_back(tri); }
 
+SimpleIdentity BasicDrawable::getSortTexId() const
+{
+    return texInfo.empty() ? EmptyIdentity : texInfo[0].texId;
+}
+
 SimpleIdentity BasicDrawable::getTexId(unsigned int which)
 {
     SimpleIdentity texId = EmptyIdentity;
@@ -534,6 +543,7 @@ void BasicDrawable::updateRenderer(WhirlyKit::SceneRendererES *renderer)
             programId = renderer->getScene()->getProgramIDBySceneName(kSceneDefaultLineShader);
         else
             programId = renderer->getScene()->getProgramIDBySceneName(kSceneDefaultTriShader);
+        sortKeyChanged();
     }
 }
 
@@ -754,7 +764,8 @@ void BasicDrawable::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *me
         for (unsigned int ii=0;ii<tris.size();ii++,basePtr+=sizeof(Triangle))
             memcpy(basePtr, &tris[ii], sizeof(Triangle));
         
-        glBufferData(GL_ARRAY_BUFFER, bufferSize, glMem, GL_STATIC_DRAW);
+        // The buffer already has storage, so don't respecify it
+        glBufferSubData(GL_ARRAY_BUFFER, sharedBufferOffset, bufferSize, glMem);
         free(glMem);
     }
     
@@ -186,7 +186,7 @@ void BasicDrawableInstance::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemMan
 //        else
 //            glUnmapBuffer(GL_ARRAY_BUFFER);
     } else {
-        glBufferData(GL_ARRAY_BUFFER, bufferSize, glMem, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bufferSize, glMem);
         free(glMem);
     }
     
@@ -39,7 +39,8 @@ BigDrawable::Buffer::Buffer()
 
 BigDrawable::BigDrawable(const std::string &name,int singleVertexSize,const std::vector<VertexAttribute> &templateAttributes,int singleElementSize,int numVertexBytes,int numElementBytes)
     : Drawable(name), singleVertexSize(singleVertexSize), vertexAttributes(templateAttributes), singleElementSize(singleElementSize), numVertexBytes(numVertexBytes), numElementBytes(numElementBytes), drawPriority(0), requestZBuffer(false), writeZBuffer(true),
-    waitingOnSwap(false), programId(0), elementChunkSize(0), minVis(DrawVisibleInvalid), maxVis(DrawVisibleInvalid), minVisibleFadeBand(0.0), maxVisibleFadeBand(0.0), enable(true), center(0,0,0), fade(1.0), renderTargetID(EmptyIdentity)
+    waitingOnSwap(false), programId(0), elementChunkSize(0), minVis(DrawVisibleInvalid), maxVis(DrawVisibleInvalid), minVisibleFadeBand(0.0), maxVisibleFadeBand(0.0), enable(true), center(0,0,0), fade(1.0), renderTargetID(EmptyIdentity),
+    streaming(false), streamDirty(false), streamStalled(false), activeSegment(-1), pendingSegment(-1), pendingFence(NULL)
 {
     activeBuffer = -1;
     transMat = transMat.Identity();
@@ -97,6 +98,7 @@ void BigDrawable::setModes(BasicDrawable *draw)
     writeZBuffer = draw->getWriteZbuffer();
     drawPriority = draw->getDrawPriority();
     draw->getVisibleRange(minVis, maxVis, minVisibleFadeBand, maxVisibleFadeBand);
+    sortKeyChanged();
 }
 
 const Eigen::Matrix4d *BigDrawable::getMatrix() const
@@ -118,6 +120,16 @@ void BigDrawable::setTexID(unsigned int which,SimpleIdentity texId)
 {
     if (which < texInfo.size())
         texInfo[which].texId = texId;
+    sortKeyChanged();
+}
+    
+void BigDrawable::setStreaming(bool newVal)
+{
+    // Can't switch once the buffers are set up
+    if (buffers[0].vertexBufferId)
+        return;
+    
+    streaming = newVal && hasMapBufferRangeSupport;
 }
     
 void BigDrawable::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *memManager)
@@ -125,6 +137,16 @@ void BigDrawable::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *memM
     if (buffers[0].vertexBufferId)
         return;
     
+    // One vertex buffer written in place and a segmented element buffer
+    if (streaming)
+    {
+        Buffer &theBuffer = buffers[0];
+        theBuffer.vertexBufferId = memManager->getBufferID(numVertexBytes,GL_DYNAMIC_DRAW);
+        theBuffer.elementBufferId = memManager->getBufferID(numElementBytes*BigDrawableStreamSegments,GL_DYNAMIC_DRAW);
+        activeBuffer = 0;
+        return;
+    }
+    
     for (unsigned int ii=0;ii<2;ii++)
     {
         Buffer &theBuffer = buffers[ii];
@@ -151,6 +173,21 @@ void BigDrawable::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *memM
     
 void BigDrawable::teardownGL(OpenGLMemManager *memManager)
 {
+    pthread_mutex_lock(&useMutex);
+    for (unsigned int ii=0;ii<BigDrawableStreamSegments;ii++)
+    {
+        StreamSegment &seg = segments[ii];
+        if (seg.retireFence)
+            glDeleteSync(seg.retireFence);
+        seg.retireFence = NULL;
+        seg.freedRegions.clear();
+    }
+    if (pendingFence)
+        glDeleteSync(pendingFence);
+    pendingFence = NULL;
+    activeSegment = pendingSegment = -1;
+    pthread_mutex_unlock(&useMutex);
+
     for (unsigned int ii=0;ii<2;ii++)
     {
         Buffer &theBuffer = buffers[ii];
@@ -173,6 +210,7 @@ void BigDrawable::updateRenderer(WhirlyKit::SceneRendererES *renderer)
     if (programId == EmptyIdentity)
     {
         programId = (int)renderer->getScene()->getProgramIDBySceneName(kSceneDefaultTriShader);
+        sortKeyChanged();
     }
 }
 
@@ -207,8 +245,20 @@ void BigDrawable::draw(WhirlyKit::RendererFrameInfo *frameInfo,Scene *scene)
     if (frameInfo->oglVersion < 2)
         return;
     
+    if (activeBuffer < 0)
+        return;
     Buffer &theBuffer = buffers[activeBuffer];
-    if (theBuffer.numElement <= 0)
+    int numElement = theBuffer.numElement;
+    GLintptr elementOffset = 0;
+    if (streaming)
+    {
+        pickUpStreamSegment();
+        if (activeSegment < 0)
+            return;
+        numElement = segments[activeSegment].numElement;
+        elementOffset = (GLintptr)activeSegment * numElementBytes;
+    }
+    if (numElement <= 0)
         return;
     
     OpenGLES2Program *prog = frameInfo->program;
@@ -394,8 +444,8 @@ void BigDrawable::draw(WhirlyKit::RendererFrameInfo *frameInfo,Scene *scene)
     	glBindVertexArray(theBuffer.vertexArrayObj);
         CheckGLError("BigDrawable::drawVBO2() glBindVertexArrayOES");
     }
-    if (theBuffer.numElement != 0)
-        glDrawElements(GL_TRIANGLES, theBuffer.numElement, GL_UNSIGNED_SHORT, 0);
+    if (numElement != 0)
+        glDrawElements(GL_TRIANGLES, numElement, GL_UNSIGNED_SHORT, CALCBUFOFF(0, elementOffset));
     if (hasVertexArraySupport)
     	glBindVertexArray(0);
     
@@ -440,12 +490,19 @@ SimpleIdentity BigDrawable::addRegion(RawDataRef vertData,int &vertPos,RawDataRe
     
     // Let's look for a region large enough to contain the new vertices
     RegionSet::iterator vrit;
-    for (vrit = vertexRegions.begin(); vrit != vertexRegions.end(); ++vrit)
+    for (unsigned int tries=0;tries<2;tries++)
     {
-        if ((*vrit).len >= vertexSize)
+        for (vrit = vertexRegions.begin(); vrit != vertexRegions.end(); ++vrit)
         {
-            break;
+            if ((size_t)(*vrit).len >= vertexSize)
+            {
+                break;
+            }
         }
+        // When streaming, there may be cleared regions the GPU is done with
+        if (vrit != vertexRegions.end() || !streaming)
+            break;
+        reclaimStreamRegions();
     }
     // Not enough room
     if (vrit == vertexRegions.end())
@@ -467,8 +524,7 @@ SimpleIdentity BigDrawable::addRegion(RawDataRef vertData,int &vertPos,RawDataRe
 
     // Set up the vertex buffer change for processing later
     ChangeRef change (new Change(ChangeAdd,vertPos,vertData));
-    for (unsigned int ii=0;ii<2;ii++)
-        buffers[ii].changes.push_back(change);
+    addChange(change);
 
     // We know the element data needs to be offset from the position, so let's do that
     int vertOffset = vertPos/singleVertexSize;
@@ -513,8 +569,19 @@ void BigDrawable::setEnableRegion(SimpleIdentity elementChunkId, bool enabled)
     // We just want to force an element rebuild
     RawDataRef emptyData;
     ChangeRef change (new Change(ChangeElements,0,emptyData));
-    for (unsigned int ii=0;ii<2;ii++)
-        buffers[ii].changes.push_back(change);
+    addChange(change);
+}
+    
+void BigDrawable::addChange(ChangeRef change)
+{
+    if (streaming)
+    {
+        buffers[0].changes.push_back(change);
+        streamDirty = true;
+    } else {
+        for (unsigned int ii=0;ii<2;ii++)
+            buffers[ii].changes.push_back(change);
+    }
 }
  
 void BigDrawable::removeRegion(RegionSet &regions,int pos,int size)
@@ -577,7 +644,13 @@ void BigDrawable::clearRegion(int vertPos,int vertSize,SimpleIdentity elementChu
 //    for (unsigned int ii=0;ii<2;ii++)
 //        buffers[ii].changes.push_back(change);
 
-    removeRegion(vertexRegions,vertPos,vertSize);
+    // The renderer may still be drawing from a streamed region, so it waits for a fence
+    if (streaming)
+    {
+        freedRegions.push_back(Region(vertPos,vertSize));
+        streamDirty = true;
+    } else
+        removeRegion(vertexRegions,vertPos,vertSize);
 
     // Remove the element chunk.  The next flush will pick it up.
     ElementChunkSet::iterator it = elementChunks.find(ElementChunk(elementChunkId));
@@ -606,7 +679,13 @@ void BigDrawable::getUtilization(int &vertSize,int &elSize)
 }
 
 void BigDrawable::executeFlush(int whichBuffer)
-{    
+{
+    if (streaming)
+    {
+        streamFlush();
+        return;
+    }
+    
     Buffer &theBuffer = buffers[whichBuffer];
     
 #ifdef __ANDROID__
@@ -692,11 +771,176 @@ void BigDrawable::executeFlush(int whichBuffer)
     theBuffer.numElement = elBufferSize / singleElementSize;
 }
     
+// True if the GPU has gotten past the fence
+static bool FenceSignaled(GLsync fence)
+{
+    GLenum ret = glClientWaitSync(fence, 0, 0);
+    return ret == GL_ALREADY_SIGNALED || ret == GL_CONDITION_SATISFIED;
+}
+
+void BigDrawable::reclaimStreamRegions()
+{
+    std::vector<Region> reclaimed;
+    
+    pthread_mutex_lock(&useMutex);
+    for (int ii=0;ii<BigDrawableStreamSegments;ii++)
+    {
+        StreamSegment &seg = segments[ii];
+        if (ii == activeSegment || ii == pendingSegment || !seg.retireFence)
+            continue;
+        if (FenceSignaled(seg.retireFence))
+        {
+            glDeleteSync(seg.retireFence);
+            seg.retireFence = NULL;
+            reclaimed.insert(reclaimed.end(),seg.freedRegions.begin(),seg.freedRegions.end());
+            seg.freedRegions.clear();
+        }
+    }
+    pthread_mutex_unlock(&useMutex);
+    
+    for (const Region &region : reclaimed)
+        removeRegion(vertexRegions,region.pos,region.len);
+}
+
+int BigDrawable::findStreamSegment()
+{
+    int whichSeg = -1;
+    pthread_mutex_lock(&useMutex);
+    for (int ii=0;ii<BigDrawableStreamSegments;ii++)
+        if (ii != activeSegment && ii != pendingSegment && !segments[ii].retireFence)
+        {
+            whichSeg = ii;
+            break;
+        }
+    pthread_mutex_unlock(&useMutex);
+    
+    return whichSeg;
+}
+
+bool BigDrawable::streamFlush()
+{
+    reclaimStreamRegions();
+    
+    // Every segment is busy.  The caller has to wait and try again.
+    int whichSeg = findStreamSegment();
+    if (whichSeg < 0)
+    {
+        streamStalled = true;
+        return false;
+    }
+    streamStalled = false;
+    
+    // New vertex data goes in place.  Nobody's drawing from those regions.
+    Buffer &theBuffer = buffers[0];
+    if (!theBuffer.changes.empty())
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, theBuffer.vertexBufferId);
+        for (unsigned int ii=0;ii<theBuffer.changes.size();ii++)
+        {
+            ChangeRef change = theBuffer.changes[ii];
+            if (change->type != ChangeAdd)
+                continue;
+            size_t len = change->vertData->getLen();
+            void *glMem = glMapBufferRange(GL_ARRAY_BUFFER, change->whereVert, len, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (glMem)
+            {
+                memcpy(glMem, change->vertData->getRawData(), len);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            } else
+                glBufferSubData(GL_ARRAY_BUFFER, change->whereVert, len, change->vertData->getRawData());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        CheckGLError("BigDrawable::streamFlush() vertices");
+        theBuffer.changes.clear();
+    }
+    
+    // Write the whole element list into the free segment
+    GLintptr segOffset = (GLintptr)whichSeg * numElementBytes;
+    int elBufferSize = 0;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, theBuffer.elementBufferId);
+    GLubyte *elBuffer = (GLubyte *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, segOffset, numElementBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    for (ElementChunkSet::iterator it = elementChunks.begin();
+         it != elementChunks.end(); ++it)
+        if (it->enabled)
+        {
+            size_t len = it->elementData->getLen();
+            if (elBufferSize + len > (size_t)numElementBytes)
+                break;
+            if (elBuffer)
+                memcpy(elBuffer + elBufferSize, it->elementData->getRawData(), len);
+            else
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, segOffset + elBufferSize, len, it->elementData->getRawData());
+            elBufferSize += len;
+        }
+    if (elBuffer)
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    CheckGLError("BigDrawable::streamFlush() elements");
+    
+    // The renderer waits on this before it draws the new segment.
+    // We're probably on another context, so it has to get to the GPU.
+    GLsync writeFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    
+    std::vector<Region> reclaimed;
+    pthread_mutex_lock(&useMutex);
+    // A segment that was never picked up can go right back in rotation
+    if (pendingSegment >= 0 && pendingFence)
+        glDeleteSync(pendingFence);
+    segments[whichSeg].numElement = elBufferSize / singleElementSize;
+    pendingSegment = whichSeg;
+    pendingFence = writeFence;
+    // Regions cleared since the last flush are free once the segment being drawn now retires
+    if (activeSegment >= 0)
+        segments[activeSegment].freedRegions.insert(segments[activeSegment].freedRegions.end(),freedRegions.begin(),freedRegions.end());
+    else
+        reclaimed.swap(freedRegions);
+    freedRegions.clear();
+    pthread_mutex_unlock(&useMutex);
+    
+    for (const Region &region : reclaimed)
+        removeRegion(vertexRegions,region.pos,region.len);
+    streamDirty = false;
+    
+    return true;
+}
+    
+void BigDrawable::pickUpStreamSegment()
+{
+    pthread_mutex_lock(&useMutex);
+    if (pendingSegment >= 0)
+    {
+        // Don't let the GPU read the segment before the writes land
+        if (pendingFence)
+        {
+            glWaitSync(pendingFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(pendingFence);
+            pendingFence = NULL;
+        }
+        // The old segment is free once the GPU gets through what we've drawn with it
+        if (activeSegment >= 0)
+            segments[activeSegment].retireFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        activeSegment = pendingSegment;
+        pendingSegment = -1;
+    }
+    pthread_mutex_unlock(&useMutex);
+}
+    
 // If set, we'll do the flushes on the main thread
 static const bool MainThreadFlush = false;
     
 void BigDrawable::swap(ChangeSet &changes,BigDrawableSwap *swapRequest)
 {
+    // Usually nothing to wait for.  The swap request just gets the renderer to pick up the flush
+    //  in order with the other changes.  If there was no free segment, we're still dirty and
+    //  isWaitingOnSwap() holds the caller off until one frees up.
+    if (streaming)
+    {
+        if (streamFlush())
+            swapRequest->addSwap(getId(), 0);
+        return;
+    }
+    
     // If we're waiting on a swap, no flushing
     if (isWaitingOnSwap())
     {
@@ -729,11 +973,22 @@ void BigDrawable::swap(ChangeSet &changes,BigDrawableSwap *swapRequest)
     
 bool BigDrawable::hasChanges()
 {
+    if (streaming)
+        return streamDirty;
+    
     return !buffers[0].changes.empty() || !buffers[1].changes.empty();
 }
     
 bool BigDrawable::isWaitingOnSwap()
 {
+    if (streaming)
+    {
+        if (!streamStalled)
+            return false;
+        reclaimStreamRegions();
+        return findStreamSegment() < 0;
+    }
+    
     bool ret = false;
     pthread_mutex_lock(&useMutex);
     ret = waitingOnSwap;
@@ -748,6 +1003,12 @@ bool BigDrawable::empty()
 
 void BigDrawable::swapBuffers(int whichBuffer)
 {
+    if (streaming)
+    {
+        pickUpStreamSegment();
+        return;
+    }
+    
     pthread_mutex_lock(&useMutex);
     activeBuffer = whichBuffer;
     waitingOnSwap = false;
@@ -0,0 +1,95 @@
+/*
+ *  ChangeQueue.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import "ChangeQueue.h"
+
+namespace WhirlyKit
+{
+
+ChangeQueue::ChangeQueue()
+    : head(NULL)
+{
+}
+
+ChangeQueue::~ChangeQueue()
+{
+    ChangeSet changes;
+    popAll(changes);
+    for (ChangeRequest *change : changes)
+        if (change)
+            delete change;
+}
+
+void ChangeQueue::push(const ChangeSet &changes)
+{
+    if (changes.empty())
+        return;
+
+    Batch *batch = new Batch();
+    batch->changes = changes;
+    pushBatch(batch);
+}
+
+void ChangeQueue::push(ChangeRequest *change)
+{
+    Batch *batch = new Batch();
+    batch->changes.push_back(change);
+    pushBatch(batch);
+}
+
+void ChangeQueue::pushBatch(Batch *batch)
+{
+    batch->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(batch->next,batch,std::memory_order_release,std::memory_order_relaxed))
+        ;
+}
+
+void ChangeQueue::popAll(ChangeSet &changes)
+{
+    // Taking the whole list at once means nobody else can be looking at these batches
+    Batch *batch = head.exchange(NULL,std::memory_order_acquire);
+    if (!batch)
+        return;
+
+    // The list is newest first, so flip it around
+    Batch *oldest = NULL;
+    while (batch)
+    {
+        Batch *next = batch->next;
+        batch->next = oldest;
+        oldest = batch;
+        batch = next;
+    }
+
+    while (oldest)
+    {
+        changes.insert(changes.end(),oldest->changes.begin(),oldest->changes.end());
+        Batch *next = oldest->next;
+        delete oldest;
+        oldest = next;
+    }
+}
+
+bool ChangeQueue::empty() const
+{
+    return head.load(std::memory_order_relaxed) == NULL;
+}
+
+}
@@ -0,0 +1,328 @@
+/*
+ *  ClusterHierarchy.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <math.h>
+#import <algorithm>
+#import "ClusterHierarchy.h"
+
+namespace WhirlyKit
+{
+
+// Below this many items a KD node is just searched in order
+static const int KDNodeSize = 64;
+
+void ClusterHierarchy::KDIndex::build(const std::vector<int> &nodeIDs,const std::vector<Node> &nodes)
+{
+    items.resize(nodeIDs.size());
+    for (unsigned int ii=0;ii<nodeIDs.size();ii++)
+    {
+        const Node &node = nodes[nodeIDs[ii]];
+        Item &item = items[ii];
+        item.x = node.x;
+        item.y = node.y;
+        item.nodeID = nodeIDs[ii];
+    }
+
+    sort(0,(int)items.size()-1,0);
+}
+
+void ClusterHierarchy::KDIndex::sort(int left,int right,int axis)
+{
+    if (right - left <= KDNodeSize)
+        return;
+
+    // Median goes in the middle, smaller to the left, bigger to the right
+    int mid = (left + right) / 2;
+    std::nth_element(items.begin()+left,items.begin()+mid,items.begin()+right+1,
+                     [axis](const Item &a,const Item &b) { return axis == 0 ? a.x < b.x : a.y < b.y; });
+
+    sort(left,mid-1,1-axis);
+    sort(mid+1,right,1-axis);
+}
+
+void ClusterHierarchy::KDIndex::range(double minX,double minY,double maxX,double maxY,std::vector<int> &nodeIDs) const
+{
+    if (items.empty())
+        return;
+
+    // Left, right, axis
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);  stack.push_back((int)items.size()-1);  stack.push_back(0);
+    while (!stack.empty())
+    {
+        int axis = stack.back();  stack.pop_back();
+        int right = stack.back();  stack.pop_back();
+        int left = stack.back();  stack.pop_back();
+
+        if (right - left <= KDNodeSize)
+        {
+            for (int ii=left;ii<=right;ii++)
+            {
+                const Item &item = items[ii];
+                if (item.x >= minX && item.x <= maxX && item.y >= minY && item.y <= maxY)
+                    nodeIDs.push_back(item.nodeID);
+            }
+            continue;
+        }
+
+        int mid = (left + right) / 2;
+        const Item &item = items[mid];
+        if (item.x >= minX && item.x <= maxX && item.y >= minY && item.y <= maxY)
+            nodeIDs.push_back(item.nodeID);
+
+        if (axis == 0 ? minX <= item.x : minY <= item.y)
+        {
+            stack.push_back(left);  stack.push_back(mid-1);  stack.push_back(1-axis);
+        }
+        if (axis == 0 ? maxX >= item.x : maxY >= item.y)
+        {
+            stack.push_back(mid+1);  stack.push_back(right);  stack.push_back(1-axis);
+        }
+    }
+}
+
+void ClusterHierarchy::KDIndex::within(double x,double y,double r,std::vector<int> &nodeIDs) const
+{
+    if (items.empty())
+        return;
+
+    double r2 = r*r;
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(0);  stack.push_back((int)items.size()-1);  stack.push_back(0);
+    while (!stack.empty())
+    {
+        int axis = stack.back();  stack.pop_back();
+        int right = stack.back();  stack.pop_back();
+        int left = stack.back();  stack.pop_back();
+
+        if (right - left <= KDNodeSize)
+        {
+            for (int ii=left;ii<=right;ii++)
+            {
+                const Item &item = items[ii];
+                double dx = item.x - x, dy = item.y - y;
+                if (dx*dx + dy*dy <= r2)
+                    nodeIDs.push_back(item.nodeID);
+            }
+            continue;
+        }
+
+        int mid = (left + right) / 2;
+        const Item &item = items[mid];
+        double dx = item.x - x, dy = item.y - y;
+        if (dx*dx + dy*dy <= r2)
+            nodeIDs.push_back(item.nodeID);
+
+        if (axis == 0 ? x - r <= item.x : y - r <= item.y)
+        {
+            stack.push_back(left);  stack.push_back(mid-1);  stack.push_back(1-axis);
+        }
+        if (axis == 0 ? x + r >= item.x : y + r >= item.y)
+        {
+            stack.push_back(mid+1);  stack.push_back(right);  stack.push_back(1-axis);
+        }
+    }
+}
+
+ClusterHierarchy::ClusterHierarchy(int minZoom,int maxZoom,double radius)
+    : minZoom(minZoom), maxZoom(maxZoom), radius(radius)
+{
+}
+
+void ClusterHierarchy::build(const std::vector<Leaf> &leaves)
+{
+    nodes.clear();
+    entries.clear();
+    leafOrder.clear();
+    entryLeaves.clear();
+    levels.clear();
+    levels.resize(maxZoom-minZoom+2);
+
+    // The points themselves sit one level past the last one we cluster
+    int numLeaves = (int)leaves.size();
+    nodes.resize(numLeaves);
+    entries.resize(numLeaves);
+    entryLeaves.reserve(numLeaves);
+    std::vector<int> levelNodes(numLeaves);
+    for (int ii=0;ii<numLeaves;ii++)
+    {
+        const Leaf &leaf = leaves[ii];
+        Node &node = nodes[ii];
+        node.x = leaf.x;
+        node.y = leaf.y;
+        node.parent = -1;
+        node.leafStart = ii;
+        node.numLeaves = 1;
+        entries[ii] = leaf.entry;
+        entryLeaves[leaf.entry] = ii;
+        levelNodes[ii] = ii;
+    }
+    levels[maxZoom+1-minZoom].build(levelNodes,nodes);
+
+    // Children of each cluster.  Only needed until the leaf ranges are sorted out.
+    std::vector<std::vector<int> > children(numLeaves);
+    // Last zoom level each node was merged or passed through at
+    std::vector<int> nodeZoom(numLeaves,maxZoom+1);
+
+    // Work up from the bottom, each level clustering what's in the one below it
+    std::vector<int> nextNodes,neighbors;
+    for (int zoom=maxZoom;zoom>=minZoom;zoom--)
+    {
+        const KDIndex &index = levels[zoom+1-minZoom];
+        double zoomRadius = radius / (256.0 * pow(2.0,zoom));
+
+        nextNodes.clear();
+        for (int nodeID : levelNodes)
+        {
+            if (nodeZoom[nodeID] <= zoom)
+                continue;
+            nodeZoom[nodeID] = zoom;
+
+            double x = nodes[nodeID].x, y = nodes[nodeID].y;
+            neighbors.clear();
+            index.within(x,y,zoomRadius,neighbors);
+
+            // Pull in anything nearby that hasn't already been taken
+            int numLeaves = nodes[nodeID].numLeaves;
+            double wx = x * numLeaves, wy = y * numLeaves;
+            std::vector<int> kids;
+            for (int neighborID : neighbors)
+            {
+                if (nodeZoom[neighborID] <= zoom)
+                    continue;
+                nodeZoom[neighborID] = zoom;
+
+                const Node &neighbor = nodes[neighborID];
+                wx += neighbor.x * neighbor.numLeaves;
+                wy += neighbor.y * neighbor.numLeaves;
+                numLeaves += neighbor.numLeaves;
+                kids.push_back(neighborID);
+            }
+
+            // Nothing close enough, so it stays on its own at this level
+            if (kids.empty())
+            {
+                nextNodes.push_back(nodeID);
+                continue;
+            }
+            kids.push_back(nodeID);
+
+            int clusterID = (int)nodes.size();
+            Node cluster;
+            cluster.x = wx / numLeaves;
+            cluster.y = wy / numLeaves;
+            cluster.parent = -1;
+            cluster.leafStart = 0;
+            cluster.numLeaves = numLeaves;
+            nodes.push_back(cluster);
+            nodeZoom.push_back(maxZoom+1);
+            for (int kidID : kids)
+                nodes[kidID].parent = clusterID;
+            children.push_back(kids);
+
+            nextNodes.push_back(clusterID);
+        }
+
+        levels[zoom-minZoom].build(nextNodes,nodes);
+        levelNodes.swap(nextNodes);
+    }
+
+    // Lay the leaves out so each node's are contiguous
+    leafOrder.reserve(numLeaves);
+    for (int nodeID : levelNodes)
+        assignLeaves(nodeID,children);
+}
+
+void ClusterHierarchy::assignLeaves(int nodeID,const std::vector<std::vector<int> > &children)
+{
+    nodes[nodeID].leafStart = (int)leafOrder.size();
+    if (nodeID < (int)entries.size())
+    {
+        leafOrder.push_back(nodeID);
+        return;
+    }
+
+    // Only as deep as the number of zoom levels
+    for (int kidID : children[nodeID])
+        assignLeaves(kidID,children);
+}
+
+void ClusterHierarchy::query(int zoom,double minX,double minY,double maxX,double maxY,std::vector<int> &nodeIDs) const
+{
+    if (levels.empty())
+        return;
+
+    zoom = std::max(minZoom,std::min(zoom,maxZoom+1));
+    levels[zoom-minZoom].range(minX,minY,maxX,maxY,nodeIDs);
+}
+
+int ClusterHierarchy::findEntry(LayoutObjectEntry *entry) const
+{
+    auto it = entryLeaves.find(entry);
+    if (it == entryLeaves.end())
+        return -1;
+
+    return it->second;
+}
+
+void ClusterHierarchy::getEntries(int nodeID,std::vector<LayoutObjectEntry *> &retEntries) const
+{
+    const Node &node = nodes[nodeID];
+    for (int ii=node.leafStart;ii<node.leafStart+node.numLeaves;ii++)
+    {
+        LayoutObjectEntry *entry = entries[leafOrder[ii]];
+        if (entry)
+            retEntries.push_back(entry);
+    }
+}
+
+void ClusterHierarchy::removeEntry(LayoutObjectEntry *entry)
+{
+    auto it = entryLeaves.find(entry);
+    if (it == entryLeaves.end())
+        return;
+
+    entries[it->second] = NULL;
+    entryLeaves.erase(it);
+}
+
+// Spherical mercator stops short of the poles
+static const double MaxMercatorLat = 85.05112878 * M_PI / 180.0;
+
+Point2d ClusterHierarchy::GeoToUnit(const Point2d &geo)
+{
+    double lat = std::max(-MaxMercatorLat,std::min(geo.y(),MaxMercatorLat));
+    double x = geo.x() / (2.0 * M_PI) + 0.5;
+    double y = 0.5 - log(tan(M_PI / 4.0 + lat / 2.0)) / (2.0 * M_PI);
+
+    return Point2d(x - floor(x),std::max(0.0,std::min(y,1.0)));
+}
+
+Point2d ClusterHierarchy::UnitToGeo(const Point2d &unit)
+{
+    double lon = (unit.x() - 0.5) * 2.0 * M_PI;
+    double lat = 2.0 * atan(exp((0.5 - unit.y()) * 2.0 * M_PI)) - M_PI / 2.0;
+
+    return Point2d(lon,lat);
+}
+
+}
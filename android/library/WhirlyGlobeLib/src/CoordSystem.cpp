@@ -21,6 +21,18 @@
 #import "Platform.h"
 #import "WhirlyKitLog.h"
 #import "CoordSystem.h"
+#import "CoordSystemConverter.h"
+#import <algorithm>
+
+// Eigen vectorization is turned off in Application.mk, so the point kernels below do it by hand.
+// Doubles need NEON on aarch64; 32 bit ARM gets the scalar loop.
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#import <arm_neon.h>
+#define WK_POINTS_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#import <emmintrin.h>
+#define WK_POINTS_SSE 1
+#endif
 
 using namespace Eigen;
 
@@ -33,6 +45,14 @@ Point3f CoordSystemConvert(CoordSystem *inSystem,CoordSystem *outSystem,Point3f
     if (inSystem->isSameAs(outSystem))
         return inCoord;
     
+    // Skip geocentric if we know a direct route
+    CoordSystemConverter *converter = CoordSystemFindConverterFast(inSystem,outSystem);
+    if (converter)
+    {
+        Point3d outPt = converter->convert(Point3d(inCoord.x(),inCoord.y(),inCoord.z()));
+        return Point3f(outPt.x(),outPt.y(),outPt.z());
+    }
+    
     // We'll go through geocentric which isn't horrible, but obviously we're assuming the same datum
     Point3f geoCPt = inSystem->localToGeocentric(inCoord);
     Point3f outPt = outSystem->geocentricToLocal(geoCPt);
@@ -45,12 +65,83 @@ Point3d CoordSystemConvert3d(CoordSystem *inSystem,CoordSystem *outSystem,Point3
     if (inSystem->isSameAs(outSystem))
         return inCoord;
     
+    // Skip geocentric if we know a direct route
+    CoordSystemConverter *converter = CoordSystemFindConverterFast(inSystem,outSystem);
+    if (converter)
+        return converter->convert(inCoord);
+    
     // We'll go through geocentric which isn't horrible, but obviously we're assuming the same datum
     Point3d geoCPt = inSystem->localToGeocentric(inCoord);
     Point3d outPt = outSystem->geocentricToLocal(geoCPt);
     return outPt;
 }
+
+void CoordSystemConvert3dBatch(CoordSystem *inSystem,CoordSystem *outSystem,const Point3d *inCoords,Point3d *outCoords,size_t numCoords)
+{
+    if (numCoords == 0)
+        return;
+    
+    // Easy if the coordinate systems are the same
+    if (inSystem->isSameAs(outSystem))
+    {
+        if (inCoords != outCoords)
+            std::copy(inCoords,inCoords+numCoords,outCoords);
+        return;
+    }
     
+    CoordSystemConverterRef converter = CoordSystemFindConverter(inSystem,outSystem);
+    if (converter)
+    {
+        converter->convert(inCoords,outCoords,numCoords);
+        return;
+    }
+    
+    // Same trip through geocentric as the single point version, but the whole array goes at once
+    inSystem->localToGeocentric(inCoords,outCoords,numCoords);
+    outSystem->geocentricToLocal(outCoords,outCoords,numCoords);
+}
+    
+void ScaleOffsetPoints(const Point3d *inPts,Point3d *outPts,size_t numPts,const Point3d &scale,const Point3d &offset)
+{
+    const double *in = inPts[0].data();
+    double *out = outPts[0].data();
+    size_t ii = 0;
+
+    // Two points are six doubles, which is three registers laid out as (x,y) (z,x) (y,z)
+#if defined(WK_POINTS_SSE)
+    const __m128d s0 = _mm_setr_pd(scale.x(),scale.y()), s1 = _mm_setr_pd(scale.z(),scale.x()), s2 = _mm_setr_pd(scale.y(),scale.z());
+    const __m128d o0 = _mm_setr_pd(offset.x(),offset.y()), o1 = _mm_setr_pd(offset.z(),offset.x()), o2 = _mm_setr_pd(offset.y(),offset.z());
+    for (;ii+2<=numPts;ii+=2,in+=6,out+=6)
+    {
+        __m128d v0 = _mm_loadu_pd(in), v1 = _mm_loadu_pd(in+2), v2 = _mm_loadu_pd(in+4);
+        _mm_storeu_pd(out,_mm_add_pd(_mm_mul_pd(v0,s0),o0));
+        _mm_storeu_pd(out+2,_mm_add_pd(_mm_mul_pd(v1,s1),o1));
+        _mm_storeu_pd(out+4,_mm_add_pd(_mm_mul_pd(v2,s2),o2));
+    }
+#elif defined(WK_POINTS_NEON)
+    const double s[6] = {scale.x(),scale.y(),scale.z(),scale.x(),scale.y(),scale.z()};
+    const double o[6] = {offset.x(),offset.y(),offset.z(),offset.x(),offset.y(),offset.z()};
+    const float64x2_t s0 = vld1q_f64(s), s1 = vld1q_f64(s+2), s2 = vld1q_f64(s+4);
+    const float64x2_t o0 = vld1q_f64(o), o1 = vld1q_f64(o+2), o2 = vld1q_f64(o+4);
+    for (;ii+2<=numPts;ii+=2,in+=6,out+=6)
+    {
+        // Separate multiply and add, not fused, so we match the scalar results exactly
+        float64x2_t v0 = vld1q_f64(in), v1 = vld1q_f64(in+2), v2 = vld1q_f64(in+4);
+        vst1q_f64(out,vaddq_f64(vmulq_f64(v0,s0),o0));
+        vst1q_f64(out+2,vaddq_f64(vmulq_f64(v1,s1),o1));
+        vst1q_f64(out+4,vaddq_f64(vmulq_f64(v2,s2),o2));
+    }
+#endif
+
+    // Whatever's left over, or everything if we don't have a vector unit
+    for (;ii<numPts;ii++,in+=3,out+=3)
+    {
+        out[0] = in[0]*scale.x() + offset.x();
+        out[1] = in[1]*scale.y() + offset.y();
+        out[2] = in[2]*scale.z() + offset.z();
+    }
+}
+
 DelayedDeletable::~DelayedDeletable()
 {
 }
@@ -61,6 +152,25 @@ CoordSystem::CoordSystem()
     
 CoordSystem::~CoordSystem()
 {
+    CoordSystemForgetConverters(this);
+}
+
+void CoordSystem::localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    for (size_t ii=0;ii<numPts;ii++)
+        outPts[ii] = localToGeocentric(inPts[ii]);
+}
+
+void CoordSystem::geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    for (size_t ii=0;ii<numPts;ii++)
+        outPts[ii] = geocentricToLocal(inPts[ii]);
+}
+    
+void CoordSystemDisplayAdapter::localToDisplay(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    for (size_t ii=0;ii<numPts;ii++)
+        outPts[ii] = localToDisplay(inPts[ii]);
 }
     
 GeneralCoordSystemDisplayAdapter::GeneralCoordSystemDisplayAdapter(CoordSystem *coordSys,const Point3d &ll,const Point3d &ur,const Point3d &inCenter,const Point3d &inScale)
@@ -110,6 +220,14 @@ WhirlyKit::Point3d GeneralCoordSystemDisplayAdapter::localToDisplay(WhirlyKit::P
     Point3d dispPt = Point3d(localPt.x()*scale.x(),localPt.y()*scale.y(),localPt.z()*scale.z())-center;
     return dispPt;
 }
+
+void GeneralCoordSystemDisplayAdapter::localToDisplay(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    
+    ScaleOffsetPoints(inPts,outPts,numPts,scale,-center);
+}
     
 WhirlyKit::Point3f GeneralCoordSystemDisplayAdapter::displayToLocal(WhirlyKit::Point3f dispPt)
 {
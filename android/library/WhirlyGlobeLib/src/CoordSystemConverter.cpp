@@ -0,0 +1,365 @@
+/*
+ *  CoordSystemConverter.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <pthread.h>
+#import <atomic>
+#import <map>
+#import <vector>
+#import <algorithm>
+#import "WhirlyKitLog.h"
+#import "CoordSystemConverter.h"
+#import "GlobeMath.h"
+#import "FlatMath.h"
+#import "SphericalMercator.h"
+#import "Proj4CoordSystem.h"
+#import "proj_api.h"
+
+namespace WhirlyKit
+{
+
+CoordSystemConverter::~CoordSystemConverter()
+{
+}
+
+void CoordSystemConverter::convert(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    for (size_t ii=0;ii<numPts;ii++)
+        outPts[ii] = convert(inPts[ii]);
+}
+
+// Keep things right below/above the poles.  Same as SphericalMercator.
+static const double MercatorPoleLimit = DegToRad(85.05113);
+
+/** Converts by way of lon/lat (radians) plus height.
+    The geographic, Plate Carree, Spherical Mercator and Proj.4 systems all know
+    how to get there without the geocentric step.
+  */
+class GeographicHopConverter : public CoordSystemConverter
+{
+public:
+    /// How one side gets to or from lon/lat
+    typedef enum {StepIdentity,StepMercator,StepProj4} StepType;
+
+    typedef struct
+    {
+        StepType type;
+        double originLon;
+        projPJ pj,pjLatLon;
+    } Step;
+
+    GeographicHopConverter(const Step &inStep,const Step &outStep) : inStep(inStep), outStep(outStep) { }
+
+    Point3d convert(const Point3d &inPt)
+    {
+        Point3d pt = inPt;
+        convert(&pt,&pt,1);
+        return pt;
+    }
+
+    void convert(const Point3d *inPts,Point3d *outPts,size_t numPts)
+    {
+        if (numPts == 0)
+            return;
+        if (inPts != outPts)
+            std::copy(inPts,inPts+numPts,outPts);
+
+        toGeographic(inStep,outPts,numPts);
+        fromGeographic(outStep,outPts,numPts);
+    }
+
+    /// Work out the step for a given coordinate system, if we can
+    static bool StepForSystem(CoordSystem *coordSys,Step &step)
+    {
+        step.type = StepIdentity;
+        step.originLon = 0.0;
+        step.pj = step.pjLatLon = NULL;
+
+        if (dynamic_cast<GeoCoordSystem *>(coordSys) || dynamic_cast<PlateCarreeCoordSystem *>(coordSys))
+            return true;
+        if (SphericalMercatorCoordSystem *merc = dynamic_cast<SphericalMercatorCoordSystem *>(coordSys))
+        {
+            step.type = StepMercator;
+            step.originLon = merc->getOriginLon();
+            return true;
+        }
+        if (Proj4CoordSystem *proj4 = dynamic_cast<Proj4CoordSystem *>(coordSys))
+        {
+            if (!proj4->isValid())
+                return false;
+            step.type = StepProj4;
+            step.pj = proj4->getProj();
+            step.pjLatLon = proj4->getProjLatLon();
+            return true;
+        }
+
+        return false;
+    }
+
+protected:
+    static void toGeographic(const Step &step,Point3d *pts,size_t numPts)
+    {
+        switch (step.type)
+        {
+            case StepIdentity:
+                break;
+            case StepMercator:
+                for (size_t ii=0;ii<numPts;ii++)
+                {
+                    Point3d &pt = pts[ii];
+                    pt.x() = pt.x() + step.originLon;
+                    pt.y() = atan(sinh(pt.y()));
+                }
+                break;
+            case StepProj4:
+            {
+                double *coords = pts[0].data();
+                if (pj_transform(step.pj, step.pjLatLon, numPts, 3, &coords[0], &coords[1], &coords[2]))
+                    WHIRLYKIT_LOGV("GeographicHopConverter: error converting to geographic");
+            }
+                break;
+        }
+    }
+
+    static void fromGeographic(const Step &step,Point3d *pts,size_t numPts)
+    {
+        switch (step.type)
+        {
+            case StepIdentity:
+                break;
+            case StepMercator:
+                for (size_t ii=0;ii<numPts;ii++)
+                {
+                    Point3d &pt = pts[ii];
+                    double lat = std::min(std::max(pt.y(),-MercatorPoleLimit),MercatorPoleLimit);
+                    pt.x() = pt.x() - step.originLon;
+                    pt.y() = log((1.0+sin(lat))/cos(lat));
+                }
+                break;
+            case StepProj4:
+            {
+                double *coords = pts[0].data();
+                if (pj_transform(step.pjLatLon, step.pj, numPts, 3, &coords[0], &coords[1], &coords[2]))
+                    WHIRLYKIT_LOGV("GeographicHopConverter: error converting from geographic");
+            }
+                break;
+        }
+    }
+
+    Step inStep,outStep;
+};
+
+/// Proj.4 to Proj.4 is a single pj_transform between the two projections
+class Proj4PairConverter : public CoordSystemConverter
+{
+public:
+    Proj4PairConverter(projPJ pjIn,projPJ pjOut) : pjIn(pjIn), pjOut(pjOut) { }
+
+    Point3d convert(const Point3d &inPt)
+    {
+        Point3d pt = inPt;
+        convert(&pt,&pt,1);
+        return pt;
+    }
+
+    void convert(const Point3d *inPts,Point3d *outPts,size_t numPts)
+    {
+        if (numPts == 0)
+            return;
+        if (inPts != outPts)
+            std::copy(inPts,inPts+numPts,outPts);
+
+        double *coords = outPts[0].data();
+        if (pj_transform(pjIn, pjOut, numPts, 3, &coords[0], &coords[1], &coords[2]))
+            WHIRLYKIT_LOGV("Proj4PairConverter: error converting");
+    }
+
+protected:
+    projPJ pjIn,pjOut;
+};
+
+// Handles the coordinate systems we know about in the toolkit
+static CoordSystemConverterRef BuiltInConverterFactory(CoordSystem *inSystem,CoordSystem *outSystem)
+{
+    Proj4CoordSystem *inProj4 = dynamic_cast<Proj4CoordSystem *>(inSystem);
+    Proj4CoordSystem *outProj4 = dynamic_cast<Proj4CoordSystem *>(outSystem);
+    if (inProj4 && outProj4)
+    {
+        if (!inProj4->isValid() || !outProj4->isValid())
+            return CoordSystemConverterRef();
+        return CoordSystemConverterRef(new Proj4PairConverter(inProj4->getProj(),outProj4->getProj()));
+    }
+
+    GeographicHopConverter::Step inStep,outStep;
+    if (GeographicHopConverter::StepForSystem(inSystem,inStep) &&
+        GeographicHopConverter::StepForSystem(outSystem,outStep))
+        return CoordSystemConverterRef(new GeographicHopConverter(inStep,outStep));
+
+    return CoordSystemConverterRef();
+}
+
+typedef std::pair<CoordSystem *,CoordSystem *> CoordSystemPair;
+typedef std::map<CoordSystemPair,CoordSystemConverterRef> ConverterCache;
+
+// Note: These are never deleted so coordinate systems can be torn down during static destruction
+static pthread_mutex_t converterLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<CoordSystemConverterFactory> *converterFactories = NULL;
+static ConverterCache *converterCache = NULL;
+// Bumped whenever the cache is cleared or trimmed, so the per-thread caches start over
+static std::atomic<unsigned int> converterGeneration(0);
+
+// Call with the lock held
+static void SetupConverterRegistry()
+{
+    if (!converterFactories)
+    {
+        converterFactories = new std::vector<CoordSystemConverterFactory>();
+        converterFactories->push_back(BuiltInConverterFactory);
+        converterCache = new ConverterCache();
+    }
+}
+
+void CoordSystemAddConverterFactory(CoordSystemConverterFactory factory)
+{
+    pthread_mutex_lock(&converterLock);
+    SetupConverterRegistry();
+    converterFactories->insert(converterFactories->begin(),factory);
+    // Misses may now be hits
+    converterCache->clear();
+    converterGeneration++;
+    pthread_mutex_unlock(&converterLock);
+}
+
+CoordSystemConverterRef CoordSystemFindConverter(CoordSystem *inSystem,CoordSystem *outSystem)
+{
+    CoordSystemConverterRef converter;
+    if (!inSystem || !outSystem)
+        return converter;
+
+    pthread_mutex_lock(&converterLock);
+    SetupConverterRegistry();
+    CoordSystemPair key(inSystem,outSystem);
+    auto it = converterCache->find(key);
+    if (it != converterCache->end())
+        converter = it->second;
+    else {
+        for (auto factory : *converterFactories)
+        {
+            converter = (*factory)(inSystem,outSystem);
+            if (converter)
+                break;
+        }
+        // Cache misses too, so we only ask the factories once per pair
+        (*converterCache)[key] = converter;
+    }
+    pthread_mutex_unlock(&converterLock);
+
+    return converter;
+}
+
+// The last few pairs a thread looked up, hits and misses both
+class ThreadConverterCache
+{
+public:
+    static const int NumEntries = 4;
+
+    ThreadConverterCache() : generation(converterGeneration), next(0)
+    {
+        for (int ii=0;ii<NumEntries;ii++)
+            inSystems[ii] = outSystems[ii] = NULL;
+    }
+
+    unsigned int generation;
+    // Entry we'll replace next
+    int next;
+    CoordSystem *inSystems[NumEntries],*outSystems[NumEntries];
+    CoordSystemConverterRef converters[NumEntries];
+};
+
+static pthread_key_t threadConverterKey;
+static pthread_once_t threadConverterOnce = PTHREAD_ONCE_INIT;
+
+static void DeleteThreadConverterCache(void *cache)
+{
+    delete (ThreadConverterCache *)cache;
+}
+
+static void MakeThreadConverterKey()
+{
+    pthread_key_create(&threadConverterKey, DeleteThreadConverterCache);
+}
+
+CoordSystemConverter *CoordSystemFindConverterFast(CoordSystem *inSystem,CoordSystem *outSystem)
+{
+    if (!inSystem || !outSystem)
+        return NULL;
+
+    pthread_once(&threadConverterOnce, MakeThreadConverterKey);
+    ThreadConverterCache *cache = (ThreadConverterCache *)pthread_getspecific(threadConverterKey);
+    if (!cache)
+    {
+        cache = new ThreadConverterCache();
+        pthread_setspecific(threadConverterKey, cache);
+    }
+
+    // Something was cleared or a coordinate system went away, so none of these can be trusted.
+    // Read the generation before the lookup so a change during the lookup gets noticed next time.
+    unsigned int generation = converterGeneration;
+    if (generation != cache->generation)
+    {
+        for (int ii=0;ii<ThreadConverterCache::NumEntries;ii++)
+        {
+            cache->inSystems[ii] = cache->outSystems[ii] = NULL;
+            cache->converters[ii].reset();
+        }
+        cache->generation = generation;
+    }
+
+    for (int ii=0;ii<ThreadConverterCache::NumEntries;ii++)
+        if (cache->inSystems[ii] == inSystem && cache->outSystems[ii] == outSystem)
+            return cache->converters[ii].get();
+
+    int which = cache->next;
+    cache->next = (cache->next + 1) % ThreadConverterCache::NumEntries;
+    cache->inSystems[which] = inSystem;
+    cache->outSystems[which] = outSystem;
+    cache->converters[which] = CoordSystemFindConverter(inSystem,outSystem);
+
+    return cache->converters[which].get();
+}
+
+void CoordSystemForgetConverters(CoordSystem *coordSys)
+{
+    pthread_mutex_lock(&converterLock);
+    if (converterCache)
+    {
+        for (auto it = converterCache->begin(); it != converterCache->end();)
+        {
+            if (it->first.first == coordSys || it->first.second == coordSys)
+                it = converterCache->erase(it);
+            else
+                ++it;
+        }
+    }
+    // The address may come back as a different system
+    converterGeneration++;
+    pthread_mutex_unlock(&converterLock);
+}
+
+}
@@ -19,43 +19,155 @@
  */
 
 #import <sstream>
+#import <deque>
+#import <unordered_map>
+#import <algorithm>
+#import <pthread.h>
 #import "Dictionary.h"
 
 namespace WhirlyKit
 {
+
+// Interned keys.  These are shared by all dictionaries and never deleted.
+// A deque keeps the names in place as it grows, so we can hand out references.
+static pthread_rwlock_t keyLock = PTHREAD_RWLOCK_INITIALIZER;
+static std::unordered_map<std::string,unsigned int> *keyIDs = NULL;
+static std::deque<std::string> *keyNames = NULL;
+
+Dictionary::KeyID Dictionary::internKey(const std::string &name)
+{
+    KeyID key;
+    if (findKey(name,key))
+        return key;
+    
+    pthread_rwlock_wrlock(&keyLock);
+    if (!keyIDs)
+    {
+        keyIDs = new std::unordered_map<std::string,unsigned int>();
+        keyNames = new std::deque<std::string>();
+    }
+    // Someone may have beaten us to it
+    auto it = keyIDs->find(name);
+    if (it != keyIDs->end())
+        key = it->second;
+    else {
+        key = (KeyID)keyNames->size();
+        keyNames->push_back(name);
+        (*keyIDs)[name] = key;
+    }
+    pthread_rwlock_unlock(&keyLock);
     
-int Dictionary::StringValue::asInt()
+    return key;
+}
+
+// Each thread's copy of the keys it's looked up, one per slot picked by the name's hash.
+// IDs never change, so these never go stale.  A name that lands on a busy slot just replaces what's there.
+class ThreadKeyCache
 {
-    std::stringstream convert(val);
-    int res;
-    if (!(convert >> res))
-        res = 0;
+public:
+    static const unsigned int NumSlots = 64;
     
-    return res;
+    ThreadKeyCache()
+    {
+        for (unsigned int ii=0;ii<NumSlots;ii++)
+            valid[ii] = false;
+    }
+    
+    std::string names[NumSlots];
+    unsigned int ids[NumSlots];
+    bool valid[NumSlots];
+};
+static pthread_key_t threadKeyCacheKey;
+static pthread_once_t threadKeyCacheOnce = PTHREAD_ONCE_INIT;
+
+static void DeleteThreadKeyCache(void *cache)
+{
+    delete (ThreadKeyCache *)cache;
 }
 
-double Dictionary::StringValue::asDouble()
+static void MakeThreadKeyCacheKey()
 {
-    std::stringstream convert(val);
-    double res;
-    if (!(convert >> res))
-        res = 0;
+    pthread_key_create(&threadKeyCacheKey, DeleteThreadKeyCache);
+}
+
+static ThreadKeyCache *GetThreadKeyCache()
+{
+    pthread_once(&threadKeyCacheOnce, MakeThreadKeyCacheKey);
+    ThreadKeyCache *cache = (ThreadKeyCache *)pthread_getspecific(threadKeyCacheKey);
+    if (!cache)
+    {
+        cache = new ThreadKeyCache();
+        pthread_setspecific(threadKeyCacheKey, cache);
+    }
     
-    return res;
+    return cache;
 }
+
+bool Dictionary::findKey(const std::string &name,KeyID &key)
+{
+    ThreadKeyCache *cache = GetThreadKeyCache();
+    unsigned int slot = std::hash<std::string>()(name) % ThreadKeyCache::NumSlots;
+    if (cache->valid[slot] && cache->names[slot] == name)
+    {
+        key = cache->ids[slot];
+        return true;
+    }
     
-void Dictionary::IntValue::asString(std::string &retStr)
+    bool found = false;
+    pthread_rwlock_rdlock(&keyLock);
+    if (keyIDs)
+    {
+        auto it = keyIDs->find(name);
+        if (it != keyIDs->end())
+        {
+            key = it->second;
+            found = true;
+        }
+    }
+    pthread_rwlock_unlock(&keyLock);
+    
+    // Misses aren't cached since someone may add the key later
+    if (found)
+    {
+        cache->names[slot] = name;
+        cache->ids[slot] = key;
+        cache->valid[slot] = true;
+    }
+    
+    return found;
+}
+
+const std::string &Dictionary::keyName(KeyID key)
 {
-    std::ostringstream stream;
-    stream << val;
-    retStr = stream.str();
+    pthread_rwlock_rdlock(&keyLock);
+    const std::string &name = (*keyNames)[key];
+    pthread_rwlock_unlock(&keyLock);
+    
+    return name;
 }
+
+Dictionary::Key Dictionary::lookupKey(const std::string &name)
+{
+    Key key;
+    KeyID keyID;
+    if (findKey(name,keyID))
+        key.id = keyID;
     
-void Dictionary::DoubleValue::asString(std::string &retStr)
+    return key;
+}
+
+Dictionary::Key::Key(const std::string &name)
+    : id(internKey(name))
+{
+}
+
+const std::string &Dictionary::Key::getName() const
 {
-    std::ostringstream stream;
-    stream << val;
-    retStr = stream.str();
+    static const std::string emptyName;
+    if (!isValid())
+        return emptyName;
+    
+    return keyName(id);
 }
     
 Dictionary::Dictionary()
@@ -64,30 +176,33 @@ Dictionary::Dictionary()
     
 Dictionary::Dictionary(const Dictionary &that)
 {
-    for (FieldMap::const_iterator it = that.fields.begin();it != that.fields.end();++it)
-        fields[it->first] = it->second->copy();
+    shareContents(that.contents);
 }
     
 Dictionary::~Dictionary()
 {
-    clear();
 }
 
 void Dictionary::clear()
 {
-    for (FieldMap::iterator it = fields.begin();it != fields.end();++it)
-        delete it->second;
-    fields.clear();
+    contents.reset();
 }
     
 Dictionary &Dictionary::operator = (const Dictionary &that)
 {
-    clear();
-    for (FieldMap::const_iterator it = that.fields.begin();it != that.fields.end();++it)
-        fields[it->first] = it->second->copy();
+    if (this != &that)
+        shareContents(that.contents);
     
     return *this;
 }
+
+void Dictionary::shareContents(const ContentsRef &that)
+{
+    // Marked before we hold on to them, so neither side changes them in place from here on
+    if (that && !that->shared.load(std::memory_order_relaxed))
+        that->shared.store(true,std::memory_order_relaxed);
+    contents = that;
+}
     
 Dictionary::Dictionary(RawData *rawData)
 {
@@ -134,27 +249,25 @@ Dictionary::Dictionary(RawData *rawData)
     
 void Dictionary::asRawData(MutableRawData *rawData)
 {
-    for (FieldMap::iterator it = fields.begin(); it != fields.end(); ++it)
+    if (!contents)
+        return;
+    
+    for (const Field &field : contents->fields)
     {
-        Value *val = it->second;
-        if (val->type() == DictTypeObject)
+        if (field.type == DictTypeObject)
             continue;
-        rawData->addInt(val->type());
-        rawData->addString(it->first);
-        switch (val->type())
+        rawData->addInt(field.type);
+        rawData->addString(keyName(field.key));
+        switch (field.type)
         {
             case DictTypeString:
-            {
-                std::string str;
-                val->asString(str);
-                rawData->addString(str);
-            }
+                rawData->addString(contents->strings[field.index]);
                 break;
             case DictTypeInt:
-                rawData->addInt(val->asInt());
+                rawData->addInt(field.intVal);
                 break;
             case DictTypeDouble:
-                rawData->addDouble(val->asDouble());
+                rawData->addDouble(field.doubleVal);
                 break;
             default:
                 throw 1;
@@ -162,67 +275,213 @@ void Dictionary::asRawData(MutableRawData *rawData)
         }
     }
 }
+
+const Dictionary::Field *Dictionary::findField(const Key &key) const
+{
+    if (!contents || !key.isValid())
+        return NULL;
+    
+    auto it = std::lower_bound(contents->fields.begin(),contents->fields.end(),key.id,
+                               [](const Field &field,KeyID key) { return field.key < key; });
+    if (it == contents->fields.end() || it->key != key.id)
+        return NULL;
+    
+    return &(*it);
+}
+
+Dictionary::Contents *Dictionary::mutableContents()
+{
+    // use_count() can't tell us this safely across threads, so we go by the flag
+    if (!contents)
+        contents = ContentsRef(new Contents());
+    else if (contents->shared.load(std::memory_order_relaxed))
+        contents = ContentsRef(new Contents(*contents));
+    
+    return contents.get();
+}
+
+void Dictionary::removeFieldAt(size_t which)
+{
+    Contents *theContents = mutableContents();
+    Field &field = theContents->fields[which];
+    
+    // Strings and objects are stored on the side, so close up the gap
+    if (field.type == DictTypeString || field.type == DictTypeObject)
+    {
+        unsigned int index = field.index;
+        DictionaryType type = field.type;
+        if (type == DictTypeString)
+            theContents->strings.erase(theContents->strings.begin()+index);
+        else
+            theContents->objects.erase(theContents->objects.begin()+index);
+        for (Field &other : theContents->fields)
+            if (other.type == type && other.index > index)
+                other.index--;
+    }
+    
+    theContents->fields.erase(theContents->fields.begin()+which);
+}
+
+Dictionary::Field *Dictionary::setField(KeyID key,DictionaryType type)
+{
+    Contents *theContents = mutableContents();
+    auto it = std::lower_bound(theContents->fields.begin(),theContents->fields.end(),key,
+                               [](const Field &field,KeyID key) { return field.key < key; });
+    if (it != theContents->fields.end() && it->key == key)
+    {
+        // Strings and objects can reuse their slot on the side
+        if (it->type == type)
+            return &(*it);
+        size_t which = it - theContents->fields.begin();
+        removeFieldAt(which);
+        it = theContents->fields.begin() + which;
+    }
+    
+    Field newField;
+    newField.key = key;
+    newField.type = type;
+    newField.doubleVal = 0.0;
+    switch (type)
+    {
+        case DictTypeString:
+            newField.index = (unsigned int)theContents->strings.size();
+            theContents->strings.resize(theContents->strings.size()+1);
+            break;
+        case DictTypeObject:
+            newField.index = (unsigned int)theContents->objects.size();
+            theContents->objects.resize(theContents->objects.size()+1);
+            break;
+        default:
+            break;
+    }
+    it = theContents->fields.insert(it,newField);
+    
+    return &(*it);
+}
+
+int Dictionary::fieldAsInt(const Field &field) const
+{
+    switch (field.type)
+    {
+        case DictTypeString:
+        {
+            std::stringstream convert(contents->strings[field.index]);
+            int res;
+            if (!(convert >> res))
+                res = 0;
+            return res;
+        }
+        case DictTypeInt:
+            return field.intVal;
+        case DictTypeDouble:
+            return (int)field.doubleVal;
+        default:
+            return 0;
+    }
+}
+
+double Dictionary::fieldAsDouble(const Field &field) const
+{
+    switch (field.type)
+    {
+        case DictTypeString:
+        {
+            std::stringstream convert(contents->strings[field.index]);
+            double res;
+            if (!(convert >> res))
+                res = 0;
+            return res;
+        }
+        case DictTypeInt:
+            return (double)field.intVal;
+        case DictTypeDouble:
+            return field.doubleVal;
+        default:
+            return 0.0;
+    }
+}
+
+void Dictionary::fieldAsString(const Field &field,std::string &retStr) const
+{
+    switch (field.type)
+    {
+        case DictTypeString:
+            retStr = contents->strings[field.index];
+            break;
+        case DictTypeInt:
+        {
+            std::ostringstream stream;
+            stream << field.intVal;
+            retStr = stream.str();
+        }
+            break;
+        case DictTypeDouble:
+        {
+            std::ostringstream stream;
+            stream << field.doubleVal;
+            retStr = stream.str();
+        }
+            break;
+        default:
+            break;
+    }
+}
     
 int Dictionary::numFields() const
 {
-    return (int)fields.size();
+    return contents ? (int)contents->fields.size() : 0;
 }
     
-bool Dictionary::hasField(const std::string &name) const
+bool Dictionary::hasField(const Key &key) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-        return (it != fields.end());
+    return findField(key) != NULL;
 }
     
-DictionaryType Dictionary::getType(const std::string &name) const
+DictionaryType Dictionary::getType(const Key &key) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return DictTypeNone;
     
-    return it->second->type();
+    return field->type;
 }
     
-void Dictionary::removeField(const std::string &name)
+void Dictionary::removeField(const Key &key)
 {
-    FieldMap::iterator it = fields.find(name);
-    if (it != fields.end())
-    {
-        delete it->second;
-        fields.erase(it);
-    }
+    const Field *field = findField(key);
+    if (field)
+        removeFieldAt(field - &contents->fields[0]);
 }
     
-int Dictionary::getInt(const std::string &name,int defVal) const
+int Dictionary::getInt(const Key &key,int defVal) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return defVal;
     
-    return it->second->asInt();
+    return fieldAsInt(*field);
 }
     
-bool Dictionary::getBool(const std::string &name,bool defVal) const
+bool Dictionary::getBool(const Key &key,bool defVal) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return defVal;
     
-    return (bool)it->second->asInt();
+    return (bool)fieldAsInt(*field);
 }
 
-RGBAColor Dictionary::getColor(const std::string &name,const RGBAColor &defVal) const
+RGBAColor Dictionary::getColor(const Key &key,const RGBAColor &defVal) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return defVal;
 
-    switch (it->second->type())
+    switch (field->type)
     {
         case DictTypeString:
         {
-            std::string str;
-            it->second->asString(str);
+            const std::string &str = contents->strings[field->index];
             // We're looking for a #RRGGBBAA
             if (str.length() < 1 || str[0] != '#')
                 return defVal;
@@ -238,7 +497,7 @@ RGBAColor Dictionary::getColor(const std::string &name,const RGBAColor &defVal)
             break;
         case DictTypeInt:
         {
-            int iVal = it->second->asInt();
+            int iVal = field->intVal;
             RGBAColor ret;
             ret.b = iVal & 0xFF;
             ret.g = (iVal >> 8) & 0xFF;
@@ -257,100 +516,203 @@ RGBAColor Dictionary::getColor(const std::string &name,const RGBAColor &defVal)
     return defVal;
 }
     
-double Dictionary::getDouble(const std::string &name,double defVal) const
+double Dictionary::getDouble(const Key &key,double defVal) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return defVal;
     
-    return it->second->asDouble();
+    return fieldAsDouble(*field);
 }
     
-std::string Dictionary::getString(const std::string &name) const
+std::string Dictionary::getString(const Key &key) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return "";
     
     std::string retStr;
-    it->second->asString(retStr);
+    fieldAsString(*field,retStr);
     return retStr;
 }
 
-std::string Dictionary::getString(const std::string &name,const std::string &defVal) const
+std::string Dictionary::getString(const Key &key,const std::string &defVal) const
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field)
         return defVal;
     
     std::string retStr;
-    it->second->asString(retStr);
+    fieldAsString(*field,retStr);
     return retStr;
 }
     
-DelayedDeletableRef Dictionary::getObject(const std::string &name)
+DelayedDeletableRef Dictionary::getObject(const Key &key)
 {
-    FieldMap::const_iterator it = fields.find(name);
-    if (it == fields.end())
+    const Field *field = findField(key);
+    if (!field || field->type != DictTypeObject)
         return DelayedDeletableRef();
     
-    return DelayedDeletableRef(it->second->asObject());
+    return contents->objects[field->index];
 }
 
-void Dictionary::setInt(const std::string &name,int val)
+void Dictionary::setInt(const Key &key,int val)
+{
+    if (!key.isValid())
+        return;
+    Field *field = setField(key.id,DictTypeInt);
+    field->intVal = val;
+}
+
+void Dictionary::setDouble(const Key &key,double val)
 {
-    removeField(name);
+    if (!key.isValid())
+        return;
+    Field *field = setField(key.id,DictTypeDouble);
+    field->doubleVal = val;
+}
+
+void Dictionary::setString(const Key &key,const std::string &val)
+{
+    if (!key.isValid())
+        return;
+    Field *field = setField(key.id,DictTypeString);
+    contents->strings[field->index] = val;
+}
     
-    IntValue *iVal = new IntValue();
-    iVal->val = val;
-    fields[name] = iVal;
+void Dictionary::setObject(const Key &key, DelayedDeletableRef obj)
+{
+    if (!key.isValid())
+        return;
+    Field *field = setField(key.id,DictTypeObject);
+    contents->objects[field->index] = obj;
+}
+    
+bool Dictionary::hasField(const std::string &name) const
+{
+    return hasField(lookupKey(name));
+}
+
+DictionaryType Dictionary::getType(const std::string &name) const
+{
+    return getType(lookupKey(name));
+}
+
+void Dictionary::removeField(const std::string &name)
+{
+    removeField(lookupKey(name));
+}
+
+int Dictionary::getInt(const std::string &name,int defVal) const
+{
+    return getInt(lookupKey(name),defVal);
+}
+
+bool Dictionary::getBool(const std::string &name,bool defVal) const
+{
+    return getBool(lookupKey(name),defVal);
+}
+
+RGBAColor Dictionary::getColor(const std::string &name,const RGBAColor &defVal) const
+{
+    return getColor(lookupKey(name),defVal);
+}
+
+double Dictionary::getDouble(const std::string &name,double defVal) const
+{
+    return getDouble(lookupKey(name),defVal);
+}
+
+std::string Dictionary::getString(const std::string &name) const
+{
+    return getString(lookupKey(name));
+}
+
+std::string Dictionary::getString(const std::string &name,const std::string &defVal) const
+{
+    return getString(lookupKey(name),defVal);
+}
+
+DelayedDeletableRef Dictionary::getObject(const std::string &name)
+{
+    return getObject(lookupKey(name));
+}
+
+void Dictionary::setInt(const std::string &name,int val)
+{
+    setInt(Key(name),val);
 }
 
 void Dictionary::setDouble(const std::string &name,double val)
 {
-    removeField(name);
-    
-    DoubleValue *dVal = new DoubleValue();
-    dVal->val = val;
-    fields[name] = dVal;
+    setDouble(Key(name),val);
 }
 
 void Dictionary::setString(const std::string &name,const std::string &val)
 {
-    removeField(name);
-    
-    StringValue *sVal = new StringValue();
-    sVal->val = val;
-    fields[name] = sVal;
+    setString(Key(name),val);
 }
-    
-void Dictionary::setObject(const std::string &name, DelayedDeletableRef obj)
+
+void Dictionary::setObject(const std::string &name,DelayedDeletableRef obj)
 {
-    removeField(name);
-    
-    ObjectValue *oVal = new ObjectValue();
-    oVal->val = obj;
-    fields[name] = oVal;
+    setObject(Key(name),obj);
 }
     
 std::string Dictionary::toString() const
 {
-    std::string str;
-    for (const auto it : fields)
+    if (!contents)
+        return "";
+    
+    // Sorted by name, rather than key ID, so the output is stable
+    std::vector<std::pair<std::string,std::string> > entries;
+    entries.reserve(contents->fields.size());
+    for (const Field &field : contents->fields)
     {
         std::string valStr;
-        it.second->asString(valStr);
-        str += it.first + ":" + valStr + "\n";
+        fieldAsString(field,valStr);
+        entries.push_back(std::make_pair(keyName(field.key),valStr));
     }
+    std::sort(entries.begin(),entries.end());
+    
+    std::string str;
+    for (const auto &entry : entries)
+        str += entry.first + ":" + entry.second + "\n";
     
     return str;
 }
 
 void Dictionary::addEntries(const Dictionary *other)
 {
-    for (FieldMap::const_iterator it = other->fields.begin();it != other->fields.end();++it)
-        fields[it->first] = it->second->copy();
-
+    if (!other || !other->contents || other->contents == contents)
+        return;
+    if (!contents)
+    {
+        shareContents(other->contents);
+        return;
+    }
+    
+    const Contents *otherContents = other->contents.get();
+    for (const Field &otherField : otherContents->fields)
+    {
+        Field *field = setField(otherField.key,otherField.type);
+        switch (otherField.type)
+        {
+            case DictTypeString:
+                contents->strings[field->index] = otherContents->strings[otherField.index];
+                break;
+            case DictTypeObject:
+                contents->objects[field->index] = otherContents->objects[otherField.index];
+                break;
+            case DictTypeInt:
+                field->intVal = otherField.intVal;
+                break;
+            case DictTypeDouble:
+                field->doubleVal = otherField.doubleVal;
+                break;
+            default:
+                break;
+        }
+    }
 }
     
 }
@@ -35,9 +35,25 @@ WhirlyKitGLSetupInfo::WhirlyKitGLSetupInfo()
     minZres = 0.0;
 }
 
+OpenGLMemStats::OpenGLMemStats()
+    : pooledBuffers(0), pooledBytes(0), liveBuffers(0), liveBytes(0), hits(0), misses(0), evictions(0)
+{
+}
+    
+double OpenGLMemStats::hitRate() const
+{
+    if (hits + misses == 0)
+        return 0.0;
+    
+    return (double)hits / (double)(hits + misses);
+}
+
 OpenGLMemManager::OpenGLMemManager()
+    : pooledBuffers(0), maxPooledBytes(WhirlyKitOpenGLMemPoolMaxBytes), liveBytes(0), hits(0), misses(0), evictions(0), trimRequest(-1)
 {
     pthread_mutex_init(&idLock,NULL);
+    for (unsigned int ii=0;ii<BufferPoolMax;ii++)
+        pooledBytes[ii] = 0;
 }
     
 OpenGLMemManager::~OpenGLMemManager()
@@ -45,79 +61,213 @@ OpenGLMemManager::~OpenGLMemManager()
     pthread_mutex_destroy(&idLock);
 }
     
+// Smallest size class that holds the given number of bytes, or -1 if it's too big for any of them
+static int SizeClassForBytes(unsigned int size)
+{
+    unsigned int classSize = 1<<WhirlyKitOpenGLMemMinClassShift;
+    for (int which=0;which<WhirlyKitOpenGLMemNumClasses;which++,classSize<<=1)
+        if (size <= classSize)
+            return which;
+    
+    return -1;
+}
+    
+static unsigned int BytesForSizeClass(int sizeClass)
+{
+    return 1u<<(sizeClass+WhirlyKitOpenGLMemMinClassShift);
+}
+    
 GLuint OpenGLMemManager::getBufferID(unsigned int size,GLenum drawType)
 {
+    BufferInfo info;
+    info.pool = (drawType == GL_STATIC_DRAW) ? BufferPoolStatic : BufferPoolDynamic;
+    info.sizeClass = (size == 0) ? -1 : SizeClassForBytes(size);
+    info.size = (info.sizeClass >= 0) ? BytesForSizeClass(info.sizeClass) : size;
+
     pthread_mutex_lock(&idLock);
     
-    if (buffIDs.empty())
+    // Reuse a free buffer of the right class, storage and all
+    GLuint which = 0;
+    bool needStorage = size != 0;
+    if (info.sizeClass >= 0)
     {
-        GLuint newAlloc[WhirlyKitOpenGLMemCacheAllocUnit];
-        glGenBuffers(WhirlyKitOpenGLMemCacheAllocUnit, newAlloc);
-        for (unsigned int ii=0;ii<WhirlyKitOpenGLMemCacheAllocUnit;ii++)
+        std::vector<GLuint> &freeList = freeBuffers[info.pool][info.sizeClass];
+        if (!freeList.empty())
         {
-            buffIDs.insert(newAlloc[ii]);
-    }
-    }
-    
-    GLuint which = 0;
-    if (!buffIDs.empty())
+            which = freeList.back();
+            freeList.pop_back();
+            pooledBytes[info.pool] -= info.size;
+            pooledBuffers--;
+            needStorage = false;
+            hits++;
+        } else
+            misses++;
+    } else if (size != 0)
+        misses++;
+
+    // Or a fresh name
+    if (!which)
     {
-        std::set<GLuint>::iterator it = buffIDs.begin();
-        which = *it;
-        buffIDs.erase(it);
+        if (spareBuffIDs.empty())
+        {
+            spareBuffIDs.resize(WhirlyKitOpenGLMemCacheAllocUnit);
+            glGenBuffers(WhirlyKitOpenGLMemCacheAllocUnit, &spareBuffIDs[0]);
+        }
+        which = spareBuffIDs.back();
+        spareBuffIDs.pop_back();
     }
+    
+    liveBuffers[which] = info;
+    liveBytes += info.size;
+
     pthread_mutex_unlock(&idLock);
 
-    if (size != 0)
+    if (needStorage)
     {
         glBindBuffer(GL_ARRAY_BUFFER, which);
-        CheckGLError("BasicDrawable::setupGL() glBindBuffer");
-        glBufferData(GL_ARRAY_BUFFER, size, NULL, drawType);
-        CheckGLError("BasicDrawable::setupGL() glBufferData");
+        CheckGLError("OpenGLMemManager::getBufferID() glBindBuffer");
+        glBufferData(GL_ARRAY_BUFFER, info.size, NULL, drawType);
+        CheckGLError("OpenGLMemManager::getBufferID() glBufferData");
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        CheckGLError("BasicDrawable::setupGL() glBindBuffer");
+        CheckGLError("OpenGLMemManager::getBufferID() glBindBuffer");
     }
     
     return which;
 }
 
-// If set, we'll reuse buffers rather than allocating new ones
-static const bool ReuseBuffers = false;
-
 void OpenGLMemManager::removeBufferID(GLuint bufID)
 {
-    bool doClear = false;
+    std::vector<GLuint> toRemove;
     
     pthread_mutex_lock(&idLock);
 
-    // Clear out the data to save memory (Note: not sure we need this)
-//    glBindBuffer(GL_ARRAY_BUFFER, bufID);
-//    glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-//    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    buffIDs.insert(bufID);
+    auto it = liveBuffers.find(bufID);
+    if (it == liveBuffers.end())
+    {
+        // Not one of ours
+        toRemove.push_back(bufID);
+    } else {
+        BufferInfo info = it->second;
+        liveBuffers.erase(it);
+        liveBytes -= info.size;
+        
+        // Only sized buffers that fit in the pool go back in
+        if (info.sizeClass < 0 || info.size > maxPooledBytes)
+        {
+            toRemove.push_back(bufID);
+        } else {
+            if (pooledBytes[info.pool] + info.size > maxPooledBytes)
+                trimPoolLocked(info.pool, maxPooledBytes - info.size, toRemove);
+            freeBuffers[info.pool][info.sizeClass].push_back(bufID);
+            pooledBytes[info.pool] += info.size;
+            pooledBuffers++;
+        }
+    }
     
-    if (!ReuseBuffers || buffIDs.size() > WhirlyKitOpenGLMemCacheMax)
-        doClear = true;
+    if (!toRemove.empty())
+        glDeleteBuffers((GLsizei)toRemove.size(), &toRemove[0]);
+
+    pthread_mutex_unlock(&idLock);
+}
+
+// Toss the biggest buffers first, oldest first within a class.
+// That gets the most memory back for the fewest deletes.
+void OpenGLMemManager::trimPoolLocked(BufferPoolType pool,size_t keepBytes,std::vector<GLuint> &toRemove)
+{
+    for (int sizeClass=WhirlyKitOpenGLMemNumClasses-1;sizeClass>=0 && pooledBytes[pool] > keepBytes;sizeClass--)
+    {
+        std::vector<GLuint> &freeList = freeBuffers[pool][sizeClass];
+        unsigned int classBytes = BytesForSizeClass(sizeClass);
+        unsigned int numToss = 0;
+        while (numToss < freeList.size() && pooledBytes[pool] > keepBytes)
+        {
+            toRemove.push_back(freeList[numToss]);
+            pooledBytes[pool] -= classBytes;
+            numToss++;
+        }
+        freeList.erase(freeList.begin(),freeList.begin()+numToss);
+        pooledBuffers -= numToss;
+        evictions += numToss;
+    }
+}
+
+void OpenGLMemManager::trimBuffers(size_t keepBytes)
+{
+    std::vector<GLuint> toRemove;
 
+    pthread_mutex_lock(&idLock);
+    
+    for (unsigned int pool=0;pool<BufferPoolMax;pool++)
+        trimPoolLocked((BufferPoolType)pool, keepBytes, toRemove);
+    if (!toRemove.empty())
+        glDeleteBuffers((GLsizei)toRemove.size(), &toRemove[0]);
+    
     pthread_mutex_unlock(&idLock);
+}
+
+void OpenGLMemManager::requestTrim(size_t keepBytes)
+{
+    trimRequest = (long long)keepBytes;
+}
+
+void OpenGLMemManager::processTrimRequest()
+{
+    if (trimRequest.load(std::memory_order_relaxed) < 0)
+        return;
     
-    if (doClear)
-        clearBufferIDs();
+    long long keepBytes = trimRequest.exchange(-1);
+    if (keepBytes >= 0)
+        trimBuffers((size_t)keepBytes);
+}
+    
+void OpenGLMemManager::setMaxPooledBytes(size_t maxBytes)
+{
+    std::vector<GLuint> toRemove;
+
+    pthread_mutex_lock(&idLock);
+    
+    maxPooledBytes = maxBytes;
+    for (unsigned int pool=0;pool<BufferPoolMax;pool++)
+        trimPoolLocked((BufferPoolType)pool, maxPooledBytes, toRemove);
+    if (!toRemove.empty())
+        glDeleteBuffers((GLsizei)toRemove.size(), &toRemove[0]);
+    
+    pthread_mutex_unlock(&idLock);
+}
+    
+OpenGLMemStats OpenGLMemManager::getStats()
+{
+    OpenGLMemStats stats;
+    
+    pthread_mutex_lock(&idLock);
+
+    stats.pooledBuffers = pooledBuffers;
+    for (unsigned int pool=0;pool<BufferPoolMax;pool++)
+        stats.pooledBytes += pooledBytes[pool];
+    stats.liveBuffers = (unsigned int)liveBuffers.size();
+    stats.liveBytes = liveBytes;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    
+    pthread_mutex_unlock(&idLock);
+    
+    return stats;
 }
 
 // Clear out any and all buffer IDs that we may have sitting around
 void OpenGLMemManager::clearBufferIDs()
 {
+    std::vector<GLuint> toRemove;
+
     pthread_mutex_lock(&idLock);
     
-    std::vector<GLuint> toRemove;
-    toRemove.reserve(buffIDs.size());
-    for (std::set<GLuint>::iterator it = buffIDs.begin();
-         it != buffIDs.end(); ++it)
-        toRemove.push_back(*it);
+    for (unsigned int pool=0;pool<BufferPoolMax;pool++)
+        trimPoolLocked((BufferPoolType)pool, 0, toRemove);
+    toRemove.insert(toRemove.end(),spareBuffIDs.begin(),spareBuffIDs.end());
+    spareBuffIDs.clear();
     if (!toRemove.empty())
         glDeleteBuffers((GLsizei)toRemove.size(), &toRemove[0]);
-    buffIDs.clear();
     
     pthread_mutex_unlock(&idLock);
 }
@@ -145,6 +295,9 @@ GLuint OpenGLMemManager::getTexID()
     
     return which;
 }
+
+// If set, we'll reuse textures rather than allocating new ones
+static const bool ReuseTextures = false;
     
 void OpenGLMemManager::removeTexID(GLuint texID)
 {
@@ -158,7 +311,7 @@ void OpenGLMemManager::removeTexID(GLuint texID)
 
     texIDs.insert(texID);
     
-    if (!ReuseBuffers || texIDs.size() > WhirlyKitOpenGLMemCacheMax)
+    if (!ReuseTextures || texIDs.size() > WhirlyKitOpenGLMemCacheMax)
         doClear = true;
 
     pthread_mutex_unlock(&idLock);
@@ -186,7 +339,10 @@ void OpenGLMemManager::clearTextureIDs()
 
 void OpenGLMemManager::dumpStats()
 {
-    WHIRLYKIT_LOGV("MemCache: %ld buffers",(long int)buffIDs.size());
+    OpenGLMemStats stats = getStats();
+    WHIRLYKIT_LOGV("MemCache: %d live buffers, %.2f MB",stats.liveBuffers,stats.liveBytes / (1024.0*1024.0));
+    WHIRLYKIT_LOGV("MemCache: %d pooled buffers, %.2f MB",stats.pooledBuffers,stats.pooledBytes / (1024.0*1024.0));
+    WHIRLYKIT_LOGV("MemCache: %.1f%% hit rate, %d evictions",100.0*stats.hitRate(),stats.evictions);
     WHIRLYKIT_LOGV("MemCache: %ld textures",(long int)texIDs.size());
 }
 		
@@ -205,7 +361,7 @@ ChangeRequest::~ChangeRequest()
 }
 		
 Drawable::Drawable(const std::string &name)
-    : name(name)
+    : name(name), sortKeyValid(false)
 {
 }
 	
@@ -213,6 +369,31 @@ Drawable::~Drawable()
 {
 }
 
+uint64_t Drawable::getSortKey() const
+{
+    if (!sortKeyValid)
+    {
+        sortKey = calcSortKey();
+        sortKeyValid = true;
+    }
+    
+    return sortKey;
+}
+
+uint64_t Drawable::calcSortKey() const
+{
+    // Bits 31-62 for the priority, 30 for the z buffer and 15 each for program and texture.
+    // That leaves bit 63 for DrawSortKeyAlphaBit.
+    int64_t priority = (int)getDrawPriority();
+    uint64_t key = ((uint64_t)(priority + 0x80000000LL) & 0xffffffff) << 31;
+    if (getRequestZBuffer())
+        key |= ((uint64_t)1) << 30;
+    key |= (getProgram() & 0x7fff) << 15;
+    key |= getSortTexId() & 0x7fff;
+    
+    return key;
+}
+
 void Drawable::runTweakers(RendererFrameInfo *frame)
 {
     for (DrawableTweakerRefSet::iterator it = tweakers.begin();
@@ -21,6 +21,7 @@
 #import "DynamicTextureAtlas.h"
 #import "GLUtils.h"
 #import "Scene.h"
+#import "WhirlyKitLog.h"
 
 using namespace Eigen;
 
@@ -33,7 +34,7 @@ DynamicTexture::Region::Region()
 }
  
 DynamicTexture::DynamicTexture(const std::string &name,int texSize,int cellSize,GLenum inFormat,bool clearTextures)
-    : TextureBase(name), texSize(texSize), cellSize(cellSize), numCell(0), numRegions(0), compressed(false), layoutGrid(NULL), clearTextures(clearTextures), interpType(GL_LINEAR)
+    : TextureBase(name), texSize(texSize), cellSize(cellSize), numCell(0), usedCells(0), numRegions(0), compressed(false), clearTextures(clearTextures), interpType(GL_LINEAR)
 {
     if (texSize <= 0 || cellSize <= 0)
         return;
@@ -103,21 +104,17 @@ DynamicTexture::DynamicTexture(const std::string &name,int texSize,int cellSize,
     }
     
     numCell = texSize/cellSize;
-    layoutGrid = new bool[numCell * numCell];
-    for (unsigned int ii=0;ii<numCell * numCell;ii++)
-        layoutGrid[ii] = false;
+    freeRegions.push_back(Region(0,0,numCell-1,numCell-1));
     
     pthread_mutex_init(&regionLock,NULL);
 }
     
 DynamicTexture::~DynamicTexture()
 {
-    if (!layoutGrid)
+    // Sorting version, which never set up the lock
+    if (numCell == 0)
         return;
     
-    delete [] layoutGrid;
-    layoutGrid = NULL;
-    
     pthread_mutex_destroy(&regionLock);
 }
 
@@ -248,14 +245,113 @@ void DynamicTexture::clearTextureData(int startX,int startY,int width,int height
 
 void DynamicTexture::setRegion(const Region &region, bool enable)
 {
-    int sx = std::max(region.sx,0), sy = std::max(region.sy,0);
-    int ex = std::min(region.ex,numCell-1), ey = std::min(region.ey,numCell-1);
+    Region clipRegion(std::max(region.sx,0),std::max(region.sy,0),
+                      std::min(region.ex,numCell-1),std::min(region.ey,numCell-1));
+    if (clipRegion.ex < clipRegion.sx || clipRegion.ey < clipRegion.sy)
+        return;
+    
+    if (enable)
+        claimRegion(clipRegion);
+    else
+        releaseRegion(clipRegion);
+}
+
+// Guillotine cut the used region out of a free one.
+// We cut along the axis that leaves the bigger leftover in one piece.
+static void SplitFreeRegion(const DynamicTexture::Region &freeRegion,const DynamicTexture::Region &used,std::vector<DynamicTexture::Region> &pieces)
+{
+    typedef DynamicTexture::Region Region;
+    Region cut(std::max(freeRegion.sx,used.sx),std::max(freeRegion.sy,used.sy),
+               std::min(freeRegion.ex,used.ex),std::min(freeRegion.ey,used.ey));
+    int leftX = cut.sx-freeRegion.sx, rightX = freeRegion.ex-cut.ex;
+    int bottomY = cut.sy-freeRegion.sy, topY = freeRegion.ey-cut.ey;
+    
+    if (leftX + rightX >= bottomY + topY)
+    {
+        // Full height strips to either side, short ones above and below
+        if (leftX > 0)
+            pieces.push_back(Region(freeRegion.sx,freeRegion.sy,cut.sx-1,freeRegion.ey));
+        if (rightX > 0)
+            pieces.push_back(Region(cut.ex+1,freeRegion.sy,freeRegion.ex,freeRegion.ey));
+        if (bottomY > 0)
+            pieces.push_back(Region(cut.sx,freeRegion.sy,cut.ex,cut.sy-1));
+        if (topY > 0)
+            pieces.push_back(Region(cut.sx,cut.ey+1,cut.ex,freeRegion.ey));
+    } else {
+        // Full width strips above and below, short ones to either side
+        if (bottomY > 0)
+            pieces.push_back(Region(freeRegion.sx,freeRegion.sy,freeRegion.ex,cut.sy-1));
+        if (topY > 0)
+            pieces.push_back(Region(freeRegion.sx,cut.ey+1,freeRegion.ex,freeRegion.ey));
+        if (leftX > 0)
+            pieces.push_back(Region(freeRegion.sx,cut.sy,cut.sx-1,cut.ey));
+        if (rightX > 0)
+            pieces.push_back(Region(cut.ex+1,cut.sy,freeRegion.ex,cut.ey));
+    }
+}
+
+void DynamicTexture::claimRegion(const Region &region)
+{
+    // Usually this is a region findRegion() handed out and it sits in the corner of one free rectangle.
+    // But callers can claim anything, so cut it out of every free rectangle it touches.
+    std::vector<Region> pieces;
+    for (unsigned int ii=0;ii<freeRegions.size();)
+    {
+        const Region freeRegion = freeRegions[ii];
+        if (!freeRegion.overlaps(region))
+        {
+            ii++;
+            continue;
+        }
+        Region cut(std::max(freeRegion.sx,region.sx),std::max(freeRegion.sy,region.sy),
+                   std::min(freeRegion.ex,region.ex),std::min(freeRegion.ey,region.ey));
+        usedCells += cut.area();
+        SplitFreeRegion(freeRegion,region,pieces);
+        freeRegions[ii] = freeRegions.back();
+        freeRegions.pop_back();
+    }
+    freeRegions.insert(freeRegions.end(),pieces.begin(),pieces.end());
+}
+
+void DynamicTexture::releaseRegion(const Region &region)
+{
+    // Anything already free doesn't get counted twice
+    claimRegion(region);
+    usedCells -= region.area();
     
-    for (unsigned int ix=sx;ix<=ex;ix++)
-        for (unsigned int iy=sy;iy<=ey;iy++)
+    // All done, so start over with one big free rectangle
+    if (usedCells == 0)
+    {
+        freeRegions.clear();
+        freeRegions.push_back(Region(0,0,numCell-1,numCell-1));
+        return;
+    }
+    
+    // Merge with any free neighbor we share a whole edge with, then try again with the bigger one
+    Region merged = region;
+    bool didMerge = true;
+    while (didMerge)
+    {
+        didMerge = false;
+        for (unsigned int ii=0;ii<freeRegions.size();ii++)
         {
-            layoutGrid[iy*numCell+ix] = enable;
+            const Region &freeRegion = freeRegions[ii];
+            bool sameColumn = freeRegion.sx == merged.sx && freeRegion.ex == merged.ex &&
+                        (freeRegion.ey+1 == merged.sy || merged.ey+1 == freeRegion.sy);
+            bool sameRow = freeRegion.sy == merged.sy && freeRegion.ey == merged.ey &&
+                        (freeRegion.ex+1 == merged.sx || merged.ex+1 == freeRegion.sx);
+            if (sameColumn || sameRow)
+            {
+                merged = Region(std::min(merged.sx,freeRegion.sx),std::min(merged.sy,freeRegion.sy),
+                                std::max(merged.ex,freeRegion.ex),std::max(merged.ey,freeRegion.ey));
+                freeRegions[ii] = freeRegions.back();
+                freeRegions.pop_back();
+                didMerge = true;
+                break;
+            }
         }
+    }
+    freeRegions.push_back(merged);
 }
     
 void DynamicTexture::clearRegion(const Region &clearRegion,ChangeSet &changes,bool mainThreadMerge,unsigned char *emptyData)
@@ -269,51 +365,46 @@ void DynamicTexture::clearRegion(const Region &clearRegion,ChangeSet &changes,bo
 
 void DynamicTexture::getReleasedRegions(std::vector<DynamicTexture::Region> &toClear)
 {
+    // Don't sit on the lock, as the main thread uses it
     pthread_mutex_lock(&regionLock);
-    toClear = releasedRegions;
+    toClear.swap(releasedRegions);
+    releasedRegions.clear();
     pthread_mutex_unlock(&regionLock);
+
+    for (const Region &region : toClear)
+        setRegion(region, false);
 }
     
 bool DynamicTexture::findRegion(int sizeX,int sizeY,Region &region)
 {
-    // First thing we need to do is clear any outstanding regions
-    // Don't sit on the lock, as the main thread uses it
-    std::vector<Region> toClear;
-    pthread_mutex_lock(&regionLock);
-    toClear = releasedRegions;
-    releasedRegions.clear();
-    pthread_mutex_unlock(&regionLock);
-    for (unsigned int ii=0;ii<toClear.size();ii++)
-        setRegion(toClear[ii], false);
-    
-    // Now look for a region that'll fit
-    // Look for a spot big enough
-    bool found = false;
-    int foundX=0,foundY=0;
-    for (int iy=0;iy<=numCell-sizeY && !found;iy++)
-        for (int ix=0;ix<=numCell-sizeX && !found;ix++)
+    // Best short side fit over the free rectangles
+    int bestIdx = -1;
+    int bestShort = 0,bestLong = 0;
+    for (unsigned int ii=0;ii<freeRegions.size();ii++)
+    {
+        const Region &freeRegion = freeRegions[ii];
+        int leftX = freeRegion.width() - sizeX, leftY = freeRegion.height() - sizeY;
+        if (leftX < 0 || leftY < 0)
+            continue;
+        int shortSide = std::min(leftX,leftY), longSide = std::max(leftX,leftY);
+        if (bestIdx < 0 || shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
         {
-            bool clear = true;
-            for (int testY=0;testY<sizeY && clear;testY++)
-                for (int testX=0;testX<sizeX && clear;testX++)
-                {
-                    if (layoutGrid[(testY+iy)*numCell+(testX+ix)])
-                        clear = false;
-                }
-            if (clear)
-            {
-                foundX = ix;
-                foundY = iy;
-                found = true;
-            }
+            bestIdx = ii;
+            bestShort = shortSide;
+            bestLong = longSide;
+            // Can't do better than an exact fit
+            if (longSide == 0)
+                break;
         }
+    }
     
-    if (!found)
+    if (bestIdx < 0)
         return false;
     
-    // Found one, so fill it in
-    region.sx = foundX;  region.sy = foundY;
-    region.ex = foundX+sizeX-1;  region.ey = foundY+sizeY-1;
+    // Tuck it into the corner of the free rectangle
+    const Region &freeRegion = freeRegions[bestIdx];
+    region.sx = freeRegion.sx;  region.sy = freeRegion.sy;
+    region.ex = freeRegion.sx+sizeX-1;  region.ey = freeRegion.sy+sizeY-1;
     
     return true;
 }
@@ -333,12 +424,19 @@ bool DynamicTexture::empty()
 void DynamicTexture::getUtilization(int &outNumCell,int &usedCell)
 {
     outNumCell = numCell*numCell;
-    usedCell = 0;
-    for (unsigned int ii=0;ii<numCell*numCell;ii++)
-    {
-        if (layoutGrid[ii])
-            usedCell++;
-    }
+    usedCell = usedCells;
+}
+
+void DynamicTexture::getUtilization(int &outNumCell,int &usedCell,float &fragmentation)
+{
+    getUtilization(outNumCell,usedCell);
+    
+    // How much of the free space is usable by the biggest request that could fit
+    int freeCells = outNumCell - usedCell;
+    int largestFree = 0;
+    for (const Region &freeRegion : freeRegions)
+        largestFree = std::max(largestFree,freeRegion.area());
+    fragmentation = freeCells > 0 ? 1.0 - largestFree / (float)freeCells : 0.0;
 }
     
 void DynamicTextureClearRegion::execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view)
@@ -655,18 +753,31 @@ void DynamicTextureAtlas::teardown(ChangeSet &changes)
     regions.clear();
 }
 
-void DynamicTextureAtlas::log()
+void DynamicTextureAtlas::getUtilization(int &numCells,int &usedCells,float &fragmentation)
 {
-    int numCells=0,usedCells=0;
+    numCells = 0;  usedCells = 0;
+    float weightedFrag = 0.0;
     for (DynamicTextureSet::iterator it = textures.begin();
          it != textures.end(); ++it)
     {
         DynamicTextureVec *texVec = *it;
         int thisNumCells,thisUsedCells;
-        texVec->at(0)->getUtilization(thisNumCells,thisUsedCells);
+        float thisFrag;
+        texVec->at(0)->getUtilization(thisNumCells,thisUsedCells,thisFrag);
         numCells += thisNumCells;
         usedCells += thisUsedCells;
+        weightedFrag += thisFrag * (thisNumCells - thisUsedCells);
     }
+    
+    int freeCells = numCells - usedCells;
+    fragmentation = freeCells > 0 ? weightedFrag / freeCells : 0.0;
+}
+
+void DynamicTextureAtlas::log()
+{
+    int numCells=0,usedCells=0;
+    float fragmentation = 0.0;
+    getUtilization(numCells,usedCells,fragmentation);
 
     int texelSize = 4;
     switch (format)
@@ -697,9 +808,9 @@ void DynamicTextureAtlas::log()
             
     }
     
-//    NSLog(@"DynamicTextureAtlas: %ld textures, (%.2f MB)",textures.size(),textures.size() * texSize*texSize*texelSize/(float)(1024*1024));
-//    if (numCells > 0)
-//        NSLog(@"DynamicTextureAtlas: using %.2f%% of the cells",100 * usedCells / (float)numCells);
+    WHIRLYKIT_LOGV("DynamicTextureAtlas: %ld textures, (%.2f MB)",(long int)textures.size(),textures.size() * texSize*texSize*texelSize/(float)(1024*1024));
+    if (numCells > 0)
+        WHIRLYKIT_LOGV("DynamicTextureAtlas: using %.2f%% of the cells, free space %.2f%% fragmented",100 * usedCells / (float)numCells,100 * fragmentation);
 }
 
 }
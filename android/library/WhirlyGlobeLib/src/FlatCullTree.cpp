@@ -0,0 +1,290 @@
+/*
+ *  FlatCullTree.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import "FlatCullTree.h"
+
+namespace WhirlyKit
+{
+
+// Mbr::overlaps() handles all sorts of cases we don't need to here
+static inline bool MbrsOverlap(const Mbr &a,const Mbr &b)
+{
+    return a.ll().x() <= b.ur().x() && b.ll().x() <= a.ur().x() &&
+           a.ll().y() <= b.ur().y() && b.ll().y() <= a.ur().y();
+}
+
+// True if a is entirely within b
+static inline bool MbrInside(const Mbr &a,const Mbr &b)
+{
+    return b.ll().x() <= a.ll().x() && a.ur().x() <= b.ur().x() &&
+           b.ll().y() <= a.ll().y() && a.ur().y() <= b.ur().y();
+}
+
+// Where a node sits relative to a set of view MBRs
+typedef enum {ViewOutside,ViewStraddles,ViewInside} ViewState;
+
+static inline bool MbrOverlapsAny(const Mbr &mbr,const std::vector<Mbr> &viewMbrs)
+{
+    for (const Mbr &viewMbr : viewMbrs)
+        if (MbrsOverlap(mbr,viewMbr))
+            return true;
+    return false;
+}
+
+static int CalcViewState(const Mbr &mbr,const std::vector<Mbr> &viewMbrs)
+{
+    int state = ViewOutside;
+    for (const Mbr &viewMbr : viewMbrs)
+    {
+        if (MbrInside(mbr,viewMbr))
+            return ViewInside;
+        if (MbrsOverlap(mbr,viewMbr))
+            state = ViewStraddles;
+    }
+    return state;
+}
+
+FlatCullTree::Node::Node(Node *parent,const Mbr &cellMbr,int level)
+    : parent(parent), cellMbr(cellMbr), level(level), numItems(0)
+{
+    Point2f half = (cellMbr.ur() - cellMbr.ll())/2.0;
+    looseMbr = Mbr(cellMbr.ll() - half,cellMbr.ur() + half);
+    for (unsigned int ii=0;ii<4;ii++)
+        children[ii] = NULL;
+}
+
+FlatCullTree::Node::~Node()
+{
+    for (unsigned int ii=0;ii<4;ii++)
+        if (children[ii])
+            delete children[ii];
+}
+
+FlatCullTree::FlatCullTree(const Mbr &mbr,int maxDepth)
+    : maxDepth(maxDepth), numNodes(1), searchId(0)
+{
+    // Cells are square, so the top one has to cover the longer side
+    Point2f mid = mbr.mid();
+    topSize = std::max(mbr.ur().x()-mbr.ll().x(),mbr.ur().y()-mbr.ll().y());
+    if (topSize <= 0.0)
+        topSize = 1.0;
+    Point2f half(topSize/2.0,topSize/2.0);
+    top = new Node(NULL,Mbr(mid-half,mid+half),0);
+}
+
+FlatCullTree::~FlatCullTree()
+{
+    delete top;
+}
+
+FlatCullTree::Node *FlatCullTree::findOrAddNode(const Point2f &center,int level)
+{
+    Node *node = top;
+    while (node->level < level)
+    {
+        Point2f mid = node->cellMbr.mid();
+        int which = (center.x() >= mid.x() ? 1 : 0) + (center.y() >= mid.y() ? 2 : 0);
+        if (!node->children[which])
+        {
+            Point2f ll(which & 1 ? mid.x() : node->cellMbr.ll().x(),which & 2 ? mid.y() : node->cellMbr.ll().y());
+            Point2f ur(which & 1 ? node->cellMbr.ur().x() : mid.x(),which & 2 ? node->cellMbr.ur().y() : mid.y());
+            node->children[which] = new Node(node,Mbr(ll,ur),node->level+1);
+            numNodes++;
+        }
+        node = node->children[which];
+    }
+
+    return node;
+}
+
+void FlatCullTree::addDrawable(DrawableRef draw)
+{
+    if (locations.find(draw->getId()) != locations.end())
+        return;
+
+    Item item;
+    item.draw = draw;
+    item.mbr = draw->getLocalMbr();
+    item.lastSearch = searchId;
+
+    Location loc;
+    // If it's got a matrix, that can be changed and we have no clue where it might end up
+    if (draw->getMatrix() || !item.mbr.valid())
+    {
+        loc.node = NULL;
+        loc.which = (unsigned int)unplaced.size();
+        unplaced.push_back(item);
+    } else {
+        // Pick the deepest level with cells at least as big as the drawable
+        float size = std::max(item.mbr.ur().x()-item.mbr.ll().x(),item.mbr.ur().y()-item.mbr.ll().y());
+        Point2f center = item.mbr.mid();
+        int level = 0;
+        if (top->cellMbr.inside(center))
+        {
+            float cellSize = topSize;
+            while (level < maxDepth && cellSize/2.0 >= size)
+            {
+                cellSize /= 2.0;
+                level++;
+            }
+        }
+
+        loc.node = findOrAddNode(center,level);
+        loc.which = (unsigned int)loc.node->items.size();
+        loc.node->items.push_back(item);
+        for (Node *node = loc.node;node;node = node->parent)
+            node->numItems++;
+    }
+
+    locations[draw->getId()] = loc;
+}
+
+void FlatCullTree::removeItem(std::vector<Item> &items,unsigned int which)
+{
+    // Move the last one in to the hole and tell it where it is now
+    if (which != items.size()-1)
+    {
+        items[which] = items.back();
+        locations[items[which].draw->getId()].which = which;
+    }
+    items.pop_back();
+}
+
+void FlatCullTree::remDrawable(DrawableRef draw)
+{
+    auto it = locations.find(draw->getId());
+    if (it == locations.end())
+        return;
+    Location loc = it->second;
+    locations.erase(it);
+
+    if (!loc.node)
+    {
+        removeItem(unplaced,loc.which);
+        return;
+    }
+
+    removeItem(loc.node->items,loc.which);
+    for (Node *node = loc.node;node;node = node->parent)
+        node->numItems--;
+
+    // Clear out any nodes that are now empty
+    Node *node = loc.node;
+    while (node != top && node->numItems == 0)
+    {
+        Node *parent = node->parent;
+        for (unsigned int ii=0;ii<4;ii++)
+            if (parent->children[ii] == node)
+                parent->children[ii] = NULL;
+        // Empty means the children are gone too
+        delete node;
+        numNodes--;
+        node = parent;
+    }
+}
+
+void FlatCullTree::findInNode(Node *node,const Mbr &viewMbr,bool allInside,std::vector<Drawable *> &found,int *drawablesConsidered)
+{
+    // The top node holds things that don't fit anywhere else, so we always look at it
+    if (!allInside && node != top)
+    {
+        if (!MbrsOverlap(node->looseMbr,viewMbr))
+            return;
+        // Everything here and below is in view, so we can stop checking
+        if (MbrInside(node->looseMbr,viewMbr))
+            allInside = true;
+    }
+
+    *drawablesConsidered += (int)node->items.size();
+    for (Item &item : node->items)
+    {
+        if (item.lastSearch == searchId)
+            continue;
+        if (allInside || MbrsOverlap(item.mbr,viewMbr))
+        {
+            item.lastSearch = searchId;
+            found.push_back(item.draw.get());
+        }
+    }
+
+    for (unsigned int ii=0;ii<4;ii++)
+        if (node->children[ii])
+            findInNode(node->children[ii],viewMbr,allInside,found,drawablesConsidered);
+}
+
+void FlatCullTree::findDrawables(const std::vector<Mbr> &viewMbrs,std::vector<Drawable *> &found,int *drawablesConsidered)
+{
+    searchId++;
+
+    *drawablesConsidered += (int)unplaced.size();
+    for (Item &item : unplaced)
+        found.push_back(item.draw.get());
+
+    for (const Mbr &viewMbr : viewMbrs)
+        findInNode(top,viewMbr,false,found,drawablesConsidered);
+}
+
+bool FlatCullTree::isInView(Drawable *draw,const std::vector<Mbr> &viewMbrs)
+{
+    Mbr mbr = draw->getLocalMbr();
+    if (draw->getMatrix() || !mbr.valid())
+        return true;
+
+    return MbrOverlapsAny(mbr,viewMbrs);
+}
+
+void FlatCullTree::findChangesInNode(Node *node,const std::vector<Mbr> &oldMbrs,const std::vector<Mbr> &newMbrs,int oldState,int newState,std::vector<Drawable *> &entered,std::vector<Drawable *> &left,int *drawablesConsidered)
+{
+    // A child's loose bounds are inside its parent's, so we only need to look again if the parent straddled
+    // The top node holds things that don't fit anywhere else, so we always check its items
+    if (node != top)
+    {
+        if (oldState == ViewStraddles)
+            oldState = CalcViewState(node->looseMbr,oldMbrs);
+        if (newState == ViewStraddles)
+            newState = CalcViewState(node->looseMbr,newMbrs);
+        // Nothing under here crossed an edge of either view
+        if (oldState == newState && oldState != ViewStraddles)
+            return;
+    }
+
+    *drawablesConsidered += (int)node->items.size();
+    for (Item &item : node->items)
+    {
+        bool wasIn = (oldState == ViewStraddles) ? MbrOverlapsAny(item.mbr,oldMbrs) : (oldState == ViewInside);
+        bool isIn = (newState == ViewStraddles) ? MbrOverlapsAny(item.mbr,newMbrs) : (newState == ViewInside);
+        if (isIn && !wasIn)
+            entered.push_back(item.draw.get());
+        else if (wasIn && !isIn)
+            left.push_back(item.draw.get());
+    }
+
+    for (unsigned int ii=0;ii<4;ii++)
+        if (node->children[ii])
+            findChangesInNode(node->children[ii],oldMbrs,newMbrs,oldState,newState,entered,left,drawablesConsidered);
+}
+
+void FlatCullTree::findChanges(const std::vector<Mbr> &oldMbrs,const std::vector<Mbr> &newMbrs,std::vector<Drawable *> &entered,std::vector<Drawable *> &left,int *drawablesConsidered)
+{
+    // Unplaced drawables are always returned, so they never change
+    findChangesInNode(top,oldMbrs,newMbrs,ViewStraddles,ViewStraddles,entered,left,drawablesConsidered);
+}
+
+}
@@ -74,6 +74,16 @@ Point3d PlateCarreeCoordSystem::geocentricToLocal(Point3d geocPt)
 {
     return GeoCoordSystem::GeocentricToLocal(geocPt);
 }
+
+void PlateCarreeCoordSystem::localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    GeoCoordSystem::LocalToGeocentric(inPts,outPts,numPts);
+}
+
+void PlateCarreeCoordSystem::geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    GeoCoordSystem::GeocentricToLocal(inPts,outPts,numPts);
+}
     
 bool PlateCarreeCoordSystem::isSameAs(CoordSystem *coordSys)
 {
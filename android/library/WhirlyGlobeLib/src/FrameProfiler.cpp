@@ -0,0 +1,269 @@
+/*
+ *  FrameProfiler.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <stdio.h>
+#import <inttypes.h>
+#import <string.h>
+#import "FrameProfiler.h"
+
+namespace WhirlyKit
+{
+
+// Names for the counters in the trace.  Same order as FrameCounter.
+static const char *FrameCounterNames[FrameCountMax] = {
+    "Drawables considered",
+    "Drawables culled",
+    "Drawables drawn",
+    "State changes",
+    "Bytes uploaded",
+    "Changes processed"
+};
+
+const char *FrameCounterName(FrameCounter which)
+{
+    if (which < 0 || which >= FrameCountMax)
+        return "";
+    return FrameCounterNames[which];
+}
+
+FrameProfilerSummary::FrameProfilerSummary()
+    : numFrames(0), frameTotal(0.0), frameMax(0.0)
+{
+    for (unsigned int ii=0;ii<FrameCountMax;ii++)
+        counts[ii] = 0;
+}
+
+// Frames go on their own track in the trace, well away from the real threads
+static const unsigned int FrameTrackID = 1000;
+
+FrameProfiler::FrameProfiler(int maxFrames,int maxPhases)
+    : enable(false), numPhases(0), numFrames(0), baseTime(0.0), frameNum(0), frameStart(0.0)
+{
+    pthread_mutex_init(&lock, NULL);
+    phases.resize(std::max(maxPhases,1));
+    frames.resize(std::max(maxFrames,1));
+    for (unsigned int ii=0;ii<FrameCountMax;ii++)
+        counts[ii] = 0;
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    pthread_mutex_destroy(&lock);
+}
+
+void FrameProfiler::setEnable(bool newEnable)
+{
+    if (newEnable && !enable)
+        clear();
+    enable = newEnable;
+}
+
+void FrameProfiler::clear()
+{
+    pthread_mutex_lock(&lock);
+    numPhases = 0;
+    numFrames = 0;
+    threads.clear();
+    baseTime = TimeGetCurrent();
+    pthread_mutex_unlock(&lock);
+
+    for (unsigned int ii=0;ii<FrameCountMax;ii++)
+        counts[ii] = 0;
+}
+
+void FrameProfiler::startFrame()
+{
+    frameStart = TimeGetCurrent();
+    for (unsigned int ii=0;ii<FrameCountMax;ii++)
+        counts[ii] = 0;
+}
+
+void FrameProfiler::endFrame()
+{
+    TimeInterval now = TimeGetCurrent();
+
+    pthread_mutex_lock(&lock);
+    Frame &frame = frames[numFrames % frames.size()];
+    frame.frameNum = frameNum;
+    frame.start = frameStart;
+    frame.end = now;
+    for (unsigned int ii=0;ii<FrameCountMax;ii++)
+        frame.counts[ii] = counts[ii].load(std::memory_order_relaxed);
+    numFrames++;
+    pthread_mutex_unlock(&lock);
+
+    frameNum++;
+}
+
+// Chrome wants small numbers for threads, so we hand them out as they show up.
+// Call with the lock held.
+unsigned int FrameProfiler::threadIndex()
+{
+    pthread_t self = pthread_self();
+    for (unsigned int ii=0;ii<threads.size();ii++)
+        if (pthread_equal(threads[ii],self))
+            return ii;
+    threads.push_back(self);
+
+    return (unsigned int)threads.size()-1;
+}
+
+void FrameProfiler::addPhase(const char *name,TimeInterval start,TimeInterval end)
+{
+    if (!isEnabled())
+        return;
+
+    pthread_mutex_lock(&lock);
+    Phase &phase = phases[numPhases % phases.size()];
+    phase.name = name;
+    phase.start = start;
+    phase.end = end;
+    phase.thread = threadIndex();
+    numPhases++;
+    pthread_mutex_unlock(&lock);
+}
+
+TimeInterval FrameProfiler::endPhase(const char *name,TimeInterval start)
+{
+    TimeInterval now = TimeGetCurrent();
+    addPhase(name,start,now);
+
+    return now;
+}
+
+void FrameProfiler::addCount(FrameCounter which,int64_t count)
+{
+    if (which < 0 || which >= FrameCountMax)
+        return;
+    counts[which].fetch_add(count,std::memory_order_relaxed);
+}
+
+void FrameProfiler::summarize(FrameProfilerSummary &summary)
+{
+    summary = FrameProfilerSummary();
+
+    pthread_mutex_lock(&lock);
+
+    // There aren't many distinct names, so a linear search is fine
+    unsigned int phaseStart = numPhases > phases.size() ? numPhases - (unsigned int)phases.size() : 0;
+    for (unsigned int ii=phaseStart;ii<numPhases;ii++)
+    {
+        const Phase &phase = phases[ii % phases.size()];
+        FrameProfilerSummary::PhaseTotal *total = NULL;
+        for (auto &entry : summary.phases)
+            if (entry.name == phase.name || !strcmp(entry.name,phase.name))
+            {
+                total = &entry;
+                break;
+            }
+        if (!total)
+        {
+            FrameProfilerSummary::PhaseTotal newTotal;
+            newTotal.name = phase.name;
+            newTotal.count = 0;
+            newTotal.total = 0.0;
+            newTotal.max = 0.0;
+            summary.phases.push_back(newTotal);
+            total = &summary.phases.back();
+        }
+        TimeInterval dur = phase.end - phase.start;
+        total->count++;
+        total->total += dur;
+        total->max = std::max(total->max,dur);
+    }
+
+    unsigned int frameStartNum = numFrames > frames.size() ? numFrames - (unsigned int)frames.size() : 0;
+    for (unsigned int ii=frameStartNum;ii<numFrames;ii++)
+    {
+        const Frame &frame = frames[ii % frames.size()];
+        TimeInterval dur = frame.end - frame.start;
+        summary.numFrames++;
+        summary.frameTotal += dur;
+        summary.frameMax = std::max(summary.frameMax,dur);
+        for (unsigned int jj=0;jj<FrameCountMax;jj++)
+            summary.counts[jj] += frame.counts[jj];
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+void FrameProfiler::writeChromeTrace(std::string &json)
+{
+    char line[1024];
+    json = "{\"traceEvents\":[\n";
+    bool first = true;
+
+    pthread_mutex_lock(&lock);
+
+    // Timestamps are in microseconds from when we started recording
+    unsigned int phaseStart = numPhases > phases.size() ? numPhases - (unsigned int)phases.size() : 0;
+    for (unsigned int ii=phaseStart;ii<numPhases;ii++)
+    {
+        const Phase &phase = phases[ii % phases.size()];
+        snprintf(line,sizeof(line),"%s{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.1f,\"dur\":%.1f}",
+                 first ? "" : ",\n",phase.name,phase.thread,(phase.start-baseTime)*1e6,(phase.end-phase.start)*1e6);
+        json += line;
+        first = false;
+    }
+
+    // Each frame is a span on the rendering thread with its counters attached.
+    // The counters also go out as counter events so they show up as graphs.
+    unsigned int frameStartNum = numFrames > frames.size() ? numFrames - (unsigned int)frames.size() : 0;
+    for (unsigned int ii=frameStartNum;ii<numFrames;ii++)
+    {
+        const Frame &frame = frames[ii % frames.size()];
+        std::string args;
+        for (unsigned int jj=0;jj<FrameCountMax;jj++)
+        {
+            snprintf(line,sizeof(line),"%s\"%s\":%" PRId64,jj == 0 ? "" : ",",FrameCounterNames[jj],frame.counts[jj]);
+            args += line;
+        }
+        snprintf(line,sizeof(line),"%s{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%u,",
+                 first ? "" : ",\n",FrameTrackID,(frame.start-baseTime)*1e6,(frame.end-frame.start)*1e6,frame.frameNum);
+        json += line;
+        json += args + "}}";
+        snprintf(line,sizeof(line),",\n{\"name\":\"Frame counters\",\"ph\":\"C\",\"pid\":0,\"ts\":%.1f,\"args\":{",(frame.start-baseTime)*1e6);
+        json += line;
+        json += args + "}}";
+        first = false;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    snprintf(line,sizeof(line),"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Frames\"}}",first ? "" : ",\n",FrameTrackID);
+    json += line;
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+bool FrameProfiler::writeChromeTrace(const std::string &fileName)
+{
+    std::string json;
+    writeChromeTrace(json);
+
+    FILE *fp = fopen(fileName.c_str(),"w");
+    if (!fp)
+        return false;
+    bool ret = fwrite(json.c_str(),1,json.size(),fp) == json.size();
+    fclose(fp);
+
+    return ret;
+}
+
+}
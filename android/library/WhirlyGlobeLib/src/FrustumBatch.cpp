@@ -0,0 +1,217 @@
+/*
+ *  FrustumBatch.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <math.h>
+#import "FrustumBatch.h"
+
+// We pick the vector unit at compile time.  Each ABI gets whatever it's guaranteed to have.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#import <arm_neon.h>
+#define WK_FRUSTUM_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#import <emmintrin.h>
+#define WK_FRUSTUM_SSE 1
+#endif
+
+using namespace Eigen;
+
+namespace WhirlyKit
+{
+
+// How much single precision error we allow for, relative to the size of the numbers involved.
+// Anything within this of a plane is called a straddle and the caller can do it in double.
+static const float FloatSlop = 1e-6f;
+
+FrustumResult SphereInFrustum(const Matrix4d &mat,const Point3d &center,double radius)
+{
+    Vector4d clipCenter = mat * Vector4d(center.x(),center.y(),center.z(),1.0);
+    bool inside = true;
+    for (unsigned int ii=0;ii<3;ii++)
+        for (int sign=-1;sign<=1;sign+=2)
+        {
+            // w + x >= 0, w - x >= 0 and so on
+            Vector4d plane = mat.row(3).transpose() + sign * mat.row(ii).transpose();
+            double dist = clipCenter.w() + sign * clipCenter[ii];
+            double extent = plane.head<3>().norm() * radius;
+            if (dist < -extent)
+                return FrustumOutside;
+            if (dist < extent)
+                inside = false;
+        }
+
+    return inside ? FrustumInside : FrustumStraddles;
+}
+
+FrustumPlanes::FrustumPlanes(const Matrix4d &mat)
+{
+    unsigned int which = 0;
+    for (unsigned int ii=0;ii<3;ii++)
+        for (int sign=-1;sign<=1;sign+=2,which++)
+        {
+            Vector4d plane = mat.row(3).transpose() + sign * mat.row(ii).transpose();
+            // Normalize so the distance is in display units and we can compare against the radius
+            double len = plane.head<3>().norm();
+            if (len > 0.0)
+                plane /= len;
+            a[which] = plane.x();  b[which] = plane.y();  c[which] = plane.z();  d[which] = plane.w();
+        }
+}
+
+// Classify one sphere.  This is the scalar version of what the vector code does.
+static unsigned char ClassifySphere(const FrustumPlanes &planes,float x,float y,float z,float r)
+{
+    float mag = std::abs(x) + std::abs(y) + std::abs(z) + r;
+    bool inside = true;
+    for (unsigned int ii=0;ii<6;ii++)
+    {
+        float dist = planes.a[ii]*x + planes.b[ii]*y + planes.c[ii]*z + planes.d[ii];
+        float tol = r + FloatSlop * (mag + std::abs(planes.d[ii]));
+        if (dist < -tol)
+            return FrustumOutside;
+        if (dist < tol)
+            inside = false;
+    }
+
+    return inside ? FrustumInside : FrustumStraddles;
+}
+
+void ClassifySpheres(const FrustumPlanes &planes,const float *x,const float *y,const float *z,const float *radius,unsigned int num,unsigned char *results)
+{
+    unsigned int ii = 0;
+
+#if defined(WK_FRUSTUM_SSE)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 slop = _mm_set1_ps(FloatSlop);
+    for (;ii+4<=num;ii+=4)
+    {
+        __m128 px = _mm_loadu_ps(x+ii), py = _mm_loadu_ps(y+ii), pz = _mm_loadu_ps(z+ii), pr = _mm_loadu_ps(radius+ii);
+        __m128 mag = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask,px),_mm_andnot_ps(signMask,py)),_mm_add_ps(_mm_andnot_ps(signMask,pz),pr));
+        __m128 anyOut = _mm_setzero_ps(), anyCross = _mm_setzero_ps();
+        for (unsigned int pi=0;pi<6;pi++)
+        {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.a[pi]),px),_mm_mul_ps(_mm_set1_ps(planes.b[pi]),py)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.c[pi]),pz),_mm_set1_ps(planes.d[pi])));
+            __m128 tol = _mm_add_ps(pr,_mm_mul_ps(slop,_mm_add_ps(mag,_mm_set1_ps(std::abs(planes.d[pi])))));
+            anyOut = _mm_or_ps(anyOut,_mm_cmplt_ps(dist,_mm_xor_ps(tol,signMask)));
+            anyCross = _mm_or_ps(anyCross,_mm_cmplt_ps(dist,tol));
+        }
+        int outMask = _mm_movemask_ps(anyOut), crossMask = _mm_movemask_ps(anyCross);
+        for (unsigned int li=0;li<4;li++)
+            results[ii+li] = ((outMask >> li) & 1) ? FrustumOutside : (((crossMask >> li) & 1) ? FrustumStraddles : FrustumInside);
+    }
+#elif defined(WK_FRUSTUM_NEON)
+    const float32x4_t slop = vdupq_n_f32(FloatSlop);
+    for (;ii+4<=num;ii+=4)
+    {
+        float32x4_t px = vld1q_f32(x+ii), py = vld1q_f32(y+ii), pz = vld1q_f32(z+ii), pr = vld1q_f32(radius+ii);
+        float32x4_t mag = vaddq_f32(vaddq_f32(vabsq_f32(px),vabsq_f32(py)),vaddq_f32(vabsq_f32(pz),pr));
+        uint32x4_t anyOut = vdupq_n_u32(0), anyCross = vdupq_n_u32(0);
+        for (unsigned int pi=0;pi<6;pi++)
+        {
+            float32x4_t dist = vdupq_n_f32(planes.d[pi]);
+            dist = vmlaq_n_f32(dist,px,planes.a[pi]);
+            dist = vmlaq_n_f32(dist,py,planes.b[pi]);
+            dist = vmlaq_n_f32(dist,pz,planes.c[pi]);
+            float32x4_t tol = vmlaq_f32(pr,slop,vaddq_f32(mag,vdupq_n_f32(std::abs(planes.d[pi]))));
+            anyOut = vorrq_u32(anyOut,vcltq_f32(dist,vnegq_f32(tol)));
+            anyCross = vorrq_u32(anyCross,vcltq_f32(dist,tol));
+        }
+        uint32_t outLanes[4],crossLanes[4];
+        vst1q_u32(outLanes,anyOut);
+        vst1q_u32(crossLanes,anyCross);
+        for (unsigned int li=0;li<4;li++)
+            results[ii+li] = outLanes[li] ? FrustumOutside : (crossLanes[li] ? FrustumStraddles : FrustumInside);
+    }
+#endif
+
+    // Whatever's left over, or everything if we've no vector unit
+    for (;ii<num;ii++)
+        results[ii] = ClassifySphere(planes,x[ii],y[ii],z[ii],radius[ii]);
+}
+
+void ProjectPoints(const Matrix4d &mat,const Point2d &halfFrameSize,const float *x,const float *y,const float *z,unsigned int num,float *screenX,float *screenY)
+{
+    // Where the origin lands in clip space, in double
+    double orgW = mat(3,3);
+    if (orgW == 0.0)
+        orgW = 1.0;
+    // Relative to the origin, the screen position is (dx - orgX/orgW * dw) / (orgW + dw).
+    // dx and dw are small, so we don't lose anything in single precision.
+    float m[3][3];
+    for (unsigned int ci=0;ci<3;ci++)
+    {
+        m[0][ci] = mat(0,ci);
+        m[1][ci] = mat(1,ci);
+        m[2][ci] = mat(3,ci);
+    }
+    float ax = mat(0,3)/orgW, ay = mat(1,3)/orgW, w0 = orgW;
+    float hx = halfFrameSize.x(), hy = halfFrameSize.y();
+    unsigned int ii = 0;
+
+#if defined(WK_FRUSTUM_SSE)
+    const __m128 hxv = _mm_set1_ps(hx), hyv = _mm_set1_ps(hy), axv = _mm_set1_ps(ax), ayv = _mm_set1_ps(ay), w0v = _mm_set1_ps(w0);
+    for (;ii+4<=num;ii+=4)
+    {
+        __m128 px = _mm_loadu_ps(x+ii), py = _mm_loadu_ps(y+ii), pz = _mm_loadu_ps(z+ii);
+        __m128 diff[3];
+        for (unsigned int ri=0;ri<3;ri++)
+            diff[ri] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[ri][0]),px),_mm_mul_ps(_mm_set1_ps(m[ri][1]),py)),_mm_mul_ps(_mm_set1_ps(m[ri][2]),pz));
+        __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f),_mm_add_ps(w0v,diff[2]));
+        _mm_storeu_ps(screenX+ii,_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(diff[0],_mm_mul_ps(axv,diff[2])),invW),hxv));
+        _mm_storeu_ps(screenY+ii,_mm_mul_ps(_mm_mul_ps(_mm_sub_ps(diff[1],_mm_mul_ps(ayv,diff[2])),invW),hyv));
+    }
+#elif defined(WK_FRUSTUM_NEON)
+    const float32x4_t w0v = vdupq_n_f32(w0);
+    for (;ii+4<=num;ii+=4)
+    {
+        float32x4_t px = vld1q_f32(x+ii), py = vld1q_f32(y+ii), pz = vld1q_f32(z+ii);
+        float32x4_t diff[3];
+        for (unsigned int ri=0;ri<3;ri++)
+        {
+            diff[ri] = vmulq_n_f32(px,m[ri][0]);
+            diff[ri] = vmlaq_n_f32(diff[ri],py,m[ri][1]);
+            diff[ri] = vmlaq_n_f32(diff[ri],pz,m[ri][2]);
+        }
+        float32x4_t w = vaddq_f32(w0v,diff[2]);
+#if defined(__aarch64__)
+        float32x4_t invW = vdivq_f32(vdupq_n_f32(1.0f),w);
+#else
+        // No divide on 32 bit NEON, so refine the reciprocal estimate
+        float32x4_t invW = vrecpeq_f32(w);
+        invW = vmulq_f32(vrecpsq_f32(w,invW),invW);
+        invW = vmulq_f32(vrecpsq_f32(w,invW),invW);
+#endif
+        vst1q_f32(screenX+ii,vmulq_n_f32(vmulq_f32(vmlsq_n_f32(diff[0],diff[2],ax),invW),hx));
+        vst1q_f32(screenY+ii,vmulq_n_f32(vmulq_f32(vmlsq_n_f32(diff[1],diff[2],ay),invW),hy));
+    }
+#endif
+
+    for (;ii<num;ii++)
+    {
+        float dx = m[0][0]*x[ii] + m[0][1]*y[ii] + m[0][2]*z[ii];
+        float dy = m[1][0]*x[ii] + m[1][1]*y[ii] + m[1][2]*z[ii];
+        float dw = m[2][0]*x[ii] + m[2][1]*y[ii] + m[2][2]*z[ii];
+        float invW = 1.0f / (w0 + dw);
+        screenX[ii] = (dx - ax*dw) * invW * hx;
+        screenY[ii] = (dy - ay*dw) * invW * hy;
+    }
+}
+
+}
@@ -22,6 +22,7 @@
 #import "GlobeMath.h"
 #import "FlatMath.h"
 #import "proj_api.h"
+#import <algorithm>
 
 using namespace Eigen;
 using namespace WhirlyKit;
@@ -99,6 +100,19 @@ Point3d GeoCoordSystem::LocalToGeocentric(Point3d localPt)
     return Point3d(x,y,z);
 }
 
+void GeoCoordSystem::LocalToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    InitProj4();
+    
+    // Point3d is three packed doubles, so Proj.4 can stride through the array in place
+    if (inPts != outPts)
+        std::copy(inPts,inPts+numPts,outPts);
+    double *coords = outPts[0].data();
+    pj_transform( pj_latlon, pj_geocentric, numPts, 3, &coords[0], &coords[1], &coords[2] );
+}
+
 /// Convert from local coordinates to WGS84 geocentric
 Point3f GeoCoordSystem::localToGeocentric(Point3f localPt)
 {
@@ -109,6 +123,11 @@ Point3d GeoCoordSystem::localToGeocentric(Point3d localPt)
 {
     return LocalToGeocentric(localPt);
 }
+
+void GeoCoordSystem::localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    LocalToGeocentric(inPts,outPts,numPts);
+}
     
 Point3f GeoCoordSystem::GeocentricToLocal(Point3f geocPt)
 {
@@ -130,6 +149,18 @@ Point3d GeoCoordSystem::GeocentricToLocal(Point3d geocPt)
     return Point3d(x,y,z);
 }
     
+void GeoCoordSystem::GeocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    InitProj4();
+    
+    if (inPts != outPts)
+        std::copy(inPts,inPts+numPts,outPts);
+    double *coords = outPts[0].data();
+    pj_transform( pj_geocentric, pj_latlon, numPts, 3, &coords[0], &coords[1], &coords[2] );
+}
+    
 /// Convert from WGS84 geocentric to local coordinates
 Point3f GeoCoordSystem::geocentricToLocal(Point3f geocPt)
 {
@@ -140,6 +171,11 @@ Point3d GeoCoordSystem::geocentricToLocal(Point3d geocPt)
 {
     return GeocentricToLocal(geocPt);
 }
+
+void GeoCoordSystem::geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    GeocentricToLocal(inPts,outPts,numPts);
+}
     
 
 Mbr GeoCoordSystem::GeographicMbrToLocal(GeoMbr geoMbr)
@@ -193,6 +229,19 @@ Point3d FakeGeocentricDisplayAdapter::localToDisplay(Point3d geoPt)
 {
     return LocalToDisplay(geoPt);
 }
+
+void FakeGeocentricDisplayAdapter::localToDisplay(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    // Same math as LocalToDisplay, but in a tight loop the compiler can inline and unroll
+    for (size_t ii=0;ii<numPts;ii++)
+    {
+        const Point3d &geoPt = inPts[ii];
+        double z = sin(geoPt.y());
+        double rad = sqrt(1.0-z*z);
+        double scale = 1.0 + geoPt.z() / EarthRadius;
+        outPts[ii] = Point3d(rad*cos(geoPt.x())*scale,rad*sin(geoPt.x())*scale,z*scale);
+    }
+}
     
 Point3f FakeGeocentricDisplayAdapter::DisplayToLocal(Point3f pt)
 {
@@ -26,6 +26,7 @@
 #import "GlobeViewState.h"
 #import "MaplyViewState.h"
 #import "OverlapHelper.h"
+#import "TaskScheduler.h"
 
 
 using namespace Eigen;
@@ -73,6 +74,10 @@ void LayoutObject::setSelectSize(const Point2d &selectSize,const Point2d &offset
 }
 
 
+// Size of the overlap sampler
+static const int OverlapSampleX = 10;
+static const int OverlapSampleY = 60;
+
 LayoutObjectEntry::LayoutObjectEntry(SimpleIdentity theId)
 	: Identifiable(theId)
 {
@@ -80,13 +85,25 @@ LayoutObjectEntry::LayoutObjectEntry(SimpleIdentity theId)
 	currentCluster = newCluster = -1;
 	offset = Point2d(MAXFLOAT,MAXFLOAT);
 	changed = true;
+	placedOrient = -1;
+	hasLayoutPt = false;
+	layoutDrift = 0.0;
+	onScreen = false;
+	inClusterTree = false;
+	clusterTreeShown = false;
+	clusterTreePass = -1;
+	hasClusterPt = false;
 }
 
     
 LayoutManager::LayoutManager()
-    : maxDisplayObjects(0), hasUpdates(false), clusterGen(NULL)
+    : maxDisplayObjects(0), hasUpdates(false), sortedObjectsValid(false),
+    incrementalLayout(false), incrementalMoveThreshold(8.0), forceFullLayout(true), parallelLayout(false),
+    lastFrameBufferSize(0.0,0.0), lastResScale(0.0),
+    cullDrift(0.0), placedOverlap(Mbr(),OverlapSampleX,OverlapSampleY), vacatedOverlap(Mbr(),OverlapSampleX,OverlapSampleY), clusterGen(NULL), hierarchicalClustering(false), layoutPass(0)
 {
     pthread_mutex_init(&layoutLock, NULL);
+    pthread_mutex_init(&pendingLock, NULL);
 }
     
 LayoutManager::~LayoutManager()
@@ -95,8 +112,13 @@ LayoutManager::~LayoutManager()
          it != layoutObjects.end(); ++it)
         delete *it;
     layoutObjects.clear();
+    for (const LayoutChange &change : pendingChanges)
+        if (change.entry)
+            delete change.entry;
+    pendingChanges.clear();
     
     pthread_mutex_destroy(&layoutLock);
+    pthread_mutex_destroy(&pendingLock);
 }
     
 void LayoutManager::setMaxDisplayObjects(int numObjects)
@@ -104,93 +126,205 @@ void LayoutManager::setMaxDisplayObjects(int numObjects)
 	pthread_mutex_lock(&layoutLock);
 
     maxDisplayObjects = numObjects;
+    forceFullLayout = true;
 
 	pthread_mutex_unlock(&layoutLock);
 }
-    
-void LayoutManager::addLayoutObjects(const std::vector<LayoutObject> &newObjects)
+
+void LayoutManager::setIncrementalLayout(bool incremental,float moveThreshold)
 {
 	pthread_mutex_lock(&layoutLock);
 
+    incrementalLayout = incremental;
+    incrementalMoveThreshold = moveThreshold;
+    forceFullLayout = true;
+
+	pthread_mutex_unlock(&layoutLock);
+}
+
+void LayoutManager::setParallelLayout(bool parallel)
+{
+	pthread_mutex_lock(&layoutLock);
+
+    parallelLayout = parallel;
+    forceFullLayout = true;
+
+	pthread_mutex_unlock(&layoutLock);
+}
+
+void LayoutManager::setHierarchicalClustering(bool hierarchical)
+{
+	pthread_mutex_lock(&layoutLock);
+
+    if (hierarchicalClustering != hierarchical)
+    {
+        hierarchicalClustering = hierarchical;
+
+        // Whatever the hierarchies were handling goes back to the regular layout
+        for (auto &it : clusterTrees)
+        {
+            LayoutClusterTree &clusterTree = it.second;
+            if (clusterTree.tree)
+                for (LayoutObjectEntry *entry : clusterTree.tree->getAllEntries())
+                    if (entry)
+                        entry->inClusterTree = false;
+            for (LayoutObjectEntry *entry : clusterTree.shown)
+                entry->clusterTreeShown = false;
+        }
+        clusterTrees.clear();
+        sortedObjectsValid = false;
+        forceFullLayout = true;
+    }
+
+	pthread_mutex_unlock(&layoutLock);
+}
+    
+void LayoutManager::addLayoutObjects(const std::vector<LayoutObject> &newObjects)
+{
+    // Set up the entries before we take the lock
+    std::vector<LayoutChange> changes;
+    changes.reserve(newObjects.size());
     for (unsigned int ii=0;ii<newObjects.size();ii++)
     {
         const LayoutObject &layoutObj = newObjects[ii];
         LayoutObjectEntry *entry = new LayoutObjectEntry(layoutObj.getId());
         entry->obj = newObjects[ii];
-        layoutObjects.insert(entry);
+        changes.push_back(LayoutChange(LayoutChange::Add,entry->getId(),entry));
     }
+
+	pthread_mutex_lock(&pendingLock);
+
+    pendingChanges.insert(pendingChanges.end(),changes.begin(),changes.end());
     hasUpdates = true;
 
-	pthread_mutex_unlock(&layoutLock);
+	pthread_mutex_unlock(&pendingLock);
 }
     
     
 void LayoutManager::addLayoutObjects(const std::vector<LayoutObject *> &newObjects)
 {
-	pthread_mutex_lock(&layoutLock);
-
+    std::vector<LayoutChange> changes;
+    changes.reserve(newObjects.size());
 	for (unsigned int ii=0;ii<newObjects.size();ii++)
     {
         const LayoutObject *layoutObj = newObjects[ii];
         LayoutObjectEntry *entry = new LayoutObjectEntry(layoutObj->getId());
         entry->obj = *(newObjects[ii]);
-        layoutObjects.insert(entry);
+        changes.push_back(LayoutChange(LayoutChange::Add,entry->getId(),entry));
     }
+
+	pthread_mutex_lock(&pendingLock);
+
+    pendingChanges.insert(pendingChanges.end(),changes.begin(),changes.end());
     hasUpdates = true;
 
-	pthread_mutex_unlock(&layoutLock);
+	pthread_mutex_unlock(&pendingLock);
 }
     
 /// Enable/disable layout objects
 void LayoutManager::enableLayoutObjects(const SimpleIDSet &theObjects,bool enable)
 {
-	pthread_mutex_lock(&layoutLock);
+	pthread_mutex_lock(&pendingLock);
 
 	for (SimpleIDSet::const_iterator it = theObjects.begin();
          it != theObjects.end(); ++it)
-    {
-        LayoutObjectEntry entry(*it);
-        LayoutEntrySet::iterator eit = layoutObjects.find(&entry);
-        if (eit != layoutObjects.end())
-            (*eit)->obj.enable = enable;
-    }
+        pendingChanges.push_back(LayoutChange(enable ? LayoutChange::Enable : LayoutChange::Disable,*it,NULL));
     hasUpdates = true;
 
-	pthread_mutex_unlock(&layoutLock);
+	pthread_mutex_unlock(&pendingLock);
 }
     
 void LayoutManager::removeLayoutObjects(const SimpleIDSet &oldObjects)
 {
-	pthread_mutex_lock(&layoutLock);
+	pthread_mutex_lock(&pendingLock);
 
 	for (SimpleIDSet::const_iterator it = oldObjects.begin();
          it != oldObjects.end(); ++it)
-    {
-        LayoutObjectEntry entry(*it);
-        LayoutEntrySet::iterator eit = layoutObjects.find(&entry);
-        if (eit != layoutObjects.end())
-        {
-            delete *eit;
-            layoutObjects.erase(eit);
-        }
-    }
+        pendingChanges.push_back(LayoutChange(LayoutChange::Remove,*it,NULL));
     hasUpdates = true;
 
-	pthread_mutex_unlock(&layoutLock);
+	pthread_mutex_unlock(&pendingLock);
 }
     
 bool LayoutManager::hasChanges()
 {
     bool ret = false;
     
-    pthread_mutex_lock(&layoutLock);
+    pthread_mutex_lock(&pendingLock);
     
     ret = hasUpdates;
     
-    pthread_mutex_unlock(&layoutLock);
+    pthread_mutex_unlock(&pendingLock);
     
     return ret;
 }
+
+bool LayoutManager::applyPendingChanges()
+{
+    std::vector<LayoutChange> changes;
+    bool updates = false;
+
+    pthread_mutex_lock(&pendingLock);
+    changes.swap(pendingChanges);
+    updates = hasUpdates;
+    hasUpdates = false;
+    pthread_mutex_unlock(&pendingLock);
+
+    // In the order they came in
+    for (const LayoutChange &change : changes)
+    {
+        switch (change.type)
+        {
+            case LayoutChange::Add:
+                if (layoutObjects.insert(change.entry).second)
+                {
+                    // Goes into the next cluster hierarchy build
+                    if (change.entry->obj.clusterGroup > -1)
+                    {
+                        LayoutClusterTree *clusterTree = findClusterTree(change.entry->obj.clusterGroup);
+                        if (clusterTree)
+                            clusterTree->dirty = true;
+                    }
+                } else
+                    delete change.entry;
+                break;
+            case LayoutChange::Remove:
+            case LayoutChange::Enable:
+            case LayoutChange::Disable:
+            {
+                LayoutObjectEntry entry(change.objID);
+                LayoutEntrySet::iterator eit = layoutObjects.find(&entry);
+                if (eit != layoutObjects.end())
+                {
+                    if (change.type == LayoutChange::Remove)
+                    {
+                        // Take it out of its cluster hierarchy and any that's being built
+                        LayoutClusterTree *clusterTree = (*eit)->obj.clusterGroup > -1 ? findClusterTree((*eit)->obj.clusterGroup) : NULL;
+                        if (clusterTree)
+                        {
+                            if (clusterTree->tree)
+                                clusterTree->tree->removeEntry(*eit);
+                            if (clusterTree->build)
+                                clusterTree->removedSinceBuild.push_back(*eit);
+                            if ((*eit)->clusterTreeShown)
+                                clusterTree->shown.erase(std::find(clusterTree->shown.begin(),clusterTree->shown.end(),*eit));
+                            clusterTree->dirty = true;
+                        }
+                        forgetPlacement(*eit);
+                        delete *eit;
+                        layoutObjects.erase(eit);
+                    } else
+                        (*eit)->obj.enable = change.type == LayoutChange::Enable;
+                }
+            }
+                break;
+        }
+    }
+    if (!changes.empty())
+        sortedObjectsValid = false;
+
+    return updates;
+}
     
 // Sort more important things to the front
 typedef struct
@@ -210,11 +344,9 @@ void LayoutManager::getScreenSpaceObjects(const SelectionManager::PlacementInfo
 {
     pthread_mutex_lock(&layoutLock);
 
-	// First the regular screen space objects
-    for (LayoutEntrySet::iterator it = layoutObjects.begin();
-         it != layoutObjects.end(); ++it)
+	// First the regular screen space objects, just the ones the last layout turned on
+    for (LayoutObjectEntry *entry : shownObjects)
     {
-        LayoutObjectEntry *entry = *it;
         if (entry->currentEnable && entry->obj.enable)
         {
             ScreenSpaceObjectLocation ssObj;
@@ -247,6 +379,28 @@ void LayoutManager::getScreenSpaceObjects(const SelectionManager::PlacementInfo
     pthread_mutex_unlock(&layoutLock);
 }
 
+void LayoutManager::forgetPlacement(LayoutObjectEntry *entry)
+{
+    if (entry->placedOrient >= 0)
+    {
+        Mbr placedMbr;
+        placedMbr.addPoints(entry->placedPts);
+        vacatedMbrs.push_back(placedMbr);
+    }
+    entry->placedOrient = -1;
+    entry->placedPts.clear();
+    entry->hasLayoutPt = false;
+}
+
+LayoutClusterTree *LayoutManager::findClusterTree(int clusterID)
+{
+    auto it = clusterTrees.find(clusterID);
+    if (it == clusterTrees.end())
+        return NULL;
+
+    return &it->second;
+}
+
 void LayoutManager::addClusterGenerator(ClusterGenerator *inClusterGen)
 {
 	pthread_mutex_lock(&layoutLock);
@@ -281,21 +435,36 @@ struct ClusteredObjectsSorter
 typedef std::set<ClusteredObjects *,ClusteredObjectsSorter> ClusteredObjectsSet;
 
 
-// Size of the overlap sampler
-static const int OverlapSampleX = 10;
-static const int OverlapSampleY = 60;
-
 // Now much around the screen we'll take into account
 static const float ScreenBuffer = 0.1;
 
+// Objects per task when working out what's on screen
+static const unsigned int CullChunkSize = 2048;
+
+// How the screen is split up for parallel layout
+static const int LayoutBinsX = 4;
+static const int LayoutBinsY = 4;
+// Not worth splitting up fewer objects than this
+static const unsigned int MinParallelLayoutObjects = 64;
+
+// Zoom levels the cluster hierarchies cover.  Past the last one everything's on its own.
+static const int ClusterTreeMinZoom = 0;
+static const int ClusterTreeMaxZoom = 16;
+// Distance (in pixels) we measure the zoom level over
+static const float ClusterZoomSampleDist = 16.0;
+
 bool LayoutManager::calcScreenPt(Point2f &objPt, LayoutObjectEntry *layoutObj,ViewState *viewState, const Mbr &screenMbr, const Point2f &frameBufferSize)
+{
+	return calcScreenPt(objPt,layoutObj->obj.worldLoc,viewState,screenMbr,frameBufferSize);
+}
+
+bool LayoutManager::calcScreenPt(Point2f &objPt, const Point3d &worldLoc,ViewState *viewState, const Mbr &screenMbr, const Point2f &frameBufferSize)
 {
 	// Figure out where this will land
 	bool isInside = false;
 	for (unsigned int offi=0;offi<viewState->viewMatrices.size();offi++)
 	{
-		Eigen::Matrix4d modelTrans = viewState->fullMatrices[offi];
-		Point2f thisObjPt = viewState->pointOnScreenFromDisplay(layoutObj->obj.worldLoc, &modelTrans, frameBufferSize);
+		Point2f thisObjPt = viewState->pointOnScreenFromDisplay(worldLoc, &viewState->fullMatrices[offi], frameBufferSize);
 		if (screenMbr.inside(Point2f(thisObjPt.x(), thisObjPt.y())))
 		{
 			isInside = true;
@@ -344,16 +513,648 @@ Matrix2d LayoutManager::calcScreenRot(float &screenRot, ViewState *viewState, Wh
 	return screenRotMat;
 }
 
+// Size and origin of an object's layout points
+static void CalcLayoutExtents(const Point2dVector &layoutPts,Point2f &layoutSpan,Point2d &layoutOrg)
+{
+    Mbr layoutMbr;
+    for (unsigned int li=0;li<layoutPts.size();li++)
+        layoutMbr.addPoint(layoutPts[li]);
+    layoutSpan = Point2f(layoutMbr.ur().x()-layoutMbr.ll().x(),layoutMbr.ur().y()-layoutMbr.ll().y());
+    layoutOrg = Point2d(layoutMbr.ll().x(),layoutMbr.ll().y());
+}
+
+/** How everything on screen moved from one layout pass to the next.
+    A scale and rotation (as a complex number) plus an offset, fit to the objects that
+    were laid out both times.  That's exact for panning, zooming and rotating a flat map
+    and close on the globe.  Whatever's left over is an object moving against its neighbours.
+  */
+class LayoutViewMotion
+{
+public:
+    LayoutViewMotion() : scale(1.0,0.0), offset(0.0,0.0) { }
+
+    // Least squares fit of last pass's screen locations to this pass's
+    void fit(const std::vector<LayoutObjectEntry *> &layoutObjs)
+    {
+        Point2d lastMid(0.0,0.0),mid(0.0,0.0);
+        int numPts = 0;
+        for (const LayoutObjectEntry *entry : layoutObjs)
+            if (entry->hasLayoutPt && entry->onScreen)
+            {
+                lastMid += entry->lastScreenPt.cast<double>();
+                mid += entry->screenPt.cast<double>();
+                numPts++;
+            }
+        if (numPts == 0)
+            return;
+        lastMid /= numPts;
+        mid /= numPts;
+
+        double sumSq = 0.0;
+        Point2d sumProd(0.0,0.0);
+        for (const LayoutObjectEntry *entry : layoutObjs)
+            if (entry->hasLayoutPt && entry->onScreen)
+            {
+                Point2d from = entry->lastScreenPt.cast<double>() - lastMid;
+                Point2d to = entry->screenPt.cast<double>() - mid;
+                sumSq += from.squaredNorm();
+                sumProd += Point2d(to.x()*from.x() + to.y()*from.y(),to.y()*from.x() - to.x()*from.y());
+            }
+        if (sumSq > 0.0)
+            scale = sumProd / sumSq;
+        offset = mid - apply(lastMid);
+    }
+
+    // Where something from the last pass should be now
+    Point2d apply(const Point2d &pt) const
+    {
+        return Point2d(scale.x()*pt.x() - scale.y()*pt.y(),scale.y()*pt.x() + scale.x()*pt.y()) + offset;
+    }
+
+    // Bounds of a box from the last pass, now
+    Mbr apply(const Mbr &mbr) const
+    {
+        Mbr newMbr;
+        newMbr.addPoint(apply(Point2d(mbr.ll().x(),mbr.ll().y())));
+        newMbr.addPoint(apply(Point2d(mbr.ur().x(),mbr.ll().y())));
+        newMbr.addPoint(apply(Point2d(mbr.ur().x(),mbr.ur().y())));
+        newMbr.addPoint(apply(Point2d(mbr.ll().x(),mbr.ur().y())));
+        return newMbr;
+    }
+
+    /** How far two objects this far apart could have moved apart or around each other.
+        Zooming out only squeezes things together, which can't open up space for a hidden
+        object.  If it did, something that was showing had to give way and we catch that
+        through its vacated footprint.
+      */
+    double spread(double dist) const
+    {
+        double zoom = scale.norm();
+        if (zoom <= 0.0)
+            return MAXFLOAT;
+        return ((scale/zoom - Point2d(1.0,0.0)).norm() + std::max(zoom-1.0,0.0)) * dist;
+    }
+
+    Point2d scale,offset;
+};
+
+typedef std::vector<Eigen::Vector4d,Eigen::aligned_allocator<Eigen::Vector4d> > CullPlaneVector;
+
+// The edges of the screen area (and the side of the eye we're looking out of) as planes in display space, five per view matrix.
+// calcScreenPt lands a point at -near*x/z in eye space, so a point with z < 0 is off the screen
+//  if it's on the negative side of any of the edges.
+static void CalcCullPlanes(ViewState *viewState,const Mbr &screenMbr,const Point2f &frameBufferSize,CullPlaneVector &planes)
+{
+    Point2d span = viewState->ur - viewState->ll;
+    double nearPlane = viewState->nearPlane;
+    double a0 = viewState->ll.x() + span.x() * screenMbr.ll().x() / frameBufferSize.x();
+    double a1 = viewState->ll.x() + span.x() * screenMbr.ur().x() / frameBufferSize.x();
+    double b0 = viewState->ll.y() + span.y() * (1.0 - screenMbr.ur().y() / frameBufferSize.y());
+    double b1 = viewState->ll.y() + span.y() * (1.0 - screenMbr.ll().y() / frameBufferSize.y());
+    Vector3d eyePlanes[5] = {Vector3d(0.0,0.0,-1.0),Vector3d(nearPlane,0.0,a0),Vector3d(-nearPlane,0.0,-a1),Vector3d(0.0,nearPlane,b0),Vector3d(0.0,-nearPlane,-b1)};
+
+    planes.clear();
+    for (const Matrix4d &mat : viewState->fullMatrices)
+        for (const Vector3d &eyePlane : eyePlanes)
+            planes.push_back(mat.topRows<3>().transpose() * eyePlane.normalized());
+}
+
+// How far (in plane units, scaled by the point) the cull planes can move before this point could land on screen.
+// Zero if it's on screen or too close to call.
+static double CalcOffScreenSlack(const CullPlaneVector &planes,const Point3d &worldLoc)
+{
+    if (planes.empty())
+        return 0.0;
+    Vector4d pt(worldLoc.x(),worldLoc.y(),worldLoc.z(),1.0);
+    double slack = MAXFLOAT;
+    for (unsigned int pi=0;pi<planes.size();pi+=5)
+    {
+        // Has to stay in front and outside one of the edges for every view matrix
+        double outside = 0.0;
+        for (unsigned int ei=1;ei<5;ei++)
+            outside = std::max(outside,-planes[pi+ei].dot(pt));
+        slack = std::min(slack,std::min(planes[pi].dot(pt),outside));
+    }
+
+    return std::max(slack / pt.norm(),0.0);
+}
+
+// Four corners of a box for the overlap helpers
+static void MbrToPts(const Mbr &mbr,Point2dVector &pts)
+{
+    pts[0] = Point2d(mbr.ll().x(),mbr.ll().y());
+    pts[1] = Point2d(mbr.ur().x(),mbr.ll().y());
+    pts[2] = Point2d(mbr.ur().x(),mbr.ur().y());
+    pts[3] = Point2d(mbr.ll().x(),mbr.ur().y());
+}
+
+// Work out the offset and screen footprint for one of the six placement orientations
+static void CalcOrientPts(int orient,const Point2f &objPt,const Point2f &layoutSpan,const Point2d &layoutOrg,float screenRot,const Matrix2d &screenRotMat,float resScale,Point2d &objOffset,Point2dVector &objPts)
+{
+    // Set up the offset for this orientation
+    // Note: This is all wrong for markers now
+    switch (orient)
+    {
+        // Don't move at all
+        case 0:
+            objOffset = Point2d(0,0);
+            break;
+        // Center
+        case 1:
+            objOffset = Point2d(-layoutSpan.x()/2.0,layoutSpan.y()/2.0);
+            break;
+        // Right
+        case 2:
+            objOffset = Point2d(0.0,layoutSpan.y()/2.0);
+            break;
+        // Left
+        case 3:
+            objOffset = Point2d(-(layoutSpan.x()),layoutSpan.y()/2.0);
+            break;
+        // Above
+        case 4:
+            objOffset = Point2d(-layoutSpan.x()/2.0,0);
+            break;
+        // Below
+        case 5:
+            objOffset = Point2d(-layoutSpan.x()/2.0,layoutSpan.y());
+            break;
+    }
+
+    // Rotate the rectangle
+    if (screenRot == 0.0)
+    {
+        objPts[0] = Point2d(objPt.x(),objPt.y()) + (objOffset + layoutOrg)*resScale;
+        objPts[1] = objPts[0] + Point2d(layoutSpan.x()*resScale,0.0);
+        objPts[2] = objPts[0] + Point2d(layoutSpan.x()*resScale,layoutSpan.y()*resScale);
+        objPts[3] = objPts[0] + Point2d(0.0,layoutSpan.y()*resScale);
+    } else {
+        Point2d center(objPt.x(),objPt.y());
+        objPts[0] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg;
+        objPts[1] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(layoutSpan.x(),0.0);
+        objPts[2] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(layoutSpan.x(),layoutSpan.y());
+        objPts[3] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(0.0,layoutSpan.y());
+        for (unsigned int oi=0;oi<4;oi++)
+        {
+            Point2d &thisObjPt = objPts[oi];
+            Point2d offPt = screenRotMat * Point2d(thisObjPt.x()*resScale,thisObjPt.y()*resScale);
+            thisObjPt = Point2d(offPt.x(),-offPt.y()) + center;
+        }
+    }
+}
+
+// The part of the screen an unrotated object covers whichever way it's placed.
+// Invalid if its acceptable orientations don't all share a spot.
+static Mbr CalcSharedPlacement(int acceptablePlacement,const Point2f &objPt,const Point2f &layoutSpan,const Point2d &layoutOrg,float resScale,Point2dVector &objPts)
+{
+    Mbr shared;
+    bool first = true;
+    Point2d objOffset;
+    for (int orient=0;orient<6;orient++)
+    {
+        if (!(acceptablePlacement & (1<<orient)))
+            continue;
+        CalcOrientPts(orient,objPt,layoutSpan,layoutOrg,0.0,Matrix2d::Identity(),resScale,objOffset,objPts);
+        Mbr orientMbr;
+        orientMbr.addPoints(objPts);
+        if (first)
+        {
+            shared = orientMbr;
+            first = false;
+        } else {
+            shared.ll() = Point2f(std::max(shared.ll().x(),orientMbr.ll().x()),std::max(shared.ll().y(),orientMbr.ll().y()));
+            shared.ur() = Point2f(std::min(shared.ur().x(),orientMbr.ur().x()),std::min(shared.ur().y(),orientMbr.ur().y()));
+        }
+    }
+    if (shared.ur().y() < shared.ll().y())
+        shared.reset();
+
+    return shared;
+}
+
+// Try an object's acceptable orientations in order and keep the first that doesn't overlap
+//  anything in the given helpers.  It goes into the last one.
+static void PlaceInHelpers(LayoutPlacement &place,int acceptablePlacement,float resScale,OverlapHelper **helpers,int numHelpers)
+{
+    for (int orient=0;orient<6;orient++)
+    {
+        // May only want to be placed certain ways.  Fair enough.
+        if (!(acceptablePlacement & (1<<orient)))
+            continue;
+
+        CalcOrientPts(orient,place.objPt,place.layoutSpan,place.layoutOrg,place.screenRot,place.screenRotMat,resScale,place.objOffset,place.objPts);
+
+        bool fits = true;
+        for (int hi=0;hi<numHelpers && fits;hi++)
+            fits = helpers[hi]->checkObject(place.objPts);
+        if (fits)
+        {
+            helpers[numHelpers-1]->insertObject(place.objPts);
+            place.placedOrient = orient;
+            return;
+        }
+    }
+
+    place.isActive = false;
+}
+
+void LayoutManager::placeObjectsInBins(const std::vector<LayoutObjectEntry *> &layoutObjs,ViewState *viewState,WhirlyGlobe::GlobeViewState *globeViewState,const Mbr &screenMbr,const Point2f &frameBufferSize,float resScale)
+{
+    TaskScheduler *scheduler = TaskScheduler::getScheduler();
+    Matrix4d modelTrans = viewState->fullMatrices[0];
+    Matrix4d normalMat = viewState->fullMatrices[0].inverse().transpose();
+    Point2f binSize((screenMbr.ur().x()-screenMbr.ll().x())/LayoutBinsX,(screenMbr.ur().y()-screenMbr.ll().y())/LayoutBinsY);
+
+    // Work out where each object could land and whether that's all in one bin
+    unsigned int numObjs = (unsigned int)layoutObjs.size();
+    placements.resize(numObjs);
+    scheduler->parallelFor(numObjs,256,
+        [&](unsigned int start,unsigned int end)
+        {
+            for (unsigned int oi=start;oi<end;oi++)
+            {
+                LayoutObjectEntry *layoutObj = layoutObjs[oi];
+                LayoutPlacement &place = placements[oi];
+                place.isActive = layoutObj->onScreen;
+                place.placedOrient = -1;
+                place.objOffset = Point2d(0.0,0.0);
+                place.reach = Mbr();
+                place.bin = -1;
+                place.screenRot = 0.0;
+                if (!place.isActive || layoutObj->obj.layoutPts.empty())
+                    continue;
+
+                place.objPt = layoutObj->screenPt;
+                if (layoutObj->obj.rotation != 0.0)
+                    place.screenRotMat = calcScreenRot(place.screenRot,viewState,globeViewState,&layoutObj->obj,Point2d(place.objPt.x(),place.objPt.y()),modelTrans,normalMat,frameBufferSize);
+                CalcLayoutExtents(layoutObj->obj.layoutPts,place.layoutSpan,place.layoutOrg);
+
+                place.objPts.resize(4);
+                for (int orient=0;orient<6;orient++)
+                    if (layoutObj->obj.acceptablePlacement & (1<<orient))
+                    {
+                        CalcOrientPts(orient,place.objPt,place.layoutSpan,place.layoutOrg,place.screenRot,place.screenRotMat,resScale,place.objOffset,place.objPts);
+                        place.reach.addPoints(place.objPts);
+                    }
+                if (!place.reach.valid())
+                {
+                    // Nowhere it's allowed to go
+                    place.isActive = false;
+                    continue;
+                }
+
+                int sx = std::min(std::max((int)floorf((place.reach.ll().x()-screenMbr.ll().x())/binSize.x()),0),LayoutBinsX-1);
+                int sy = std::min(std::max((int)floorf((place.reach.ll().y()-screenMbr.ll().y())/binSize.y()),0),LayoutBinsY-1);
+                int ex = std::min(std::max((int)floorf((place.reach.ur().x()-screenMbr.ll().x())/binSize.x()),0),LayoutBinsX-1);
+                int ey = std::min(std::max((int)floorf((place.reach.ur().y()-screenMbr.ll().y())/binSize.y()),0),LayoutBinsY-1);
+                if (sx == ex && sy == ey)
+                    place.bin = sy*LayoutBinsX + sx;
+            }
+        });
+
+    // Sort them into bins, still in importance order
+    std::vector<std::vector<unsigned int> > binObjs(LayoutBinsX*LayoutBinsY);
+    std::vector<unsigned int> straddlers;
+    for (unsigned int oi=0;oi<numObjs;oi++)
+    {
+        const LayoutPlacement &place = placements[oi];
+        if (!place.isActive || !place.reach.valid())
+            continue;
+        if (place.bin >= 0)
+            binObjs[place.bin].push_back(oi);
+        else
+            straddlers.push_back(oi);
+    }
+
+    // Lay out each bin on its own
+    int sampleX = std::max(1,(OverlapSampleX+LayoutBinsX-1)/LayoutBinsX);
+    int sampleY = std::max(1,(OverlapSampleY+LayoutBinsY-1)/LayoutBinsY);
+    std::vector<OverlapHelper *> binHelpers(LayoutBinsX*LayoutBinsY);
+    for (int by=0;by<LayoutBinsY;by++)
+        for (int bx=0;bx<LayoutBinsX;bx++)
+        {
+            Point2f binOrg(screenMbr.ll().x()+bx*binSize.x(),screenMbr.ll().y()+by*binSize.y());
+            binHelpers[by*LayoutBinsX+bx] = new OverlapHelper(Mbr(binOrg,binOrg+binSize),sampleX,sampleY);
+        }
+    scheduler->parallelFor((unsigned int)binObjs.size(),1,
+        [&](unsigned int start,unsigned int end)
+        {
+            for (unsigned int bi=start;bi<end;bi++)
+                for (unsigned int oi : binObjs[bi])
+                    PlaceInHelpers(placements[oi],layoutObjs[oi]->obj.acceptablePlacement,resScale,&binHelpers[bi],1);
+        });
+
+    // Then the ones that could land in more than one, in order, around what the bins did
+    OverlapHelper straddleHelper(screenMbr,OverlapSampleX,OverlapSampleY);
+    std::vector<OverlapHelper *> helpers;
+    for (unsigned int oi : straddlers)
+    {
+        LayoutPlacement &place = placements[oi];
+        int sx = std::min(std::max((int)floorf((place.reach.ll().x()-screenMbr.ll().x())/binSize.x()),0),LayoutBinsX-1);
+        int sy = std::min(std::max((int)floorf((place.reach.ll().y()-screenMbr.ll().y())/binSize.y()),0),LayoutBinsY-1);
+        int ex = std::min(std::max((int)floorf((place.reach.ur().x()-screenMbr.ll().x())/binSize.x()),0),LayoutBinsX-1);
+        int ey = std::min(std::max((int)floorf((place.reach.ur().y()-screenMbr.ll().y())/binSize.y()),0),LayoutBinsY-1);
+        helpers.clear();
+        for (int by=sy;by<=ey;by++)
+            for (int bx=sx;bx<=ex;bx++)
+                helpers.push_back(binHelpers[by*LayoutBinsX+bx]);
+        helpers.push_back(&straddleHelper);
+        PlaceInHelpers(place,layoutObjs[oi]->obj.acceptablePlacement,resScale,&helpers[0],(int)helpers.size());
+    }
+
+    for (OverlapHelper *helper : binHelpers)
+        delete helper;
+}
+
 // Do the actual layout logic.  We'll modify the offset and on value in place.
+void LayoutManager::updateClusterTrees()
+{
+    CoordSystemDisplayAdapter *coordAdapter = scene->getCoordAdapter();
+    CoordSystem *coordSys = coordAdapter->getCoordSystem();
+    float resScale = renderer->getScale();
+
+    for (auto &it : clusterTrees)
+    {
+        int clusterID = it.first;
+        LayoutClusterTree &clusterTree = it.second;
+
+        // Swap in a finished build, catching it up on what was removed while it ran
+        if (clusterTree.build && clusterTree.build->done)
+        {
+            ClusterHierarchyRef newTree = clusterTree.build->tree;
+            clusterTree.build.reset();
+            for (LayoutObjectEntry *entry : clusterTree.removedSinceBuild)
+                newTree->removeEntry(entry);
+            clusterTree.removedSinceBuild.clear();
+
+            if (clusterTree.tree)
+                for (LayoutObjectEntry *entry : clusterTree.tree->getAllEntries())
+                    if (entry)
+                        entry->inClusterTree = false;
+            for (LayoutObjectEntry *entry : newTree->getAllEntries())
+                if (entry)
+                {
+                    entry->inClusterTree = true;
+                    // If the regular layout was showing it, the hierarchy has to turn it off
+                    if (entry->currentEnable && !entry->clusterTreeShown)
+                    {
+                        clusterTree.shown.push_back(entry);
+                        entry->clusterTreeShown = true;
+                    }
+                }
+            clusterTree.tree = newTree;
+            sortedObjectsValid = false;
+        }
+
+        // Objects closer than a cluster is big get clustered
+        ClusterGenerator::ClusterClassParams params;
+        clusterGen->paramsForClusterClass(clusterID,params);
+        double radius = std::max(params.clusterSize.x(),params.clusterSize.y()) * resScale;
+        if (clusterTree.tree && clusterTree.tree->getRadius() != radius)
+            clusterTree.dirty = true;
+
+        if (!clusterTree.dirty || clusterTree.build)
+            continue;
+
+        // Snapshot the group and build the hierarchy in the background
+        std::shared_ptr<std::vector<ClusterHierarchy::Leaf> > leaves(new std::vector<ClusterHierarchy::Leaf>());
+        for (LayoutObjectEntry *entry : layoutObjects)
+        {
+            if (entry->obj.clusterGroup != clusterID)
+                continue;
+            if (!entry->hasClusterPt)
+            {
+                entry->clusterPt = ClusterHierarchy::GeoToUnit(coordSys->localToGeographicD(coordAdapter->displayToLocal(entry->obj.worldLoc)));
+                entry->hasClusterPt = true;
+            }
+            leaves->push_back(ClusterHierarchy::Leaf(entry,entry->clusterPt));
+        }
+
+        LayoutClusterTreeBuildRef build(new LayoutClusterTreeBuild());
+        build->tree = ClusterHierarchyRef(new ClusterHierarchy(ClusterTreeMinZoom,ClusterTreeMaxZoom,radius));
+        TaskGroupRef taskGroup(new TaskGroup(TaskScheduler::getScheduler(),0.0));
+        taskGroup->addTask([build,leaves]()
+                           {
+                               build->tree->build(*leaves);
+                               build->done = true;
+                           });
+        clusterTree.build = build;
+        clusterTree.removedSinceBuild.clear();
+        clusterTree.dirty = false;
+    }
+}
+
+// Where a screen point lands in the unit mercator the cluster hierarchies use
+static bool ScreenToClusterSpace(const Point2f &screenPt,WhirlyGlobe::GlobeViewState *globeViewState,Maply::MapViewState *mapViewState,const Matrix4d &modelTrans,const Point2f &frameBufferSize,CoordSystemDisplayAdapter *coordAdapter,Point2d &unitPt)
+{
+    Point3d dispPt;
+    bool valid = false;
+    if (globeViewState != nullptr)
+        valid = globeViewState->pointOnSphereFromScreen(screenPt, &modelTrans, frameBufferSize, &dispPt);
+    else
+        valid = mapViewState->pointOnPlaneFromScreen(Point2d(screenPt.x(), screenPt.y()), modelTrans, frameBufferSize, dispPt, false);
+    if (!valid)
+        return false;
+
+    unitPt = ClusterHierarchy::GeoToUnit(coordAdapter->getCoordSystem()->localToGeographicD(coordAdapter->displayToLocal(dispPt)));
+    return true;
+}
+
+// Nearest cluster above the given node that was showing on the last pass
+static int FindShownAncestor(const ClusterHierarchy *tree,int nodeID,const std::unordered_map<int,int> &shownClusters)
+{
+    for (int parentID = tree->getNode(nodeID).parent; parentID >= 0; parentID = tree->getNode(parentID).parent)
+    {
+        auto it = shownClusters.find(parentID);
+        if (it != shownClusters.end())
+            return it->second;
+    }
+
+    return -1;
+}
+
+bool LayoutManager::layoutClusterTree(int clusterID,LayoutClusterTree &clusterTree,ViewState *viewState,WhirlyGlobe::GlobeViewState *globeViewState,Maply::MapViewState *mapViewState,const Mbr &screenMbr,const Point2f &frameBufferSize,const ClusterGenerator::ClusterClassParams &params,int clusterParamID,std::vector<ClusterEntry> &clusterEntries,std::vector<LayoutObjectEntry *> &clusterLayoutObjs)
+{
+    bool hadChanges = false;
+    ClusterHierarchy *tree = clusterTree.tree.get();
+    CoordSystemDisplayAdapter *coordAdapter = scene->getCoordAdapter();
+    CoordSystem *coordSys = coordAdapter->getCoordSystem();
+
+	Matrix4d modelTrans = viewState->fullMatrices[0];
+	Matrix4f fullMatrix4f = Matrix4dToMatrix4f(viewState->fullMatrices[0]);
+    Matrix4f fullNormalMatrix4f = Matrix4dToMatrix4f(viewState->fullNormalMatrices[0]);
+    double height = globeViewState ? globeViewState->heightAboveGlobe : mapViewState->heightAboveSurface;
+
+    // Work out the zoom level from how far a few pixels go in the middle of the screen
+    int zoom = tree->getMinZoom();
+    double unitsPerPixel = 0.0;
+    Point2f center = frameBufferSize / 2.0;
+    Point2d centerPt,offPt;
+    if (ScreenToClusterSpace(center,globeViewState,mapViewState,modelTrans,frameBufferSize,coordAdapter,centerPt) &&
+        ScreenToClusterSpace(center + Point2f(ClusterZoomSampleDist,0.0),globeViewState,mapViewState,modelTrans,frameBufferSize,coordAdapter,offPt))
+    {
+        double dx = std::abs(offPt.x() - centerPt.x());
+        if (dx > 0.5)
+            dx = 1.0 - dx;
+        double dy = offPt.y() - centerPt.y();
+        unitsPerPixel = sqrt(dx*dx + dy*dy) / ClusterZoomSampleDist;
+        if (unitsPerPixel > 0.0)
+            zoom = (int)floor(log2(1.0 / (unitsPerPixel * 256.0)));
+    }
+    zoom = std::max(tree->getMinZoom(),std::min(zoom,tree->getMaxZoom()+1));
+
+    // Bounds of what's in view.  If we can't tell, take the whole world.
+    double minX = 0.0, minY = 0.0, maxX = 1.0, maxY = 1.0;
+    Point2f spanSize = screenMbr.ur() - screenMbr.ll();
+    if (unitsPerPixel > 0.0 && std::max(spanSize.x(),spanSize.y()) * unitsPerPixel < 0.5)
+    {
+        Point2f corners[4] = {screenMbr.ll(),Point2f(screenMbr.ur().x(),screenMbr.ll().y()),screenMbr.ur(),Point2f(screenMbr.ll().x(),screenMbr.ur().y())};
+        double cMinX = MAXFLOAT, cMinY = MAXFLOAT, cMaxX = -MAXFLOAT, cMaxY = -MAXFLOAT;
+        bool valid = true;
+        for (unsigned int ii=0;ii<4 && valid;ii++)
+        {
+            Point2d cornerPt;
+            valid = ScreenToClusterSpace(corners[ii],globeViewState,mapViewState,modelTrans,frameBufferSize,coordAdapter,cornerPt);
+            cMinX = std::min(cMinX,cornerPt.x());  cMaxX = std::max(cMaxX,cornerPt.x());
+            cMinY = std::min(cMinY,cornerPt.y());  cMaxY = std::max(cMaxY,cornerPt.y());
+        }
+        // Corners on either side of the date line or a pole in view mean going the long way around
+        if (valid && cMaxX - cMinX < 0.5)
+        {
+            if (globeViewState != nullptr)
+                for (int pole=0;pole<2 && valid;pole++)
+                {
+                    Point3d poleLoc = coordAdapter->localToDisplay(coordSys->geographicToLocal(Point2d(0.0,pole == 0 ? M_PI/2.0 : -M_PI/2.0)));
+                    Point2f polePt;
+                    if (CheckPointAndNormFacing(Vector3dToVector3f(poleLoc),Vector3dToVector3f(poleLoc.normalized()),fullMatrix4f,fullNormalMatrix4f) > 0.0 &&
+                        calcScreenPt(polePt,poleLoc,viewState,screenMbr,frameBufferSize))
+                        valid = false;
+                }
+            if (valid)
+            {
+                // Take in clusters just off screen that still reach onto it
+                double pad = tree->getRadius() / (256.0 * pow(2.0,zoom));
+                minX = cMinX - pad;  minY = cMinY - pad;
+                maxX = cMaxX + pad;  maxY = cMaxY + pad;
+            }
+        }
+    }
+
+    std::vector<int> nodeIDs;
+    tree->query(zoom,minX,minY,maxX,maxY,nodeIDs);
+
+    // Clusters showing on the last pass, so new ones can animate out of them
+    std::unordered_map<int,int> oldClusters(clusterTree.shownClusters.begin(),clusterTree.shownClusters.end());
+    std::vector<std::pair<int,int> > newClusters;
+
+    std::vector<LayoutObjectEntry *> nodeEntries;
+    for (int nodeID : nodeIDs)
+    {
+        nodeEntries.clear();
+        tree->getEntries(nodeID,nodeEntries);
+        nodeEntries.erase(std::remove_if(nodeEntries.begin(),nodeEntries.end(),[](LayoutObjectEntry *entry) { return !entry->obj.enable; }),nodeEntries.end());
+        if (nodeEntries.empty())
+            continue;
+
+        // On its own, so it's laid out like anything else
+        if (nodeEntries.size() == 1)
+        {
+            LayoutObjectEntry *entry = nodeEntries[0];
+            const Point3d &worldLoc = entry->obj.worldLoc;
+            bool use = entry->obj.state.minVis == DrawVisibleInvalid || entry->obj.state.maxVis == DrawVisibleInvalid ||
+                       (entry->obj.state.minVis < height && height < entry->obj.state.maxVis);
+            if (use && globeViewState != nullptr)
+                use = CheckPointAndNormFacing(Vector3dToVector3f(worldLoc),Vector3dToVector3f(worldLoc.normalized()),fullMatrix4f,fullNormalMatrix4f) > 0.0;
+            entry->onScreen = use && calcScreenPt(entry->screenPt,worldLoc,viewState,screenMbr,frameBufferSize);
+            if (!entry->onScreen)
+                continue;
+
+            // Just came out of a cluster
+            if (!entry->currentEnable)
+                entry->currentCluster = FindShownAncestor(tree,tree->findEntry(entry),oldClusters);
+            entry->newEnable = true;
+            entry->newCluster = -1;
+            entry->clusterTreePass = layoutPass;
+            if (!entry->clusterTreeShown)
+            {
+                clusterTree.shown.push_back(entry);
+                entry->clusterTreeShown = true;
+            }
+            clusterLayoutObjs.push_back(entry);
+            passObjects.push_back(entry);
+            continue;
+        }
+
+        // A cluster goes where the hierarchy put it
+        const ClusterHierarchy::Node &node = tree->getNode(nodeID);
+        Point3d dispPt = coordAdapter->localToDisplay(coordSys->geographicToLocal(ClusterHierarchy::UnitToGeo(Point2d(node.x,node.y))));
+        if (globeViewState != nullptr &&
+            CheckPointAndNormFacing(Vector3dToVector3f(dispPt),Vector3dToVector3f(dispPt.normalized()),fullMatrix4f,fullNormalMatrix4f) <= 0.0)
+            continue;
+        Point2f screenPt;
+        if (!calcScreenPt(screenPt,dispPt,viewState,screenMbr,frameBufferSize))
+            continue;
+
+        int clusterEntryID = clusterEntries.size();
+        clusterEntries.resize(clusterEntryID+1);
+        ClusterEntry &clusterEntry = clusterEntries[clusterEntryID];
+        clusterEntry.layoutObj.worldLoc = dispPt;
+        for (auto thisObj : nodeEntries)
+            clusterEntry.objectIDs.push_back(thisObj->obj.getId());
+        clusterGen->makeLayoutObject(clusterID, nodeEntries, clusterEntry.layoutObj);
+        if (!params.selectable)
+            clusterEntry.layoutObj.selectPts.clear();
+        clusterEntry.clusterParamID = clusterParamID;
+
+        // If it split off from a cluster that was showing, it comes out of that one
+        clusterEntry.childOfCluster = oldClusters.find(nodeID) != oldClusters.end() ? -1 : FindShownAncestor(tree,nodeID,oldClusters);
+        newClusters.push_back(std::make_pair(nodeID,clusterEntryID));
+    }
+
+    // Anything that was on its own and isn't now gets turned off
+    unsigned int numShown = 0;
+    for (LayoutObjectEntry *entry : clusterTree.shown)
+    {
+        if (entry->clusterTreePass == layoutPass)
+        {
+            clusterTree.shown[numShown++] = entry;
+            continue;
+        }
+
+        entry->clusterTreeShown = false;
+        entry->onScreen = false;
+        entry->newEnable = false;
+        entry->newCluster = -1;
+        forgetPlacement(entry);
+        passObjects.push_back(entry);
+        if (entry->currentEnable)
+            hadChanges = true;
+    }
+    clusterTree.shown.resize(numShown);
+
+    // A different set of clusters means new drawables
+    if (newClusters.size() != clusterTree.shownClusters.size())
+        hadChanges = true;
+    else
+        for (unsigned int ii=0;ii<newClusters.size() && !hadChanges;ii++)
+            if (newClusters[ii].first != clusterTree.shownClusters[ii].first)
+                hadChanges = true;
+    clusterTree.shownClusters.swap(newClusters);
+
+    return hadChanges;
+}
+
 bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntry> &clusterEntries, std::vector<ClusterGenerator::ClusterClassParams> &clusterParams)
 {
+    passObjects.clear();
     if (layoutObjects.empty())
         return false;
+    layoutPass++;
     
     bool hadChanges = false;
     
     ClusteredObjectsSet clusterObjs;
-	LayoutSortingSet layoutObjs;
+	std::vector<LayoutObjectEntry *> layoutObjs;
 
 	// The globe has some special requirements
 
@@ -366,87 +1167,204 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
     Matrix4f fullNormalMatrix4f = Matrix4dToMatrix4f(viewState->fullNormalMatrices[0]);
     Matrix4d normalMat = viewState->fullMatrices[0].inverse().transpose();
 
-    // Turn everything off and sort by importance
-    for (LayoutEntrySet::iterator it = layoutObjects.begin();
-         it != layoutObjects.end(); ++it)
+	// Extents for the layout helpers
+	Point2f frameBufferSize;
+	frameBufferSize.x() = renderer->framebufferWidth;
+	frameBufferSize.y() = renderer->framebufferHeight;
+	Mbr screenMbr(Point2f(-ScreenBuffer * frameBufferSize.x(),-ScreenBuffer * frameBufferSize.y()),frameBufferSize * (1.0 + ScreenBuffer));
+
+    // Cluster hierarchies that finished building change who's in them
+    if (clusterGen && hierarchicalClustering)
+        updateClusterTrees();
+
+    // The importance order only changes when objects come or go
+    if (!sortedObjectsValid)
     {
-		LayoutObjectEntry *layoutObj = *it;
-        if (layoutObj->obj.enable)
+        // Objects in a cluster hierarchy are looked up there instead
+        std::vector<LayoutObjectEntry *> entries;
+        entries.reserve(layoutObjects.size());
+        for (LayoutObjectEntry *entry : layoutObjects)
+            if (!entry->inClusterTree)
+                entries.push_back(entry);
+        std::sort(entries.begin(),entries.end(),LayoutEntrySorter());
+        sortedObjects.resize(entries.size());
+        for (unsigned int ii=0;ii<entries.size();ii++)
         {
-            LayoutObjectEntry *obj = *it;
-            bool use = false;
-            if (globeViewState != nullptr)
+            LayoutObjectEntry *entry = entries[ii];
+            LayoutCullEntry &cull = sortedObjects[ii];
+            cull.entry = entry;
+            cull.worldLoc = entry->obj.worldLoc;
+            cull.minVis = entry->obj.state.minVis;
+            cull.maxVis = entry->obj.state.maxVis;
+            cull.clusterGroup = entry->obj.clusterGroup;
+            cull.enable = entry->obj.enable;
+            cull.idle = false;
+            cull.offScreenUntil = -1.0;
+        }
+        sortedObjectsValid = true;
+    }
+
+    // Work out what's in range, facing us and on screen.
+    // Each object stands on its own here, so this part is spread over the task scheduler.
+    double height = globeViewState ? globeViewState->heightAboveGlobe : mapViewState->heightAboveSurface;
+    // The view state sets up the frustum the first time it projects something, so get that out of the way
+    if (viewState->ll.x() == viewState->ur.x())
+        viewState->calcFrustumWidth(frameBufferSize.x(),frameBufferSize.y());
+    // In incremental mode anything that was well off the screen stays off until the screen edges have moved
+    //  far enough to reach it, so we only have to project the ones that are close
+    bool cullCoherent = false;
+    if (incrementalLayout)
+    {
+        CullPlaneVector newCullPlanes;
+        CalcCullPlanes(viewState,screenMbr,frameBufferSize,newCullPlanes);
+        if (!newCullPlanes.empty() && newCullPlanes.size() == cullPlanes.size())
+        {
+            double step = 0.0;
+            for (unsigned int pi=0;pi<cullPlanes.size();pi++)
+                step = std::max(step,(newCullPlanes[pi] - cullPlanes[pi]).norm());
+            cullDrift += step;
+            cullCoherent = true;
+        } else {
+            cullDrift = 0.0;
+            for (LayoutCullEntry &cull : sortedObjects)
+                cull.offScreenUntil = -1.0;
+        }
+        cullPlanes.swap(newCullPlanes);
+    } else
+        cullPlanes.clear();
+    TaskScheduler::getScheduler()->parallelFor((unsigned int)sortedObjects.size(),CullChunkSize,
+        [&](unsigned int start,unsigned int end)
+        {
+            for (unsigned int ii=start;ii<end;ii++)
             {
-                if (obj->obj.state.minVis == DrawVisibleInvalid || obj->obj.state.maxVis == DrawVisibleInvalid ||
-                    (obj->obj.state.minVis < globeViewState->heightAboveGlobe && globeViewState->heightAboveGlobe < obj->obj.state.maxVis))
-                    use = true;
-			} else {
-				if (obj->obj.state.minVis == DrawVisibleInvalid || obj->obj.state.maxVis == DrawVisibleInvalid ||
-					(obj->obj.state.minVis < mapViewState->heightAboveSurface && mapViewState->heightAboveSurface < obj->obj.state.maxVis))
-					use = true;
-			}
-			if (use) {
-				// Make sure this one isn't behind the globe
-				if (globeViewState != nullptr)
-				{
-					// Make sure this one is facing toward the viewer
-					use = CheckPointAndNormFacing(Vector3dToVector3f(layoutObj->obj.worldLoc),Vector3dToVector3f(layoutObj->obj.worldLoc.normalized()),fullMatrix4f,fullNormalMatrix4f) > 0.0;
-				}
+                LayoutCullEntry &cull = sortedObjects[ii];
+                cull.use = false;
+                cull.onScreen = false;
+                if (!cull.enable)
+                    continue;
+
+                if (cull.minVis == DrawVisibleInvalid || cull.maxVis == DrawVisibleInvalid ||
+                    (cull.minVis < height && height < cull.maxVis))
+                    cull.use = true;
+                // Make sure this one is facing toward the viewer
+                if (cull.use && globeViewState != nullptr)
+                    cull.use = CheckPointAndNormFacing(Vector3dToVector3f(cull.worldLoc),Vector3dToVector3f(cull.worldLoc.normalized()),fullMatrix4f,fullNormalMatrix4f) > 0.0;
+                if (!cull.use || (cullCoherent && cull.offScreenUntil > cullDrift))
+                    continue;
+                cull.onScreen = calcScreenPt(cull.screenPt,cull.worldLoc,viewState,screenMbr,frameBufferSize);
+                // Leave a little room for rounding
+                if (incrementalLayout)
+                    cull.offScreenUntil = cull.onScreen ? -1.0 : cullDrift + 0.99 * CalcOffScreenSlack(cullPlanes,cull.worldLoc);
+            }
+        });
 
-				if (use)
-				{
-					obj->newCluster = -1;
-					if (obj->obj.clusterGroup > -1)
-					{
-						// Put the entry in the right cluster
-						ClusteredObjects findClusterObj(obj->obj.clusterGroup);
-						ClusteredObjects *thisClusterObj = NULL;
-						auto cit = clusterObjs.find(&findClusterObj);
-						if (cit == clusterObjs.end())
-						{
-							// Create a new cluster object
-							thisClusterObj = new ClusteredObjects(obj->obj.clusterGroup);
-							clusterObjs.insert(thisClusterObj);
+    // Turn everything off and pick out the ones to lay out, most important first
+    for (LayoutCullEntry &cull : sortedObjects)
+    {
+        LayoutObjectEntry *obj = cull.entry;
+        if (!cull.enable)
+        {
+            if (!cull.idle)
+            {
+                forgetPlacement(obj);
+                passObjects.push_back(obj);
+            }
+            cull.idle = true;
+            continue;
+        }
 
-							hadChanges = true;
-						} else
-							thisClusterObj = *cit;
+        bool use = cull.use;
 
-						thisClusterObj->layoutObjects.insert(layoutObj);
+        bool clustered = cull.clusterGroup > -1;
+        if (clustered && clusterGen && hierarchicalClustering)
+        {
+            LayoutClusterTree *clusterTree = findClusterTree(cull.clusterGroup);
+            if (!clusterTree)
+            {
+                // The first build starts on the next pass
+                clusterTrees[cull.clusterGroup];
+            } else if (clusterTree->tree)
+            {
+                // Came in after the last build, so it's on its own until the next one
+                clustered = false;
+            }
+        }
 
-						obj->newEnable = false;
-						obj->newCluster = -1;
-					} else {
-						// Not a cluster
-						layoutObjs.insert(layoutObj);
-					}
-				} else {
-					obj->newEnable = false;
-					obj->newCluster = -1;
-				}
-			} else {
-				obj->newEnable = false;
-				obj->newCluster = -1;
-			}
+        // Something that was already off and is staying off has nothing to update.
+        // With lots of objects, that's most of them.
+        bool staysOff = !use || (!clustered && !cull.onScreen);
+        if (staysOff && cull.idle)
+            continue;
+        cull.idle = staysOff;
+        passObjects.push_back(obj);
+        obj->onScreen = cull.onScreen;
+        obj->screenPt = cull.screenPt;
+
+        if (use)
+        {
+            obj->newCluster = -1;
+            if (clustered)
+            {
+                // Put the entry in the right cluster
+                ClusteredObjects findClusterObj(cull.clusterGroup);
+                ClusteredObjects *thisClusterObj = NULL;
+                auto cit = clusterObjs.find(&findClusterObj);
+                if (cit == clusterObjs.end())
+                {
+                    // Create a new cluster object
+                    thisClusterObj = new ClusteredObjects(cull.clusterGroup);
+                    clusterObjs.insert(thisClusterObj);
+
+                    hadChanges = true;
+                } else
+                    thisClusterObj = *cit;
 
-			// Note: Update this for clusters
-            if ((use && !obj->currentEnable) || (!use && obj->currentEnable))
+                thisClusterObj->layoutObjects.insert(obj);
+
+                obj->newEnable = false;
+                obj->newCluster = -1;
+            } else {
+                // Not a cluster
+                layoutObjs.push_back(obj);
+            }
+        } else {
+            obj->newEnable = false;
+            obj->newCluster = -1;
+
+            // The ones we lay out are checked for changes below
+            forgetPlacement(obj);
+            if (obj->currentEnable)
                 hadChanges = true;
         }
     }
 
-	// Extents for the layout helpers
-	Point2f frameBufferSize;
-	frameBufferSize.x() = renderer->framebufferWidth;
-	frameBufferSize.y() = renderer->framebufferHeight;
-	Mbr screenMbr(Point2f(-ScreenBuffer * frameBufferSize.x(),-ScreenBuffer * frameBufferSize.y()),frameBufferSize * (1.0 + ScreenBuffer));
-
     // Need to scale for retina displays
     float resScale = renderer->getScale();
 
+    // Anything that changes where everything lands means starting over
+    bool fullLayout = !incrementalLayout || forceFullLayout ||
+                frameBufferSize != lastFrameBufferSize || resScale != lastResScale;
+    forceFullLayout = false;
+    lastFrameBufferSize = frameBufferSize;
+    lastResScale = resScale;
+
 	if (clusterGen)
 	{
 		clusterGen->startLayoutObjects();
+		std::vector<LayoutObjectEntry *> clusterLayoutObjs;
+
+		// Groups with a cluster hierarchy just look up what's in view
+		if (hierarchicalClustering)
+			for (auto &it : clusterTrees)
+			{
+				if (!it.second.tree)
+					continue;
+				clusterParams.resize(clusterParams.size()+1);
+				ClusterGenerator::ClusterClassParams &params = clusterParams.back();
+				clusterGen->paramsForClusterClass(it.first,params);
+
+				hadChanges |= layoutClusterTree(it.first,it.second,viewState,globeViewState,mapViewState,screenMbr,frameBufferSize,params,(int)clusterParams.size()-1,clusterEntries,clusterLayoutObjs);
+			}
 
 		// Lay out the clusters in order
 		for (ClusteredObjectsSet::iterator it = clusterObjs.begin(); it != clusterObjs.end(); ++it)
@@ -465,10 +1383,12 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
 
 				// Project the point and figure out the rotation
 				bool isActive = true;
-				Point2f objPt;
-				bool isInside = calcScreenPt(objPt,entry,viewState,screenMbr,frameBufferSize);
+				Point2f objPt = entry->screenPt;
+				bool isInside = entry->onScreen;
 
 				isActive &= isInside;
+				if (!isActive)
+					forgetPlacement(entry);
 
 				if (isActive)
 				{
@@ -505,10 +1425,11 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
 			{
 				if (obj.parentObject < 0)
 				{
-					layoutObjs.insert(obj.objEntry);
+					clusterLayoutObjs.push_back(obj.objEntry);
 					obj.objEntry->newEnable = true;
 					obj.objEntry->newCluster = -1;
-				}
+				} else
+					forgetPlacement(obj.objEntry);
 			}
 
 			// Create new objects for the clusters
@@ -574,20 +1495,57 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
 		clusterObjs.clear();
 
 		clusterGen->endLayoutObjects();
+
+		// Merge the objects that didn't end up in clusters into the importance order
+		if (!clusterLayoutObjs.empty())
+		{
+			size_t numSorted = layoutObjs.size();
+			std::sort(clusterLayoutObjs.begin(),clusterLayoutObjs.end(),LayoutEntrySorter());
+			layoutObjs.insert(layoutObjs.end(),clusterLayoutObjs.begin(),clusterLayoutObjs.end());
+			std::inplace_merge(layoutObjs.begin(),layoutObjs.begin()+numSorted,layoutObjs.end(),LayoutEntrySorter());
+		}
 	}
 
 	// Set up the overlap sampler
-	OverlapHelper overlapMan(screenMbr,OverlapSampleX,OverlapSampleY);
+	OverlapHelper &overlapMan = placedOverlap;
+	overlapMan.reset(screenMbr);
+
+	// How the view moved since the last pass.  Objects moving along with it keep their neighbours.
+	LayoutViewMotion viewMotion;
+	if (!fullLayout)
+		viewMotion.fit(layoutObjs);
+
+	// Footprints of objects that were showing on the last pass and aren't now (or moved).
+	// Hidden objects that haven't moved only get another try if they touch one of these.
+	OverlapHelper &vacatedMan = vacatedOverlap;
+	vacatedMan.reset(screenMbr);
+	int numVacated = 0;
+	Point2dVector objPts(4),footPts(4);
+	if (!fullLayout)
+		for (const Mbr &mbr : vacatedMbrs)
+		{
+			MbrToPts(viewMotion.apply(mbr),footPts);
+			vacatedMan.insertObject(footPts);
+			numVacated++;
+		}
+	vacatedMbrs.clear();
+
+	// Objects that can only land in one part of the screen don't affect the other parts,
+	//  so those can be laid out in parallel
+	bool binned = parallelLayout && !incrementalLayout && maxDisplayObjects == 0 && layoutObjs.size() >= MinParallelLayoutObjects;
+	if (binned)
+		placeObjectsInBins(layoutObjs,viewState,globeViewState,screenMbr,frameBufferSize,resScale);
 
 	// Lay out the various objects that are active
 	int numSoFar = 0;
-	for (LayoutSortingSet::iterator it = layoutObjs.begin();
-		 it != layoutObjs.end(); ++it)
+	for (unsigned int oi=0;oi<layoutObjs.size();oi++)
 	{
-		LayoutObjectEntry *layoutObj = *it;
+		LayoutObjectEntry *layoutObj = layoutObjs[oi];
 		bool isActive;
+		int placedOrient = -1;
 		Point2d objOffset(0.0,0.0);
-		Point2dVector objPts(4);
+		// How far it moved against the view since the last pass
+		double moved = 0.0;
 
 		// Start with a max objects check
 		isActive = true;
@@ -597,10 +1555,21 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
 		// Figure out the rotation situation
 		float screenRot = 0.0;
 		Matrix2d screenRotMat;
-		if (isActive)
+		if (binned)
+		{
+			// Already done
+			const LayoutPlacement &placement = placements[oi];
+			isActive = placement.isActive;
+			placedOrient = placement.placedOrient;
+			if (placedOrient >= 0)
+			{
+				objOffset = placement.objOffset;
+				objPts = placement.objPts;
+			}
+		} else if (isActive)
 		{
-			Point2f objPt;
-			bool isInside = calcScreenPt(objPt,layoutObj,viewState,screenMbr,frameBufferSize);
+			Point2f objPt = layoutObj->screenPt;
+			bool isInside = layoutObj->onScreen;
 
 			isActive &= isInside;
 
@@ -614,93 +1583,122 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
                 // Try the four different orientations
                 if (!layoutObj->obj.layoutPts.empty())
                 {
+                    Point2f layoutSpan;
+                    Point2d layoutOrg;
+                    CalcLayoutExtents(layoutObj->obj.layoutPts,layoutSpan,layoutOrg);
+
                     bool validOrient = false;
-                    for (unsigned int orient=0;orient<6;orient++)
+                    bool tryAll = true;
+                    int triedOrient = -1;
+                    if (!fullLayout && layoutObj->hasLayoutPt)
                     {
-                        // May only want to be placed certain ways.  Fair enough.
-                        if (!(layoutObj->obj.acceptablePlacement & (1<<orient)))
-                            continue;
-                        const Point2dVector &layoutPts = layoutObj->obj.layoutPts;
-                        Mbr layoutMbr;
-                        for (unsigned int li=0;li<layoutPts.size();li++)
-                            layoutMbr.addPoint(layoutPts[li]);
-                        Point2f layoutSpan(layoutMbr.ur().x()-layoutMbr.ll().x(),layoutMbr.ur().y()-layoutMbr.ll().y());
-						Point2d layoutOrg(layoutMbr.ll().x(),layoutMbr.ll().y());
-
-                        // Set up the offset for this orientation
-                        // Note: This is all wrong for markers now
-                        switch (orient)
+                        // Every way it could be placed is within this far of where it lands
+                        Point2d reach((std::abs(layoutOrg.x()) + layoutSpan.x())*resScale,(std::abs(layoutOrg.y()) + 2*layoutSpan.y())*resScale);
+                        if (screenRot != 0.0)
+                            reach = Point2d(reach.norm(),reach.norm());
+                        reach += Point2d(incrementalMoveThreshold,incrementalMoveThreshold);
+                        // Neighbours it could run into are within twice that
+                        moved = (objPt.cast<double>() - viewMotion.apply(layoutObj->lastScreenPt.cast<double>())).norm();
+                        layoutObj->layoutDrift += moved + viewMotion.spread(2*reach.norm());
+
+                        if (layoutObj->placedOrient >= 0)
                         {
-                            // Don't move at all
-                            case 0:
-                                objOffset = Point2d(0,0);
-                                break;
-							// Center
-							case 1:
-								objOffset = Point2d(-layoutSpan.x()/2.0,layoutSpan.y()/2.0);
-								break;
-							// Right
-                            case 2:
-								objOffset = Point2d(0.0,layoutSpan.y()/2.0);
-								break;
-							// Left
-                            case 3:
-								objOffset = Point2d(-(layoutSpan.x()),layoutSpan.y()/2.0);
-                                break;
-							// Above
-                            case 4:
-								objOffset = Point2d(-layoutSpan.x()/2.0,0);
-								break;
-                                // Below
-                            case 5:
-								objOffset = Point2d(-layoutSpan.x()/2.0,layoutSpan.y());
-								break;
+                            // It was showing, so see if it still fits the same way
+                            triedOrient = layoutObj->placedOrient;
+                            CalcOrientPts(triedOrient,objPt,layoutSpan,layoutOrg,screenRot,screenRotMat,resScale,objOffset,objPts);
+                            if (overlapMan.addObject(objPts))
+                            {
+                                validOrient = true;
+                                placedOrient = triedOrient;
+                            }
+                        } else if (layoutObj->layoutDrift <= incrementalMoveThreshold)
+                        {
+                            // It didn't fit last time and it hasn't moved against its neighbours.
+                            // Only worth another try if something it could land on went away.
+                            tryAll = false;
+                            if (numVacated > 0)
+                            {
+                                MbrToPts(Mbr(Point2f(objPt.x()-reach.x(),objPt.y()-reach.y()),Point2f(objPt.x()+reach.x(),objPt.y()+reach.y())),footPts);
+                                tryAll = !vacatedMan.checkObject(footPts);
+                            }
                         }
+                    }
 
-                        // Rotate the rectangle
-                        if (screenRot == 0.0)
+                    // It was hidden last time, so it's likely still buried.  If something's already
+                    //  sitting on the spot every orientation covers, none of them will fit.
+                    if (!fullLayout && tryAll && !validOrient && layoutObj->hasLayoutPt && layoutObj->placedOrient < 0 && screenRot == 0.0)
+                    {
+                        Mbr shared = CalcSharedPlacement(layoutObj->obj.acceptablePlacement,objPt,layoutSpan,layoutOrg,resScale,footPts);
+                        if (shared.valid())
                         {
-                            objPts[0] = Point2d(objPt.x(),objPt.y()) + (objOffset + layoutOrg)*resScale;
-                            objPts[1] = objPts[0] + Point2d(layoutSpan.x()*resScale,0.0);
-                            objPts[2] = objPts[0] + Point2d(layoutSpan.x()*resScale,layoutSpan.y()*resScale);
-                            objPts[3] = objPts[0] + Point2d(0.0,layoutSpan.y()*resScale);
-                        } else {
-                            Point2d center(objPt.x(),objPt.y());
-                            objPts[0] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg;
-                            objPts[1] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(layoutSpan.x(),0.0);
-                            objPts[2] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(layoutSpan.x(),layoutSpan.y());
-                            objPts[3] = Point2d(objOffset.x(),-objOffset.y()) + layoutOrg + Point2d(0.0,layoutSpan.y());
-                            for (unsigned int oi=0;oi<4;oi++)
+                            MbrToPts(shared,footPts);
+                            if (!overlapMan.checkObject(footPts))
                             {
-                                Point2d &thisObjPt = objPts[oi];
-                                Point2d offPt = screenRotMat * Point2d(thisObjPt.x()*resScale,thisObjPt.y()*resScale);
-                                thisObjPt = Point2d(offPt.x(),-offPt.y()) + center;
+                                tryAll = false;
+                                layoutObj->layoutDrift = 0.0;
                             }
                         }
-                        
-                        // Now try it
-                        if (overlapMan.addObject(objPts))
+                    }
+
+                    if (tryAll && !validOrient)
+                    {
+                        for (int orient=0;orient<6;orient++)
                         {
-                            validOrient = true;
-                            break;
+                            // May only want to be placed certain ways.  Fair enough.
+                            if (!(layoutObj->obj.acceptablePlacement & (1<<orient)))
+                                continue;
+                            // Already tried the way it was
+                            if (orient == triedOrient)
+                                continue;
+
+                            CalcOrientPts(orient,objPt,layoutSpan,layoutOrg,screenRot,screenRotMat,resScale,objOffset,objPts);
+
+                            // Now try it
+                            if (overlapMan.addObject(objPts))
+                            {
+                                validOrient = true;
+                                placedOrient = orient;
+                                break;
+                            }
                         }
+                        layoutObj->layoutDrift = 0.0;
                     }
-                    
+                    layoutObj->hasLayoutPt = true;
+                    layoutObj->lastScreenPt = objPt;
+
                     isActive = validOrient;
                 }
-            }
+            } else
+                layoutObj->hasLayoutPt = false;
 
 //            NSLog(@" Valid (%s): %@, pos = (%f,%f), size = (%f, %f), offset = (%f,%f)",(isActive ? "yes" : "no"),layoutObj->obj.hint,objPt.x,objPt.y,layoutObj->obj.size.x(),layoutObj->obj.size.y(),
 //                  layoutObj->offset.x(),layoutObj->offset.y());
-        }
-        
+        } else
+            layoutObj->hasLayoutPt = false;
+
         if (isActive)
             numSoFar++;
-        
+
+        // If it's not where it was, the space it had is open to the less important objects after it
+        if (!fullLayout && layoutObj->placedOrient >= 0 &&
+            (placedOrient != layoutObj->placedOrient || moved > incrementalMoveThreshold))
+        {
+            Mbr placedMbr;
+            placedMbr.addPoints(layoutObj->placedPts);
+            MbrToPts(viewMotion.apply(placedMbr),footPts);
+            vacatedMan.insertObject(footPts);
+            numVacated++;
+        }
+        layoutObj->placedOrient = placedOrient;
+        if (placedOrient >= 0)
+            layoutObj->placedPts = objPts;
+        else
+            layoutObj->placedPts.clear();
+
         // See if we've changed any of the state
         layoutObj->changed = (layoutObj->currentEnable != isActive);
-        if (!layoutObj->changed && (layoutObj->newEnable ||
-            (layoutObj->offset.x() != objOffset.x() || layoutObj->offset.y() != -objOffset.y())))
+        if (!layoutObj->changed && isActive &&
+            (layoutObj->offset.x() != objOffset.x() || layoutObj->offset.y() != -objOffset.y()))
         {
             layoutObj->changed = true;
         }
@@ -709,7 +1707,7 @@ bool LayoutManager::runLayoutRules(ViewState *viewState, std::vector<ClusterEntr
 		layoutObj->newCluster = -1;
         layoutObj->offset = Point2d(objOffset.x(),-objOffset.y());
     }
-    
+
 //    NSLog(@"----Finished layout----");
     
     return hadChanges;
@@ -721,10 +1719,15 @@ static float const DisappearFade = 0.1;
 // Layout all the objects we're tracking
 void LayoutManager::updateLayout(WhirlyKit::ViewState *viewState,ChangeSet &changes)
 {
+    FrameProfilerScope profileScope(scene->getProfiler(),"Layout");
+    
     CoordSystemDisplayAdapter *coordAdapter = scene->getCoordAdapter();
     
     pthread_mutex_lock(&layoutLock);
 
+    // Whatever came in since last time.  Anything arriving from here on waits for the next pass.
+    bool hadUpdates = applyPendingChanges();
+
     TimeInterval curTime = TimeGetCurrent();
 
 	std::vector<ClusterEntry> oldClusters = clusters;
@@ -740,20 +1743,18 @@ void LayoutManager::updateLayout(WhirlyKit::ViewState *viewState,ChangeSet &chan
 	if (!layoutChanges && clusters.size() != oldClusters.size())
 		layoutChanges = true;
 
-	if (hasUpdates || layoutChanges)
+	if (hadUpdates || layoutChanges)
     {
         // Get rid of the last set of drawables
         for (SimpleIDSet::iterator it = drawIDs.begin(); it != drawIDs.end(); ++it)
             changes.push_back(new RemDrawableReq(*it));
         drawIDs.clear();
 
-        // Generate the drawables
+        // Generate the drawables.
+        // Objects the layout pass skipped were off and stayed off, so there's nothing to do for them.
         ScreenSpaceBuilder ssBuild(coordAdapter,renderer->getScale());
-        for (LayoutEntrySet::iterator it = layoutObjects.begin();
-             it != layoutObjects.end(); ++it)
+        for (LayoutObjectEntry *layoutObj : passObjects)
         {
-            LayoutObjectEntry *layoutObj = *it;
-
             layoutObj->obj.offset = Point2d(layoutObj->offset.x(),layoutObj->offset.y());
             if (!layoutObj->currentEnable)
             {
@@ -812,47 +1813,53 @@ void LayoutManager::updateLayout(WhirlyKit::ViewState *viewState,ChangeSet &chan
 			layoutObj->currentCluster = layoutObj->newCluster;
 
             layoutObj->changed = false;
+        }
 
-			// Add in the clusters
-			for (auto &cluster : clusters)
-			{
-				// Animate from the old cluster if there is one
-				if (cluster.childOfCluster > -1)
-				{
-					ClusterEntry *oldCluster = NULL;
-					if (cluster.childOfCluster < oldClusters.size()) {
-						oldCluster = &oldClusters[cluster.childOfCluster];
-					} else {
-						//NSLog(@"Cluster ID mismatch");
-						continue;
-					}
-					ClusterGenerator::ClusterClassParams &params = oldClusterParams[oldCluster->clusterParamID];
-
-					// Animate from the old cluster to the new one
-					ScreenSpaceObject animObj = cluster.layoutObj;
-					animObj.setMovingLoc(animObj.worldLoc, curTime, curTime+params.markerAnimationTime);
-					animObj.worldLoc = oldCluster->layoutObj.worldLoc;
-					animObj.setEnableTime(curTime, curTime+params.markerAnimationTime);
-					animObj.state.progID = params.motionShaderID;
-					for (auto &geom : animObj.geometry)
-						geom.progID = params.motionShaderID;
-					ssBuild.addScreenObject(animObj);
-
-					// Hold off on adding the new one
-					ScreenSpaceObject shortObj = cluster.layoutObj;
-					shortObj.setEnableTime(curTime+params.markerAnimationTime, curTime+1e10);
-					ssBuild.addScreenObject(shortObj);
+        // Only these can be selected until the next time through here
+        shownObjects.clear();
+        for (LayoutObjectEntry *layoutObj : passObjects)
+        {
+            if (layoutObj->currentEnable)
+                shownObjects.push_back(layoutObj);
+        }
 
+		// Add in the clusters
+		for (auto &cluster : clusters)
+		{
+			// Animate from the old cluster if there is one
+			if (cluster.childOfCluster > -1)
+			{
+				ClusterEntry *oldCluster = NULL;
+				if (cluster.childOfCluster < oldClusters.size()) {
+					oldCluster = &oldClusters[cluster.childOfCluster];
 				} else {
-					ssBuild.addScreenObject(cluster.layoutObj);
+					//NSLog(@"Cluster ID mismatch");
+					continue;
 				}
+				ClusterGenerator::ClusterClassParams &params = oldClusterParams[oldCluster->clusterParamID];
+
+				// Animate from the old cluster to the new one
+				ScreenSpaceObject animObj = cluster.layoutObj;
+				animObj.setMovingLoc(animObj.worldLoc, curTime, curTime+params.markerAnimationTime);
+				animObj.worldLoc = oldCluster->layoutObj.worldLoc;
+				animObj.setEnableTime(curTime, curTime+params.markerAnimationTime);
+				animObj.state.progID = params.motionShaderID;
+				for (auto &geom : animObj.geometry)
+					geom.progID = params.motionShaderID;
+				ssBuild.addScreenObject(animObj);
+
+				// Hold off on adding the new one
+				ScreenSpaceObject shortObj = cluster.layoutObj;
+				shortObj.setEnableTime(curTime+params.markerAnimationTime, curTime+1e10);
+				ssBuild.addScreenObject(shortObj);
+
+			} else {
+				ssBuild.addScreenObject(cluster.layoutObj);
 			}
 		}
         ssBuild.flushChanges(changes, drawIDs);
     }
 
-    hasUpdates = false;
-
     pthread_mutex_unlock(&layoutLock);
 }
 
@@ -198,7 +198,7 @@ void TileBuilder::clearAtlases(ChangeSet &theChangeRequests)
 }
 
 // Helper routine for constructing the skirt around a tile
-void TileBuilder::buildSkirt(BasicDrawable *draw,Point3dVector &pts,std::vector<TexCoord> &texCoords,float skirtFactor,bool haveElev,const Point3d &theCenter)
+void TileBuilder::buildSkirt(BasicDrawable *draw,const ScratchVector<Point3d> &pts,const ScratchVector<TexCoord> &texCoords,float skirtFactor,bool haveElev,const Point3d &theCenter)
 {
     for (unsigned int ii=0;ii<pts.size()-1;ii++)
     {
@@ -336,12 +336,15 @@ void TileBuilder::generateDrawables(ElevationDrawInfo *drawInfo,BasicDrawable **
             }
     } else {
         chunk->setType(GL_TRIANGLES);
+        // Temporary geometry goes in this thread's scratch arena and is all thrown out at the end
+        ScratchArena &arena = ScratchArena::getThreadArena();
+        ScratchArena::Scope scratchScope(arena);
         // Generate point, texture coords, and normals
-        Point3dVector locs((sphereTessX+1)*(sphereTessY+1));
-        std::vector<float> elevs;
+        ScratchVector<Point3d> locs((sphereTessX+1)*(sphereTessY+1),Point3d(0,0,0),&arena);
+        ScratchVector<float> elevs(&arena);
         if (includeElev || useElevAsZ)
             elevs.resize((sphereTessX+1)*(sphereTessY+1));
-        std::vector<TexCoord> texCoords((sphereTessX+1)*(sphereTessY+1));
+        ScratchVector<TexCoord> texCoords((sphereTessX+1)*(sphereTessY+1),TexCoord(0,0),&arena);
         for (unsigned int iy=0;iy<sphereTessY+1;iy++)
         {
             for (unsigned int ix=0;ix<sphereTessX+1;ix++)
@@ -429,8 +432,10 @@ void TileBuilder::generateDrawables(ElevationDrawInfo *drawInfo,BasicDrawable **
             float skirtFactor = 1.0 - 0.2 / (1<<drawInfo->ident.level);
             
             // Bottom skirt
-            Point3dVector skirtLocs;
-            std::vector<TexCoord> skirtTexCoords;
+            ScratchVector<Point3d> skirtLocs(&arena);
+            ScratchVector<TexCoord> skirtTexCoords(&arena);
+            skirtLocs.reserve(std::max(sphereTessX,sphereTessY)+1);
+            skirtTexCoords.reserve(std::max(sphereTessX,sphereTessY)+1);
             for (unsigned int ix=0;ix<=sphereTessX;ix++)
             {
                 skirtLocs.push_back(locs[ix]);
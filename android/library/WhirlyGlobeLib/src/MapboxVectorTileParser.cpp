@@ -18,9 +18,10 @@
  *
  */
 
+#import <cstring>
+#import <map>
 #import "MapboxVectorTileParser.h"
 #import "VectorObject.h"
-#import "vector_tile.pb.h"
 
 static double MAX_EXTENT = 20037508.342789244;
 
@@ -29,6 +30,456 @@ using namespace Eigen;
 namespace WhirlyKit
 {
 
+/** Minimal protocol buffer wire format reader.
+    This walks the encoded bytes in place rather than building a message tree.
+    Malformed input sets the error flag and stops the reader.
+  */
+class PBFReader
+{
+public:
+    typedef enum {WireVarint=0,WireFixed64=1,WireLengthDelim=2,WireFixed32=5} WireType;
+    
+    PBFReader() : ptr(NULL), end(NULL), fieldNum(0), wireType(0), error(false) { }
+    PBFReader(const unsigned char *data,size_t len) : ptr(data), end(data+len), fieldNum(0), wireType(0), error(false) { }
+    
+    /// Move on to the next field.  Returns false at the end or on an error.
+    bool next()
+    {
+        if (error || ptr >= end)
+            return false;
+        uint64_t key = varint();
+        fieldNum = (uint32_t)(key >> 3);
+        wireType = (int)(key & 0x7);
+        return !error;
+    }
+    
+    /// Field number of the current field
+    uint32_t field() const { return fieldNum; }
+    /// Wire type of the current field
+    int type() const { return wireType; }
+    /// True if we ran into malformed data
+    bool hasError() const { return error; }
+    /// True if there's nothing left to read
+    bool done() const { return error || ptr >= end; }
+    
+    uint64_t varint()
+    {
+        uint64_t val = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (ptr >= end)
+                break;
+            unsigned char byte = *ptr++;
+            val |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return val;
+        }
+        error = true;
+        return 0;
+    }
+    
+    int64_t svarint()
+    {
+        uint64_t val = varint();
+        return (int64_t)((val >> 1) ^ (~(val & 1) + 1));
+    }
+    
+    uint32_t fixed32()
+    {
+        uint32_t val = 0;
+        if (end - ptr < 4)
+        {
+            error = true;
+            return 0;
+        }
+        memcpy(&val,ptr,4);
+        ptr += 4;
+        return val;
+    }
+    
+    uint64_t fixed64()
+    {
+        uint64_t val = 0;
+        if (end - ptr < 8)
+        {
+            error = true;
+            return 0;
+        }
+        memcpy(&val,ptr,8);
+        ptr += 8;
+        return val;
+    }
+    
+    float float32()
+    {
+        uint32_t bits = fixed32();
+        float val;
+        memcpy(&val,&bits,4);
+        return val;
+    }
+    
+    double float64()
+    {
+        uint64_t bits = fixed64();
+        double val;
+        memcpy(&val,&bits,8);
+        return val;
+    }
+    
+    /// Return the length delimited data for the current field and skip over it
+    bool bytes(const unsigned char *&data,size_t &len)
+    {
+        uint64_t size = varint();
+        if (error || size > (uint64_t)(end - ptr))
+        {
+            error = true;
+            return false;
+        }
+        data = ptr;
+        len = (size_t)size;
+        ptr += len;
+        return true;
+    }
+    
+    /// Reader for an embedded message
+    PBFReader message()
+    {
+        const unsigned char *data = NULL;
+        size_t len = 0;
+        if (!bytes(data,len))
+            return PBFReader();
+        return PBFReader(data,len);
+    }
+    
+    std::string string()
+    {
+        const unsigned char *data = NULL;
+        size_t len = 0;
+        if (!bytes(data,len))
+            return std::string();
+        return std::string((const char *)data,len);
+    }
+    
+    /// True if the current field has the given wire type.  If not, it's skipped.
+    bool expect(WireType want)
+    {
+        if (wireType == want)
+            return true;
+        skip();
+        return false;
+    }
+    
+    /// Skip the current field, whatever it is
+    void skip()
+    {
+        switch (wireType)
+        {
+            case WireVarint:
+                varint();
+                break;
+            case WireFixed64:
+                fixed64();
+                break;
+            case WireLengthDelim:
+            {
+                const unsigned char *data;
+                size_t len;
+                bytes(data,len);
+            }
+                break;
+            case WireFixed32:
+                fixed32();
+                break;
+            default:
+                error = true;
+                break;
+        }
+    }
+    
+protected:
+    const unsigned char *ptr,*end;
+    uint32_t fieldNum;
+    int wireType;
+    bool error;
+};
+
+// Field numbers from vector_tile.proto
+static const uint32_t TileLayersField = 3;
+static const uint32_t LayerNameField = 1, LayerFeaturesField = 2, LayerKeysField = 3, LayerValuesField = 4, LayerExtentField = 5;
+static const uint32_t FeatureTagsField = 2, FeatureTypeField = 3, FeatureGeometryField = 4;
+static const uint32_t ValueStringField = 1, ValueFloatField = 2, ValueDoubleField = 3, ValueIntField = 4, ValueUIntField = 5, ValueSIntField = 6, ValueBoolField = 7;
+
+// Attributes we add to every feature
+static const Dictionary::Key GeometryTypeKey("geometry_type"), LayerNameKey("layer_name"), LayerOrderKey("layer_order");
+
+/// A layer value decoded once and shared by all the features that refer to it
+class MVTLayerValue
+{
+public:
+    MVTLayerValue() : type(DictTypeNone), intVal(0), doubleVal(0.0) { }
+    
+    /// Copy into the given dictionary
+    void apply(Dictionary &dict,const Dictionary::Key &key) const
+    {
+        switch (type)
+        {
+            case DictTypeString:
+                dict.setString(key,stringVal);
+                break;
+            case DictTypeInt:
+                dict.setInt(key,intVal);
+                break;
+            case DictTypeDouble:
+                dict.setDouble(key,doubleVal);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    DictionaryType type;
+    std::string stringVal;
+    int intVal;
+    double doubleVal;
+};
+
+// Decode a Tile.Value message.  Follows the precedence of the old protobuf based parser.
+static bool ParseLayerValue(PBFReader valMsg,MVTLayerValue &val)
+{
+    bool hasString = false, hasInt = false, hasDouble = false, hasFloat = false, hasBool = false, hasSInt = false, hasUInt = false;
+    std::string stringVal;
+    int64_t intVal = 0, sintVal = 0;
+    uint64_t uintVal = 0;
+    double doubleVal = 0.0;
+    float floatVal = 0.0;
+    bool boolVal = false;
+    
+    while (valMsg.next())
+    {
+        switch (valMsg.field())
+        {
+            // Fields with the wrong wire type are skipped like unknown ones
+            case ValueStringField:
+                if (valMsg.expect(PBFReader::WireLengthDelim)) {
+                    stringVal = valMsg.string();  hasString = true;
+                }
+                break;
+            case ValueFloatField:
+                if (valMsg.expect(PBFReader::WireFixed32)) {
+                    floatVal = valMsg.float32();  hasFloat = true;
+                }
+                break;
+            case ValueDoubleField:
+                if (valMsg.expect(PBFReader::WireFixed64)) {
+                    doubleVal = valMsg.float64();  hasDouble = true;
+                }
+                break;
+            case ValueIntField:
+                if (valMsg.expect(PBFReader::WireVarint)) {
+                    intVal = (int64_t)valMsg.varint();  hasInt = true;
+                }
+                break;
+            case ValueUIntField:
+                if (valMsg.expect(PBFReader::WireVarint)) {
+                    uintVal = valMsg.varint();  hasUInt = true;
+                }
+                break;
+            case ValueSIntField:
+                if (valMsg.expect(PBFReader::WireVarint)) {
+                    sintVal = valMsg.svarint();  hasSInt = true;
+                }
+                break;
+            case ValueBoolField:
+                if (valMsg.expect(PBFReader::WireVarint)) {
+                    boolVal = valMsg.varint() != 0;  hasBool = true;
+                }
+                break;
+            default:
+                valMsg.skip();
+                break;
+        }
+    }
+    if (valMsg.hasError())
+        return false;
+    
+    if (hasString) {
+        val.type = DictTypeString;  val.stringVal = stringVal;
+    } else if (hasInt) {
+        val.type = DictTypeInt;  val.intVal = (int)intVal;
+    } else if (hasDouble) {
+        val.type = DictTypeDouble;  val.doubleVal = doubleVal;
+    } else if (hasFloat) {
+        val.type = DictTypeDouble;  val.doubleVal = floatVal;
+    } else if (hasBool) {
+        val.type = DictTypeInt;  val.intVal = (int)boolVal;
+    } else if (hasSInt) {
+        val.type = DictTypeInt;  val.intVal = (int)sintVal;
+    } else if (hasUInt) {
+        val.type = DictTypeInt;  val.intVal = (int)uintVal;
+    }
+    
+    return true;
+}
+
+/// Walks a packed repeated uint32 field without copying it out
+class PackedUInt32Iter
+{
+public:
+    PackedUInt32Iter() { }
+    PackedUInt32Iter(const unsigned char *data,size_t len) : reader(data,len) { }
+    
+    bool done() const { return reader.done(); }
+    bool hasError() const { return reader.hasError(); }
+    uint32_t next() { return (uint32_t)reader.varint(); }
+    
+protected:
+    PBFReader reader;
+};
+
+/// Everything we need out of a layer before we can decode its features
+class MVTLayer
+{
+public:
+    MVTLayer() : extent(4096) { }
+    
+    /// Reset for the next layer
+    void clear()
+    {
+        name.clear();
+        extent = 4096;
+        keys.clear();
+        values.clear();
+        valueData.clear();
+        valueDecoded.clear();
+        features.clear();
+    }
+    
+    /// Return the given value, decoding it the first time it's asked for.
+    /// Returns NULL if it's out of range or malformed.
+    const MVTLayerValue *getValue(uint32_t which)
+    {
+        if (which >= valueData.size())
+            return NULL;
+        if (!valueDecoded[which])
+        {
+            if (!ParseLayerValue(PBFReader(valueData[which].first,valueData[which].second),values[which]))
+                return NULL;
+            valueDecoded[which] = true;
+        }
+        return &values[which];
+    }
+    
+    std::string name;
+    uint32_t extent;
+    // Keys we're not keeping are left empty.  The rest are looked up once for all the features.
+    std::vector<Dictionary::Key> keys;
+    // Values are only decoded if a feature we keep refers to them
+    std::vector<MVTLayerValue> values;
+    std::vector<std::pair<const unsigned char *,size_t> > valueData;
+    std::vector<bool> valueDecoded;
+    // Features are decoded after the keys and values, which may come later in the message
+    std::vector<std::pair<const unsigned char *,size_t> > features;
+};
+
+// Look for just the name of a layer, skipping everything else
+static bool ParseLayerName(PBFReader layerMsg,std::string &name)
+{
+    while (layerMsg.next())
+    {
+        if (layerMsg.field() == LayerNameField && layerMsg.type() == PBFReader::WireLengthDelim)
+        {
+            name = layerMsg.string();
+            return !layerMsg.hasError();
+        }
+        layerMsg.skip();
+    }
+    
+    return false;
+}
+
+static bool ParseLayer(PBFReader layerMsg,MVTLayer &layer,const MapboxVectorTileFilter::LayerFilter *layerFilter)
+{
+    while (layerMsg.next())
+    {
+        // Fields with the wrong wire type are skipped like unknown ones.  Only running out of data is fatal.
+        switch (layerMsg.field())
+        {
+            case LayerNameField:
+                if (layerMsg.expect(PBFReader::WireLengthDelim))
+                    layer.name = layerMsg.string();
+                break;
+            case LayerFeaturesField:
+            case LayerValuesField:
+            {
+                if (!layerMsg.expect(PBFReader::WireLengthDelim))
+                    break;
+                const unsigned char *data;
+                size_t len;
+                if (!layerMsg.bytes(data,len))
+                    return false;
+                if (layerMsg.field() == LayerFeaturesField)
+                    layer.features.push_back(std::make_pair(data,len));
+                else
+                    layer.valueData.push_back(std::make_pair(data,len));
+            }
+                break;
+            case LayerKeysField:
+            {
+                if (!layerMsg.expect(PBFReader::WireLengthDelim))
+                    break;
+                const unsigned char *data;
+                size_t len;
+                if (!layerMsg.bytes(data,len))
+                    return false;
+                layer.keys.resize(layer.keys.size()+1);
+                std::string key((const char *)data,len);
+                if (!key.empty() && (!layerFilter || layerFilter->allAttrs || layerFilter->keepAttr(key)))
+                    layer.keys.back() = Dictionary::Key(key);
+            }
+                break;
+            case LayerExtentField:
+                if (layerMsg.expect(PBFReader::WireVarint))
+                    layer.extent = (uint32_t)layerMsg.varint();
+                break;
+            default:
+                layerMsg.skip();
+                break;
+        }
+    }
+    layer.values.resize(layer.valueData.size());
+    layer.valueDecoded.resize(layer.valueData.size(),false);
+    
+    return !layerMsg.hasError();
+}
+
+// Throw out anything we produced for a tile we couldn't finish parsing
+static bool ParseFailed(std::vector<VectorObject *> &vecObjs,size_t startObjs)
+{
+    for (size_t ii=startObjs;ii<vecObjs.size();ii++)
+        delete vecObjs[ii];
+    vecObjs.resize(startObjs);
+    
+    return false;
+}
+
+void MapboxVectorTileFilter::addLayer(const std::string &layerName)
+{
+    layers[layerName] = LayerFilter();
+}
+
+void MapboxVectorTileFilter::addLayer(const std::string &layerName,const LayerFilter &layerFilter)
+{
+    layers[layerName] = layerFilter;
+}
+
+const MapboxVectorTileFilter::LayerFilter *MapboxVectorTileFilter::findLayer(const std::string &layerName) const
+{
+    auto it = layers.find(layerName);
+    if (it == layers.end())
+        return NULL;
+    return &it->second;
+}
+
 MapboxVectorTileParser::MapboxVectorTileParser()
 {
 }
@@ -37,8 +488,9 @@ MapboxVectorTileParser::~MapboxVectorTileParser()
 {
 }
     
-    
-bool MapboxVectorTileParser::parseVectorTile(RawData *rawData,std::vector<VectorObject *> &vecObjs,const Mbr &mbr)
+// Decode the features for a single layer, adding them to vecObjs
+static bool ParseLayerFeatures(PBFReader layerMsg,unsigned layerIdx,const MapboxVectorTileFilter::LayerFilter *layerFilter,
+                               const Mbr &mbr,TaskGroup *group,std::vector<VectorObject *> &vecObjs)
 {
     //calulate tile bounds and coordinate shift
     int tileSize = 256;
@@ -48,238 +500,322 @@ bool MapboxVectorTileParser::parseVectorTile(RawData *rawData,std::vector<Vector
     double tileOriginX = mbr.ll().x();
     double tileOriginY = mbr.ur().y();
     
-    double scale;
-    double x;
-    double y;
-    int32_t dx;
-    int32_t dy;
-    int geometrySize;
-    MapnikGeometryType g_type;
-    int cmd;
     const int cmd_bits = 3;
-    unsigned length;
-    int k;
-    unsigned cmd_length;
     Point2f point;
     Point2f firstCoord;
     
-    unsigned featureCount = 0;
+    size_t startObjs = vecObjs.size();
+    
+    // Keys and values are decoded once per layer, not once per feature
+    MVTLayer layer;
+    if (!ParseLayer(layerMsg,layer,layerFilter))
+        return ParseFailed(vecObjs,startObjs);
+    double scale = layer.extent / 256.0;
+    // Tile coordinates to epsg:3785 to radians, folded into a couple of factors
+    double xFactor = 1.0 / (scale * sx), yFactor = 1.0 / (scale * sy);
+    double toRad = M_PI / MAX_EXTENT;
+    
+    // Features with the same type and tags share one attribute set.  The copies handed to the
+    //  shapes share its contents until someone changes them.
+    typedef std::map<std::vector<uint32_t>,Dictionary> AttrSetMap;
+    AttrSetMap attrSets;
+    std::vector<uint32_t> attrSetKey;
     
-    //now attempt to open protobuf
-    vector_tile::Tile tile;
-    if(tile.ParseFromArray(rawData->getRawData(), (int)rawData->getLen())) {
-        //Itterate layers
-        for (unsigned i=0;i<tile.layers_size();++i) {
-            vector_tile::Tile_Layer const& tileLayer = tile.layers(i);
-            scale = tileLayer.extent() / 256.0;
+    // iterate over features
+    for (const auto &featData : layer.features)
+    {
+        if (group && group->isCancelled())
+            return ParseFailed(vecObjs,startObjs);
+        
+        MapnikGeometryType g_type = GeomTypeUnknown;
+        PackedUInt32Iter tags,geom;
+        PBFReader featMsg(featData.first,featData.second);
+        while (featMsg.next())
+        {
+            switch (featMsg.field())
+            {
+                // Fields with the wrong wire type are skipped like unknown ones
+                case FeatureTypeField:
+                    if (featMsg.expect(PBFReader::WireVarint))
+                        g_type = static_cast<MapnikGeometryType>(featMsg.varint());
+                    break;
+                case FeatureTagsField:
+                case FeatureGeometryField:
+                {
+                    // Both are packed uint32
+                    if (!featMsg.expect(PBFReader::WireLengthDelim))
+                        break;
+                    const unsigned char *data;
+                    size_t len;
+                    if (!featMsg.bytes(data,len))
+                        return ParseFailed(vecObjs,startObjs);
+                    if (featMsg.field() == FeatureTagsField)
+                        tags = PackedUInt32Iter(data,len);
+                    else
+                        geom = PackedUInt32Iter(data,len);
+                }
+                    break;
+                default:
+                    featMsg.skip();
+                    break;
+            }
+        }
+        if (featMsg.hasError())
+            return ParseFailed(vecObjs,startObjs);
+        if (layerFilter && !layerFilter->keepGeomType(g_type))
+            continue;
+        
+        //Parse attributes
+        attrSetKey.clear();
+        attrSetKey.push_back(g_type);
+        while (!tags.done())
+            attrSetKey.push_back(tags.next());
+        AttrSetMap::iterator attrIt = attrSets.find(attrSetKey);
+        if (attrIt == attrSets.end())
+        {
+            Dictionary attributes;
+            attributes.setInt(GeometryTypeKey, (int)g_type);
+            attributes.setString(LayerNameKey, layer.name);
+            attributes.setInt(LayerOrderKey,layerIdx);
             
-            // iterate over features
-            for (unsigned j=0;j<tileLayer.features_size();++j) {
-                featureCount++;
-                vector_tile::Tile_Feature const & f = tileLayer.features(j);
-                g_type = static_cast<MapnikGeometryType>(f.type());
-                
-                //Parse attributes
-                Dictionary attributes;
-                attributes.setInt("geometry_type", (int)g_type);
-                attributes.setString("layer_name", tileLayer.name());
-                attributes.setInt("layer_order",i);
-                
-                for (int m = 0; m < f.tags_size(); m += 2) {
-                    int32_t key_name = f.tags(m);
-                    int32_t key_value = f.tags(m + 1);
-                    if (key_name < static_cast<std::size_t>(tileLayer.keys_size())
-                        && key_value < static_cast<std::size_t>(tileLayer.values_size())) {
-                        const std::string &key = tileLayer.keys(key_name);
-                        if(key.empty()) {
-                            continue;
-                        }
-                        
-                        vector_tile::Tile_Value const& value = tileLayer.values(key_value);
-                        if (value.has_string_value()) {
-                            attributes.setString(key, value.string_value());
-                        } else if (value.has_int_value()) {
-                            attributes.setInt(key, value.int_value());
-                        } else if (value.has_double_value()) {
-                            attributes.setDouble(key, value.double_value());
-                        } else if (value.has_float_value()) {
-                            attributes.setDouble(key, value.float_value());
-                        } else if (value.has_bool_value()) {
-                            attributes.setInt(key, (int)value.bool_value());
-                        } else if (value.has_sint_value()) {
-                            attributes.setInt(key, (int)value.sint_value());
-                        } else if (value.has_uint_value()) {
-                            attributes.setInt(key, (int)value.uint_value());
-                        }
-                    }
+            for (size_t ti=1;ti+1<attrSetKey.size();ti+=2)
+            {
+                uint32_t key_name = attrSetKey[ti];
+                uint32_t key_value = attrSetKey[ti+1];
+                if (key_name < layer.keys.size())
+                {
+                    const Dictionary::Key &key = layer.keys[key_name];
+                    if (!key.isValid())
+                        continue;
+                    const MVTLayerValue *val = layer.getValue(key_value);
+                    if (val)
+                        val->apply(attributes,key);
                 }
+            }
+            attrIt = attrSets.insert(AttrSetMap::value_type(attrSetKey,attributes)).first;
+        }
+        const Dictionary &attributes = attrIt->second;
+        
+        VectorObject *vecObj = new VectorObject();
+        vecObjs.push_back(vecObj);
+        
+        //Parse geometry
+        int32_t cx = 0, cy = 0;
+        int cmd = -1;
+        unsigned length = 0;
+        VectorLinearRef lin;
+        VectorArealRef areal;
+        VectorPointsRef points;
+        VectorRing ring;
+        switch (g_type)
+        {
+            case GeomTypeLineString:
+                break;
+            case GeomTypePolygon:
+                areal = VectorAreal::createAreal();
+                break;
+            case GeomTypePoint:
+                points = VectorPoints::createPoints();
+                break;
+            default:
+                // Unknown geometry type, nothing to decode
+                geom = PackedUInt32Iter();
+                break;
+        }
+        
+        while (!geom.done())
+        {
+            if (!length)
+            {
+                unsigned cmd_length = geom.next();
+                cmd = cmd_length & ((1 << cmd_bits) - 1);
+                length = cmd_length >> cmd_bits;
+                //length is the number of coordinates before the CMD changes
+                // Make room for them up front
+                if (cmd == SEG_LINETO)
+                {
+                    if (lin)
+                        lin->pts.reserve(lin->pts.size()+length);
+                    else if (areal)
+                        ring.reserve(ring.size()+length+1);
+                } else if (cmd == SEG_MOVETO && points)
+                    points->pts.reserve(points->pts.size()+length);
+                if (!length)
+                    continue;
+            }
+            
+            length--;
+            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+            {
+                if (geom.done())
+                    break;
+                uint32_t dx = geom.next();
+                if (geom.done())
+                    break;
+                uint32_t dy = geom.next();
+                cx += (int32_t)((dx >> 1) ^ (~(dx & 1) + 1));
+                cy += (int32_t)((dy >> 1) ^ (~(dy & 1) + 1));
+                //At this point cx/cy is a coord encoded in tile coord space, from 0 to extent
+                //Covert to epsg:3785, then to radians
+                point.x() = (tileOriginX + cx * xFactor) * toRad;
+                point.y() = 2 * atan(exp((tileOriginY - cy * yFactor) * toRad)) - M_PI_2;
                 
-                //Parse geometry
-                x = 0;
-                y = 0;
-                geometrySize = f.geometry_size();
-                cmd = -1;
-                length = 0;
-                
-                VectorObject *vecObj = new VectorObject();
-                vecObjs.push_back(vecObj);
-                
-                try {
-                    if(g_type == GeomTypeLineString) {
-                        VectorLinearRef lin;
-                        for (k = 0; k < geometrySize;) {
-                            if (!length) {
-                                cmd_length = f.geometry(k++);
-                                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                                length = cmd_length >> cmd_bits;
-                            }//length is the number of coordinates before the CMD changes
-                            
-                            if (length > 0) {
-                                length--;
-                                if (cmd == SEG_MOVETO || cmd == SEG_LINETO) {
-                                    dx = f.geometry(k++);
-                                    dy = f.geometry(k++);
-                                    dx = ((dx >> 1) ^ (-(dx & 1)));
-                                    dy = ((dy >> 1) ^ (-(dy & 1)));
-                                    x += (static_cast<double>(dx) / scale);
-                                    y += (static_cast<double>(dy) / scale);
-                                    //At this point x/y is a coord encoded in tile coord space, from 0 to TILE_SIZE
-                                    //Covert to epsg:3785, then to degrees, then to radians
-                                    point.x() = DegToRad(((tileOriginX + x / sx) / MAX_EXTENT) * 180.0);
-                                    point.y() = 2 * atan(exp(DegToRad(((tileOriginY - y / sy) / MAX_EXTENT) * 180.0))) - M_PI_2;
-                                    
-                                    if(cmd == SEG_MOVETO) { //move to means we are starting a new segment
-                                        if(lin && lin->pts.size() > 0) { //We've already got a line, finish it
-                                            lin->initGeoMbr();
-                                            vecObj->shapes.insert(lin);
-                                        }
-                                        lin = VectorLinear::createLinear();
-                                        lin->pts.reserve(length);
-                                        firstCoord = point;
-                                    }
-                                    
-                                    lin->pts.push_back(point);
-                                } else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1))) {
-                                    //NSLog(@"Close line, layer:%@", layerName);
-                                    if(lin->pts.size() > 0) { //We've already got a line, finish it
-                                        lin->pts.push_back(firstCoord);
-                                        lin->initGeoMbr();
-                                        vecObj->shapes.insert(lin);
-                                        lin.reset();
-                                    } else {
-//                                        NSLog(@"Error: Close line with no points");
-                                    }
-                                } else {
-//                                    NSLog(@"Unknown command type:%i", cmd);
-                                }
-                            }
-                        }
-                        
-                        if(lin->pts.size() > 0) {
-                            lin->initGeoMbr();
-                            vecObj->shapes.insert(lin);
-                        }
-                    } else if(g_type == GeomTypePolygon) {
-                        VectorArealRef shape = VectorAreal::createAreal();
-                        VectorRing ring;
-                        
-                        for (k = 0; k < geometrySize;) {
-                            if (!length) {
-                                cmd_length = f.geometry(k++);
-                                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                                length = cmd_length >> cmd_bits;
-                            }
-                            
-                            if (length > 0) {
-                                length--;
-                                if (cmd == SEG_MOVETO || cmd == SEG_LINETO) {
-                                    dx = f.geometry(k++);
-                                    dy = f.geometry(k++);
-                                    dx = ((dx >> 1) ^ (-(dx & 1)));
-                                    dy = ((dy >> 1) ^ (-(dy & 1)));
-                                    x += (static_cast<double>(dx) / scale);
-                                    y += (static_cast<double>(dy) / scale);
-                                    //At this point x/y is a coord is encoded in tile coord space, from 0 to TILE_SIZE
-                                    //Covert to epsg:3785, then to degrees, then to radians
-                                    point.x() = DegToRad(((tileOriginX + x / sx) / MAX_EXTENT) * 180.0);
-                                    point.y() = 2 * atan(exp(DegToRad(((tileOriginY - y / sy) / MAX_EXTENT) * 180.0))) - M_PI_2;
-                                    
-                                    if(cmd == SEG_MOVETO) { //move to means we are starting a new segment
-                                        firstCoord = point;
-                                        //TODO: does this ever happen when we are part way through a shape? holes?
-                                    }
-                                    
-                                    ring.push_back(point);
-                                } else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1))) {
-                                    if(ring.size() > 0) { //We've already got a line, finish it
-                                        ring.push_back(firstCoord); //close the loop
-                                        shape->loops.push_back(ring); //add loop to shape
-                                        ring.clear(); //reuse the ring
-                                    }
-                                } else {
-//                                    NSLog(@"Unknown command type:%i", cmd);
-                                }
-                            }
-                        }
-                        
-                        if(ring.size() > 0) {
-//                            NSLog(@"Finished polygon loop, and ring has points");
-                        }
-                        //TODO: Is there a posibilty of still having a ring here that hasn't been added by a close command?
-                        
-                        shape->initGeoMbr();
-                        vecObj->shapes.insert(shape);
-                    } else if(g_type == GeomTypePoint) {
-                        VectorPointsRef shape = VectorPoints::createPoints();
-                        
-                        for (k = 0; k < geometrySize;) {
-                            if (!length) {
-                                cmd_length = f.geometry(k++);
-                                cmd = cmd_length & ((1 << cmd_bits) - 1);
-                                length = cmd_length >> cmd_bits;
-                            }
-                            
-                            if (length > 0) {
-                                length--;
-                                if (cmd == SEG_MOVETO || cmd == SEG_LINETO) {
-                                    dx = f.geometry(k++);
-                                    dy = f.geometry(k++);
-                                    dx = ((dx >> 1) ^ (-(dx & 1)));
-                                    dy = ((dy >> 1) ^ (-(dy & 1)));
-                                    x += (static_cast<double>(dx) / scale);
-                                    y += (static_cast<double>(dy) / scale);
-                                    //At this point x/y is a coord is encoded in tile coord space, from 0 to TILE_SIZE
-                                    //Covert to epsg:3785, then to degrees, then to radians
-                                    point.x() = DegToRad(((tileOriginX + x / sx) / MAX_EXTENT) * 180.0);
-                                    point.y() = 2 * atan(exp(DegToRad(((tileOriginY - y / sy) / MAX_EXTENT) * 180.0))) - M_PI_2;
-                                    
-                                    shape->pts.push_back(point);
-                                } else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1))) {
-//                                    NSLog(@"Close point feature?");
-                                } else {
-//                                    NSLog(@"Unknown command type:%i", cmd);
-                                }
+                switch (g_type)
+                {
+                    case GeomTypeLineString:
+                        if (cmd == SEG_MOVETO) { //move to means we are starting a new segment
+                            if (lin && lin->pts.size() > 0) { //We've already got a line, finish it
+                                lin->initGeoMbr();
+                                vecObj->shapes.insert(lin);
                             }
+                            lin = VectorLinear::createLinear();
+                            firstCoord = point;
                         }
-                        
-                        shape->initGeoMbr();
-                        vecObj->shapes.insert(shape);
-                    } else if(g_type == GeomTypeUnknown) {
-//                        NSLog(@"Unknown geom type");
+                        if (lin)
+                            lin->pts.push_back(point);
+                        break;
+                    case GeomTypePolygon:
+                        if (cmd == SEG_MOVETO)
+                            firstCoord = point;
+                        ring.push_back(point);
+                        break;
+                    case GeomTypePoint:
+                        points->pts.push_back(point);
+                        break;
+                    default:
+                        break;
+                }
+            } else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1))) {
+                if (g_type == GeomTypeLineString)
+                {
+                    if (lin && lin->pts.size() > 0) { //We've already got a line, finish it
+                        lin->pts.push_back(firstCoord);
+                        lin->initGeoMbr();
+                        vecObj->shapes.insert(lin);
+                        lin.reset();
+                    }
+                } else if (g_type == GeomTypePolygon) {
+                    if (ring.size() > 0) {
+                        ring.push_back(firstCoord); //close the loop
+                        areal->loops.resize(areal->loops.size()+1);
+                        areal->loops.back().swap(ring); //hand the loop to the shape
                     }
-                } catch(...) {
-//                    NSLog(@"Error parsing feature");
                 }
-                
-                for (auto shape: vecObj->shapes)
-                    shape->setAttrDict(attributes);
-            } //end of iterating features
-        }//end of iterating layers
-    } else {
+            } else {
+                // Unknown command type
+            }
+        }
+        if (geom.hasError())
+            return ParseFailed(vecObjs,startObjs);
+        
+        if (lin && lin->pts.size() > 0) {
+            lin->initGeoMbr();
+            vecObj->shapes.insert(lin);
+        }
+        if (areal) {
+            areal->initGeoMbr();
+            vecObj->shapes.insert(areal);
+        }
+        if (points) {
+            points->initGeoMbr();
+            vecObj->shapes.insert(points);
+        }
+        
+        for (auto shape: vecObj->shapes)
+            shape->setAttrDict(attributes);
+    } //end of iterating features
+    
+    return true;
+}
+
+bool MapboxVectorTileParser::parseVectorTile(RawData *rawData,std::vector<VectorObject *> &vecObjs,const Mbr &mbr,const MapboxVectorTileFilter *filter,TaskGroup *group)
+{
+    if (filter && filter->empty())
+        filter = NULL;
+    
+    // Sort out which layers we're decoding first
+    typedef struct
+    {
+        PBFReader layerMsg;
+        unsigned layerIdx;
+        const MapboxVectorTileFilter::LayerFilter *layerFilter;
+    } LayerToParse;
+    std::vector<LayerToParse> layers;
+    
+    PBFReader tileMsg(rawData->getRawData(),rawData->getLen());
+    std::string layerName;
+    unsigned layerOrder = 0;
+    while (tileMsg.next())
+    {
+        if (tileMsg.field() != TileLayersField || tileMsg.type() != PBFReader::WireLengthDelim)
+        {
+            tileMsg.skip();
+            continue;
+        }
+        
+        PBFReader layerMsg = tileMsg.message();
+        if (tileMsg.hasError())
+            return false;
+        // Skipped layers still count toward the layer order
+        unsigned layerIdx = layerOrder++;
+        
+        // Layers we're not interested in are skipped before we look at the rest of their contents
+        const MapboxVectorTileFilter::LayerFilter *layerFilter = NULL;
+        if (filter)
+        {
+            if (!ParseLayerName(layerMsg,layerName))
+                continue;
+            layerFilter = filter->findLayer(layerName);
+            if (!layerFilter)
+                continue;
+        }
+        
+        LayerToParse toParse;
+        toParse.layerMsg = layerMsg;
+        toParse.layerIdx = layerIdx;
+        toParse.layerFilter = layerFilter;
+        layers.push_back(toParse);
+    }
+    if (tileMsg.hasError())
         return false;
+    
+    // Do the layers one after another
+    if (!group || layers.size() < 2)
+    {
+        size_t startObjs = vecObjs.size();
+        for (const LayerToParse &toParse : layers)
+            if (!ParseLayerFeatures(toParse.layerMsg,toParse.layerIdx,toParse.layerFilter,mbr,group,vecObjs))
+                return ParseFailed(vecObjs,startObjs);
+        return true;
     }
     
-    return true;
+    // Or spread them out over the task scheduler, keeping the results in layer order
+    std::vector<std::vector<VectorObject *> > layerObjs(layers.size());
+    std::vector<char> layerOk(layers.size(),false);
+    for (unsigned int ii=0;ii<layers.size();ii++)
+    {
+        const LayerToParse *toParse = &layers[ii];
+        std::vector<VectorObject *> *theseObjs = &layerObjs[ii];
+        char *thisOk = &layerOk[ii];
+        group->addTask([toParse,theseObjs,thisOk,&mbr,group]()
+                       {
+                           *thisOk = ParseLayerFeatures(toParse->layerMsg,toParse->layerIdx,toParse->layerFilter,mbr,group,*theseObjs);
+                       });
+    }
+    bool success = group->wait();
+    for (unsigned int ii=0;ii<layers.size() && success;ii++)
+        success = layerOk[ii];
+    
+    for (std::vector<VectorObject *> &theseObjs : layerObjs)
+    {
+        if (success)
+            vecObjs.insert(vecObjs.end(),theseObjs.begin(),theseObjs.end());
+        else
+            for (VectorObject *vecObj : theseObjs)
+                delete vecObj;
+    }
+    
+    return success;
 }
     
 }
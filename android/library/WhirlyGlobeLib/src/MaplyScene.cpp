@@ -28,23 +28,43 @@ namespace Maply
     
 MapScene::MapScene(WhirlyKit::CoordSystemDisplayAdapter *coordAdapter)
 {
-    Init(coordAdapter,GeoMbr(GeoCoord::CoordFromDegrees(-180,-90),GeoCoord::CoordFromDegrees(180,90)),1);
+    GeoMbr geoMbr(GeoCoord::CoordFromDegrees(-180,-90),GeoCoord::CoordFromDegrees(180,90));
+    Init(coordAdapter,geoMbr,1);
+    
+    // Some builders use local coordinates for the drawable MBRs and some use geographic.
+    // So the tree covers both.
+    Mbr treeMbr(geoMbr.ll(),geoMbr.ur());
+    Point2d geoLL,geoUR;
+    if (coordAdapter->getGeoBounds(geoLL,geoUR))
+    {
+        treeMbr.addPoint(Point2f(geoLL.x(),geoLL.y()));
+        treeMbr.addPoint(Point2f(geoUR.x(),geoUR.y()));
+    }
+    Point3f ll,ur;
+    if (coordAdapter->getBounds(ll,ur))
+    {
+        treeMbr.addPoint(Point2f(ll.x(),ll.y()));
+        treeMbr.addPoint(Point2f(ur.x(),ur.y()));
+    }
+    flatCullTree = new FlatCullTree(treeMbr);
+}
+    
+MapScene::~MapScene()
+{
+    delete flatCullTree;
+    flatCullTree = NULL;
 }
     
 void MapScene::addDrawable(DrawableRef draw)
 {
     drawables.insert(draw);
     
-    // Dump it in the top level for now
-    Mbr localMbr = draw->getLocalMbr();
-    cullTree->getTopCullable()->addDrawable(cullTree, localMbr, draw);
+    flatCullTree->addDrawable(draw);
 }
 
 void MapScene::remDrawable(DrawableRef draw)
 {
-    // We're expecting it to just be at the top level
-    Mbr localMbr = draw->getLocalMbr();
-    cullTree->getTopCullable()->remDrawable(cullTree, localMbr, draw);
+    flatCullTree->remDrawable(draw);
     
     drawables.erase(draw);
 }
@@ -22,6 +22,15 @@
 #import "WhirlyGeometry.h"
 #import "VectorData.h"
 
+// Vector unit for the batch box tests, picked at compile time like FrustumBatch does
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#import <arm_neon.h>
+#define WK_OVERLAP_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#import <emmintrin.h>
+#define WK_OVERLAP_SSE 1
+#endif
+
 
 using namespace Eigen;
 using namespace WhirlyKit;
@@ -29,53 +38,215 @@ using namespace WhirlyKit;
 namespace WhirlyKit
 {
 
+// True if the points are a rectangle lined up with the axes.  Its bounding box is then exact.
+static bool IsAxisAligned(const Point2dVector &pts)
+{
+    if (pts.size() != 4)
+        return false;
+    
+    return (pts[0].y() == pts[1].y() && pts[1].x() == pts[2].x() && pts[2].y() == pts[3].y() && pts[3].x() == pts[0].x()) ||
+           (pts[0].x() == pts[1].x() && pts[1].y() == pts[2].y() && pts[2].x() == pts[3].x() && pts[3].y() == pts[0].y());
+}
+
+// Range of a polygon along an axis
+static void ProjectPoly(const Point2d *pts,unsigned int numPts,const Point2d &axis,double &minVal,double &maxVal)
+{
+    minVal = maxVal = pts[0].dot(axis);
+    for (unsigned int ii=1;ii<numPts;ii++)
+    {
+        double val = pts[ii].dot(axis);
+        minVal = std::min(minVal,val);
+        maxVal = std::max(maxVal,val);
+    }
+}
+
+// Separating axis test for two convex polygons.
+// Touching counts as overlapping, same as the bounding box test.
+static bool ConvexPolysOverlap(const Point2d *pts0,unsigned int numPts0,const Point2d *pts1,unsigned int numPts1)
+{
+    for (unsigned int which=0;which<2;which++)
+    {
+        const Point2d *pts = which == 0 ? pts0 : pts1;
+        unsigned int numPts = which == 0 ? numPts0 : numPts1;
+        for (unsigned int ii=0;ii<numPts;ii++)
+        {
+            const Point2d &p0 = pts[ii], &p1 = pts[(ii+1)%numPts];
+            Point2d axis(p0.y()-p1.y(),p1.x()-p0.x());
+            double min0,max0,min1,max1;
+            ProjectPoly(pts0,numPts0,axis,min0,max0);
+            ProjectPoly(pts1,numPts1,axis,min1,max1);
+            if (max0 < min1 || max1 < min0)
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+// Index of the first box at or after start that touches the query box, or num if none do.
+// Four boxes at a time where we have SSE or NEON.
+static unsigned int FindBoxOverlap(const float *minX,const float *minY,const float *maxX,const float *maxY,unsigned int start,unsigned int num,const Mbr &query)
+{
+    float qMinX = query.ll().x(), qMinY = query.ll().y(), qMaxX = query.ur().x(), qMaxY = query.ur().y();
+    unsigned int ii = start;
+    
+#if defined(WK_OVERLAP_SSE)
+    const __m128 qMinXv = _mm_set1_ps(qMinX), qMinYv = _mm_set1_ps(qMinY), qMaxXv = _mm_set1_ps(qMaxX), qMaxYv = _mm_set1_ps(qMaxY);
+    for (;ii+4<=num;ii+=4)
+    {
+        __m128 hitX = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minX+ii),qMaxXv),_mm_cmple_ps(qMinXv,_mm_loadu_ps(maxX+ii)));
+        __m128 hitY = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minY+ii),qMaxYv),_mm_cmple_ps(qMinYv,_mm_loadu_ps(maxY+ii)));
+        int hitMask = _mm_movemask_ps(_mm_and_ps(hitX,hitY));
+        if (hitMask)
+            for (unsigned int li=0;li<4;li++)
+                if (hitMask & (1<<li))
+                    return ii + li;
+    }
+#elif defined(WK_OVERLAP_NEON)
+    const float32x4_t qMinXv = vdupq_n_f32(qMinX), qMinYv = vdupq_n_f32(qMinY), qMaxXv = vdupq_n_f32(qMaxX), qMaxYv = vdupq_n_f32(qMaxY);
+    for (;ii+4<=num;ii+=4)
+    {
+        uint32x4_t hitX = vandq_u32(vcleq_f32(vld1q_f32(minX+ii),qMaxXv),vcleq_f32(qMinXv,vld1q_f32(maxX+ii)));
+        uint32x4_t hitY = vandq_u32(vcleq_f32(vld1q_f32(minY+ii),qMaxYv),vcleq_f32(qMinYv,vld1q_f32(maxY+ii)));
+        uint32x4_t hit = vandq_u32(hitX,hitY);
+        uint32x2_t hitHalf = vorr_u32(vget_low_u32(hit),vget_high_u32(hit));
+        if (vget_lane_u32(vpmax_u32(hitHalf,hitHalf),0))
+        {
+            uint32_t hitLanes[4];
+            vst1q_u32(hitLanes,hit);
+            for (unsigned int li=0;li<4;li++)
+                if (hitLanes[li])
+                    return ii + li;
+        }
+    }
+#endif
+    
+    // Whatever's left over, or everything if we've no vector unit
+    for (;ii<num;ii++)
+        if (minX[ii] <= qMaxX && qMinX <= maxX[ii] && minY[ii] <= qMaxY && qMinY <= maxY[ii])
+            return ii;
+    
+    return num;
+}
+
 OverlapHelper::OverlapHelper(const Mbr &mbr,int sizeX,int sizeY)
-	: mbr(mbr), sizeX(sizeX), sizeY(sizeY)
+	: mbr(mbr), sizeX(sizeX), sizeY(sizeY), queryTag(0)
 {
     grid.resize(sizeX*sizeY);
     cellSize = Point2f((mbr.ur().x()-mbr.ll().x())/sizeX,(mbr.ur().y()-mbr.ll().y())/sizeY);
 }
 
-// Try to add an object.  Might fail (kind of the whole point).
-bool OverlapHelper::addObject(const Point2dVector &pts)
+void OverlapHelper::reset(const Mbr &newMbr)
 {
-    Mbr objMbr;
-    for (unsigned int ii=0;ii<pts.size();ii++)
-        objMbr.addPoint(pts[ii]);
-    int sx = floorf((objMbr.ll().x()-mbr.ll().x())/cellSize.x());
+    mbr = newMbr;
+    cellSize = Point2f((mbr.ur().x()-mbr.ll().x())/sizeX,(mbr.ur().y()-mbr.ll().y())/sizeY);
+    objects.clear();
+    for (GridCell &cell : grid)
+    {
+        cell.ids.clear();
+        cell.minX.clear();  cell.minY.clear();
+        cell.maxX.clear();  cell.maxY.clear();
+    }
+    queryTag = 0;
+}
+
+void OverlapHelper::calcCells(const Mbr &objMbr,int &sx,int &sy,int &ex,int &ey)
+{
+    sx = floorf((objMbr.ll().x()-mbr.ll().x())/cellSize.x());
     if (sx < 0) sx = 0;
-    int sy = floorf((objMbr.ll().y()-mbr.ll().y())/cellSize.y());
+    sy = floorf((objMbr.ll().y()-mbr.ll().y())/cellSize.y());
     if (sy < 0) sy = 0;
-    int ex = ceilf((objMbr.ur().x()-mbr.ll().x())/cellSize.x());
+    ex = ceilf((objMbr.ur().x()-mbr.ll().x())/cellSize.x());
     if (ex >= sizeX)  ex = sizeX-1;
-    int ey = ceilf((objMbr.ur().y()-mbr.ll().y())/cellSize.y());
+    ey = ceilf((objMbr.ur().y()-mbr.ll().y())/cellSize.y());
     if (ey >= sizeY)  ey = sizeY-1;
-    for (int ix=sx;ix<=ex;ix++)
-        for (int iy=sy;iy<=ey;iy++)
+}
+
+// Try to add an object.  Might fail (kind of the whole point).
+bool OverlapHelper::addObject(const Point2dVector &pts)
+{
+    if (!checkObject(pts))
+        return false;
+    
+    // Okay, so it doesn't overlap.  Let's add it where needed.
+    insertObject(pts);
+
+    return true;
+}
+
+bool OverlapHelper::checkObject(const Point2dVector &pts)
+{
+    if (pts.empty())
+        return true;
+    
+    Mbr objMbr;
+    objMbr.addPoints(pts);
+    bool axisAligned = IsAxisAligned(pts);
+    int sx,sy,ex,ey;
+    calcCells(objMbr,sx,sy,ex,ey);
+    
+    // Anything spanning several cells shows up in each of them
+    queryTag++;
+    for (int iy=sy;iy<=ey;iy++)
+        for (int ix=sx;ix<=ex;ix++)
         {
-            std::vector<int> &objList = grid[iy*sizeX + ix];
-            for (unsigned int ii=0;ii<objList.size();ii++)
+            GridCell &cell = grid[iy*sizeX + ix];
+            unsigned int numBoxes = (unsigned int)cell.ids.size();
+            for (unsigned int bi = FindBoxOverlap(cell.minX.data(),cell.minY.data(),cell.maxX.data(),cell.maxY.data(),0,numBoxes,objMbr);
+                 bi < numBoxes;
+                 bi = FindBoxOverlap(cell.minX.data(),cell.minY.data(),cell.maxX.data(),cell.maxY.data(),bi+1,numBoxes,objMbr))
             {
-                BoundedObject &testObj = objects[objList[ii]];
-                // Note: This will result in testing the same thing multiple times
-                if (ConvexPolyIntersect(testObj.pts,pts))
+                BoundedObject &testObj = objects[cell.ids[bi]];
+                // Two boxes that touch are all we need to know
+                if (axisAligned && testObj.axisAligned)
+                    return false;
+                
+                // Rotated ones get the full test, but only the once
+                if (testObj.queryTag == queryTag)
+                    continue;
+                testObj.queryTag = queryTag;
+                if (testObj.axisAligned)
+                {
+                    Point2d box[4] = {Point2d(cell.minX[bi],cell.minY[bi]),Point2d(cell.maxX[bi],cell.minY[bi]),
+                                      Point2d(cell.maxX[bi],cell.maxY[bi]),Point2d(cell.minX[bi],cell.maxY[bi])};
+                    if (ConvexPolysOverlap(box,4,&pts[0],(unsigned int)pts.size()))
+                        return false;
+                } else if (ConvexPolysOverlap(&testObj.pts[0],(unsigned int)testObj.pts.size(),&pts[0],(unsigned int)pts.size()))
                     return false;
-                }
             }
+        }
+
+    return true;
+}
+
+void OverlapHelper::insertObject(const Point2dVector &pts)
+{
+    if (pts.empty())
+        return;
+    
+    Mbr objMbr;
+    objMbr.addPoints(pts);
+    int sx,sy,ex,ey;
+    calcCells(objMbr,sx,sy,ex,ey);
 
-    // Okay, so it doesn't overlap.  Let's add it where needed.
     objects.resize(objects.size()+1);
     int newId = (int)(objects.size()-1);
     BoundedObject &newObj = objects[newId];
-    newObj.pts = pts;
-    for (int ix=sx;ix<=ex;ix++)
-        for (int iy=sy;iy<=ey;iy++)
+    newObj.axisAligned = IsAxisAligned(pts);
+    newObj.queryTag = queryTag;
+    // The box is enough for the axis aligned ones
+    if (!newObj.axisAligned)
+        newObj.pts = pts;
+    for (int iy=sy;iy<=ey;iy++)
+        for (int ix=sx;ix<=ex;ix++)
         {
-            std::vector<int> &objList = grid[iy*sizeX + ix];
-            objList.push_back(newId);
+            GridCell &cell = grid[iy*sizeX + ix];
+            cell.ids.push_back(newId);
+            cell.minX.push_back(objMbr.ll().x());
+            cell.minY.push_back(objMbr.ll().y());
+            cell.maxX.push_back(objMbr.ur().x());
+            cell.maxY.push_back(objMbr.ur().y());
         }
-
-    return true;
 }
 
 ClusterHelper::ObjectWithBounds::ObjectWithBounds()
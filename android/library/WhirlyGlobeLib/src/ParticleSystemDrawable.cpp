@@ -84,11 +84,11 @@ void ParticleSystemDrawable::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemMa
             verts[11] = Point2f(0,1.0);
             
             int rectSize = 2*sizeof(float)*6*2;
-            rectBuffer = memManager->getBufferID(0,GL_STATIC_DRAW);
+            rectBuffer = memManager->getBufferID(rectSize,GL_STATIC_DRAW);
             
             glBindBuffer(GL_ARRAY_BUFFER, rectBuffer);
-            glBufferData(GL_ARRAY_BUFFER, rectSize, (const GLvoid *)&verts[0], GL_STATIC_DRAW);
-            CheckGLError("ParticleSystemDrawable::setupGL() glBufferData");
+            glBufferSubData(GL_ARRAY_BUFFER, 0, rectSize, (const GLvoid *)&verts[0]);
+            CheckGLError("ParticleSystemDrawable::setupGL() glBufferSubData");
             glBindBuffer(GL_ARRAY_BUFFER, 0);
         } else {
            // NSLog(@"ParticleSystemDrawable: Can only do instanced rectangles at present.  This system can't handle instancing.");
@@ -21,7 +21,9 @@
 #import "WhirlyKitLog.h"
 #import "Proj4CoordSystem.h"
 #import "GlobeMath.h"
+#import "CoordSystemConverter.h"
 #import "proj_api.h"
+#import <algorithm>
 
 namespace WhirlyKit
 {
@@ -36,6 +38,8 @@ Proj4CoordSystem::Proj4CoordSystem(const std::string &proj4Str)
     
 Proj4CoordSystem::~Proj4CoordSystem()
 {
+    // Cached converters point at our projections, so they have to go before the projections do
+    CoordSystemForgetConverters(this);
     pj_free(pj);
     pj_free(pj_latlon);
     pj_free(pj_geocentric);
@@ -155,6 +159,31 @@ Point3d Proj4CoordSystem::geocentricToLocal(Point3d geocPt)
     return coord;
 }
 
+void Proj4CoordSystem::localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    
+    // Point3d is three packed doubles, so Proj.4 can stride through the array in place
+    if (inPts != outPts)
+        std::copy(inPts,inPts+numPts,outPts);
+    double *coords = outPts[0].data();
+    if (pj_transform(pj, pj_geocentric, numPts, 3, &coords[0], &coords[1], &coords[2]))
+        WHIRLYKIT_LOGV("Proj4CoordSystem::localToGeocentric error converting to geocentric");
+}
+
+void Proj4CoordSystem::geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    
+    if (inPts != outPts)
+        std::copy(inPts,inPts+numPts,outPts);
+    double *coords = outPts[0].data();
+    if (pj_transform(pj_geocentric, pj, numPts, 3, &coords[0], &coords[1], &coords[2]))
+        WHIRLYKIT_LOGV("Proj4CoordSystem::geocentricToLocal error converting to local");
+}
+
 bool Proj4CoordSystem::isSameAs(CoordSystem *coordSys)
 {
     Proj4CoordSystem *other = dynamic_cast<Proj4CoordSystem *>(coordSys);
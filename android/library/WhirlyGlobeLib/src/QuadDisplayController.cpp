@@ -28,6 +28,7 @@
 #import "FlatMath.h"
 #import "VectorData.h"
 #import "WhirlyKitLog.h"
+#import "TaskScheduler.h"
 
 // Turn on output logging
 //#define LOGLOADING
@@ -71,6 +72,9 @@ QuadDisplayController::~QuadDisplayController()
         quadDisplayControllers.erase(it);
     }
 
+    // Anything still working on our tiles is wasted effort
+    TaskScheduler::getScheduler()->cancelOwner(getId());
+
     if (quadtree)
         delete quadtree;
     quadtree = NULL;
@@ -303,6 +307,8 @@ bool QuadDisplayController::waitingForLocalLoads()
 // Run the evaluation step for outstanding nodes
 bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameInterval,float availableFrame,ChangeSet &changes)
 {
+    FrameProfilerScope profileScope(scene->getProfiler(),"Quad eval");
+    
     bool didSomething = false;
     somethingHappened = false;
     
@@ -453,7 +459,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
                     //                    NSLog(@"Forcing unload tile: %d: (%d,%d) phantom = %@, import = %f",remNodeInfo.ident.level,remNodeInfo.ident.x,remNodeInfo.ident.y,(remNodeInfo.phantom ? @"YES" : @"NO"), remNodeInfo.importance);
                     quadtree->removeTile(remNodeInfo.ident);
                     
-                    loader->unloadTile(remNodeInfo);
+                    unloadTile(remNodeInfo);
                 }
                 
                 quadtree->setPhantom(nodeInfo.ident, false);
@@ -473,7 +479,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
 #endif
 #endif
                     //                    NSLog(@"Loading tile: %d: (%d,%d), frame = %d",nodeInfo.ident.level,nodeInfo.ident.x,nodeInfo.ident.y,frameId);
-                    loader->loadTile(nodeInfo,frameId);
+                    loadTile(nodeInfo,frameId);
                 } else {
 #ifdef __ANDROID__
 #ifdef LOGLOADING
@@ -481,7 +487,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
 #endif
 #endif
                     //                    NSLog(@"Loading tile: %d: (%d,%d)",nodeInfo.ident.level,nodeInfo.ident.x,nodeInfo.ident.y);
-                    loader->loadTile(nodeInfo,-1);
+                    loadTile(nodeInfo,-1);
                 }
             }
             
@@ -499,7 +505,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
 #endif
 #endif
                 //                NSLog(@"Unload tile: %d: (%d,%d)",nodeInfo.ident.level,nodeInfo.ident.x,nodeInfo.ident.y);
-                loader->unloadTile(nodeInfo);
+                unloadTile(nodeInfo);
             }
             
             // Turn this into a phantom node
@@ -534,7 +540,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
         //        NSLog(@"Unload tile: %d: (%d,%d) phantom = %@, import = %f",remNodeInfo.ident.level,remNodeInfo.ident.x,remNodeInfo.ident.y,(remNodeInfo.phantom ? @"YES" : @"NO"), remNodeInfo.importance);
         quadtree->removeTile(remNodeInfo.ident);
         if (!remNodeInfo.phantom)
-            loader->unloadTile(remNodeInfo);
+            unloadTile(remNodeInfo);
         
         didSomething = true;
     }
@@ -556,7 +562,7 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
                 const Quadtree::NodeInfo *nodeInfo = quadtree->getNodeInfo(ident);
                 if (nodeInfo)
                 {
-                    loader->unloadTile(*nodeInfo);
+                    unloadTile(*nodeInfo);
                     quadtree->setPhantom(ident, true);
                     quadtree->setLoading(ident, -1, false);
                     didSomething = true;
@@ -664,6 +670,22 @@ bool QuadDisplayController::evalStep(TimeInterval frameStart,TimeInterval frameI
     return somethingHappened;
 }
 
+void QuadDisplayController::loadTile(const Quadtree::NodeInfo &nodeInfo,int frame)
+{
+    // Decode and build work for the tile runs at the tile's importance
+    TaskScheduler::getScheduler()->addTileGroup(getId(), nodeInfo.ident, nodeInfo.importance);
+
+    loader->loadTile(nodeInfo,frame);
+}
+
+void QuadDisplayController::unloadTile(const Quadtree::NodeInfo &nodeInfo)
+{
+    // Stop any work still in progress for the tile
+    TaskScheduler::getScheduler()->cancelTile(getId(), nodeInfo.ident);
+
+    loader->unloadTile(nodeInfo);
+}
+
 void QuadDisplayController::tileDidLoad(const WhirlyKit::Quadtree::Identifier &tileIdent,int frame)
 {
 #ifdef __ANDROID__
@@ -676,9 +698,17 @@ void QuadDisplayController::tileDidLoad(const WhirlyKit::Quadtree::Identifier &t
     // Make sure we still want this one
     const Quadtree::NodeInfo *node = quadtree->getNodeInfo(tileIdent);
     if (!node)
+    {
+        TaskScheduler::getScheduler()->removeTileGroup(getId(), tileIdent);
         return;
+    }
     
     quadtree->didLoad(tileIdent,frame);
+
+    // Done with the tile's task group once all its frames are in.
+    // Most loaders never use it, so it shouldn't hang around until the tile's unloaded.
+    if (!quadtree->isLoading(tileIdent,-1))
+        TaskScheduler::getScheduler()->removeTileGroup(getId(), tileIdent);
     
     // Update the parent coverage and then make those tiles phantoms if
     //  they're now fully covered
@@ -751,6 +781,8 @@ void QuadDisplayController::tileDidNotLoad(const Quadtree::Identifier &tileIdent
 #endif
     //    NSLog(@"Tile failed to load: %d: (%d,%d) %d",tileIdent.level,tileIdent.x,tileIdent.y,frame);
     
+    TaskScheduler::getScheduler()->removeTileGroup(getId(), tileIdent);
+    
     quadtree->setLoading(tileIdent, frame, false);
     quadtree->setPhantom(tileIdent, true);
     quadtree->setFailed(tileIdent, true);
@@ -794,7 +826,7 @@ void QuadDisplayController::refresh(ChangeSet &changes)
     {
         
         quadtree->removeTile(remNodeInfo.ident);
-        loader->unloadTile(remNodeInfo);
+        unloadTile(remNodeInfo);
     }
     waitForLocalLoads = true;
     
@@ -811,6 +843,8 @@ void QuadDisplayController::refresh(ChangeSet &changes)
     
 void QuadDisplayController::shutdown(ChangeSet &changes)
 {
+    TaskScheduler::getScheduler()->cancelOwner(getId());
+    
     loader->endUpdates(changes);
     
     dataStructure->shutdown();
@@ -831,6 +865,7 @@ void QuadDisplayController::reset(ChangeSet &changes)
     {
         quadtree->removeTile(remNodeInfo.ident);
     }
+    TaskScheduler::getScheduler()->cancelOwner(getId());
     
     // Tell the tile loader to reset
     loader->reset(changes);
@@ -860,5 +895,17 @@ double QuadDisplayController::importanceForTile(const Quadtree::Identifier &iden
     return import;
 }
 
+// Bounds on importance for the quad tree, so it can skip tiles that won't change much
+bool QuadDisplayController::importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &theMbr,Quadtree *tree,Dictionary *attrs,double &minImport,double &maxImport)
+{
+    return dataStructure->importanceBoundsForTile(ident,theMbr,&viewState,renderer->getFramebufferSize(),attrs,minImport,maxImport);
+}
+
+// Batch off screen test for the quad tree
+void QuadDisplayController::nodesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,Quadtree *tree,std::vector<bool> &offScreen)
+{
+    dataStructure->tilesOffScreen(nodes,&viewState,renderer->getFramebufferSize(),offScreen);
+}
+
 }
 
@@ -20,6 +20,7 @@
 
 #import "glwrapper.h"
 #import "Quadtree.h"
+#import <algorithm>
 #import "WhirlyKitLog.h"
 
 namespace WhirlyKit
@@ -80,7 +81,7 @@ void Quadtree::NodeInfo::setFrameLoading(int theFrame,bool val)
     }
 }
     
-Quadtree::Node::Node(Quadtree *tree)
+Quadtree::Node::Node()
 {
     parent = NULL;
     for (unsigned int ii=0;ii<4;ii++)
@@ -88,17 +89,13 @@ Quadtree::Node::Node(Quadtree *tree)
         children[ii] = NULL;
         childOffscreen[ii] = false;
     }
-    identPos = tree->nodesByIdent.end();
-    sizePos = tree->nodesBySize.end();
+    sizePos = -1;
+    evalPos = -1;
 }
     
 void Quadtree::Node::addChild(Quadtree *tree,Node *child)
 {
-    // Note: The iterators don't appear to be safe
-    NodesBySizeType::iterator it = tree->nodesBySize.find(this);
-    if (it != tree->nodesBySize.end())
-        tree->nodesBySize.erase(it);
-    sizePos = tree->nodesBySize.end();
+    tree->nodesBySize.remove(this);
 
     int ix = child->nodeInfo.ident.x - nodeInfo.ident.x*2;
     int iy = child->nodeInfo.ident.y - nodeInfo.ident.y*2;
@@ -115,7 +112,7 @@ void Quadtree::Node::removeChild(Quadtree *tree, Node *child)
         hasChildren |= (children[ii] != NULL);
     }
     if (!hasChildren)
-        sizePos = tree->nodesBySize.insert(this).first;
+        tree->nodesBySize.push(this);
 }
     
 bool Quadtree::Node::hasChildren()
@@ -171,29 +168,236 @@ void Quadtree::Node::Print()
 //            NSLog(@"  Child = (%d,%d,%d)",children[ii]->nodeInfo.ident.x,children[ii]->nodeInfo.ident.y,children[ii]->nodeInfo.ident.level);
 #endif
 }
+    
+bool Quadtree::NodeTable::canPack(const Identifier &ident)
+{
+    if (ident.level < 0 || ident.level > MaxPackedLevel)
+        return false;
+    return ident.x >= 0 && ident.y >= 0 && ident.x < (1<<ident.level) && ident.y < (1<<ident.level);
+}
+    
+// Level in the top 6 bits, then 29 bits each of x and y
+bool Quadtree::NodeTable::packIdent(const Identifier &ident,unsigned long long &key)
+{
+    if (!canPack(ident))
+        return false;
+    
+    key = ((unsigned long long)ident.level << 58) | ((unsigned long long)ident.x << 29) | (unsigned long long)ident.y;
+    return true;
+}
+
+unsigned int Quadtree::NodeTable::hashKey(unsigned long long key)
+{
+    // Finalizer from splitmix64.  Neighboring tiles end up well apart.
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    key = key ^ (key >> 31);
+    return (unsigned int)key;
+}
+    
+Quadtree::NodeTable::NodeTable()
+    : mask(63), numNodes(0)
+{
+    Slot empty;
+    empty.key = 0;
+    empty.node = NULL;
+    slots.resize(mask+1,empty);
+}
+    
+Quadtree::Node *Quadtree::NodeTable::find(const Identifier &ident) const
+{
+    unsigned long long key;
+    if (!packIdent(ident,key))
+        return NULL;
+    
+    for (unsigned int which = hashKey(key) & mask;slots[which].node;which = (which+1) & mask)
+        if (slots[which].key == key)
+            return slots[which].node;
+    
+    return NULL;
+}
+    
+void Quadtree::NodeTable::insert(Node *node)
+{
+    unsigned long long key;
+    if (!packIdent(node->nodeInfo.ident,key))
+        return;
+    
+    // Keep the load under half
+    if (2*(numNodes+1) > (int)slots.size())
+        grow();
+    
+    unsigned int which = hashKey(key) & mask;
+    while (slots[which].node)
+        which = (which+1) & mask;
+    slots[which].key = key;
+    slots[which].node = node;
+    numNodes++;
+}
+    
+void Quadtree::NodeTable::erase(const Identifier &ident)
+{
+    unsigned long long key;
+    if (!packIdent(ident,key))
+        return;
+    
+    unsigned int which = hashKey(key) & mask;
+    while (slots[which].node && slots[which].key != key)
+        which = (which+1) & mask;
+    if (!slots[which].node)
+        return;
+    
+    // Shift back anything in the run that would no longer be reachable
+    unsigned int hole = which;
+    unsigned int next = which;
+    while (true)
+    {
+        next = (next+1) & mask;
+        if (!slots[next].node)
+            break;
+        unsigned int home = hashKey(slots[next].key) & mask;
+        bool reachable = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (reachable)
+            continue;
+        slots[hole] = slots[next];
+        hole = next;
+    }
+    slots[hole].node = NULL;
+    numNodes--;
+}
+    
+void Quadtree::NodeTable::getNodes(std::vector<Node *> &nodes) const
+{
+    nodes.reserve(nodes.size()+numNodes);
+    for (const Slot &slot : slots)
+        if (slot.node)
+            nodes.push_back(slot.node);
+}
+    
+void Quadtree::NodeTable::grow()
+{
+    std::vector<Slot> oldSlots;
+    oldSlots.swap(slots);
+    
+    Slot empty;
+    empty.key = 0;
+    empty.node = NULL;
+    slots.resize(2*oldSlots.size(),empty);
+    mask = (unsigned int)slots.size()-1;
+    
+    for (const Slot &slot : oldSlots)
+        if (slot.node)
+        {
+            unsigned int which = hashKey(slot.key) & mask;
+            while (slots[which].node)
+                which = (which+1) & mask;
+            slots[which] = slot;
+        }
+}
+    
+Quadtree::NodeHeap::NodeHeap(int Node::*posField,bool maxFirst)
+    : posField(posField), maxFirst(maxFirst)
+{
+}
+    
+bool Quadtree::NodeHeap::before(const Node *a,const Node *b) const
+{
+    return maxFirst ? (b->nodeInfo < a->nodeInfo) : (a->nodeInfo < b->nodeInfo);
+}
+    
+void Quadtree::NodeHeap::place(Node *node,int which)
+{
+    nodes[which] = node;
+    node->*posField = which;
+}
+    
+void Quadtree::NodeHeap::siftUp(int which)
+{
+    Node *node = nodes[which];
+    while (which > 0)
+    {
+        int parent = (which-1)/2;
+        if (!before(node,nodes[parent]))
+            break;
+        place(nodes[parent],which);
+        which = parent;
+    }
+    place(node,which);
+}
+    
+void Quadtree::NodeHeap::siftDown(int which)
+{
+    Node *node = nodes[which];
+    int numNodes = (int)nodes.size();
+    while (true)
+    {
+        int child = 2*which+1;
+        if (child >= numNodes)
+            break;
+        if (child+1 < numNodes && before(nodes[child+1],nodes[child]))
+            child++;
+        if (!before(nodes[child],node))
+            break;
+        place(nodes[child],which);
+        which = child;
+    }
+    place(node,which);
+}
+    
+void Quadtree::NodeHeap::push(Node *node)
+{
+    if (contains(node))
+        return;
+    
+    nodes.push_back(node);
+    node->*posField = (int)nodes.size()-1;
+    siftUp(node->*posField);
+}
+    
+void Quadtree::NodeHeap::remove(Node *node)
+{
+    if (!contains(node))
+        return;
+    
+    int which = node->*posField;
+    node->*posField = -1;
+    Node *last = nodes.back();
+    nodes.pop_back();
+    if (last != node)
+    {
+        place(last,which);
+        siftUp(which);
+        siftDown(last->*posField);
+    }
+}
+    
+void Quadtree::NodeHeap::clear()
+{
+    for (Node *node : nodes)
+        node->*posField = -1;
+    nodes.clear();
+}
 
 Quadtree::Quadtree(Mbr mbr,int minLevel,int maxLevel,int maxNodes,float minImportance,QuadTreeImportanceCalculator *importDelegate)
-    : mbr(mbr), minLevel(minLevel), maxLevel(maxLevel), maxNodes(maxNodes), minImportance(minImportance), numPhantomNodes(0)
+    : mbr(mbr), minLevel(minLevel), maxLevel(maxLevel), maxNodes(maxNodes), minImportance(minImportance), importanceTolerance(0.1), numPhantomNodes(0), knownNumNodes(0),
+      nodesBySize(&Node::sizePos,false), evalNodes(&Node::evalPos,true)
 {
     this->importDelegate = importDelegate;
 }
     
 Quadtree::~Quadtree()
 {
-    for (NodesByIdentType::iterator it = nodesByIdent.begin();
-         it != nodesByIdent.end(); ++it)
-        delete *it;
-    nodesByIdent.clear();
-    nodesBySize.clear();
+    std::vector<Node *> nodes;
+    nodesByIdent.getNodes(nodes);
+    for (Node *node : nodes)
+        delete node;
+    for (Node *node : freeNodes)
+        delete node;
 }
     
 bool Quadtree::isTilePresent(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesBySizeType::iterator it = nodesByIdent.find(&dummyNode);
-    return it != nodesByIdent.end();
+    return nodesByIdent.find(ident) != NULL;
 }
     
 bool Quadtree::isFull()
@@ -227,26 +431,21 @@ bool Quadtree::shouldLoadTile(const Identifier &ident,int frame)
         return true;
     
     // Otherwise, this one needs to be more important
-    NodesBySizeType::iterator it = nodesBySize.begin();
+    Node *compNode = nodesBySize.top();
     // Should never happen
-    if (it == nodesBySize.end())
+    if (!compNode)
         return false;
-    Node *compNode = *it;
     
     return compNode->nodeInfo.importance < node->nodeInfo.importance;
 }
     
 bool Quadtree::isPhantom(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it == nodesByIdent.end())
+    Node *node = getNode(ident);
+    if (!node)
         return false;
 
-    bool phantom = (*it)->nodeInfo.phantom;
-    return phantom;
+    return node->nodeInfo.phantom;
 }
     
     
@@ -365,84 +564,66 @@ void Quadtree::recalcCoverage(Node *node)
     
 void Quadtree::setPhantom(const Identifier &ident,bool newPhantom)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    Node *node = NULL;
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
-    {
-        node = *it;
-        bool wasPhantom = node->nodeInfo.phantom;
-        node->nodeInfo.phantom = newPhantom;
-        if (wasPhantom)
-            numPhantomNodes--;
-        if (newPhantom)
-            numPhantomNodes++;
-    } else
+    Node *node = getNode(ident);
+    if (!node)
         // Haven't heard of it
         return;
 
-    NodesBySizeType::iterator sit = nodesBySize.find(&dummyNode);
-    // Clean it out of the nodes by size if it's a phantom
+    bool wasPhantom = node->nodeInfo.phantom;
+    node->nodeInfo.phantom = newPhantom;
+    if (wasPhantom)
+        numPhantomNodes--;
+    if (newPhantom)
+        numPhantomNodes++;
+
+    // Phantoms stay in the nodes by size so we can still unload them
     if (newPhantom)
     {
         clearFlagCounts(node->nodeInfo.frameFlags);
         node->nodeInfo.frameFlags = 0;
-        if (sit != nodesBySize.end())
-            nodesBySize.erase(sit);
     } else {
         // Add it in if it's no longer a phantom
-        if (sit == nodesBySize.end())
-            nodesBySize.insert(*it);
+        nodesBySize.push(node);
     }
 }
 
 bool Quadtree::isLoading(const Identifier &ident,int frame)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it == nodesByIdent.end())
+    Node *node = getNode(ident);
+    if (!node)
         return false;
     
-    bool loading = (*it)->nodeInfo.isFrameLoading(frame);
-    return loading;
+    return node->nodeInfo.isFrameLoading(frame);
 }
 
 void Quadtree::setLoading(const Identifier &ident,int frame,bool newLoading)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
+    Node *node = getNode(ident);
+    if (!node)
+        // Haven't heard of it
+        return;
+
+    bool wasLoading = node->nodeInfo.isFrameLoading(frame);
+    node->nodeInfo.setFrameLoading(frame,newLoading);
     
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
+    // Let the parents know
+    if (wasLoading && !newLoading)
     {
-        bool wasLoading = (*it)->nodeInfo.isFrameLoading(frame);
-        (*it)->nodeInfo.setFrameLoading(frame,newLoading);
-        
-        // Let the parents know
-        if (wasLoading && !newLoading)
+        Node *parent = node->parent;
+        while (parent)
         {
-            Node *parent = (*it)->parent;
-            while (parent)
-            {
-                parent->nodeInfo.childrenLoading--;
-                parent = parent->parent;
-            }
-        } else if (!wasLoading && newLoading)
+            parent->nodeInfo.childrenLoading--;
+            parent = parent->parent;
+        }
+    } else if (!wasLoading && newLoading)
+    {
+        Node *parent = node->parent;
+        while (parent)
         {
-            Node *parent = (*it)->parent;
-            while (parent)
-            {
-                parent->nodeInfo.childrenLoading++;
-                parent = parent->parent;
-            }
+            parent->nodeInfo.childrenLoading++;
+            parent = parent->parent;
         }
-    } else
-        // Haven't heard of it
-        return;
+    }
 }
     
 void Quadtree::didLoad(const Identifier &tileIdent,int frame)
@@ -467,57 +648,47 @@ void Quadtree::didLoad(const Identifier &tileIdent,int frame)
     
 bool Quadtree::isEvaluating(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it == nodesByIdent.end())
+    Node *node = getNode(ident);
+    if (!node)
         return false;
     
-    bool eval = (*it)->nodeInfo.eval;
-    return eval;
+    return node->nodeInfo.eval;
 }
 
 void Quadtree::setEvaluating(const Identifier &ident,bool newEval)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
+    Node *node = getNode(ident);
+    if (!node)
+        // Haven't heard of it
+        return;
+
+    bool wasEval = node->nodeInfo.eval;
+    node->nodeInfo.eval = newEval;
     
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
+    // Let the parents know
+    if (wasEval && !newEval)
     {
-        bool wasEval = (*it)->nodeInfo.eval;
-        Node *node = *it;
-        node->nodeInfo.eval = newEval;
-        
-        // Let the parents know
-        if (wasEval && !newEval)
+        Node *parent = node->parent;
+        while (parent)
         {
-            Node *parent = node->parent;
-            while (parent)
-            {
-                parent->nodeInfo.childrenEval--;
-                if (parent->nodeInfo.childrenEval < 0)
-                    parent->nodeInfo.childrenEval = 0;
-                parent = parent->parent;
-            }
-            
-            evalNodes.erase(node->evalPos);
-            node->evalPos = evalNodes.end();
-        } else if (!wasEval && newEval)
+            parent->nodeInfo.childrenEval--;
+            if (parent->nodeInfo.childrenEval < 0)
+                parent->nodeInfo.childrenEval = 0;
+            parent = parent->parent;
+        }
+        
+        evalNodes.remove(node);
+    } else if (!wasEval && newEval)
+    {
+        Node *parent = node->parent;
+        while (parent)
         {
-            Node *parent = node->parent;
-            while (parent)
-            {
-                parent->nodeInfo.childrenEval++;
-                parent = parent->parent;
-            }
-            
-            node->evalPos = evalNodes.insert(node).first;
+            parent->nodeInfo.childrenEval++;
+            parent = parent->parent;
         }
-    } else
-        // Haven't heard of it
-        return;
+        
+        evalNodes.push(node);
+    }
 }
     
 bool Quadtree::didFail(const Quadtree::Identifier &ident)
@@ -532,14 +703,9 @@ bool Quadtree::didFail(const Quadtree::Identifier &ident)
     
 void Quadtree::setFailed(const Identifier &ident,bool newFail)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
-    {
-        (*it)->nodeInfo.failed = newFail;
-    }
+    Node *node = getNode(ident);
+    if (node)
+        node->nodeInfo.failed = newFail;
 }
 
 bool Quadtree::childFailed(const Identifier &ident)
@@ -562,36 +728,34 @@ int Quadtree::numEvals()
     
 void Quadtree::clearEvals()
 {
-    for (NodesByIdentType::iterator it = nodesByIdent.begin();it != nodesByIdent.end(); ++it)
+    evalNodes.clear();
+
+    std::vector<Node *> nodes;
+    nodesByIdent.getNodes(nodes);
+    for (Node *node : nodes)
     {
-        Node *node = *it;
-        node->evalPos = evalNodes.end();
         node->nodeInfo.eval = false;
 //        node->nodeInfo.loading = false;
 //        node->nodeInfo.childrenLoading = 0;
         node->nodeInfo.childrenEval = 0;
         node->nodeInfo.failed = false;
     }
-    
-    evalNodes.clear();
 }
     
 void Quadtree::clearFails()
 {
-    for (NodesByIdentType::iterator it = nodesByIdent.begin();it != nodesByIdent.end(); ++it)
-    {
-        Node *node = *it;
+    std::vector<Node *> nodes;
+    nodesByIdent.getNodes(nodes);
+    for (Node *node : nodes)
         node->nodeInfo.failed = false;
-    }
-    }
+}
     
 bool Quadtree::popLastEval(NodeInfo &retNodeInfo)
 {
-    if (evalNodes.empty())
+    Node *node = evalNodes.top();
+    if (!node)
         return false;
-    NodesBySizeType::iterator it = std::prev(evalNodes.end());
-    Node *node = *it;
-    evalNodes.erase(it);
+    evalNodes.remove(node);
     node->nodeInfo.eval = false;
     
     // Remove children eval
@@ -610,29 +774,20 @@ bool Quadtree::popLastEval(NodeInfo &retNodeInfo)
     
 bool Quadtree::childrenLoading(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
-    {
-        return (*it)->nodeInfo.childrenLoading;
-    } else
+    Node *node = getNode(ident);
+    if (!node)
         return false;
+
+    return node->nodeInfo.childrenLoading;
 }
 
 bool Quadtree::childrenEvaluating(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it != nodesByIdent.end())
-    {
-        int numEval = (*it)->nodeInfo.childrenEval;
-        return numEval;
-    } else
+    Node *node = getNode(ident);
+    if (!node)
         return false;
+
+    return node->nodeInfo.childrenEval;
 }
     
 void Quadtree::reevaluateNodes()
@@ -643,18 +798,32 @@ void Quadtree::reevaluateNodes()
     if (nodesByIdent.empty())
         return;
     
-    for (NodesByIdentType::iterator it = nodesByIdent.begin();
-         it != nodesByIdent.end(); ++it)
-    {
-        Node *node = *it;
+    std::vector<Node *> nodes;
+    nodesByIdent.getNodes(nodes);
+    
+    // Children flag their parents below, so clear everyone first
+    for (Node *node : nodes)
         for (unsigned int ii=0;ii<4;ii++)
             node->childOffscreen[ii] = false;
-        node->nodeInfo.importance = importDelegate->importanceForTile(node->nodeInfo.ident, node->nodeInfo.mbr, this, &node->nodeInfo.attrs);
+    
+    // Settle the ones that are off screen in one go
+    std::vector<NodeInfo *> nodeInfos(nodes.size());
+    for (unsigned int ii=0;ii<nodes.size();ii++)
+        nodeInfos[ii] = &nodes[ii]->nodeInfo;
+    std::vector<bool> offScreen(nodes.size(),false);
+    importDelegate->nodesOffScreen(nodeInfos, this, offScreen);
+    
+    for (unsigned int ii=0;ii<nodes.size();ii++)
+    {
+        Node *node = nodes[ii];
+        if (offScreen[ii])
+            node->nodeInfo.importance = 0.0;
+        else if (!importanceSettled(node))
+            node->nodeInfo.importance = importDelegate->importanceForTile(node->nodeInfo.ident, node->nodeInfo.mbr, this, &node->nodeInfo.attrs);
         // Let the parent know this node is offscreen
         if (node->nodeInfo.importance == 0)
         {
             Node *parent = getNode(Identifier(node->nodeInfo.ident.x / 2, node->nodeInfo.ident.y / 2, node->nodeInfo.ident.level - 1));
-
             if (parent)
             {
                 int ix = node->nodeInfo.ident.x-parent->nodeInfo.ident.x*2;
@@ -664,17 +833,42 @@ void Quadtree::reevaluateNodes()
             }
         }
         if (!node->hasChildren())
-            node->sizePos = nodesBySize.insert(node).first;
-        node->evalPos = evalNodes.insert(node).first;
+            nodesBySize.push(node);
+        evalNodes.push(node);
+    }
+    
+    // Recalculate the coverage for children, bottom up
+    std::sort(nodes.begin(),nodes.end(),
+              [](const Node *a,const Node *b) { return a->nodeInfo.ident.level > b->nodeInfo.ident.level; });
+    for (Node *node : nodes)
+        node->recalcCoverage();
+}
+
+bool Quadtree::importanceSettled(Node *node)
+{
+    double minImport,maxImport;
+    if (importanceTolerance <= 0.0 ||
+        !importDelegate->importanceBoundsForTile(node->nodeInfo.ident, node->nodeInfo.mbr, this, &node->nodeInfo.attrs, minImport, maxImport))
+        return false;
+    
+    // Definitely off screen
+    if (maxImport == 0.0)
+    {
+        node->nodeInfo.importance = 0.0;
+        return true;
     }
     
-    // Recalculate the coverage for children
-    NodesByIdentType::iterator it = std::prev(nodesByIdent.end());
-    do {
-        (*it)->recalcCoverage();
-        if (it != nodesByIdent.begin())
-            it = std::prev(it);
-    } while (it != nodesByIdent.begin());
+    // The bounds are relative to the last calculation, which should be what we have
+    float import = node->nodeInfo.importance;
+    if (import < (float)minImport || import > (float)maxImport)
+        return false;
+    
+    // Can't make it over the minimum
+    if (maxImport < minImportance)
+        return true;
+    
+    // Can't drop below the minimum and won't change much
+    return minImport >= minImportance && maxImport <= minImport * (1.0 + importanceTolerance);
 }
 
 const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval,bool checkImportance,std::vector<Identifier> &newlyCoveredTiles)
@@ -686,6 +880,13 @@ const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval
     // Make up a new node
     if (!node)
     {
+        // We can't track tiles this deep or outside their level.  Catch those before we allocate anything.
+        if (!NodeTable::canPack(ident))
+        {
+            WHIRLYKIT_LOGV("Quadtree: Can't track tile %d: (%d,%d)",ident.level,ident.x,ident.y);
+            return NULL;
+        }
+
         // Look for the parent
         Node *parent = NULL;
         if (ident.level > minLevel)
@@ -712,7 +913,7 @@ const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval
         }
         
         // Set up the node first, so we don't remove the parent
-        node = new Node(this);
+        node = newNode();
         node->nodeInfo = nodeInfo;
         node->parent = parent;
         node->nodeInfo.phantom = true;
@@ -722,16 +923,17 @@ const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval
             node->parent->addChild(this,node);
         if (node->nodeInfo.phantom)
             numPhantomNodes++;
+
+        // Add the new node into the lists here, so we don't remove it immediately
+        nodesByIdent.insert(node);
     } else {
         oldEval = node->nodeInfo.eval;
         oldLoading = node->nodeInfo.isFrameLoading(-1);
         node->nodeInfo.eval = newEval;
     }
 
-    // Add the new node into the lists here, so we don't remove it immediately
-    node->identPos = nodesByIdent.insert(node).first;
     if (!node->nodeInfo.phantom)
-        node->sizePos = nodesBySize.insert(node).first;
+        nodesBySize.push(node);
     
     // Let the parents know
     if (!oldEval && newEval)
@@ -742,7 +944,7 @@ const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval
             parent->nodeInfo.childrenEval++;
             parent = parent->parent;
         }
-        node->evalPos = evalNodes.insert(node).first;
+        evalNodes.push(node);
     } else if (oldEval && !newEval)
     {
         Node *parent = node->parent;
@@ -753,9 +955,7 @@ const Quadtree::NodeInfo *Quadtree::addTile(const Identifier &ident,bool newEval
                 parent->nodeInfo.childrenEval = 0;
             parent = parent->parent;
         }
-        NodesBySizeType::iterator it = evalNodes.find(node);
-        if (it != evalNodes.end())
-            evalNodes.erase(it);
+        evalNodes.remove(node);
     }
     
     if (!oldLoading && node->nodeInfo.isFrameLoading(-1))
@@ -838,11 +1038,28 @@ void Quadtree::generateMbrForNode(const Identifier &ident,Point2d &ll,Point2d &u
     
 bool Quadtree::leastImportantNode(NodeInfo &nodeInfo,bool force)
 {
+    if (nodesBySize.empty())
+        return false;
+    
+    // Walk the heap in order, least important first.  The frontier holds heap positions
+    //  whose parents we've already looked at, and is itself a heap.
+    auto frontierCmp = [this](int a,int b) { return nodesBySize.before(nodesBySize.at(b),nodesBySize.at(a)); };
+    std::vector<int> frontier;
+    frontier.push_back(0);
+    
     // Look for the most unimportant node that isn't therwise engaged
-    for (NodesBySizeType::iterator it = nodesBySize.begin();
-         it != nodesBySize.end(); ++it)
+    while (!frontier.empty())
     {
-        Node *node = *it;
+        std::pop_heap(frontier.begin(),frontier.end(),frontierCmp);
+        int which = frontier.back();
+        frontier.pop_back();
+        for (int child = 2*which+1;child <= 2*which+2 && child < nodesBySize.size();child++)
+        {
+            frontier.push_back(child);
+            std::push_heap(frontier.begin(),frontier.end(),frontierCmp);
+        }
+        
+        Node *node = nodesBySize.at(which);
         if (force || node->nodeInfo.importance == 0.0 || ((node->nodeInfo.importance < minImportance && node->nodeInfo.ident.level > minLevel) &&
                                  !node->parentLoading() && node->nodeInfo.childrenLoading == 0 && node->hasNonPhantomParent()))
         {
@@ -873,15 +1090,8 @@ bool Quadtree::parentIsLoading(const Identifier &ident)
     Node *node = getNode(ident);
     if (!node)
         return false;
-    Node *p = node->parent;
-    while (p)
-    {
-        if (p->nodeInfo.isFrameLoading(-1))
-    return true;
-        p = node->parent;
-}
 
-    return false;
+    return node->parentLoading();
 }
 
 bool Quadtree::hasParent(const Quadtree::Identifier &ident,Quadtree::Identifier &parentIdent)
@@ -900,23 +1110,28 @@ bool Quadtree::hasParent(const Quadtree::Identifier &ident,Quadtree::Identifier
 void Quadtree::Print()
 {
 //    NSLog(@"***QuadTree Dump***");
-    for (NodesByIdentType::iterator it = nodesByIdent.begin();
-         it != nodesByIdent.end(); ++it)
-    {
-        Node *node = *it;
+    std::vector<Node *> nodes;
+    nodesByIdent.getNodes(nodes);
+    std::sort(nodes.begin(),nodes.end(),
+              [](const Node *a,const Node *b) { return a->nodeInfo.ident < b->nodeInfo.ident; });
+    for (Node *node : nodes)
         node->Print();
-    }
 //    NSLog(@"******");
 }
 
 Quadtree::Node *Quadtree::getNode(const Identifier &ident)
 {
-    Node dummyNode(this);
-    dummyNode.nodeInfo.ident = ident;
-    NodesByIdentType::iterator it = nodesByIdent.find(&dummyNode);
-    if (it == nodesByIdent.end())
-        return NULL;
-    return *it;
+    return nodesByIdent.find(ident);
+}
+    
+Quadtree::Node *Quadtree::newNode()
+{
+    if (freeNodes.empty())
+        return new Node();
+    
+    Node *node = freeNodes.back();
+    freeNodes.pop_back();
+    return node;
 }
     
 void Quadtree::removeNode(Node *node)
@@ -948,16 +1163,9 @@ void Quadtree::removeNode(Node *node)
         }
     }
     
-    // Note: Iterators don't seem to be safe
-    NodesByIdentType::iterator iit = nodesByIdent.find(node);
-    if (iit != nodesByIdent.end())
-        nodesByIdent.erase(iit);
-    NodesBySizeType::iterator sit = nodesBySize.find(node);
-    if (sit != nodesBySize.end())
-        nodesBySize.erase(sit);
-    NodesBySizeType::iterator eit = evalNodes.find(node);
-    if (eit != evalNodes.end())
-        evalNodes.erase(eit);
+    nodesByIdent.erase(node->nodeInfo.ident);
+    nodesBySize.remove(node);
+    evalNodes.remove(node);
     
     // Note: Shouldn't happen, but just in case
     for (unsigned int ii=0;ii<4;ii++)
@@ -968,7 +1176,9 @@ void Quadtree::removeNode(Node *node)
     if (node->parent)
         node->parent->removeChild(this, node);
     
-    delete node;
+    // Keep the node around for the next tile, minus its attributes
+    *node = Node();
+    freeNodes.push_back(node);
 }
     
 void Quadtree::setMaxNodes(int newMaxNodes)
@@ -981,4 +1191,9 @@ void Quadtree::setMinImportance(float newMinImportance)
     minImportance = newMinImportance;
 }
 
+void Quadtree::setImportanceTolerance(double newTolerance)
+{
+    importanceTolerance = newTolerance;
+}
+
 }
@@ -18,6 +18,7 @@
  *
  */
 
+#import <algorithm>
 #import "WhirlyKitLog.h"
 #import "Scene.h"
 #import "GlobeView.h"
@@ -44,15 +45,17 @@
 namespace WhirlyKit
 {
     
+// Default time we'll spend on change requests per frame
+static const TimeInterval DefaultChangeBudget = 1.0/120.0;
+    
 Scene::Scene()
-    : fontTextureManager(NULL)
+    : drawableDeltasLost(true), changesWaiting(false), nextTimedChange(MAXFLOAT), changeBudget(DefaultChangeBudget), numPendingChanges(0), lastChangesProcessed(0), lastChangeTime(0.0), lastBytesUploaded(0), fontTextureManager(NULL)
 {
 }
     
 void Scene::Init(WhirlyKit::CoordSystemDisplayAdapter *adapter,Mbr localMbr,unsigned int depth)
 {
     pthread_mutex_init(&coordAdapterLock,NULL);
-    pthread_mutex_init(&changeRequestLock,NULL);
     pthread_mutex_init(&subTexLock, NULL);
     pthread_mutex_init(&textureLock,NULL);
     pthread_mutex_init(&generatorLock,NULL);
@@ -136,16 +139,16 @@ Scene::~Scene()
     // Note: Porting
 //    fontTexManager = nil;
     
-    pthread_mutex_lock(&changeRequestLock);
-    auto theChangeRequests = changeRequests;
+    // The change queue cleans up after itself
+    for (ChangeRequest *change : changeRequests)
+        if (change)
+            delete change;
     changeRequests.clear();
-    pthread_mutex_unlock(&changeRequestLock);
-
-    for (unsigned int ii=0;ii<theChangeRequests.size();ii++)
-        delete theChangeRequests[ii];
+    for (ChangeRequest *change : timedChangeRequests)
+        delete change;
+    timedChangeRequests.clear();
     
     pthread_mutex_destroy(&managerLock);
-    pthread_mutex_destroy(&changeRequestLock);
     pthread_mutex_destroy(&subTexLock);
     pthread_mutex_destroy(&textureLock);
     pthread_mutex_destroy(&generatorLock);
@@ -201,32 +204,16 @@ SimpleIdentity Scene::getGeneratorIDByName(const std::string &name)
 }
 
 // Add change requests to our list
+// The renderer sorts out the timed ones when it picks them up
 void Scene::addChangeRequests(const ChangeSet &newChanges)
 {
-    pthread_mutex_lock(&changeRequestLock);
-    
-    for (ChangeRequest *change : newChanges)
-    {
-        if (change && change->when > 0.0)
-            timedChangeRequests.insert(change);
-        else
-            changeRequests.push_back(change);
-    }
-    
-    pthread_mutex_unlock(&changeRequestLock);
+    changeQueue.push(newChanges);
 }
 
 // Add a single change request
 void Scene::addChangeRequest(ChangeRequest *newChange)
 {
-    pthread_mutex_lock(&changeRequestLock);
-    
-    if (newChange && newChange->when > 0.0)
-        timedChangeRequests.insert(newChange);
-    else
-        changeRequests.push_back(newChange);
-    
-    pthread_mutex_unlock(&changeRequestLock);
+    changeQueue.push(newChange);
 }
 
 GLuint Scene::getGLTexture(SimpleIdentity texIdent)
@@ -349,6 +336,8 @@ void Scene::teardownGL()
         cullTree = NULL;
     }
     drawables.clear();
+    drawableDeltas.clear();
+    drawableDeltasLost = true;
     for (TextureSet::iterator it = textures.begin();
          it != textures.end(); ++it)
     {
@@ -388,60 +377,98 @@ const DrawableRefSet &Scene::getDrawables()
 {
     return drawables;
 }
+    
+void Scene::addDrawableDelta(Drawable *draw,bool added)
+{
+    if (drawableDeltasLost)
+        return;
+    
+    // Nobody's been asking, so don't let these pile up
+    if (drawableDeltas.size() >= MaxDrawableDeltas)
+    {
+        drawableDeltas.clear();
+        drawableDeltasLost = true;
+        return;
+    }
+    
+    drawableDeltas.push_back(DrawableDelta(draw,added));
+}
+    
+bool Scene::takeDrawableDeltas(std::vector<DrawableDelta> &deltas)
+{
+    bool valid = !drawableDeltasLost;
+    deltas.swap(drawableDeltas);
+    drawableDeltas.clear();
+    drawableDeltasLost = false;
+    
+    return valid;
+}
 
 // Process outstanding changes.
 // We'll grab the lock and we're only expecting to be called in the rendering thread
 void Scene::processChanges(WhirlyKit::View *view,WhirlyKit::SceneRendererES *renderer,TimeInterval now)
 {
-    // We're not willing to wait in the rendering thread
-    if (!pthread_mutex_trylock(&changeRequestLock))
+    FrameProfilerScope profileScope(&profiler,"Scene changes");
+    
+    // We're on the rendering thread, so this is where a memory warning gets handled
+    memManager.processTrimRequest();
+
+    // Pick up whatever the other threads have sent us.  Timed changes wait in their own heap.
+    ChangeSet newChanges;
+    changeQueue.popAll(newChanges);
+    for (ChangeRequest *req : newChanges)
     {
-        // See if any of the timed changes are ready
-        std::vector<ChangeRequest *> toMove;
-        for (ChangeRequest *req : timedChangeRequests)
-        {
-            if (now >= req->when)
-                toMove.push_back(req);
-            else
-                break;
-        }
-        for (ChangeRequest *req : toMove)
+        if (req && req->when > 0.0)
         {
-            timedChangeRequests.erase(req);
+            timedChangeRequests.push_back(req);
+            std::push_heap(timedChangeRequests.begin(),timedChangeRequests.end(),ChangeHeapSorter());
+        } else
             changeRequests.push_back(req);
+    }
+    
+    // See if any of the timed changes are ready
+    while (!timedChangeRequests.empty() && now >= timedChangeRequests.front()->when)
+    {
+        std::pop_heap(timedChangeRequests.begin(),timedChangeRequests.end(),ChangeHeapSorter());
+        changeRequests.push_back(timedChangeRequests.back());
+        timedChangeRequests.pop_back();
+    }
+    
+    // Work through the changes in order until we run out of time.
+    // The rest stay at the front of the queue for the next frame, so nothing
+    //  gets ahead of a change it depends on.
+    TimeInterval startTime = TimeGetCurrent();
+    TimeInterval spent = 0.0;
+    unsigned int numProcessed = 0;
+    size_t bytesUploaded = 0;
+    bool profiling = profiler.isEnabled();
+    for (;numProcessed<changeRequests.size();numProcessed++)
+    {
+        ChangeRequest *req = changeRequests[numProcessed];
+        if (req) {
+            if (changeBudget > 0.0 && numProcessed > 0 && spent + req->estimateCost() > changeBudget)
+                break;
+            // Requests tend to let go of their data once they run
+            if (profiling)
+                bytesUploaded += req->uploadSize();
+            req->execute(this,renderer,view);
+            delete req;
+            spent = TimeGetCurrent() - startTime;
         }
-        
-        for (unsigned int ii=0;ii<changeRequests.size();ii++)
-        {
-            ChangeRequest *req = changeRequests[ii];
-            if (req) {
-                req->execute(this,renderer,view);
-                delete req;
-            }
-        }
-        changeRequests.clear();
-        
-        pthread_mutex_unlock(&changeRequestLock);
     }
+    changeRequests.erase(changeRequests.begin(),changeRequests.begin()+numProcessed);
+    
+    changesWaiting = !changeRequests.empty();
+    nextTimedChange = timedChangeRequests.empty() ? MAXFLOAT : timedChangeRequests.front()->when;
+    numPendingChanges = changeRequests.size() + timedChangeRequests.size();
+    lastChangesProcessed = numProcessed;
+    lastChangeTime = spent;
+    lastBytesUploaded = bytesUploaded;
 }
     
 bool Scene::hasChanges(TimeInterval now)
 {
-    bool changes = false;
-    if (!pthread_mutex_trylock(&changeRequestLock))
-    {
-        changes = !changeRequests.empty();
-        
-        if (!changes)
-            if (timedChangeRequests.size() > 0)
-                changes = now >= (*timedChangeRequests.begin())->when;
-        
-        pthread_mutex_unlock(&changeRequestLock);
-    }
-    if (changes)
-        return true;
-    
-    return changes;
+    return !changeQueue.empty() || changesWaiting || now >= nextTimedChange;
 }
 
 // Add a single sub texture map
@@ -664,6 +691,27 @@ void AddTextureReq::setupGL(WhirlyKitGLSetupInfo *setupInfo,OpenGLMemManager *me
         tex->createInGL(memManager);
 }
     
+TimeInterval AddTextureReq::estimateCost()
+{
+    if (!tex || tex->getGLId())
+        return ChangeBaseCost;
+    
+    // Uploads are the big one
+    return ChangeGLObjectCost + uploadSize() * ChangeGLByteCost;
+}
+    
+size_t AddTextureReq::uploadSize()
+{
+    if (!tex || tex->getGLId())
+        return 0;
+    
+    Texture *fullTex = dynamic_cast<Texture *>(tex);
+    if (fullTex)
+        return fullTex->getWidth() * fullTex->getHeight() * 4;
+    
+    return 0;
+}
+    
 void AddTextureReq::execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view)
 {
     if (!tex->getGLId())
@@ -694,6 +742,24 @@ AddDrawableReq::~AddDrawableReq()
     drawable = NULL;
 }
 
+TimeInterval AddDrawableReq::estimateCost()
+{
+    size_t numBytes = uploadSize();
+    if (numBytes == 0)
+        return ChangeBaseCost;
+    return ChangeGLObjectCost + numBytes * ChangeGLByteCost;
+}
+    
+size_t AddDrawableReq::uploadSize()
+{
+    // Drawables set up on another thread have already let go of their geometry
+    BasicDrawable *basicDraw = dynamic_cast<BasicDrawable *>(drawable);
+    if (basicDraw)
+        return basicDraw->getNumPoints() * basicDraw->singleVertexSize() + basicDraw->getNumTris() * sizeof(BasicDrawable::Triangle);
+    
+    return 0;
+}
+
 void AddDrawableReq::execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view)
 {
     // If this is an instance, deal with that madness
@@ -714,6 +780,7 @@ void AddDrawableReq::execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,W
 
     DrawableRef drawRef(drawable);
     scene->addDrawable(drawRef);
+    scene->addDrawableDelta(drawable,true);
     
     // Initialize any OpenGL foo
     WhirlyKitGLSetupInfo setupInfo;
@@ -736,7 +803,8 @@ void RemDrawableReq::execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,W
         // Teardown OpenGL foo
         (*it)->teardownGL(scene->getMemManager());
 
-        scene->remDrawable(*it);        
+        scene->addDrawableDelta(it->get(),false);
+        scene->remDrawable(*it);
     }
 }
 
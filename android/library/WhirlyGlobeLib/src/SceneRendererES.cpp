@@ -399,10 +399,9 @@ void SceneRendererES::mergeDrawableSet(const std::set<DrawableRef,IdentifiableRe
          it != newDrawables.end(); ++it)
     {
         DrawableRef draw = *it;
-        // Make sure we haven't added it already and it's on
-        // Note: We're doing the on check repeatedly
-        //       And we're doing the refusal check repeatedly as well, possibly
-        if ((toDraw->find(draw) == toDraw->end()) && draw->isOn(frameInfo))
+        // Make sure we haven't added it already
+        // The renderer checks if it's on, every frame, since it may reuse this set
+        if (toDraw->find(draw) == toDraw->end())
             toDraw->insert(draw);
     }
 }
@@ -18,6 +18,9 @@
  *
  */
 
+#import <unordered_set>
+#import <unordered_map>
+#import <algorithm>
 #import "Platform.h"
 #import "SceneRendererES2.h"
 #import "GLUtils.h"
@@ -35,57 +38,264 @@ namespace WhirlyKit
 class DrawableContainer
 {
 public:
-    DrawableContainer(Drawable *draw) : drawable(draw) { mvpMat = mvpMat.Identity(); mvMat = mvMat.Identity();  mvNormalMat = mvNormalMat.Identity(); }
-    DrawableContainer(Drawable *draw,Matrix4d mvpMat,Matrix4d mvMat,Matrix4d mvNormalMat) : drawable(draw), mvpMat(mvpMat), mvMat(mvMat), mvNormalMat(mvNormalMat) { }
+    DrawableContainer(Drawable *draw) : drawable(draw), offset(0) { mvpMat = mvpMat.Identity(); mvMat = mvMat.Identity();  mvNormalMat = mvNormalMat.Identity(); }
+    DrawableContainer(Drawable *draw,Matrix4d mvpMat,Matrix4d mvMat,Matrix4d mvNormalMat) : drawable(draw), offset(0), mvpMat(mvpMat), mvMat(mvMat), mvNormalMat(mvNormalMat) { }
     
     Drawable *drawable;
+    // Which offset matrix we're using
+    unsigned int offset;
     Matrix4d mvpMat,mvMat,mvNormalMat;
 };
 
-// Alpha stuff goes at the end
-// Otherwise sort by draw priority
-class DrawListSortStruct2
+// Set up the matrices for a drawable given the ones for its offset
+static void SetContainerMatrices(DrawableContainer &drawContain,const Matrix4d &projMat,const Matrix4d &mvMat,const Matrix4d &mvNormalMat)
+{
+    const Matrix4d *localMat = drawContain.drawable->getMatrix();
+    if (localMat)
+    {
+        drawContain.mvMat = mvMat * (*localMat);
+        drawContain.mvpMat = projMat * drawContain.mvMat;
+        drawContain.mvNormalMat = drawContain.mvMat.inverse().transpose();
+    } else {
+        drawContain.mvMat = mvMat;
+        drawContain.mvpMat = projMat * mvMat;
+        drawContain.mvNormalMat = mvNormalMat;
+    }
+}
+
+// Sort key for a drawable and where it is in the draw list
+class DrawListSortEntry
+{
+public:
+    uint64_t key;
+    unsigned int which;
+};
+
+// Least significant digit radix sort, a byte at a time.  It's stable.
+// Bytes that are the same for every key get skipped, which is usually most of them.
+static void RadixSortDrawList(std::vector<DrawListSortEntry> &entries)
+{
+    if (entries.size() < 2)
+        return;
+    
+    // The byte counts don't depend on the order, so we can get them all in one pass
+    std::vector<unsigned int> counts(8*256,0);
+    for (const DrawListSortEntry &entry : entries)
+        for (unsigned int bi=0;bi<8;bi++)
+            counts[bi*256 + ((entry.key >> (bi*8)) & 0xff)]++;
+    
+    std::vector<DrawListSortEntry> scratch(entries.size());
+    for (unsigned int bi=0;bi<8;bi++)
+    {
+        unsigned int *count = &counts[bi*256];
+        if (count[(entries[0].key >> (bi*8)) & 0xff] == entries.size())
+            continue;
+        
+        unsigned int offset = 0;
+        for (unsigned int ci=0;ci<256;ci++)
+        {
+            unsigned int num = count[ci];
+            count[ci] = offset;
+            offset += num;
+        }
+        for (const DrawListSortEntry &entry : entries)
+            scratch[count[(entry.key >> (bi*8)) & 0xff]++] = entry;
+        entries.swap(scratch);
+    }
+}
+
+// Alpha stuff goes at the end if we're asked.
+// Otherwise sort by draw priority, then z buffer request, then program and texture.
+static uint64_t DrawListKey(Drawable *draw,bool useAlpha,WhirlyKit::RendererFrameInfo *frameInfo)
+{
+    uint64_t key = draw->getSortKey();
+    // Alpha can change frame to frame (e.g. fades), so it's not in the cached key
+    if (useAlpha && draw->hasAlpha(frameInfo))
+        key |= DrawSortKeyAlphaBit;
+    return key;
+}
+
+static void SortDrawList(std::vector<DrawableContainer> &drawList,bool useAlpha,WhirlyKit::RendererFrameInfo *frameInfo)
+{
+    std::vector<DrawListSortEntry> entries(drawList.size());
+    for (unsigned int ii=0;ii<drawList.size();ii++)
+    {
+        entries[ii].key = DrawListKey(drawList[ii].drawable,useAlpha,frameInfo);
+        entries[ii].which = ii;
+    }
+    
+    RadixSortDrawList(entries);
+
+    std::vector<DrawableContainer> sortedList;
+    sortedList.reserve(drawList.size());
+    for (const DrawListSortEntry &entry : entries)
+        sortedList.push_back(drawList[entry.which]);
+    drawList.swap(sortedList);
+}
+
+// A drawable that's on this frame, what we'll sort it by and its offset matrix
+class DrawListItem
+{
+public:
+    DrawListItem(Drawable *draw,uint64_t key,unsigned int offset) : draw(draw), key(key), offset(offset) { }
+    
+    bool operator == (const DrawListItem &that) const { return draw == that.draw && key == that.key && offset == that.offset; }
+    
+    Drawable *draw;
+    uint64_t key;
+    unsigned int offset;
+};
+
+// Sort the drawables that are on and set up their matrices
+static void BuildDrawList(const std::vector<DrawListItem> &drawItems,const Matrix4d &projMat,const std::vector<Matrix4d> &mvMats,const std::vector<Matrix4d> &mvNormalMats,std::vector<DrawableContainer> &drawList)
+{
+    std::vector<DrawListSortEntry> entries(drawItems.size());
+    for (unsigned int ii=0;ii<drawItems.size();ii++)
+    {
+        entries[ii].key = drawItems[ii].key;
+        entries[ii].which = ii;
+    }
+    
+    RadixSortDrawList(entries);
+    
+    drawList.clear();
+    drawList.reserve(entries.size());
+    for (const DrawListSortEntry &entry : entries)
+    {
+        const DrawListItem &item = drawItems[entry.which];
+        drawList.push_back(DrawableContainer(item.draw));
+        DrawableContainer &drawContain = drawList.back();
+        drawContain.offset = item.offset;
+        SetContainerMatrices(drawContain,projMat,mvMats[item.offset],mvNormalMats[item.offset]);
+    }
+}
+
+// How we're finding the drawables to draw
+typedef enum {CullModeRaw,CullModeFlat,CullModeTree} CullMode;
+
+/* What we culled last frame and the view we culled it for.
+    If the view doesn't change, we patch the visible sets with what the scene
+    added and removed rather than culling again.  If the same drawables are on
+    with the same sort keys, we can reuse the sorted draw list too.
+  */
+class CullCache
 {
 public:
-    DrawListSortStruct2(bool useAlpha,bool useZBuffer,WhirlyKit::RendererFrameInfo *frameInfo) : useAlpha(useAlpha), useZBuffer(useZBuffer), frameInfo(frameInfo)
+    CullCache() : valid(false), cullMode(CullModeRaw) { }
+    
+    // Toss it all, we'll cull from scratch next frame
+    void clear()
     {
+        valid = false;
+        viewMbrs.clear();
+        visible.clear();
+        drawItems.clear();
+        drawList.clear();
     }
-    DrawListSortStruct2() { }
-    DrawListSortStruct2(const DrawListSortStruct &that) : useAlpha(that.useAlpha), useZBuffer(that.useZBuffer), frameInfo(that.frameInfo)
+    
+    // True if we last culled the same way, with the same projection and number of offset matrices
+    bool isSameSetup(int inCullMode,const Matrix4d &inProjMat,const std::vector<Matrix4d> &inMvMats,const Point2f &inFrameSize)
     {
+        return valid && cullMode == inCullMode && frameSize == inFrameSize && projMat == inProjMat &&
+               mvMats.size() == inMvMats.size();
     }
-    DrawListSortStruct2 & operator = (const DrawListSortStruct &that)
+    
+    // True if we last culled for exactly this view.  Check the setup first.
+    bool isSameView(const std::vector<Matrix4d> &inMvMats)
     {
-        useAlpha = that.useAlpha;
-        useZBuffer= that.useZBuffer;
-        frameInfo = that.frameInfo;
-        return *this;
+        for (unsigned int ii=0;ii<mvMats.size();ii++)
+            if (mvMats[ii] != inMvMats[ii])
+                return false;
+        return true;
     }
-    bool operator()(const DrawableContainer &conA, const DrawableContainer &conB)
+    
+    // Set up for a full cull of this view
+    void reset(int inCullMode,const Matrix4d &inProjMat,const std::vector<Matrix4d> &inMvMats,const Point2f &inFrameSize)
     {
-        Drawable *a = conA.drawable;
-        Drawable *b = conB.drawable;
-        // We may or may not sort all alpha containing drawables to the end
-        if (useAlpha)
-            if (a->hasAlpha(frameInfo) != b->hasAlpha(frameInfo))
-                return !a->hasAlpha(frameInfo);
- 
-        if (a->getDrawPriority() == b->getDrawPriority())
+        valid = true;
+        cullMode = inCullMode;
+        projMat = inProjMat;
+        mvMats = inMvMats;
+        frameSize = inFrameSize;
+        viewMbrs.clear();
+        viewMbrs.resize(mvMats.size());
+        visible.resize(mvMats.size());
+        for (std::vector<Drawable *> &vis : visible)
+            vis.clear();
+    }
+    
+    // Patch one visible set with what the flat cull tree says came and went when the view moved
+    void applyMove(unsigned int off,const std::vector<Drawable *> &entered,const std::vector<Drawable *> &left)
+    {
+        std::vector<Drawable *> &vis = visible[off];
+        if (!left.empty())
         {
-            if (useZBuffer)
-            {
-                bool bufferA = a->getRequestZBuffer();
-                bool bufferB = b->getRequestZBuffer();
-                if (bufferA != bufferB)
-                    return !bufferA;
-            }
+            std::unordered_set<Drawable *> leftSet(left.begin(),left.end());
+            vis.erase(std::remove_if(vis.begin(),vis.end(),
+                                     [&leftSet](Drawable *draw) { return leftSet.find(draw) != leftSet.end(); }),
+                      vis.end());
         }
-                
-        return a->getDrawPriority() < b->getDrawPriority();
+        vis.insert(vis.end(),entered.begin(),entered.end());
     }
     
-    bool useAlpha,useZBuffer;
-    WhirlyKit::RendererFrameInfo *frameInfo;
+    // Patch the visible sets with drawables the scene added and removed.
+    // Returns false if we can't and need to cull again.
+    bool applyDeltas(const std::vector<DrawableDelta> &deltas,FlatCullTree *flatCullTree)
+    {
+        if (deltas.empty())
+            return true;
+        
+        // A removed drawable's pointer can come back for a new one, so only the last thing that happened counts.
+        // We never look at removed drawables, they may be gone.
+        std::unordered_set<Drawable *> removed;
+        std::unordered_map<Drawable *,bool> lastAdded;
+        for (const DrawableDelta &delta : deltas)
+        {
+            if (!delta.added)
+                removed.insert(delta.draw);
+            lastAdded[delta.draw] = delta.added;
+        }
+        
+        // The globe cull tree looks at a lot more than overlap, so we just run it again
+        if (cullMode == CullModeTree)
+            for (auto it : lastAdded)
+                if (it.second)
+                    return false;
+        
+        if (!removed.empty())
+            for (std::vector<Drawable *> &vis : visible)
+                vis.erase(std::remove_if(vis.begin(),vis.end(),
+                                         [&removed](Drawable *draw) { return removed.find(draw) != removed.end(); }),
+                          vis.end());
+        
+        for (const DrawableDelta &delta : deltas)
+        {
+            auto it = lastAdded.find(delta.draw);
+            if (!delta.added || !it->second)
+                continue;
+            it->second = false;
+            
+            for (unsigned int off=0;off<visible.size();off++)
+                if (!flatCullTree || flatCullTree->isInView(delta.draw,viewMbrs[off]))
+                    visible[off].push_back(delta.draw);
+        }
+        
+        return true;
+    }
+    
+    bool valid;
+    int cullMode;
+    Matrix4d projMat;
+    std::vector<Matrix4d> mvMats;
+    Point2f frameSize;
+    // View MBRs for each offset matrix when we're using a flat cull tree
+    std::vector<std::vector<Mbr> > viewMbrs;
+    // What might be visible for each offset matrix.  Not checked for isOn().
+    std::vector<std::vector<Drawable *> > visible;
+    // What we sorted last time, in the order we found it
+    std::vector<DrawListItem> drawItems;
+    // The sorted list we drew with
+    std::vector<DrawableContainer> drawList;
 };
     
 }
@@ -95,6 +305,8 @@ SceneRendererES2::SceneRendererES2()
 // Note: Porting
 : SceneRendererES(2), renderStateOptimizer(NULL), extraFrameDrawn(false)
 {
+    cullCache = new CullCache();
+
     // Add a simple default light
     WhirlyKitDirectionalLight *light = new WhirlyKitDirectionalLight();
     light->setPos(Vector3f(0.75,0.5, -1.0));
@@ -126,6 +338,7 @@ SceneRendererES2::~SceneRendererES2()
     if (renderStateOptimizer)
         delete renderStateOptimizer;
     renderStateOptimizer = NULL;
+    delete cullCache;
 }
 
 void SceneRendererES2::forceRenderSetup()
@@ -139,6 +352,7 @@ void SceneRendererES2::setScene(WhirlyKit::Scene *inScene)
 {
     SceneRendererES::setScene(inScene);
     scene = inScene;
+    cullCache->clear();
     
     SetupDefaultShaders(scene);
     
@@ -193,6 +407,64 @@ bool SceneRendererES2::hasChanges()
 // Make the screen a bit bigger for testing
 static const float ScreenOverlap = 0.1;
 
+// Work out what part of a flat map is in view, in both local and geographic coordinates.
+// Drawables might have their MBRs in either one.
+// Returns false if we can't tell, such as when the horizon is showing.
+static bool CalcFlatViewMbrs(Maply::MapView *mapView,CoordSystemDisplayAdapter *coordAdapter,const Matrix4d &modelAndViewMat,const Point2f &frameSize,Mbr &localMbr,Mbr &geoMbr)
+{
+    CoordSystem *coordSys = coordAdapter->getCoordSystem();
+    
+    // Stretch the screen a little for safety, as with the globe
+    Point2f corners[4];
+    corners[0] = Point2f(-ScreenOverlap*frameSize.x(),-ScreenOverlap*frameSize.y());
+    corners[1] = Point2f((1+ScreenOverlap)*frameSize.x(),-ScreenOverlap*frameSize.y());
+    corners[2] = Point2f((1+ScreenOverlap)*frameSize.x(),(1+ScreenOverlap)*frameSize.y());
+    corners[3] = Point2f(-ScreenOverlap*frameSize.x(),(1+ScreenOverlap)*frameSize.y());
+    for (unsigned int ii=0;ii<4;ii++)
+    {
+        Point3d hit;
+        if (!mapView->pointOnPlaneFromScreen(corners[ii],&modelAndViewMat,frameSize,&hit,false))
+            return false;
+        // Rays that miss the plane come back with a hit behind the eye
+        Vector4d eyePt = modelAndViewMat * Vector4d(hit.x(),hit.y(),hit.z(),1.0);
+        if (eyePt.z() >= 0.0)
+            return false;
+        
+        Point3d localPt = coordAdapter->displayToLocal(hit);
+        localMbr.addPoint(Point2f(localPt.x(),localPt.y()));
+        GeoCoord geoPt = coordSys->localToGeographic(localPt);
+        geoMbr.addPoint(Point2f(geoPt.x(),geoPt.y()));
+    }
+    
+    return true;
+}
+
+// If the view moved less than this fraction of its size, we just look at what crossed the edges
+static const float SmallViewMove = 0.5;
+
+// True if the new flat view is close enough to the old one that patching the visible set beats searching again.
+// We only judge by the local MBRs, which is what most drawables use.
+static bool IsSmallFlatMove(const std::vector<Mbr> &oldMbrs,const std::vector<Mbr> &newMbrs)
+{
+    // One MBR means we couldn't tell what was in view
+    if (oldMbrs.size() != 2 || newMbrs.size() != 2)
+        return false;
+    
+    const Mbr &oldMbr = oldMbrs[0],&newMbr = newMbrs[0];
+    Point2f oldSize = oldMbr.ur() - oldMbr.ll(),newSize = newMbr.ur() - newMbr.ll();
+    for (unsigned int ii=0;ii<2;ii++)
+    {
+        // Zoomed too far
+        if (newSize[ii] > oldSize[ii] * (1.0+SmallViewMove) || newSize[ii] < oldSize[ii] * (1.0-SmallViewMove))
+            return false;
+        // Panned too far
+        if (std::abs(newMbr.mid()[ii] - oldMbr.mid()[ii]) > SmallViewMove * oldSize[ii])
+            return false;
+    }
+    
+    return true;
+}
+
 void SceneRendererES2::render()
 {
     if (!scene || !theView)
@@ -220,6 +492,13 @@ void SceneRendererES2::render()
         extraFrameDrawn = false;
     
     lastDraw = TimeGetCurrent();
+    
+    // The frame profiler is cheap enough to leave on, unlike the perf timer
+    FrameProfiler *profiler = scene->getProfiler();
+    bool profiling = profiler->isEnabled();
+    TimeInterval phaseStart = lastDraw;
+    if (profiling)
+        profiler->startFrame();
         
     if (perfInterval > 0)
         perfTimer.startTiming("Render Frame");
@@ -297,6 +576,8 @@ void SceneRendererES2::render()
         {
             // Note: Porting
 //            NSLog(@"SceneRendererES2: No valid triangle or line shader.  Giving up.");
+            if (profiling)
+                profiler->endFrame();
             return;
         }
         
@@ -343,6 +624,9 @@ void SceneRendererES2::render()
             baseFrameInfo.heightAboveSurface = globeView->heightAboveSurface();
         baseFrameInfo.eyePos = Vector3d(eyeVec4d.x(),eyeVec4d.y(),eyeVec4d.z()) * (1.0+baseFrameInfo.heightAboveSurface);
 
+        if (profiling)
+            phaseStart = profiler->endPhase("Render setup",phaseStart);
+        
         if (perfInterval > 0)
             perfTimer.startTiming("Scene processing");
         
@@ -362,9 +646,16 @@ void SceneRendererES2::render()
 		// Merge any outstanding changes into the scenegraph
 		// Or skip it if we don't acquire the lock
 		scene->processChanges(theView,this,lastDraw);
+        // The scene records its own phase
+        if (profiling)
+            phaseStart = TimeGetCurrent();
         
         if (perfInterval > 0)
+        {
+            perfTimer.addCount("Scene changes processed", scene->getLastChangesProcessed());
+            perfTimer.addCount("Scene changes pending", scene->getNumPendingChanges());
             perfTimer.stopTiming("Scene processing");
+        }
         
         if (perfInterval > 0)
             perfTimer.startTiming("Culling");
@@ -393,26 +684,52 @@ void SceneRendererES2::render()
 		
         // Work through the available offset matrices (only 1 if we're not wrapping)
         std::vector<Matrix4d> &offsetMats = baseFrameInfo.offsetMatrices;
-        // Turn these drawables in to a vector
-        std::vector<DrawableContainer> drawList;
         std::vector<DrawableRef> screenDrawables;
         std::vector<DrawableRef> generatedDrawables;
-        std::vector<Matrix4d> mvpMats;
+        std::vector<Matrix4d> mvpMats,mvMats,mvNormalMats;
         std::vector<Matrix4f> mvpMats4f;
         mvpMats.resize(offsetMats.size());
+        mvMats.resize(offsetMats.size());
+        mvNormalMats.resize(offsetMats.size());
         mvpMats4f.resize(offsetMats.size());
         for (unsigned int off=0;off<offsetMats.size();off++)
+        {
+            mvMats[off] = viewTrans4d * offsetMats[off] * modelTrans4d;
+            mvpMats[off] = projMat4d * mvMats[off];
+            mvpMats4f[off] = Matrix4dToMatrix4f(mvpMats[off]);
+            mvNormalMats[off] = mvMats[off].inverse().transpose();
+        }
+        
+        // If we're looking at exactly what we were last frame, we only need to
+        //  patch last frame's visible sets with what the scene added and removed
+        FlatCullTree *flatCullTree = mapView ? scene->getFlatCullTree() : NULL;
+        int cullMode = flatCullTree ? CullModeFlat : (doCulling ? CullModeTree : CullModeRaw);
+        // If it moved a little, flat maps can patch them with what crossed the edges of the view
+        std::vector<DrawableDelta> deltas;
+        bool sameSetup = scene->takeDrawableDeltas(deltas) &&
+                         cullCache->isSameSetup(cullMode,projMat4d,mvMats,frameSize);
+        bool sameView = sameSetup && cullCache->isSameView(mvMats);
+        bool reuseVisible = sameView && cullCache->applyDeltas(deltas,flatCullTree);
+        bool moveVisible = !sameView && sameSetup && flatCullTree && cullCache->applyDeltas(deltas,flatCullTree);
+        if (moveVisible)
+            cullCache->mvMats = mvMats;
+        else if (!reuseVisible)
+            cullCache->reset(cullMode,projMat4d,mvMats,frameSize);
+        int visibleSetsMoved = 0;
+        
+        // Everything that's on, with its sort key
+        std::vector<DrawListItem> drawItems;
+        int drawablesConsidered = 0;
+        int cullTreeCount = 0;
+        for (unsigned int off=0;off<offsetMats.size();off++)
         {
             WhirlyKit::RendererFrameInfo offFrameInfo(baseFrameInfo);
             // Tweak with the appropriate offset matrix
-            modelAndViewMat4d = viewTrans4d * offsetMats[off] * modelTrans4d;
+            modelAndViewMat4d = mvMats[off];
             pvMat = projMat4d * viewTrans4d * offsetMats[off];
             modelAndViewMat = Matrix4dToMatrix4f(modelAndViewMat4d);
-            mvpMats[off] = projMat4d * modelAndViewMat4d;
-            mvpMats4f[off] = Matrix4dToMatrix4f(mvpMats[off]);
-            modelAndViewNormalMat4d = modelAndViewMat4d.inverse().transpose();
+            modelAndViewNormalMat4d = mvNormalMats[off];
             modelAndViewNormalMat = Matrix4dToMatrix4f(modelAndViewNormalMat4d);
-            Matrix4d &thisMvpMat = mvpMats[off];
             offFrameInfo.mvpMat = mvpMats4f[off];
             mvpNormalMat4f = Matrix4dToMatrix4f(mvpMats[off].inverse().transpose());
             offFrameInfo.mvpNormalMat = mvpNormalMat4f;
@@ -423,103 +740,129 @@ void SceneRendererES2::render()
             offFrameInfo.pvMat = pvMat4f;
             offFrameInfo.pvMat4d = pvMat;
             
-            // If we're looking at a globe, run the culling
-            int drawablesConsidered = 0;
-            int cullTreeCount = 0;
-            if (doCulling)
+            std::vector<Drawable *> &visible = cullCache->visible[off];
+            if (!reuseVisible)
             {
-                std::set<DrawableRef> toDraw;
-                CullTree *cullTree = scene->getCullTree();
-                // Recursively search for the drawables that overlap the screen
-                Mbr screenMbr;
-                // Stretch the screen MBR a little for safety
-                screenMbr.addPoint(Point2f(-ScreenOverlap*framebufferWidth,-ScreenOverlap*framebufferHeight));
-                screenMbr.addPoint(Point2f((1+ScreenOverlap)*framebufferWidth,(1+ScreenOverlap)*framebufferHeight));
-                findDrawables(cullTree->getTopCullable(),globeView,frameSize,&modelTrans4d,eyeVec3,&offFrameInfo,screenMbr,true,&toDraw,&drawablesConsidered);
-                
-                //		drawList.reserve(toDraw.size());
-                for (std::set<DrawableRef>::iterator it = toDraw.begin();
-                     it != toDraw.end(); ++it)
+                if (flatCullTree)
                 {
-                    Drawable *theDrawable = it->get();
-                    if (theDrawable)
+                    // Flat maps look up what's in view with a 2D search
+                    std::vector<Mbr> viewMbrs(2);
+                    if (!CalcFlatViewMbrs(mapView,scene->getCoordAdapter(),modelAndViewMat4d,frameSize,viewMbrs[0],viewMbrs[1]))
                     {
-                        const Matrix4d *localMat = theDrawable->getMatrix();
-                        if (localMat)
-                        {
-                            Eigen::Matrix4d newMvpMat = projMat4d * viewTrans4d * offsetMats[off] * modelTrans4d * (*localMat);
-                            Eigen::Matrix4d newMvMat = viewTrans4d * offsetMats[off] * modelTrans4d * (*localMat);
-                            Eigen::Matrix4d newMvNormalMat = newMvMat.inverse().transpose();
-                            drawList.push_back(DrawableContainer(theDrawable,newMvpMat,newMvMat,newMvNormalMat));
-                        } else
-                            drawList.push_back(DrawableContainer(theDrawable,thisMvpMat,modelAndViewMat4d,modelAndViewNormalMat4d));
-                    } else
-                        fprintf(stderr,"Bad drawable coming from cull tree.");
-                }
-                cullTreeCount = cullTree->getCount();
-            } else {
-                DrawableRefSet rawDrawables = scene->getDrawables();
-                for (DrawableRefSet::iterator it = rawDrawables.begin(); it != rawDrawables.end(); ++it)
-                {
-                    Drawable *theDrawable = it->get();
-                    if (theDrawable->isOn(&offFrameInfo))
+                        viewMbrs.resize(1);
+                        viewMbrs[0] = Mbr(Point2f(-MAXFLOAT,-MAXFLOAT),Point2f(MAXFLOAT,MAXFLOAT));
+                    }
+                    std::vector<Mbr> &lastViewMbrs = cullCache->viewMbrs[off];
+                    if (moveVisible && IsSmallFlatMove(lastViewMbrs,viewMbrs))
                     {
-                        const Matrix4d *localMat = theDrawable->getMatrix();
-                        if (localMat)
-                        {
-                            Eigen::Matrix4d newMvpMat = projMat4d * viewTrans4d * offsetMats[off] * modelTrans4d * (*localMat);
-                            Eigen::Matrix4d newMvMat = viewTrans4d * offsetMats[off] * modelTrans4d * (*localMat);
-                            Eigen::Matrix4d newMvNormalMat = newMvMat.inverse().transpose();
-                            drawList.push_back(DrawableContainer(theDrawable,newMvpMat,newMvMat,newMvNormalMat));
-                        } else
-                            drawList.push_back(DrawableContainer(theDrawable,thisMvpMat,modelAndViewMat4d,modelAndViewNormalMat4d));
+                        // Only the nodes crossing the edge of the old or new view can change
+                        std::vector<Drawable *> entered,left;
+                        flatCullTree->findChanges(lastViewMbrs,viewMbrs,entered,left,&drawablesConsidered);
+                        cullCache->applyMove(off,entered,left);
+                        visibleSetsMoved++;
+                    } else {
+                        visible.clear();
+                        flatCullTree->findDrawables(viewMbrs,visible,&drawablesConsidered);
                     }
-                }
-            }
-            
-            
-            if (perfInterval > 0)
-                perfTimer.stopTiming("Culling");
-            
-            if (perfInterval > 0)
-                perfTimer.startTiming("Generators - generate");
-
-            // Run the generators only once, they have to be aware of multiple offset matrices
-            if (off == offsetMats.size()-1)
-            {
-                // Now ask our generators to make their drawables
-                // Note: Not doing any culling here
-                //       And we should reuse these Drawables
-                const GeneratorSet *generators = scene->getGenerators();
-                for (GeneratorSet::iterator it = generators->begin();
-                     it != generators->end(); ++it)
-                    (*it)->generateDrawables(&baseFrameInfo, generatedDrawables, screenDrawables);
-                
-                // Add the generated drawables and sort them all together
-                for (unsigned int ii=0;ii<generatedDrawables.size();ii++)
+                    lastViewMbrs.swap(viewMbrs);
+                    cullTreeCount = flatCullTree->getNodeCount();
+                } else if (doCulling)
                 {
-                    Drawable *theDrawable = generatedDrawables[ii].get();
-                    if (theDrawable)
-                        drawList.push_back(DrawableContainer(theDrawable,thisMvpMat,modelAndViewMat4d,modelAndViewNormalMat4d));
+                    // If we're looking at a globe, run the culling
+                    std::set<DrawableRef> toDraw;
+                    CullTree *cullTree = scene->getCullTree();
+                    // Recursively search for the drawables that overlap the screen
+                    Mbr screenMbr;
+                    // Stretch the screen MBR a little for safety
+                    screenMbr.addPoint(Point2f(-ScreenOverlap*framebufferWidth,-ScreenOverlap*framebufferHeight));
+                    screenMbr.addPoint(Point2f((1+ScreenOverlap)*framebufferWidth,(1+ScreenOverlap)*framebufferHeight));
+                    findDrawables(cullTree->getTopCullable(),globeView,frameSize,&modelTrans4d,eyeVec3,&offFrameInfo,screenMbr,true,&toDraw,&drawablesConsidered);
+                    
+                    visible.reserve(toDraw.size());
+                    for (std::set<DrawableRef>::iterator it = toDraw.begin();
+                         it != toDraw.end(); ++it)
+                    {
+                        if (it->get())
+                            visible.push_back(it->get());
+                        else
+                            fprintf(stderr,"Bad drawable coming from cull tree.");
+                    }
+                    cullTreeCount = cullTree->getCount();
+                } else {
+                    const DrawableRefSet &rawDrawables = scene->getDrawables();
+                    visible.reserve(rawDrawables.size());
+                    for (DrawableRefSet::const_iterator it = rawDrawables.begin(); it != rawDrawables.end(); ++it)
+                        visible.push_back(it->get());
                 }
-                bool sortLinesToEnd = (zBufferMode == zBufferOffDefault);
-                std::sort(drawList.begin(),drawList.end(),DrawListSortStruct2(sortAlphaToEnd,sortLinesToEnd,&baseFrameInfo));
-            }
-            
-            if (perfInterval > 0)
-            {
-                perfTimer.addCount("Drawables considered", drawablesConsidered);
-                perfTimer.addCount("Cullables", cullTreeCount);
             }
             
-            if (perfInterval > 0)
-                perfTimer.stopTiming("Generators - generate");
+            // Drawables turn on and off by time and height, so we check every frame
+            for (Drawable *theDrawable : visible)
+                if (theDrawable->isOn(&offFrameInfo))
+                    drawItems.push_back(DrawListItem(theDrawable,DrawListKey(theDrawable,sortAlphaToEnd,&baseFrameInfo),off));
         }
+        // Scene drawables that made it past culling and are on
+        int numVisible = (int)drawItems.size();
+        
+        if (perfInterval > 0)
+            perfTimer.stopTiming("Culling");
+        if (profiling)
+            phaseStart = profiler->endPhase("Culling",phaseStart);
+        
+        if (perfInterval > 0)
+            perfTimer.startTiming("Generators - generate");
+        
+        // Run the generators only once, they have to be aware of multiple offset matrices
+        // Now ask our generators to make their drawables
+        // Note: Not doing any culling here
+        //       And we should reuse these Drawables
+        unsigned int lastOff = (unsigned int)offsetMats.size()-1;
+        const GeneratorSet *generators = scene->getGenerators();
+        for (GeneratorSet::iterator it = generators->begin();
+             it != generators->end(); ++it)
+            (*it)->generateDrawables(&baseFrameInfo, generatedDrawables, screenDrawables);
+        
+        // Add the generated drawables and sort them all together
+        for (unsigned int ii=0;ii<generatedDrawables.size();ii++)
+        {
+            Drawable *theDrawable = generatedDrawables[ii].get();
+            if (theDrawable)
+                drawItems.push_back(DrawListItem(theDrawable,DrawListKey(theDrawable,sortAlphaToEnd,&baseFrameInfo),lastOff));
+        }
+        
+        // If the same things are on with the same keys, the order is the same as last frame.
+        // Only the matrices might need updating.
+        std::vector<DrawableContainer> &drawList = cullCache->drawList;
+        bool reuseDrawList = (drawItems == cullCache->drawItems);
+        if (reuseDrawList)
+        {
+            for (DrawableContainer &drawContain : drawList)
+                if (!reuseVisible || drawContain.drawable->getMatrix())
+                    SetContainerMatrices(drawContain,projMat4d,mvMats[drawContain.offset],mvNormalMats[drawContain.offset]);
+        } else {
+            BuildDrawList(drawItems,projMat4d,mvMats,mvNormalMats,drawList);
+            cullCache->drawItems.swap(drawItems);
+        }
+        
+        if (perfInterval > 0)
+        {
+            perfTimer.addCount("Drawables considered", drawablesConsidered);
+            perfTimer.addCount("Cullables", cullTreeCount);
+            perfTimer.addCount("Visible sets reused", reuseVisible ? 1 : 0);
+            perfTimer.addCount("Visible sets moved", visibleSetsMoved);
+            perfTimer.addCount("Draw lists reused", reuseDrawList ? 1 : 0);
+        }
+        
+        if (perfInterval > 0)
+            perfTimer.stopTiming("Generators - generate");
+        if (profiling)
+            phaseStart = profiler->endPhase("Generators",phaseStart);
         
         if (perfInterval > 0)
             perfTimer.startTiming("Draw Execution");
         
         SimpleIdentity curProgramId = EmptyIdentity;
+        int numProgramChanges = 0;
 		
         // Iterate through rendering targets here
         for (RenderTarget &renderTarget : renderTargets)
@@ -581,6 +924,7 @@ void SceneRendererES2::render()
             if (drawProgramId != curProgramId)
             {
                 curProgramId = drawProgramId;
+                numProgramChanges++;
                 OpenGLES2Program *program = scene->getProgram(drawProgramId);
                 if (program)
                 {
@@ -633,14 +977,26 @@ void SceneRendererES2::render()
         }
                 
         if (perfInterval > 0)
+        {
             perfTimer.addCount("Drawables drawn", numDrawables);
+            perfTimer.addCount("Program changes", numProgramChanges);
+        }
         
         if (perfInterval > 0)
             perfTimer.stopTiming("Draw Execution");
+        if (profiling)
+        {
+            phaseStart = profiler->endPhase("Draw",phaseStart);
+            profiler->addCount(FrameCountDrawablesConsidered,drawablesConsidered);
+            profiler->addCount(FrameCountDrawablesCulled,std::max((int)scene->getDrawables().size() - numVisible,0));
+            profiler->addCount(FrameCountStateChanges,numProgramChanges);
+            profiler->addCount(FrameCountBytesUploaded,scene->getLastBytesUploaded());
+            profiler->addCount(FrameCountChangesProcessed,scene->getLastChangesProcessed());
+        }
         
         // Anything generated needs to be cleaned up
+        // The draw list stays with the cull cache for next frame
         generatedDrawables.clear();
-        drawList.clear();
         
         if (perfInterval > 0)
             perfTimer.startTiming("Generators - Draw 2D");
@@ -651,18 +1007,19 @@ void SceneRendererES2::render()
             curProgramId = EmptyIdentity;
             
             renderStateOptimizer->setEnableDepthTest(false);
+            std::vector<DrawableContainer> screenDrawList;
             // Sort by draw priority (and alpha, I guess)
             for (unsigned int ii=0;ii<screenDrawables.size();ii++)
             {
                 Drawable *theDrawable = screenDrawables[ii].get();
                 if (theDrawable)
-                    drawList.push_back(theDrawable);
+                    screenDrawList.push_back(theDrawable);
                 else {
                     // Note: Porting
 //                    NSLog(@"Bad drawable coming from generator.");
                 }
             }
-            std::sort(drawList.begin(),drawList.end(),DrawListSortStruct2(false,false,&baseFrameInfo));
+            SortDrawList(screenDrawList,false,&baseFrameInfo);
 
             // Build an orthographic projection
             // We flip the vertical axis and spread the window out (0,0)->(width,height)
@@ -678,9 +1035,9 @@ void SceneRendererES2::render()
             // Turn off lights
             baseFrameInfo.lights->clear();
             
-            for (unsigned int ii=0;ii<drawList.size();ii++)
+            for (unsigned int ii=0;ii<screenDrawList.size();ii++)
             {
-                DrawableContainer &drawContain = drawList[ii];
+                DrawableContainer &drawContain = screenDrawList[ii];
                 
                 if (drawContain.drawable->isOn(&baseFrameInfo))
                 {
@@ -708,11 +1065,15 @@ void SceneRendererES2::render()
             }
             
             screenDrawables.clear();
-            drawList.clear();
         }
         
         if (perfInterval > 0)
             perfTimer.stopTiming("Generators - Draw 2D");
+        if (profiling)
+        {
+            profiler->endPhase("Draw 2D",phaseStart);
+            profiler->addCount(FrameCountDrawablesDrawn,numDrawables);
+        }
     }
     
 //    if (perfInterval > 0)
@@ -740,6 +1101,11 @@ void SceneRendererES2::render()
     if (perfInterval > 0)
         perfTimer.stopTiming("Render Frame");
     
+    if (profiling)
+    {
+        profiler->endFrame();
+    }
+    
 	// Update the frames per sec
 	if (perfInterval > 0 && frameCount > perfInterval)
 	{
@@ -0,0 +1,157 @@
+/*
+ *  ScratchArena.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <algorithm>
+#import "ScratchArena.h"
+
+namespace WhirlyKit
+{
+
+// An idle arena holding more than this gives the extra back
+static const size_t MaxRetainedScratch = 4*1024*1024;
+
+ScratchArena::ScratchArena(size_t blockSize)
+    : blockSize(blockSize), curBlock(0), curOffset(0)
+{
+}
+
+ScratchArena::~ScratchArena()
+{
+    for (Block &block : blocks)
+        free(block.data);
+    blocks.clear();
+}
+
+void *ScratchArena::allocate(size_t size,size_t align)
+{
+    if (size == 0)
+        size = 1;
+
+    while (true)
+    {
+        if (curBlock < blocks.size())
+        {
+            Block &block = blocks[curBlock];
+            uintptr_t base = (uintptr_t)block.data;
+            uintptr_t start = (base + curOffset + align-1) & ~(uintptr_t)(align-1);
+            if (start + size <= base + block.size)
+            {
+                curOffset = start + size - base;
+                return (void *)start;
+            }
+
+            // Move on to the next block we already have, if it's big enough
+            if (curBlock+1 < blocks.size() && blocks[curBlock+1].size >= size+align)
+            {
+                curBlock++;
+                curOffset = 0;
+                continue;
+            }
+        }
+
+        // Need a new block right after the current one
+        Block newBlock;
+        newBlock.size = std::max(blockSize,size+align);
+        newBlock.data = (char *)malloc(newBlock.size);
+        if (!newBlock.data)
+            throw std::bad_alloc();
+        unsigned int where = blocks.empty() ? 0 : curBlock+1;
+        blocks.insert(blocks.begin()+where,newBlock);
+        curBlock = where;
+        curOffset = 0;
+    }
+}
+
+void ScratchArena::deallocate(void *ptr,size_t size)
+{
+    if (size == 0)
+        size = 1;
+    if (curBlock >= blocks.size())
+        return;
+
+    Block &block = blocks[curBlock];
+    if ((char *)ptr >= block.data && (char *)ptr + size == block.data + curOffset)
+        curOffset = (char *)ptr - block.data;
+}
+
+void ScratchArena::reset()
+{
+    for (unsigned int ii=1;ii<blocks.size();ii++)
+        free(blocks[ii].data);
+    if (blocks.size() > 1)
+        blocks.resize(1);
+    curBlock = 0;
+    curOffset = 0;
+}
+
+ScratchArena::Mark ScratchArena::getMark() const
+{
+    Mark mark;
+    mark.block = curBlock;
+    mark.offset = curOffset;
+    return mark;
+}
+
+void ScratchArena::rewind(const Mark &mark)
+{
+    curBlock = mark.block;
+    curOffset = mark.offset;
+
+    // Back to empty, so see if we're hanging on to too much
+    if (curBlock == 0 && curOffset == 0 && blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (const Block &block : blocks)
+            total += block.size;
+        if (total > MaxRetainedScratch)
+            reset();
+    }
+}
+
+static pthread_key_t threadArenaKey;
+static pthread_once_t threadArenaOnce = PTHREAD_ONCE_INIT;
+
+static void DeleteThreadArena(void *arena)
+{
+    delete (ScratchArena *)arena;
+}
+
+static void MakeThreadArenaKey()
+{
+    pthread_key_create(&threadArenaKey, DeleteThreadArena);
+}
+
+ScratchArena &ScratchArena::getThreadArena()
+{
+    pthread_once(&threadArenaOnce, MakeThreadArenaKey);
+    ScratchArena *arena = (ScratchArena *)pthread_getspecific(threadArenaKey);
+    if (!arena)
+    {
+        arena = new ScratchArena();
+        pthread_setspecific(threadArenaKey, arena);
+    }
+
+    return *arena;
+}
+
+}
@@ -24,17 +24,22 @@
 #import "VectorData.h"
 #import "FlatMath.h"
 #import "ViewState.h"
+#import "FrustumBatch.h"
+#import "ScratchArena.h"
 
 using namespace Eigen;
 
 namespace WhirlyKit
 {
 
+// Where tiles keep their display solid
+static const Dictionary::Key DisplaySolidKey("DisplaySolid");
+
 // Let's not support tiles less than 10m on a side
 static float const BoundsEps = 10.0 / EarthRadius;
 
 DisplaySolid::DisplaySolid(const Quadtree::Identifier &nodeIdent,const Mbr &nodeMbr,float inMinZ,float inMaxZ,CoordSystem *srcSystem,CoordSystemDisplayAdapter *coordAdapter)
-    : valid(true)
+    : valid(true), center(0,0,0), radius(0.0), lastBoundable(false), lastEyeMargin(0.0), lastFacing(false)
 {
     // Start with the outline in the source coordinate system
     WhirlyKit::CoordSystem *displaySystem = coordAdapter->getCoordSystem();
@@ -268,80 +273,126 @@ DisplaySolid::DisplaySolid(const Quadtree::Identifier &nodeIdent,const Mbr &node
         }
     }
     
-    valid = true;
-}
-
-double PolyImportance(const Point3dVector &poly,const Point3d &norm,WhirlyKit::ViewState *viewState,WhirlyKit::Point2f frameSize)
-{
-    double import = 0.0;
-    
-    for (unsigned int offi=0;offi<viewState->viewMatrices.size();offi++)
-    {
-        double origArea = PolygonArea(poly,norm);
-        origArea = std::abs(origArea);
-    
-        Vector4dVector pts;
-        pts.reserve(poly.size());
-        for (unsigned int ii=0;ii<poly.size();ii++)
-        {
-            const Point3d &pt = poly[ii];
-            // Run through the model transform
-            Vector4d modPt = viewState->fullMatrices[offi] * Vector4d(pt.x(),pt.y(),pt.z(),1.0);
-            // And then the projection matrix.  Now we're in clip space
-            Vector4d projPt = viewState->projMatrix * modPt;
-            pts.push_back(projPt);
-        }
-    
-        // The points are in clip space, so clip!
-        Vector4dVector clipSpacePts;
-        clipSpacePts.reserve(2*pts.size());
-        ClipHomogeneousPolygon(pts,clipSpacePts);
-    
-        // Outside the viewing frustum, so ignore it
-        if (clipSpacePts.empty())
-            continue;
-    
-        // Project to the screen
-        Point2dVector screenPts;
-        screenPts.reserve(clipSpacePts.size());
-        Point2d halfFrameSize(frameSize.x()/2.0,frameSize.y()/2.0);
-        for (unsigned int ii=0;ii<clipSpacePts.size();ii++)
+    // Bounding sphere, for quick checks against the viewing frustum
+    int numPts = 0;
+    for (const Point3dVector &poly : polys)
+        for (const Point3d &pt : poly)
         {
-            Vector4d &outPt = clipSpacePts[ii];
-            Point2d screenPt(outPt.x()/outPt.w() * halfFrameSize.x()+halfFrameSize.x(),outPt.y()/outPt.w() * halfFrameSize.y()+halfFrameSize.y());
-            screenPts.push_back(screenPt);
+            center += pt;
+            numPts++;
         }
-    
-        double screenArea = CalcLoopArea(screenPts);
-        screenArea = std::abs(screenArea);
-        if (std::isnan(screenArea))
-            screenArea = 0.0;
-    
-        // Now project the screen points back into model space
-        Point3dVector backPts;
-        backPts.reserve(screenPts.size());
-        for (unsigned int ii=0;ii<screenPts.size();ii++)
+    center /= numPts;
+    for (const Point3dVector &poly : polys)
+        for (const Point3d &pt : poly)
+            radius = std::max(radius,(pt-center).norm());
+    
+    // Single precision copies of the points, relative to the center, for the batch projection
+    ptX.reserve(numPts);  ptY.reserve(numPts);  ptZ.reserve(numPts);
+    polyStarts.reserve(polys.size()+1);
+    for (const Point3dVector &poly : polys)
+    {
+        polyStarts.push_back(ptX.size());
+        for (const Point3d &pt : poly)
         {
-            Vector4d modelPt = viewState->invProjMatrix * clipSpacePts[ii];
-            Vector4d backPt = viewState->invFullMatrices[offi] * modelPt;
-            backPts.push_back(Point3d(backPt.x(),backPt.y(),backPt.z()));
+            ptX.push_back(pt.x()-center.x());
+            ptY.push_back(pt.y()-center.y());
+            ptZ.push_back(pt.z()-center.z());
         }
-        // Then calculate the area
-        double backArea = PolygonArea(backPts,norm);
-        backArea = std::abs(backArea);
-    
-        // Now we know how much of the original polygon made it out to the screen
-        // We can scale its importance accordingly.
-        // This gets rid of small slices of big tiles not getting loaded
-        double scale = (backArea == 0.0) ? 1.0 : origArea / backArea;
-    
-        // Note: Turned off for the moment
-        double newImport =  std::abs(screenArea) * scale;
-        if (newImport > import)
-        	import = newImport;
     }
+    polyStarts.push_back(ptX.size());
     
-    return import;
+    valid = true;
+}
+
+// Most polygons a display solid will have
+static const unsigned int MaxBoundPolys = 6;
+
+// Screen area (in CalcLoopArea units) and perimeter for a polygon already projected to the screen
+static void ScreenAreaForPoly(const float *screenX,const float *screenY,unsigned int numPts,double &area,double &perimeter)
+{
+    area = 0.0;
+    perimeter = 0.0;
+    if (numPts == 0)
+        return;
+    // Work relative to the first point to keep the precision we have
+    Point2d org(screenX[0],screenY[0]);
+    Point2d prevPt(0.0,0.0);
+    for (unsigned int ii=1;ii<=numPts;ii++)
+    {
+        unsigned int which = ii % numPts;
+        Point2d screenPt(screenX[which]-org.x(),screenY[which]-org.y());
+        area += prevPt.x()*screenPt.y() - prevPt.y()*screenPt.x();
+        perimeter += (screenPt-prevPt).norm();
+        prevPt = screenPt;
+    }
+    area = std::abs(area);
+    if (std::isnan(area))
+        area = 0.0;
+}
+
+// Importance for a polygon that might be partly on screen, for a single view offset
+double PolyImportance(const Point3dVector &poly,const Point3d &norm,WhirlyKit::ViewState *viewState,unsigned int offi,WhirlyKit::Point2f frameSize)
+{
+    double origArea = PolygonArea(poly,norm);
+    origArea = std::abs(origArea);
+
+    Vector4dVector pts;
+    pts.reserve(poly.size());
+    for (unsigned int ii=0;ii<poly.size();ii++)
+    {
+        const Point3d &pt = poly[ii];
+        // Run through the model transform
+        Vector4d modPt = viewState->fullMatrices[offi] * Vector4d(pt.x(),pt.y(),pt.z(),1.0);
+        // And then the projection matrix.  Now we're in clip space
+        Vector4d projPt = viewState->projMatrix * modPt;
+        pts.push_back(projPt);
+    }
+
+    // The points are in clip space, so clip!
+    Vector4dVector clipSpacePts;
+    clipSpacePts.reserve(2*pts.size());
+    ClipHomogeneousPolygon(pts,clipSpacePts);
+
+    // Outside the viewing frustum, so ignore it
+    if (clipSpacePts.empty())
+        return 0.0;
+
+    // Project to the screen
+    Point2dVector screenPts;
+    screenPts.reserve(clipSpacePts.size());
+    Point2d halfFrameSize(frameSize.x()/2.0,frameSize.y()/2.0);
+    for (unsigned int ii=0;ii<clipSpacePts.size();ii++)
+    {
+        Vector4d &outPt = clipSpacePts[ii];
+        Point2d screenPt(outPt.x()/outPt.w() * halfFrameSize.x()+halfFrameSize.x(),outPt.y()/outPt.w() * halfFrameSize.y()+halfFrameSize.y());
+        screenPts.push_back(screenPt);
+    }
+
+    double screenArea = CalcLoopArea(screenPts);
+    screenArea = std::abs(screenArea);
+    if (std::isnan(screenArea))
+        screenArea = 0.0;
+
+    // Now project the screen points back into model space
+    Point3dVector backPts;
+    backPts.reserve(screenPts.size());
+    for (unsigned int ii=0;ii<screenPts.size();ii++)
+    {
+        Vector4d modelPt = viewState->invProjMatrix * clipSpacePts[ii];
+        Vector4d backPt = viewState->invFullMatrices[offi] * modelPt;
+        backPts.push_back(Point3d(backPt.x(),backPt.y(),backPt.z()));
+    }
+    // Then calculate the area
+    double backArea = PolygonArea(backPts,norm);
+    backArea = std::abs(backArea);
+
+    // Now we know how much of the original polygon made it out to the screen
+    // We can scale its importance accordingly.
+    // This gets rid of small slices of big tiles not getting loaded
+    double scale = (backArea == 0.0) ? 1.0 : origArea / backArea;
+
+    // Note: Turned off for the moment
+    return std::abs(screenArea) * scale;
 }
 
 bool DisplaySolid::isInside(const Point3d &pt)
@@ -360,33 +411,100 @@ bool DisplaySolid::isInside(const Point3d &pt)
 double DisplaySolid::importanceForViewState(ViewState *viewState,const Point2f &frameSize)
 {
     Point3d eyePos = viewState->eyePos;
+    lastBoundable = false;
+    lastFrameSize = frameSize;
+    lastEyePos = eyePos;
+    lastEyeMargin = MAXFLOAT;
+    lastFacing = true;
     
     if (!viewState->coordAdapter->isFlat())
     {
         // If the viewer is inside the bounds, the node is maximimally important (duh)
-        if (isInside(eyePos))
+        // We also want to know how far outside we are
+        double outside = -MAXFLOAT;
+        for (unsigned int ii=0;ii<polys.size();ii++)
+        {
+            double normLen = normals[ii].norm();
+            if (normLen > 0.0)
+                outside = std::max(outside,(eyePos-polys[ii][0]).dot(normals[ii]) / normLen);
+        }
+        if (outside <= 0.0)
             return MAXFLOAT;
+        lastEyeMargin = outside;
         
         // Make sure that we're pointed toward the eye, even a bit
         if (!surfNormals.empty())
         {
-            bool isFacing = false;
+            double maxFacing = -MAXFLOAT, maxNormLen = 0.0;
             for (unsigned int ii=0;ii<surfNormals.size();ii++)
             {
                 const Vector3d &surfNorm = surfNormals[ii];
-                if ((isFacing |= (surfNorm.dot(eyePos) >= 0.0)))
-                    break;
+                maxFacing = std::max(maxFacing,surfNorm.dot(eyePos));
+                maxNormLen = std::max(maxNormLen,surfNorm.norm());
             }
-            if (!isFacing)
+            if (maxNormLen > 0.0)
+                lastEyeMargin = std::min(lastEyeMargin,std::abs(maxFacing)/maxNormLen);
+            if (maxFacing < 0.0)
+            {
+                lastFacing = false;
+                lastBoundable = true;
                 return 0.0;
+            }
         }
     }
     
     // Now work through the polygons and project each to the screen
+    // If the tile is all the way on or off screen, that's simple and we remember what we saw
+    unsigned int numOffsets = viewState->viewMatrices.size();
+    unsigned int numPolys = polys.size();
+    Point2d halfFrameSize(frameSize.x()/2.0,frameSize.y()/2.0);
+    lastMatrices.resize(numOffsets);
+    lastOnScreen.resize(numOffsets);
+    lastAreas.assign(numOffsets*numPolys,0.0);
+    lastPerimeters.assign(numOffsets*numPolys,0.0);
+    lastBoundable = true;
+    ScratchArena &arena = ScratchArena::getThreadArena();
+    ScratchArena::Scope scope(arena);
+    unsigned int numPts = ptX.size();
+    float *screenX = (float *)arena.allocate(numPts*sizeof(float),alignof(float));
+    float *screenY = (float *)arena.allocate(numPts*sizeof(float),alignof(float));
+    for (unsigned int offi=0;offi<numOffsets;offi++)
+    {
+        Matrix4d &mat = lastMatrices[offi];
+        mat = viewState->projMatrix * viewState->fullMatrices[offi];
+        FrustumResult where = SphereInFrustum(mat,center,radius);
+        lastOnScreen[offi] = (where != FrustumOutside);
+        if (where == FrustumInside)
+        {
+            // All the points are in front of us, so project them in one go
+            Matrix4d centerMat = mat;
+            centerMat.col(3) = mat * Vector4d(center.x(),center.y(),center.z(),1.0);
+            ProjectPoints(centerMat, halfFrameSize, &ptX[0], &ptY[0], &ptZ[0], numPts, screenX, screenY);
+        }
+        for (unsigned int ii=0;ii<numPolys;ii++)
+        {
+            double &area = lastAreas[offi*numPolys+ii];
+            switch (where)
+            {
+                case FrustumOutside:
+                    break;
+                case FrustumInside:
+                    ScreenAreaForPoly(screenX+polyStarts[ii], screenY+polyStarts[ii], polyStarts[ii+1]-polyStarts[ii], area, lastPerimeters[offi*numPolys+ii]);
+                    break;
+                case FrustumStraddles:
+                    area = PolyImportance(polys[ii], normals[ii], viewState, offi, frameSize);
+                    lastBoundable = false;
+                    break;
+            }
+        }
+    }
+    
     double totalImport = 0.0;
-    for (unsigned int ii=0;ii<polys.size();ii++)
+    for (unsigned int ii=0;ii<numPolys;ii++)
     {
-        double import = PolyImportance(polys[ii], normals[ii], viewState, frameSize);
+        double import = 0.0;
+        for (unsigned int offi=0;offi<numOffsets;offi++)
+            import = std::max(import,lastAreas[offi*numPolys+ii]);
         totalImport += import;
     }
     
@@ -396,6 +514,86 @@ double DisplaySolid::importanceForViewState(ViewState *viewState,const Point2f &
     return totalImport*scaleFactor;
 }
 
+bool DisplaySolid::importanceBoundsForViewState(ViewState *viewState,const Point2f &frameSize,double &minImport,double &maxImport)
+{
+    unsigned int numOffsets = viewState->viewMatrices.size();
+    if (!lastBoundable || frameSize != lastFrameSize)
+        return false;
+    
+    // The eye mustn't move far enough to change the inside or facing tests
+    if (!viewState->coordAdapter->isFlat() && (viewState->eyePos - lastEyePos).norm() >= lastEyeMargin)
+        return false;
+    if (!lastFacing)
+    {
+        minImport = maxImport = 0.0;
+        return true;
+    }
+    if (numOffsets != lastMatrices.size())
+        return false;
+    
+    // Bound each polygon's area by how far any point in the bounding sphere can move on the screen.
+    // For a convex polygon whose points all move less than delta, the area changes by less
+    //  than perimeter*delta + pi*delta^2.
+    unsigned int numPolys = polys.size();
+    double polyMin[MaxBoundPolys],polyMax[MaxBoundPolys];
+    if (numPolys > MaxBoundPolys)
+        return false;
+    for (unsigned int ii=0;ii<numPolys;ii++)
+        polyMin[ii] = polyMax[ii] = 0.0;
+    Point2d halfFrameSize(frameSize.x()/2.0,frameSize.y()/2.0);
+    Vector4d center4(center.x(),center.y(),center.z(),1.0);
+    for (unsigned int offi=0;offi<numOffsets;offi++)
+    {
+        Matrix4d mat = viewState->projMatrix * viewState->fullMatrices[offi];
+        FrustumResult where = SphereInFrustum(mat,center,radius);
+        if (!lastOnScreen[offi])
+        {
+            // Still off screen is still nothing
+            if (where != FrustumOutside)
+                return false;
+            continue;
+        }
+        if (where != FrustumInside)
+            return false;
+        
+        // How far x, y and w can change in clip space
+        Matrix4d diffMat = mat - lastMatrices[offi];
+        Vector4d diffCenter = diffMat * center4;
+        double diffX = std::abs(diffCenter.x()) + diffMat.row(0).head<3>().norm() * radius;
+        double diffY = std::abs(diffCenter.y()) + diffMat.row(1).head<3>().norm() * radius;
+        double diffW = std::abs(diffCenter.w()) + diffMat.row(3).head<3>().norm() * radius;
+        double minW = mat.row(3).dot(center4) - mat.row(3).head<3>().norm() * radius;
+        if (minW <= 0.0)
+            return false;
+        // We were inside the frustum, so |x/w| <= 1 before and the change in x/w is under (dx + dw)/w
+        double deltaX = (diffX + diffW) / minW * halfFrameSize.x();
+        double deltaY = (diffY + diffW) / minW * halfFrameSize.y();
+        double delta = sqrt(deltaX*deltaX + deltaY*deltaY);
+        
+        for (unsigned int ii=0;ii<numPolys;ii++)
+        {
+            double area = lastAreas[offi*numPolys+ii];
+            // Areas are doubled, as from CalcLoopArea
+            double slack = 2.0 * (lastPerimeters[offi*numPolys+ii] * delta + M_PI * delta * delta);
+            polyMin[ii] = std::max(polyMin[ii],std::max(area-slack,0.0));
+            polyMax[ii] = std::max(polyMax[ii],area+slack);
+        }
+    }
+    
+    minImport = 0.0;
+    maxImport = 0.0;
+    for (unsigned int ii=0;ii<numPolys;ii++)
+    {
+        minImport += polyMin[ii];
+        maxImport += polyMax[ii];
+    }
+    double scaleFactor = (polys.size() > 1 ? 0.5 : 1.0);
+    minImport *= scaleFactor;
+    maxImport *= scaleFactor;
+    
+    return true;
+}
+
 bool DisplaySolid::isOnScreenForViewState(ViewState *viewState,const Point2f &frameSize)
 {
     if (!viewState->coordAdapter->isFlat())
@@ -421,6 +619,13 @@ bool DisplaySolid::isOnScreenForViewState(ViewState *viewState,const Point2f &fr
     
     for (unsigned int offi=0;offi<viewState->viewMatrices.size();offi++)
     {
+        // The bounding sphere settles most tiles without clipping anything
+        FrustumResult where = SphereInFrustum(viewState->projMatrix * viewState->fullMatrices[offi],center,radius);
+        if (where == FrustumOutside)
+            continue;
+        if (where == FrustumInside)
+            return true;
+        
         for (unsigned int ii=0;ii<polys.size();ii++)
         {
             const Point3dVector &poly = polys[ii];
@@ -455,12 +660,12 @@ bool DisplaySolid::isOnScreenForViewState(ViewState *viewState,const Point2f &fr
 
 bool TileIsOnScreen(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const WhirlyKit::Mbr &nodeMbr,const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs)
 {
-    DelayedDeletableRef objRef = attrs->getObject("DisplaySolid");
+    DelayedDeletableRef objRef = attrs->getObject(DisplaySolidKey);
     DisplaySolidRef dispSolid = std::dynamic_pointer_cast<DisplaySolid>(objRef);
     if (!dispSolid)
     {
         dispSolid = DisplaySolidRef(new DisplaySolid(nodeIdent,nodeMbr,0.0,0.0,srcSystem,coordAdapter));
-        attrs->setObject("DisplaySolid",dispSolid);
+        attrs->setObject(DisplaySolidKey,dispSolid);
     }
     
     // This means the tile is degenerate (as far as we're concerned)
@@ -470,16 +675,71 @@ bool TileIsOnScreen(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &fr
     return dispSolid->isOnScreenForViewState(viewState,frameSize);
 }
 
+void TilesOffScreen(WhirlyKit::ViewState *viewState,const std::vector<WhirlyKit::Quadtree::NodeInfo *> &nodes,int minLevel,std::vector<bool> &offScreen)
+{
+    unsigned int numNodes = nodes.size();
+    if (numNodes == 0)
+        return;
+
+    // Bounding spheres in structure of arrays form for ClassifySpheres
+    ScratchArena &arena = ScratchArena::getThreadArena();
+    ScratchArena::Scope scope(arena);
+    float *x = (float *)arena.allocate(numNodes*sizeof(float),alignof(float));
+    float *y = (float *)arena.allocate(numNodes*sizeof(float),alignof(float));
+    float *z = (float *)arena.allocate(numNodes*sizeof(float),alignof(float));
+    float *radius = (float *)arena.allocate(numNodes*sizeof(float),alignof(float));
+    unsigned int *which = (unsigned int *)arena.allocate(numNodes*sizeof(unsigned int),alignof(unsigned int));
+    unsigned int num = 0;
+    bool checkInside = !viewState->coordAdapter->isFlat();
+    for (unsigned int ii=0;ii<numNodes;ii++)
+    {
+        Quadtree::NodeInfo *nodeInfo = nodes[ii];
+        if (nodeInfo->ident.level < minLevel)
+            continue;
+        DelayedDeletableRef objRef = nodeInfo->attrs.getObject(DisplaySolidKey);
+        DisplaySolid *dispSolid = dynamic_cast<DisplaySolid *>(objRef.get());
+        if (!dispSolid)
+            continue;
+        if (!dispSolid->valid)
+        {
+            offScreen[ii] = true;
+            continue;
+        }
+        // An eye inside the solid makes it maximally important, wherever the frustum is
+        if (checkInside && (viewState->eyePos - dispSolid->center).squaredNorm() <= dispSolid->radius*dispSolid->radius)
+            continue;
+        x[num] = dispSolid->center.x();  y[num] = dispSolid->center.y();  z[num] = dispSolid->center.z();
+        radius[num] = dispSolid->radius;
+        which[num++] = ii;
+    }
+    if (num == 0)
+        return;
+
+    // Off screen means outside the frustum for every view offset
+    unsigned char *results = (unsigned char *)arena.allocate(num,1);
+    unsigned char *onScreen = (unsigned char *)arena.allocate(num,1);
+    memset(onScreen,0,num);
+    for (unsigned int offi=0;offi<viewState->viewMatrices.size();offi++)
+    {
+        FrustumPlanes planes(viewState->projMatrix * viewState->fullMatrices[offi]);
+        ClassifySpheres(planes,x,y,z,radius,num,results);
+        for (unsigned int ii=0;ii<num;ii++)
+            onScreen[ii] |= (results[ii] != FrustumOutside);
+    }
+    for (unsigned int ii=0;ii<num;ii++)
+        if (!onScreen[ii])
+            offScreen[which[ii]] = true;
+}
 
 // Calculate the max pixel size for a tile
 double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,const Point3d &notUsed,int pixelsSquare,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const Mbr &nodeMbr,const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs)
 {
-    DelayedDeletableRef objRef = attrs->getObject("DisplaySolid");
+    DelayedDeletableRef objRef = attrs->getObject(DisplaySolidKey);
     DisplaySolidRef dispSolid = std::dynamic_pointer_cast<DisplaySolid>(objRef);
     if (!dispSolid)
     {
         dispSolid = DisplaySolidRef(new DisplaySolid(nodeIdent,nodeMbr,0.0,0.0,srcSystem,coordAdapter));
-        attrs->setObject("DisplaySolid",dispSolid);
+        attrs->setObject(DisplaySolidKey,dispSolid);
     }
     
     // This means the tile is degenerate (as far as we're concerned)
@@ -495,15 +755,37 @@ double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f
     return import;
 }
 
+bool ScreenImportanceBounds(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,int pixelsSquare,Dictionary *attrs,double &minImport,double &maxImport)
+{
+    DelayedDeletableRef objRef = attrs->getObject(DisplaySolidKey);
+    DisplaySolidRef dispSolid = std::dynamic_pointer_cast<DisplaySolid>(objRef);
+    if (!dispSolid)
+        return false;
+    
+    // Degenerate tiles don't change
+    if (!dispSolid->valid)
+    {
+        minImport = maxImport = 0.0;
+        return true;
+    }
+    
+    if (!dispSolid->importanceBoundsForViewState(viewState,frameSize,minImport,maxImport))
+        return false;
+    minImport = minImport/(pixelsSquare * pixelsSquare);
+    maxImport = maxImport/(pixelsSquare * pixelsSquare);
+    
+    return true;
+}
+
 // This version is for volumes with height
 double ScreenImportance(WhirlyKit::ViewState *viewState,const WhirlyKit::Point2f &frameSize,int pixelsSquare,WhirlyKit::CoordSystem *srcSystem,WhirlyKit::CoordSystemDisplayAdapter *coordAdapter,const Mbr &nodeMbr,double minZ,double maxZ,const WhirlyKit::Quadtree::Identifier &nodeIdent,Dictionary *attrs)
 {
-    DelayedDeletableRef objRef = attrs->getObject("DisplaySolid");
+    DelayedDeletableRef objRef = attrs->getObject(DisplaySolidKey);
     DisplaySolidRef dispSolid = std::dynamic_pointer_cast<DisplaySolid>(objRef);
     if (!dispSolid)
     {
         dispSolid = DisplaySolidRef(new DisplaySolid(nodeIdent,nodeMbr,minZ,maxZ,srcSystem,coordAdapter));
-        attrs->setObject("DisplaySolid",dispSolid);
+        attrs->setObject(DisplaySolidKey,dispSolid);
     }
     
     // This means the tile is degenerate (as far as we're concerned)
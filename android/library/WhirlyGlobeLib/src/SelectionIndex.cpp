@@ -0,0 +1,278 @@
+/*
+ *  SelectionIndex.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <math.h>
+#import <algorithm>
+#import "SelectionIndex.h"
+
+namespace WhirlyKit
+{
+
+// Children per R-tree node
+static const int RTreeNodeSize = 16;
+// Pending adds we'll check one by one before it's worth a rebuild
+static const int MinPendingItems = 1024;
+
+SelectionPickRay::SelectionPickRay()
+    : nearPt(0,0,0), farPt(0,0,0), nearPixelSize(0.0), farPixelSize(0.0)
+{
+}
+
+// Screen location back through the projection to display space at the given depth (-1 near, 1 far)
+static Point3d Unproject(const Eigen::Matrix4d &invMat,const Point2f &screenPt,const Point2f &frameSize,double depth)
+{
+    Eigen::Vector4d ndc(2.0 * screenPt.x() / frameSize.x() - 1.0,1.0 - 2.0 * screenPt.y() / frameSize.y(),depth,1.0);
+    Eigen::Vector4d pt = invMat * ndc;
+
+    return Point3d(pt.x()/pt.w(),pt.y()/pt.w(),pt.z()/pt.w());
+}
+
+bool SelectionPickRay::init(const Point2f &touchPt,const Point2f &frameSize,const Eigen::Matrix4d &projMat,const Eigen::Matrix4d &modelViewMat)
+{
+    if (frameSize.x() <= 0.0 || frameSize.y() <= 0.0)
+        return false;
+
+    Eigen::Matrix4d fullMat = projMat * modelViewMat;
+    Eigen::Matrix4d invMat;
+    bool invertible = false;
+    double det;
+    fullMat.computeInverseAndDetWithCheck(invMat,det,invertible);
+    if (!invertible)
+        return false;
+
+    nearPt = Unproject(invMat,touchPt,frameSize,-1.0);
+    farPt = Unproject(invMat,touchPt,frameSize,1.0);
+
+    // How far a pixel goes at either end, in whichever direction is bigger
+    Point2f touchX(touchPt.x()+1.0,touchPt.y()), touchY(touchPt.x(),touchPt.y()+1.0);
+    nearPixelSize = std::max((Unproject(invMat,touchX,frameSize,-1.0) - nearPt).norm(),
+                             (Unproject(invMat,touchY,frameSize,-1.0) - nearPt).norm());
+    farPixelSize = std::max((Unproject(invMat,touchX,frameSize,1.0) - farPt).norm(),
+                            (Unproject(invMat,touchY,frameSize,1.0) - farPt).norm());
+
+    // Leave some room for diagonals and the various ways objects get projected
+    nearPixelSize *= 1.5;
+    farPixelSize *= 1.5;
+
+    return std::isfinite(nearPt.squaredNorm()) && std::isfinite(farPt.squaredNorm()) &&
+           std::isfinite(nearPixelSize) && std::isfinite(farPixelSize);
+}
+
+bool SelectionPickRay::overlaps(const Point3d &ll,const Point3d &ur,double pixels) const
+{
+    Point3d dir = farPt - nearPt;
+    double len2 = dir.squaredNorm();
+
+    // Furthest along the ray any part of the box could be, which is where it's widest
+    double s = 1.0;
+    if (len2 > 0.0)
+    {
+        s = 0.0;
+        for (unsigned int ii=0;ii<3;ii++)
+            s += std::max((ll[ii]-nearPt[ii])*dir[ii],(ur[ii]-nearPt[ii])*dir[ii]);
+        s = std::max(0.0,std::min(s/len2,1.0));
+    }
+    double r = (nearPixelSize + (farPixelSize-nearPixelSize)*s) * (pixels + 1.0);
+
+    // Slab test against the box grown by that much
+    double t0 = 0.0, t1 = 1.0;
+    for (unsigned int ii=0;ii<3;ii++)
+    {
+        double lo = ll[ii] - r, hi = ur[ii] + r;
+        if (std::abs(dir[ii]) < 1e-300)
+        {
+            if (nearPt[ii] < lo || nearPt[ii] > hi)
+                return false;
+            continue;
+        }
+
+        double ta = (lo - nearPt[ii]) / dir[ii], tb = (hi - nearPt[ii]) / dir[ii];
+        if (ta > tb)
+            std::swap(ta,tb);
+        t0 = std::max(t0,ta);
+        t1 = std::min(t1,tb);
+        if (t0 > t1)
+            return false;
+    }
+
+    return true;
+}
+
+SelectionRTree::SelectionRTree()
+    : numRemoved(0)
+{
+}
+
+// Spread the low 21 bits out to every third bit
+static uint64_t SpreadBits(uint64_t val)
+{
+    val &= 0x1fffff;
+    val = (val | val << 32) & 0x1f00000000ffffULL;
+    val = (val | val << 16) & 0x1f0000ff0000ffULL;
+    val = (val | val << 8) & 0x100f00f00f00f00fULL;
+    val = (val | val << 4) & 0x10c30c30c30c30c3ULL;
+    val = (val | val << 2) & 0x1249249249249249ULL;
+
+    return val;
+}
+
+void SelectionRTree::BoundItems(const Item *items,int num,Node &node)
+{
+    node.ll = items[0].ll;
+    node.ur = items[0].ur;
+    node.pixelRadius = items[0].pixelRadius;
+    for (int ii=1;ii<num;ii++)
+    {
+        node.ll = node.ll.cwiseMin(items[ii].ll);
+        node.ur = node.ur.cwiseMax(items[ii].ur);
+        node.pixelRadius = std::max(node.pixelRadius,items[ii].pixelRadius);
+    }
+}
+
+void SelectionRTree::build(std::vector<Item> &newItems)
+{
+    items.clear();
+    nodes.clear();
+    pending.clear();
+    numRemoved = 0;
+    if (newItems.empty())
+        return;
+
+    // Sort along a Morton curve through the box centers
+    Node bounds;
+    BoundItems(&newItems[0],(int)newItems.size(),bounds);
+    Point3d span = bounds.ur - bounds.ll;
+    for (unsigned int ii=0;ii<3;ii++)
+        if (span[ii] <= 0.0)
+            span[ii] = 1.0;
+    std::vector<std::pair<uint64_t,int> > keys(newItems.size());
+    for (unsigned int ii=0;ii<newItems.size();ii++)
+    {
+        Point3d center = ((newItems[ii].ll + newItems[ii].ur) / 2.0 - bounds.ll).cwiseQuotient(span) * (double)0x1fffff;
+        keys[ii].first = SpreadBits((uint64_t)center.x()) | SpreadBits((uint64_t)center.y()) << 1 | SpreadBits((uint64_t)center.z()) << 2;
+        keys[ii].second = ii;
+    }
+    std::sort(keys.begin(),keys.end());
+    items.reserve(newItems.size());
+    for (const auto &key : keys)
+        items.push_back(newItems[key.second]);
+
+    // Bottom level is runs of items
+    int numItems = (int)items.size();
+    nodes.reserve(numItems / RTreeNodeSize * 2 + 2);
+    for (int ii=0;ii<numItems;ii+=RTreeNodeSize)
+    {
+        Node node;
+        node.start = ii;
+        node.num = std::min(RTreeNodeSize,numItems-ii);
+        BoundItems(&items[ii],node.num,node);
+        nodes.push_back(node);
+    }
+
+    // Then group the level below until there's just the root
+    int levelStart = 0, levelEnd = (int)nodes.size();
+    while (levelEnd - levelStart > 1)
+    {
+        for (int ii=levelStart;ii<levelEnd;ii+=RTreeNodeSize)
+        {
+            Node node = nodes[ii];
+            node.start = ii;
+            node.num = std::min(RTreeNodeSize,levelEnd-ii);
+            for (int jj=ii+1;jj<ii+node.num;jj++)
+            {
+                const Node &child = nodes[jj];
+                node.ll = node.ll.cwiseMin(child.ll);
+                node.ur = node.ur.cwiseMax(child.ur);
+                node.pixelRadius = std::max(node.pixelRadius,child.pixelRadius);
+            }
+            nodes.push_back(node);
+        }
+        levelStart = levelEnd;
+        levelEnd = (int)nodes.size();
+    }
+}
+
+void SelectionRTree::addItem(const Item &item)
+{
+    pending.push_back(item);
+}
+
+bool SelectionRTree::needsRebuild() const
+{
+    int numItems = (int)items.size();
+    return (int)pending.size() > std::max(MinPendingItems,numItems/8) ||
+           numRemoved > std::max(MinPendingItems,numItems/4);
+}
+
+// True if the box could be close enough to any of the rays
+static bool NearRays(const std::vector<SelectionPickRay> &rays,const Point3d &ll,const Point3d &ur,double pixels)
+{
+    for (const SelectionPickRay &ray : rays)
+        if (ray.overlaps(ll,ur,pixels))
+            return true;
+
+    return false;
+}
+
+void SelectionRTree::findNearRays(const std::vector<SelectionPickRay> &rays,float maxDist,std::vector<SimpleIdentity> &selectIDs) const
+{
+    selectIDs.clear();
+
+    if (!nodes.empty())
+    {
+        // Nodes are a level at a time from the bottom, so the bottom level is the first run
+        int numLeafNodes = ((int)items.size() + RTreeNodeSize - 1) / RTreeNodeSize;
+
+        std::vector<int> stack;
+        stack.reserve(64);
+        stack.push_back((int)nodes.size()-1);
+        while (!stack.empty())
+        {
+            const Node &node = nodes[stack.back()];
+            bool isLeaf = stack.back() < numLeafNodes;
+            stack.pop_back();
+            if (!NearRays(rays,node.ll,node.ur,maxDist + node.pixelRadius))
+                continue;
+
+            if (isLeaf)
+            {
+                for (int ii=node.start;ii<node.start+node.num;ii++)
+                {
+                    const Item &item = items[ii];
+                    if (NearRays(rays,item.ll,item.ur,maxDist + item.pixelRadius))
+                        selectIDs.push_back(item.selectID);
+                }
+            } else {
+                for (int ii=node.start;ii<node.start+node.num;ii++)
+                    stack.push_back(ii);
+            }
+        }
+    }
+
+    for (const Item &item : pending)
+        if (NearRays(rays,item.ll,item.ur,maxDist + item.pixelRadius))
+            selectIDs.push_back(item.selectID);
+
+    // Same order the selectables are kept in
+    std::sort(selectIDs.begin(),selectIDs.end());
+    selectIDs.erase(std::unique(selectIDs.begin(),selectIDs.end()),selectIDs.end());
+}
+
+}
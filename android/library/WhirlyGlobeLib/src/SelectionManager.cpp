@@ -26,6 +26,7 @@
 #import "SceneRendererES.h"
 #import "ScreenSpaceBuilder.h"
 #import "LayoutManager.h"
+#import "SelectionIndex.h"
 
 using namespace Eigen;
 using namespace WhirlyKit;
@@ -66,6 +67,98 @@ bool BillboardSelectable::operator < (const BillboardSelectable &that) const
     return selectID < that.selectID;
 }
 
+// Display space bounds for each of the indexed selectables
+static SelectionRTree::Item IndexItem(const RectSelectable3D &sel)
+{
+    SelectionRTree::Item item;
+    item.selectID = sel.selectID;
+    item.ll = item.ur = Vector3fToVector3d(sel.pts[0]);
+    for (unsigned int ii=1;ii<4;ii++)
+    {
+        item.ll = item.ll.cwiseMin(Vector3fToVector3d(sel.pts[ii]));
+        item.ur = item.ur.cwiseMax(Vector3fToVector3d(sel.pts[ii]));
+    }
+
+    return item;
+}
+
+static SelectionRTree::Item IndexItem(const RectSelectable2D &sel)
+{
+    // Just the center, but the rectangle can reach this far around it on the screen
+    SelectionRTree::Item item;
+    item.selectID = sel.selectID;
+    item.ll = item.ur = sel.center;
+    for (unsigned int ii=0;ii<4;ii++)
+        item.pixelRadius = std::max(item.pixelRadius,sel.pts[ii].norm());
+
+    return item;
+}
+
+static SelectionRTree::Item IndexItem(const PolytopeSelectable &sel)
+{
+    SelectionRTree::Item item;
+    item.selectID = sel.selectID;
+    item.ll = item.ur = sel.centerPt;
+    for (const Point3fVector &poly : sel.polys)
+        for (const Point3f &pt : poly)
+        {
+            Point3d pt3d = Vector3fToVector3d(pt) + sel.centerPt;
+            item.ll = item.ll.cwiseMin(pt3d);
+            item.ur = item.ur.cwiseMax(pt3d);
+        }
+
+    return item;
+}
+
+static SelectionRTree::Item IndexItem(const LinearSelectable &sel)
+{
+    SelectionRTree::Item item;
+    item.selectID = sel.selectID;
+    if (sel.pts.empty())
+        return item;
+    item.ll = item.ur = sel.pts[0];
+    for (const Point3d &pt : sel.pts)
+    {
+        item.ll = item.ll.cwiseMin(pt);
+        item.ur = item.ur.cwiseMax(pt);
+    }
+
+    return item;
+}
+
+static SelectionRTree::Item IndexItem(const BillboardSelectable &sel)
+{
+    // Billboards turn toward the viewer, so anywhere it could turn to
+    double rad = sqrt(sel.size.x()*sel.size.x()/4.0 + sel.size.y()*sel.size.y());
+    SelectionRTree::Item item;
+    item.selectID = sel.selectID;
+    item.ll = sel.center - Point3d(rad,rad,rad);
+    item.ur = sel.center + Point3d(rad,rad,rad);
+
+    return item;
+}
+
+template<typename T> static void RebuildIndex(SelectionRTree &index,const std::set<T> &selectables)
+{
+    std::vector<SelectionRTree::Item> items;
+    items.reserve(selectables.size());
+    for (const T &sel : selectables)
+        items.push_back(IndexItem(sel));
+    index.build(items);
+}
+
+// Selectables the index says might be near the touch, or all of them if we couldn't work out the rays
+template<typename T> static void FindCandidates(const SelectionRTree &index,const std::set<T> &selectables,const std::vector<SelectionPickRay> &rays,float maxDist,std::vector<SimpleIdentity> &selectIDs)
+{
+    if (rays.empty())
+    {
+        selectIDs.clear();
+        for (const T &sel : selectables)
+            selectIDs.push_back(sel.selectID);
+    } else
+        index.findNearRays(rays,maxDist,selectIDs);
+}
+
 SelectionManager::SelectionManager(Scene *scene,float viewScale)
     : scene(scene), scale(viewScale)
 {
@@ -92,7 +185,8 @@ void SelectionManager::addSelectableRect(SimpleIdentity selectId,Point3f *pts,bo
         newSelect.pts[ii] = pts[ii];
 
     pthread_mutex_lock(&mutex);
-    rect3Dselectables.insert(newSelect);
+    if (rect3Dselectables.insert(newSelect).second)
+        rect3DIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -111,7 +205,8 @@ void SelectionManager::addSelectableRect(SimpleIdentity selectId,Point3f *pts,fl
         newSelect.pts[ii] = pts[ii];
     
     pthread_mutex_lock(&mutex);
-    rect3Dselectables.insert(newSelect);
+    if (rect3Dselectables.insert(newSelect).second)
+        rect3DIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -131,7 +226,8 @@ void SelectionManager::addSelectableScreenRect(SimpleIdentity selectId,const Poi
         newSelect.pts[ii] = pts[ii];
     
     pthread_mutex_lock(&mutex);
-    rect2Dselectables.insert(newSelect);
+    if (rect2Dselectables.insert(newSelect).second)
+        rect2DIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -190,7 +286,8 @@ void SelectionManager::addSelectableRectSolid(SimpleIdentity selectId,Point3f *p
     }
     
     pthread_mutex_lock(&mutex);
-    polytopeSelectables.insert(newSelect);
+    if (polytopeSelectables.insert(newSelect).second)
+        polytopeIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -235,7 +332,8 @@ void SelectionManager::addPolytope(SimpleIdentity selectId,const std::vector<Poi
     }
     
     pthread_mutex_lock(&mutex);
-    polytopeSelectables.insert(newSelect);
+    if (polytopeSelectables.insert(newSelect).second)
+        polytopeIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -367,7 +465,8 @@ void SelectionManager::addSelectableLinear(SimpleIdentity selectId,const Point3f
     }
 
     pthread_mutex_lock(&mutex);
-    linearSelectables.insert(newSelect);
+    if (linearSelectables.insert(newSelect).second)
+        linearIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -387,7 +486,8 @@ void SelectionManager::addSelectableBillboard(SimpleIdentity selectId,const Poin
     newSelect.maxVis = maxVis;
     
     pthread_mutex_lock(&mutex);
-    billboardSelectables.insert(newSelect);
+    if (billboardSelectables.insert(newSelect).second)
+        billboardIndex.addItem(IndexItem(newSelect));
     pthread_mutex_unlock(&mutex);
 }
 
@@ -545,11 +645,17 @@ void SelectionManager::removeSelectable(SimpleIdentity selectID)
     RectSelectable3DSet::iterator it = rect3Dselectables.find(RectSelectable3D(selectID));
     
     if (it != rect3Dselectables.end())
+    {
         rect3Dselectables.erase(it);
+        rect3DIndex.removeItem();
+    }
     
     RectSelectable2DSet::iterator it2 = rect2Dselectables.find(RectSelectable2D(selectID));
     if (it2 != rect2Dselectables.end())
+    {
         rect2Dselectables.erase(it2);
+        rect2DIndex.removeItem();
+    }
     
     MovingRectSelectable2DSet::iterator itM = movingRect2Dselectables.find(MovingRectSelectable2D(selectID));
     if (itM != movingRect2Dselectables.end())
@@ -557,7 +663,10 @@ void SelectionManager::removeSelectable(SimpleIdentity selectID)
 
     PolytopeSelectableSet::iterator it3 = polytopeSelectables.find(PolytopeSelectable(selectID));
     if (it3 != polytopeSelectables.end())
+    {
         polytopeSelectables.erase(it3);
+        polytopeIndex.removeItem();
+    }
     
     MovingPolytopeSelectableSet::iterator it3a = movingPolytopeSelectables.find(MovingPolytopeSelectable(selectID));
     if (it3a != movingPolytopeSelectables.end())
@@ -565,11 +674,17 @@ void SelectionManager::removeSelectable(SimpleIdentity selectID)
     
     LinearSelectableSet::iterator it5 = linearSelectables.find(LinearSelectable(selectID));
     if (it5 != linearSelectables.end())
+    {
         linearSelectables.erase(it5);
+        linearIndex.removeItem();
+    }
     
     BillboardSelectableSet::iterator it4 = billboardSelectables.find(BillboardSelectable(selectID));
     if (it4 != billboardSelectables.end())
+    {
         billboardSelectables.erase(it4);
+        billboardIndex.removeItem();
+    }
 
     pthread_mutex_unlock(&mutex);
 }
@@ -588,6 +703,7 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
         {
             found = true;
             rect3Dselectables.erase(it);
+            rect3DIndex.removeItem();
         }
         
         RectSelectable2DSet::iterator it2 = rect2Dselectables.find(RectSelectable2D(selectID));
@@ -595,6 +711,7 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
         {
             found = true;
             rect2Dselectables.erase(it2);
+            rect2DIndex.removeItem();
         }
         
         MovingRectSelectable2DSet::iterator itM = movingRect2Dselectables.find(MovingRectSelectable2D(selectID));
@@ -609,6 +726,7 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
         {
             found = true;
             polytopeSelectables.erase(it3);
+            polytopeIndex.removeItem();
         }
 
         MovingPolytopeSelectableSet::iterator it3a = movingPolytopeSelectables.find(MovingPolytopeSelectable(selectID));
@@ -623,6 +741,7 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
         {
             found = true;
             linearSelectables.erase(it5);
+            linearIndex.removeItem();
         }
 
         BillboardSelectableSet::iterator it4 = billboardSelectables.find(BillboardSelectable(selectID));
@@ -630,6 +749,7 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
         {
             found = true;
             billboardSelectables.erase(it4);
+            billboardIndex.removeItem();
         }
     }
     
@@ -639,11 +759,27 @@ void SelectionManager::removeSelectables(const SimpleIDSet &selectIDs)
     pthread_mutex_unlock(&mutex);
 }
 
-void SelectionManager::getScreenSpaceObjects(const PlacementInfo &pInfo,std::vector<ScreenSpaceObjectLocation> &screenPts,TimeInterval now)
+void SelectionManager::updateIndices()
+{
+    if (rect3DIndex.needsRebuild())
+        RebuildIndex(rect3DIndex,rect3Dselectables);
+    if (rect2DIndex.needsRebuild())
+        RebuildIndex(rect2DIndex,rect2Dselectables);
+    if (polytopeIndex.needsRebuild())
+        RebuildIndex(polytopeIndex,polytopeSelectables);
+    if (linearIndex.needsRebuild())
+        RebuildIndex(linearIndex,linearSelectables);
+    if (billboardIndex.needsRebuild())
+        RebuildIndex(billboardIndex,billboardSelectables);
+}
+
+void SelectionManager::getScreenSpaceObjects(const PlacementInfo &pInfo,const std::vector<SimpleIdentity> &rect2DIDs,std::vector<ScreenSpaceObjectLocation> &screenPts,TimeInterval now)
 {
-    for (RectSelectable2DSet::iterator it = rect2Dselectables.begin();
-         it != rect2Dselectables.end(); ++it)
+    for (SimpleIdentity selectID : rect2DIDs)
     {
+        RectSelectable2DSet::iterator it = rect2Dselectables.find(RectSelectable2D(selectID));
+        if (it == rect2Dselectables.end())
+            continue;
         const RectSelectable2D &sel = *it;
         if (sel.selectID != EmptyIdentity)
         {
@@ -805,13 +941,34 @@ void SelectionManager::pickObjects(Point2f touchPt,float maxDist,View *theView,b
     Vector3d eyeVec(eyeVec4.x(),eyeVec4.y(),eyeVec4.z());
 
     LayoutManager *layoutManager = (LayoutManager *)scene->getManager(kWKLayoutManager);
-    
+
+    // Where the touch goes in display space.  The 3D objects are projected directly and
+    //  the rest go through each of the wrapping offsets.  No rays means look at everything.
+    std::vector<SelectionPickRay> rays3D,raysWrapped;
+    SelectionPickRay ray;
+    if (ray.init(touchPt,pInfo.frameSizeScale,pInfo.projMat,pInfo.viewAndModelMat))
+        rays3D.push_back(ray);
+    Point2f frameSizeView(pInfo.frameSize.x()/scale,pInfo.frameSize.y()/scale);
+    for (const Eigen::Matrix4d &offMatrix : pInfo.offsetMatrices)
+    {
+        if (!ray.init(touchPt,frameSizeView,pInfo.projMat,pInfo.viewMat * offMatrix * pInfo.modelMat))
+        {
+            raysWrapped.clear();
+            break;
+        }
+        raysWrapped.push_back(ray);
+    }
+
     pthread_mutex_lock(&mutex);
 
+    updateIndices();
+    std::vector<SimpleIdentity> candidates;
+
     // Figure out where the screen space objects are, both layout manager
     //  controlled and other
     std::vector<ScreenSpaceObjectLocation> ssObjs;
-    getScreenSpaceObjects(pInfo,ssObjs,now);
+    FindCandidates(rect2DIndex,rect2Dselectables,raysWrapped,maxDist,candidates);
+    getScreenSpaceObjects(pInfo,candidates,ssObjs,now);
     if (layoutManager)
         layoutManager->getScreenSpaceObjects(pInfo,ssObjs);
     
@@ -895,9 +1052,12 @@ void SelectionManager::pickObjects(Point2f touchPt,float maxDist,View *theView,b
     if (!polytopeSelectables.empty())
     {
         // Work through the axis aligned rectangular solids
-        for (PolytopeSelectableSet::iterator it = polytopeSelectables.begin();
-             it != polytopeSelectables.end(); ++it)
+        FindCandidates(polytopeIndex,polytopeSelectables,rays3D,maxDist,candidates);
+        for (SimpleIdentity selectID : candidates)
         {
+            PolytopeSelectableSet::iterator it = polytopeSelectables.find(PolytopeSelectable(selectID));
+            if (it == polytopeSelectables.end())
+                continue;
             PolytopeSelectable sel = *it;
             if (sel.selectID != EmptyIdentity && sel.enable)
             {
@@ -1012,9 +1172,12 @@ void SelectionManager::pickObjects(Point2f touchPt,float maxDist,View *theView,b
     
     if (!linearSelectables.empty())
     {
-        for (LinearSelectableSet::iterator it = linearSelectables.begin();
-             it != linearSelectables.end(); ++it)
+        FindCandidates(linearIndex,linearSelectables,raysWrapped,maxDist,candidates);
+        for (SimpleIdentity selectID : candidates)
         {
+            LinearSelectableSet::iterator it = linearSelectables.find(LinearSelectable(selectID));
+            if (it == linearSelectables.end())
+                continue;
             LinearSelectable sel = *it;
             
             if (sel.selectID != EmptyIdentity && sel.enable)
@@ -1065,9 +1228,12 @@ void SelectionManager::pickObjects(Point2f touchPt,float maxDist,View *theView,b
     if (!rect3Dselectables.empty())
     {
         // Work through the 3D rectangles
-        for (RectSelectable3DSet::iterator it = rect3Dselectables.begin();
-             it != rect3Dselectables.end(); ++it)
+        FindCandidates(rect3DIndex,rect3Dselectables,rays3D,maxDist,candidates);
+        for (SimpleIdentity selectID : candidates)
         {
+            RectSelectable3DSet::iterator it = rect3Dselectables.find(RectSelectable3D(selectID));
+            if (it == rect3Dselectables.end())
+                continue;
             RectSelectable3D sel = *it;
             if (sel.selectID != EmptyIdentity && sel.enable)
             {
@@ -1130,9 +1296,12 @@ void SelectionManager::pickObjects(Point2f touchPt,float maxDist,View *theView,b
     if (!billboardSelectables.empty())
     {
         // Work through the billboards
-        for (BillboardSelectableSet::iterator it = billboardSelectables.begin();
-             it != billboardSelectables.end(); ++it)
+        FindCandidates(billboardIndex,billboardSelectables,rays3D,maxDist,candidates);
+        for (SimpleIdentity selectID : candidates)
         {
+            BillboardSelectableSet::iterator it = billboardSelectables.find(BillboardSelectable(selectID));
+            if (it == billboardSelectables.end())
+                continue;
             BillboardSelectable sel = *it;
             if (sel.selectID != EmptyIdentity && sel.enable)
             {
@@ -20,6 +20,7 @@
 
 #import "SphericalMercator.h"
 #import "GlobeMath.h"
+#import <algorithm>
 
 namespace WhirlyKit
 {
@@ -127,6 +128,29 @@ Point3d SphericalMercatorCoordSystem::geocentricToLocal(Point3d geocPt)
     Point3d localPt = geographicToLocal3d(GeoCoord(geoCoordPlus.x(),geoCoordPlus.y()));
     return Point3d(localPt.x(),localPt.y(),geoCoordPlus.z());
 }
+
+void SphericalMercatorCoordSystem::localToGeocentric(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    // Unproject to lon/lat in place, keeping the height, then do the datum conversion in one go
+    for (size_t ii=0;ii<numPts;ii++)
+    {
+        const Point3d &pt = inPts[ii];
+        outPts[ii] = Point3d(pt.x() + originLon,atan(sinh(pt.y())),pt.z());
+    }
+    GeoCoordSystem::LocalToGeocentric(outPts,outPts,numPts);
+}
+
+void SphericalMercatorCoordSystem::geocentricToLocal(const Point3d *inPts,Point3d *outPts,size_t numPts)
+{
+    GeoCoordSystem::GeocentricToLocal(inPts,outPts,numPts);
+    for (size_t ii=0;ii<numPts;ii++)
+    {
+        Point3d &pt = outPts[ii];
+        double lat = std::min(std::max(pt.y(),-PoleLimit),PoleLimit);
+        pt.x() = pt.x() - originLon;
+        pt.y() = log((1.0+sin(lat))/cos(lat));
+    }
+}
     
 bool SphericalMercatorCoordSystem::isSameAs(CoordSystem *coordSys)
 {
@@ -182,6 +206,14 @@ WhirlyKit::Point3d SphericalMercatorDisplayAdapter::localToDisplay(WhirlyKit::Po
     Point3d dispPt = localPt-Point3d(org.x(),org.y(),0.0);
     return dispPt;
 }
+
+void SphericalMercatorDisplayAdapter::localToDisplay(const WhirlyKit::Point3d *inPts,WhirlyKit::Point3d *outPts,size_t numPts)
+{
+    if (numPts == 0)
+        return;
+    
+    ScaleOffsetPoints(inPts,outPts,numPts,Point3d(1.0,1.0,1.0),Point3d(-org.x(),-org.y(),0.0));
+}
     
 /// Convert from display coordinates to the local system's coordinates
 WhirlyKit::Point3f SphericalMercatorDisplayAdapter::displayToLocal(WhirlyKit::Point3f dispPt)
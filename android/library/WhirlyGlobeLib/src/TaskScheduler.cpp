@@ -0,0 +1,459 @@
+/*
+ *  TaskScheduler.cpp
+ *  WhirlyGlobeLib
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <unistd.h>
+#import <algorithm>
+#import <climits>
+#import "TaskScheduler.h"
+#import "WhirlyKitLog.h"
+
+namespace WhirlyKit
+{
+
+TaskGroup::TaskGroup(TaskScheduler *scheduler,double importance)
+    : scheduler(scheduler), importance(importance), cancelled(false), outstanding(0)
+{
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+TaskGroup::~TaskGroup()
+{
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&cond);
+}
+
+void TaskGroup::addTask(const TaskFunc &func)
+{
+    if (cancelled)
+        return;
+
+    PendingTaskRef pendingTask(new PendingTask(func));
+    pthread_mutex_lock(&lock);
+    outstanding++;
+    pending.push_back(pendingTask);
+    // Somebody in wait() can pick this up
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    // The scheduler holds on to the group until the task is done
+    scheduler->addTask(shared_from_this(),pendingTask);
+}
+
+void TaskGroup::runClaimed(PendingTask *task)
+{
+    // Cancelled tasks are dropped
+    if (!cancelled)
+    {
+        try
+        {
+            task->func();
+        }
+        catch (...)
+        {
+            WHIRLYKIT_LOGV("TaskScheduler: Task threw an exception");
+        }
+    }
+    taskDone();
+}
+
+void TaskGroup::taskDone()
+{
+    pthread_mutex_lock(&lock);
+    outstanding--;
+    while (!pending.empty() && pending.front()->claimed)
+        pending.pop_front();
+    if (outstanding == 0)
+        pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+bool TaskGroup::wait()
+{
+    pthread_mutex_lock(&lock);
+    while (outstanding > 0)
+    {
+        // Run our own tasks that haven't started.  Never anyone else's, since they might
+        //  need a lock our caller is holding or take far longer than ours.
+        if (!pending.empty())
+        {
+            PendingTaskRef task = pending.front();
+            pending.pop_front();
+            if (task->claim())
+            {
+                pthread_mutex_unlock(&lock);
+                runClaimed(task.get());
+                pthread_mutex_lock(&lock);
+            }
+            continue;
+        }
+
+        // What's left is running elsewhere.  We'll hear about it finishing or adding more.
+        pthread_cond_wait(&cond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    return !cancelled;
+}
+
+void TaskGroup::cancel()
+{
+    cancelled = true;
+}
+
+TaskScheduler::WorkerQueue::WorkerQueue()
+{
+    pthread_mutex_init(&lock, NULL);
+}
+
+TaskScheduler::WorkerQueue::~WorkerQueue()
+{
+    pthread_mutex_destroy(&lock);
+}
+
+void TaskScheduler::WorkerQueue::push(const Task &task)
+{
+    pthread_mutex_lock(&lock);
+    tasks.push_back(task);
+    std::push_heap(tasks.begin(),tasks.end());
+    pthread_mutex_unlock(&lock);
+}
+
+bool TaskScheduler::WorkerQueue::pop(Task &task)
+{
+    bool found = false;
+    pthread_mutex_lock(&lock);
+    if (!tasks.empty())
+    {
+        std::pop_heap(tasks.begin(),tasks.end());
+        task = tasks.back();
+        tasks.pop_back();
+        found = true;
+    }
+    pthread_mutex_unlock(&lock);
+
+    return found;
+}
+
+// Which worker (if any) the current thread is
+static pthread_key_t workerKey;
+static pthread_once_t workerKeyOnce = PTHREAD_ONCE_INIT;
+
+static void MakeWorkerKey()
+{
+    pthread_key_create(&workerKey, NULL);
+}
+
+// Passed to the worker threads on startup
+typedef struct
+{
+    TaskScheduler *scheduler;
+    int which;
+} WorkerStartInfo;
+
+TaskScheduler::TaskScheduler(int numThreads)
+    : numPending(0), nextOrder(0), nextWorker(0), shuttingDown(false)
+{
+    pthread_once(&workerKeyOnce, MakeWorkerKey);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+    pthread_mutex_init(&tileLock, NULL);
+
+    numThreads = std::max(numThreads,1);
+    for (int ii=0;ii<numThreads;ii++)
+        workers.push_back(new WorkerQueue());
+    for (int ii=0;ii<numThreads;ii++)
+    {
+        WorkerStartInfo *startInfo = new WorkerStartInfo();
+        startInfo->scheduler = this;
+        startInfo->which = ii;
+        if (pthread_create(&workers[ii]->thread, NULL, &TaskScheduler::workerMain, startInfo))
+        {
+            WHIRLYKIT_LOGV("TaskScheduler: Failed to start worker thread");
+            delete startInfo;
+        }
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    pthread_mutex_lock(&lock);
+    shuttingDown = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    for (WorkerQueue *worker : workers)
+    {
+        pthread_join(worker->thread, NULL);
+        // Anything left over is dropped
+        Task task;
+        while (worker->pop(task))
+            if (task.pendingTask->claim())
+                task.group->taskDone();
+        delete worker;
+    }
+    workers.clear();
+
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&tileLock);
+}
+
+// Note: Never deleted, so workers can be running during static destruction
+static TaskScheduler *sharedScheduler = NULL;
+static pthread_once_t sharedSchedulerOnce = PTHREAD_ONCE_INIT;
+
+static void MakeSharedScheduler()
+{
+    long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+    sharedScheduler = new TaskScheduler(numCores > 0 ? (int)numCores : 1);
+}
+
+TaskScheduler *TaskScheduler::getScheduler()
+{
+    pthread_once(&sharedSchedulerOnce, MakeSharedScheduler);
+    return sharedScheduler;
+}
+
+// Shared by the calling thread and the helpers in a parallelFor.
+// Helpers that start late find nothing left to do, so this can outlive the call.
+class ParallelForState
+{
+public:
+    ParallelForState(unsigned int num,unsigned int chunkSize,const RangeFunc &func)
+        : num(num), chunkSize(chunkSize), func(func), next(0), done(0)
+    {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+    }
+
+    ~ParallelForState()
+    {
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&cond);
+    }
+
+    // Run chunks until they're all spoken for
+    void run()
+    {
+        while (true)
+        {
+            unsigned int start = next.fetch_add(chunkSize);
+            if (start >= num)
+                break;
+            unsigned int end = std::min(start+chunkSize,num);
+            func(start,end);
+            if (done.fetch_add(end-start) + (end-start) == num)
+            {
+                pthread_mutex_lock(&lock);
+                pthread_cond_broadcast(&cond);
+                pthread_mutex_unlock(&lock);
+            }
+        }
+    }
+
+    // Wait for the chunks someone else is still working on
+    void wait()
+    {
+        pthread_mutex_lock(&lock);
+        while (done < num)
+            pthread_cond_wait(&cond, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+
+protected:
+    unsigned int num,chunkSize;
+    RangeFunc func;
+    std::atomic<unsigned int> next,done;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+void TaskScheduler::parallelFor(unsigned int num,unsigned int chunkSize,const RangeFunc &func)
+{
+    chunkSize = std::max(chunkSize,1u);
+    unsigned int numChunks = (num + chunkSize - 1) / chunkSize;
+    if (numChunks < 2)
+    {
+        if (num > 0)
+            func(0,num);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state(new ParallelForState(num,chunkSize,func));
+
+    // Jump the queue, since the caller is waiting on these
+    TaskGroupRef group(new TaskGroup(this,MAXFLOAT));
+    unsigned int numHelpers = std::min(numChunks-1,(unsigned int)workers.size());
+    for (unsigned int ii=0;ii<numHelpers;ii++)
+        group->addTask([state]()
+                       {
+                           state->run();
+                       });
+
+    // We pitch in on our own chunks and then wait for just those.
+    // Helpers that haven't started by then have nothing to do, so there's no need to wait on the group.
+    state->run();
+    state->wait();
+}
+
+void TaskScheduler::addTask(const TaskGroupRef &group,const TaskGroup::PendingTaskRef &pendingTask)
+{
+    pthread_mutex_lock(&lock);
+    Task task;
+    task.group = group;
+    task.pendingTask = pendingTask;
+    task.importance = group->getImportance();
+    task.order = nextOrder++;
+    // Our own threads keep their work local.  Everyone else spreads it around.
+    long which = (long)pthread_getspecific(workerKey) - 1;
+    if (which < 0 || which >= (long)workers.size())
+        which = nextWorker++ % workers.size();
+    numPending++;
+    pthread_mutex_unlock(&lock);
+
+    workers[which]->push(task);
+
+    pthread_mutex_lock(&lock);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+bool TaskScheduler::runTask(int which)
+{
+    Task task;
+    bool found = false;
+    int numWorkers = (int)workers.size();
+
+    // Our own queue first
+    if (which >= 0)
+        found = workers[which]->pop(task);
+    // Then steal from the others
+    for (int ii=1;ii<=numWorkers && !found;ii++)
+    {
+        int other = (std::max(which,0) + ii) % numWorkers;
+        if (other != which)
+            found = workers[other]->pop(task);
+    }
+    if (!found)
+        return false;
+
+    pthread_mutex_lock(&lock);
+    numPending--;
+    pthread_mutex_unlock(&lock);
+
+    // Somebody waiting on the group may have gotten to it first
+    if (task.pendingTask->claim())
+        task.group->runClaimed(task.pendingTask.get());
+
+    return true;
+}
+
+void *TaskScheduler::workerMain(void *arg)
+{
+    WorkerStartInfo *startInfo = (WorkerStartInfo *)arg;
+    TaskScheduler *scheduler = startInfo->scheduler;
+    int which = startInfo->which;
+    delete startInfo;
+
+    pthread_setspecific(workerKey, (void *)(long)(which+1));
+
+    while (true)
+    {
+        if (scheduler->runTask(which))
+            continue;
+
+        pthread_mutex_lock(&scheduler->lock);
+        while (scheduler->numPending == 0 && !scheduler->shuttingDown)
+            pthread_cond_wait(&scheduler->cond, &scheduler->lock);
+        bool done = scheduler->shuttingDown;
+        pthread_mutex_unlock(&scheduler->lock);
+        if (done)
+            break;
+    }
+
+    return NULL;
+}
+
+TaskGroupRef TaskScheduler::addTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident,double importance)
+{
+    TaskGroupRef group;
+    TileKey key(ownerID,ident);
+
+    pthread_mutex_lock(&tileLock);
+    TileGroupMap::iterator it = tileGroups.find(key);
+    if (it != tileGroups.end())
+    {
+        group = it->second;
+        group->setImportance(importance);
+    } else {
+        group = TaskGroupRef(new TaskGroup(this,importance));
+        tileGroups[key] = group;
+    }
+    pthread_mutex_unlock(&tileLock);
+
+    return group;
+}
+
+TaskGroupRef TaskScheduler::findTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident)
+{
+    TaskGroupRef group;
+
+    pthread_mutex_lock(&tileLock);
+    TileGroupMap::iterator it = tileGroups.find(TileKey(ownerID,ident));
+    if (it != tileGroups.end())
+        group = it->second;
+    pthread_mutex_unlock(&tileLock);
+
+    return group;
+}
+
+void TaskScheduler::removeTileGroup(SimpleIdentity ownerID,const Quadtree::Identifier &ident)
+{
+    pthread_mutex_lock(&tileLock);
+    tileGroups.erase(TileKey(ownerID,ident));
+    pthread_mutex_unlock(&tileLock);
+}
+
+void TaskScheduler::cancelTile(SimpleIdentity ownerID,const Quadtree::Identifier &ident)
+{
+    pthread_mutex_lock(&tileLock);
+    TileGroupMap::iterator it = tileGroups.find(TileKey(ownerID,ident));
+    if (it != tileGroups.end())
+    {
+        it->second->cancel();
+        tileGroups.erase(it);
+    }
+    pthread_mutex_unlock(&tileLock);
+}
+
+void TaskScheduler::cancelOwner(SimpleIdentity ownerID)
+{
+    pthread_mutex_lock(&tileLock);
+    TileGroupMap::iterator it = tileGroups.lower_bound(TileKey(ownerID,Quadtree::Identifier(INT_MIN,INT_MIN,INT_MIN)));
+    while (it != tileGroups.end() && it->first.first == ownerID)
+    {
+        it->second->cancel();
+        it = tileGroups.erase(it);
+    }
+    pthread_mutex_unlock(&tileLock);
+}
+
+}
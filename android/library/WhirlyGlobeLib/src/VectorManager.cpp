@@ -25,6 +25,7 @@
 #import "GridClipper.h"
 #import "SharedAttributes.h"
 #import "Platform.h"
+#import "ScratchArena.h"
 
 using namespace Eigen;
 using namespace WhirlyKit;
@@ -113,8 +114,9 @@ class VectorDrawableBuilder
 {
 public:
     VectorDrawableBuilder(Scene *scene,ChangeSet &changeRequests,VectorSceneRep *sceneRep,
-                          const VectorInfo *vecInfo,bool linesOrPoints,bool doColor)
-    : changeRequests(changeRequests), scene(scene), sceneRep(sceneRep), vecInfo(vecInfo), drawable(NULL), centerValid(false), center(0,0,0), geoCenter(0,0), doColor(doColor)
+                          const VectorInfo *vecInfo,bool linesOrPoints,bool doColor,ScratchArena &arena)
+    : changeRequests(changeRequests), scene(scene), sceneRep(sceneRep), vecInfo(vecInfo), drawable(NULL), centerValid(false), center(0,0,0), geoCenter(0,0), doColor(doColor),
+      arena(arena), localPts(&arena), dispPts(&arena)
     {
         primType = (linesOrPoints ? GL_LINES : GL_POINTS);
     }
@@ -133,22 +135,27 @@ public:
     
     void addPoints(VectorRing3d &inPts,bool closed,Dictionary *attrs)
     {
-        VectorRing pts;
-        pts.reserve(pts.size());
+        ScratchVector<Point2f> pts(&arena);
+        pts.reserve(inPts.size());
         for (const auto &pt : inPts)
             pts.push_back(Point2f(pt.x(),pt.y()));
         
-        addPoints(pts,closed,attrs);
+        addPoints(pts.data(),pts.size(),closed,attrs);
     }
 
     void addPoints(VectorRing &pts,bool closed,Dictionary *attrs)
+    {
+        addPoints(pts.data(),pts.size(),closed,attrs);
+    }
+
+    void addPoints(const Point2f *pts,size_t numPts,bool closed,Dictionary *attrs)
     {
         CoordSystemDisplayAdapter *coordAdapter = scene->getCoordAdapter();
         RGBAColor ringColor = attrs->getColor(MaplyColor, vecInfo->color);
         
         // Decide if we'll appending to an existing drawable or
         //  create a new one
-        int ptCount = (int)(2*(pts.size()+1));
+        int ptCount = (int)(2*(numPts+1));
         if (!drawable || (drawable->getNumPoints()+ptCount > MaxDrawablePoints))
         {
             // We're done with it, toss it to the scene
@@ -163,18 +170,28 @@ public:
             drawable->setColor(ringColor);
             drawable->setLineWidth(vecInfo->lineWidth);
         }
-        drawMbr.addPoints(pts);
+        for (size_t jj=0;jj<numPts;jj++)
+            drawMbr.addPoint(pts[jj]);
+        
+        // Convert to real world coordinates, then to display in one batch
+        CoordSystem *coordSys = coordAdapter->getCoordSystem();
+        localPts.resize(numPts);
+        dispPts.resize(numPts);
+        for (unsigned int jj=0;jj<numPts;jj++)
+        {
+            const Point2f &geoPt = pts[jj];
+            localPts[jj] = coordSys->geographicToLocal(Point2d(geoPt.x()+geoCenter.x(),geoPt.y()+geoCenter.y()));
+        }
+        if (numPts > 0)
+            coordAdapter->localToDisplay(&localPts[0],&dispPts[0],numPts);
         
         Point3f prevPt,prevNorm,firstPt,firstNorm;
-        for (unsigned int jj=0;jj<pts.size();jj++)
+        for (unsigned int jj=0;jj<numPts;jj++)
         {
-            // Convert to real world coordinates and offset from the globe
-            Point2f &geoPt = pts[jj];
-            Point2d geoCoordD(geoPt.x()+geoCenter.x(),geoPt.y()+geoCenter.y());
-            Point3d localPt = coordAdapter->getCoordSystem()->geographicToLocal(geoCoordD);
-            Point3d norm3d = coordAdapter->normalForLocal(localPt);
+            // Offset from the globe
+            Point3d norm3d = coordAdapter->normalForLocal(localPts[jj]);
             Point3f norm(norm3d.x(),norm3d.y(),norm3d.z());
-            Point3d pt3d = coordAdapter->localToDisplay(localPt) - center;
+            Point3d pt3d = dispPts[jj] - center;
             Point3f pt(pt3d.x(),pt3d.y(),pt3d.z());
             
             // Add to drawable
@@ -258,6 +275,9 @@ protected:
     const VectorInfo *vecInfo;
     Point3d center;
     Point2d geoCenter;
+    // Scratch space for coordinate conversion, reused between rings
+    ScratchArena &arena;
+    ScratchVector<Point3d> localPts,dispPts;
     bool centerValid;
     GLenum primType;
 };
@@ -270,8 +290,8 @@ class VectorDrawableBuilderTri
 {
 public:
     VectorDrawableBuilderTri(Scene *scene,ChangeSet &changeRequests,VectorSceneRep *sceneRep,
-                             const VectorInfo *vecInfo,bool doColor)
-    : changeRequests(changeRequests), scene(scene), sceneRep(sceneRep), vecInfo(vecInfo), drawable(NULL), centerValid(false), center(0,0,0), doColor(doColor), geoCenter(0,0)
+                             const VectorInfo *vecInfo,bool doColor,ScratchArena &arena)
+    : changeRequests(changeRequests), scene(scene), sceneRep(sceneRep), vecInfo(vecInfo), drawable(NULL), centerValid(false), center(0,0,0), doColor(doColor), geoCenter(0,0), arena(arena)
     {
     }
     
@@ -291,14 +311,15 @@ public:
     void addPoints(VectorRing &ring,Dictionary *attrs)
     {
         // Grid subdivision is done here
-        std::vector<VectorRing> inRings;
+        VectorTrianglesRef mesh(VectorTriangles::createTriangles());
         if (vecInfo->subdivEps > 0.0 && vecInfo->gridSubdiv)
+        {
+            std::vector<VectorRing> inRings;
             ClipLoopToGrid(ring, Point2f(0.0,0.0), Point2f(vecInfo->subdivEps,vecInfo->subdivEps), inRings);
-        else
-            inRings.push_back(ring);
-        VectorTrianglesRef mesh(VectorTriangles::createTriangles());
-        for (unsigned int ii=0;ii<inRings.size();ii++)
-            TesselateRing(inRings[ii],mesh);
+            for (unsigned int ii=0;ii<inRings.size();ii++)
+                TesselateRing(inRings[ii],mesh);
+        } else
+            TesselateRing(ring,mesh);
         
         addPoints(mesh, attrs);
     }
@@ -311,31 +332,23 @@ public:
         for (const auto &pt : inRing)
             ring.push_back(Point2f(pt.x(),pt.y()));
         
-        // Grid subdivision is done here
-        std::vector<VectorRing> inRings;
-        if (vecInfo->subdivEps > 0.0 && vecInfo->gridSubdiv)
-            ClipLoopToGrid(ring, Point2f(0.0,0.0), Point2f(vecInfo->subdivEps,vecInfo->subdivEps), inRings);
-        else
-            inRings.push_back(ring);
-        VectorTrianglesRef mesh(VectorTriangles::createTriangles());
-        for (unsigned int ii=0;ii<inRings.size();ii++)
-            TesselateRing(inRings[ii],mesh);
-        
-        addPoints(mesh, attrs);
+        addPoints(ring, attrs);
     }
 
     // This version converts a ring into a mesh (chopping, tesselating, etc...)
     void addPoints(std::vector<VectorRing> &rings,Dictionary *attrs)
     {
         // Grid subdivision is done here
-        std::vector<VectorRing> inRings;
+        std::vector<VectorRing> clippedRings;
+        const std::vector<VectorRing> *inRings = &rings;
         if (vecInfo->subdivEps > 0.0 && vecInfo->gridSubdiv)
+        {
             for (unsigned int ii=0;ii<rings.size();ii++)
-                ClipLoopToGrid(rings[ii], Point2f(0.0,0.0), Point2f(vecInfo->subdivEps,vecInfo->subdivEps), inRings);
-        else
-            inRings = rings;
+                ClipLoopToGrid(rings[ii], Point2f(0.0,0.0), Point2f(vecInfo->subdivEps,vecInfo->subdivEps), clippedRings);
+            inRings = &clippedRings;
+        }
         VectorTrianglesRef mesh(VectorTriangles::createTriangles());
-        TesselateLoops(inRings, mesh);
+        TesselateLoops(*inRings, mesh);
         
         addPoints(mesh, attrs);
     }
@@ -353,10 +366,21 @@ public:
             centroid.y() = attrs->getDouble(MaplyVecCenterY);
         }
         
+        // Reused for every triangle
+        ScratchVector<Point2f> pts(&arena);
+        pts.reserve(3);
+        ScratchVector<TexCoord> texCoords(&arena);
+        texCoords.reserve(3);
+
         for (unsigned int ir=0;ir<mesh->tris.size();ir++)
         {
-            VectorRing pts;
-            mesh->getTriangle(ir, pts);
+            pts.clear();
+            const VectorTriangles::Triangle &tri = mesh->tris[ir];
+            for (unsigned int ii=0;ii<3;ii++)
+            {
+                const Point3f &meshPt = mesh->pts[tri.pts[ii]];
+                pts.push_back(Point2f(meshPt.x(),meshPt.y()));
+            }
             // Decide if we'll appending to an existing drawable or
             //  create a new one
             int ptCount = (int)pts.size();
@@ -380,7 +404,8 @@ public:
                     drawable->setProgram(vecInfo->programID);
             }
             int baseVert = drawable->getNumPoints();
-            drawMbr.addPoints(pts);
+            for (const Point2f &pt : pts)
+                drawMbr.addPoint(pt);
             
             bool doTexCoords = vecInfo->texId != EmptyIdentity;
             
@@ -402,10 +427,9 @@ public:
             }
             
             // Generate the textures coordinates
-            std::vector<TexCoord> texCoords;
+            texCoords.clear();
             if (doTexCoords)
             {
-                texCoords.reserve(pts.size());
                 TexCoord minCoord(MAXFLOAT,MAXFLOAT);
                 for (unsigned int jj=0;jj<pts.size();jj++)
                 {
@@ -524,6 +548,7 @@ protected:
     bool centerValid;
     BasicDrawable *drawable;
     const VectorInfo *vecInfo;
+    ScratchArena &arena;
 };
 
 VectorManager::VectorManager()
@@ -596,14 +621,22 @@ SimpleIdentity VectorManager::addVectors(ShapeSet *shapes, const VectorInfo &vec
         }
     }
     
+    // Temporary geometry goes in this thread's scratch arena and is all thrown out at the end
+    ScratchArena &arena = ScratchArena::getThreadArena();
+    ScratchArena::Scope scratchScope(arena);
+
     // Used to toss out drawables as we go
     // Its destructor will flush out the last drawable
-    VectorDrawableBuilder drawBuild(scene,changes,sceneRep,&vecInfo,true,doColors);
+    VectorDrawableBuilder drawBuild(scene,changes,sceneRep,&vecInfo,true,doColors,arena);
     if (centerValid)
         drawBuild.setCenter(center,geoCenter);
-    VectorDrawableBuilderTri drawBuildTri(scene,changes,sceneRep,&vecInfo,doColors);
+    VectorDrawableBuilderTri drawBuildTri(scene,changes,sceneRep,&vecInfo,doColors,arena);
     if (centerValid)
         drawBuildTri.setCenter(center,geoCenter);
+
+    // Subdivided edges go here, reused between shapes
+    VectorRing newPts;
+    VectorRing3d newPts3d;
         
     for (ShapeSet::iterator it = shapes->begin();
          it != shapes->end(); ++it)
@@ -628,7 +661,7 @@ SimpleIdentity VectorManager::addVectors(ShapeSet *shapes, const VectorInfo &vec
                     // Break the edges around the globe (presumably)
                     if (vecInfo.sample > 0.0)
                     {
-                        VectorRing newPts;
+                        newPts.clear();
                         SubdivideEdges(ring, newPts, false, vecInfo.sample);
                         drawBuild.addPoints(newPts,true,theAreal->getAttrDict());
                     } else
@@ -646,7 +679,7 @@ SimpleIdentity VectorManager::addVectors(ShapeSet *shapes, const VectorInfo &vec
                 } else {
                     if (vecInfo.sample > 0.0)
                     {
-                        VectorRing newPts;
+                        newPts.clear();
                         SubdivideEdges(theLinear->pts, newPts, false, vecInfo.sample);
                         drawBuild.addPoints(newPts,false,theLinear->getAttrDict());
                     } else
@@ -663,9 +696,9 @@ SimpleIdentity VectorManager::addVectors(ShapeSet *shapes, const VectorInfo &vec
                     } else {
                         if (vecInfo.sample > 0.0)
                         {
-                            VectorRing3d newPts;
-                            SubdivideEdges(theLinear3d->pts, newPts, false, vecInfo.sample);
-                            drawBuild.addPoints(newPts,false,theLinear3d->getAttrDict());
+                            newPts3d.clear();
+                            SubdivideEdges(theLinear3d->pts, newPts3d, false, vecInfo.sample);
+                            drawBuild.addPoints(newPts3d,false,theLinear3d->getAttrDict());
                         } else
                             drawBuild.addPoints(theLinear3d->pts,false,theLinear3d->getAttrDict());
                     }
@@ -678,9 +711,9 @@ SimpleIdentity VectorManager::addVectors(ShapeSet *shapes, const VectorInfo &vec
                         else {
                             for (unsigned int ti=0;ti<theMesh->tris.size();ti++)
                             {
-                                VectorRing ring;
-                                theMesh->getTriangle(ti, ring);
-                                drawBuild.addPoints(ring,true,theMesh->getAttrDict());
+                                newPts.clear();
+                                theMesh->getTriangle(ti, newPts);
+                                drawBuild.addPoints(newPts,true,theMesh->getAttrDict());
                             }
                         }
                     } else {
@@ -22,6 +22,7 @@
 #import "FlatMath.h"
 #import "SharedAttributes.h"
 #import "WhirlyKitLog.h"
+#import "ScratchArena.h"
 
 using namespace WhirlyKit;
 using namespace Eigen;
@@ -62,8 +63,9 @@ capType(WideVecButtCap),texID(EmptyIdentity),miterLimit(2.0)
 class WideVectorBuilder
 {
 public:
-    WideVectorBuilder(const WideVectorInfo *vecInfo,const Point3d &localCenter,const Point3d &dispCenter,const RGBAColor inColor,bool makeTurns,CoordSystemDisplayAdapter *coordAdapter)
-    : vecInfo(vecInfo), angleCutoff(DegToRad(30.0)), texOffset(0.0), edgePointsValid(false), coordAdapter(coordAdapter), localCenter(localCenter), dispCenter(dispCenter), makeDistinctTurn(makeTurns)
+    WideVectorBuilder(const WideVectorInfo *vecInfo,const Point3d &localCenter,const Point3d &dispCenter,const RGBAColor inColor,bool makeTurns,CoordSystemDisplayAdapter *coordAdapter,ScratchArena &arena)
+    : vecInfo(vecInfo), angleCutoff(DegToRad(30.0)), texOffset(0.0), edgePointsValid(false), coordAdapter(coordAdapter), localCenter(localCenter), dispCenter(dispCenter), makeDistinctTurn(makeTurns),
+      pts(&arena)
     {
 //        color = [vecInfo.color asRGBAColor];
         color = inColor;
@@ -458,6 +460,12 @@ public:
         lastUp = up;
     }
     
+    // Make room for the points we're about to add
+    void reservePoints(int numPts)
+    {
+        pts.reserve(std::max(numPts,0));
+    }
+
     // Flush out any outstanding points
     void flush(BasicDrawable *drawable,bool buildLastSegment, bool buildLastJunction)
     {
@@ -478,7 +486,7 @@ public:
     
     double texOffset;
 
-    Point3dVector pts;
+    ScratchVector<Point3d> pts;
     Point3d lastUp;
     
     bool edgePointsValid;
@@ -490,8 +498,8 @@ public:
 class WideVectorDrawableBuilder
 {
 public:
-    WideVectorDrawableBuilder(Scene *scene,const WideVectorInfo *vecInfo)
-    : scene(scene), vecInfo(vecInfo), drawable(NULL), centerValid(false), localCenter(0,0,0), dispCenter(0,0,0)
+    WideVectorDrawableBuilder(Scene *scene,const WideVectorInfo *vecInfo,ScratchArena &arena)
+    : scene(scene), vecInfo(vecInfo), drawable(NULL), centerValid(false), localCenter(0,0,0), dispCenter(0,0,0), arena(arena)
     {
         coordAdapter = scene->getCoordAdapter();
         coordSys = coordAdapter->getCoordSystem();
@@ -547,7 +555,7 @@ public:
     }
     
     // Add the points for a linear
-    void addLinear(const VectorRing &pts,const Point3d &up,bool closed)
+    void addLinear(const Point2f *pts,int numPts,const Point3d &up,bool closed)
     {
         // We'll add one on the beginning and two on the end
         //  if we're doing a closed loop.  This gets us
@@ -559,9 +567,9 @@ public:
             // Note: We need this so we don't lose one turn
             //       This could be optimized
             makeDistinctTurns = true;
-            if (pts.size() > 2)
+            if (numPts > 2)
             {
-                if (pts.front() == pts.back())
+                if (pts[0] == pts[numPts-1])
                 {
                     startPoint = -3;
                 } else {
@@ -571,10 +579,11 @@ public:
         }
  
         RGBAColor color = vecInfo->color;
-        WideVectorBuilder vecBuilder(vecInfo,localCenter,dispCenter,color,makeDistinctTurns,coordAdapter);
+        WideVectorBuilder vecBuilder(vecInfo,localCenter,dispCenter,color,makeDistinctTurns,coordAdapter,arena);
+        vecBuilder.reservePoints(numPts-startPoint);
 
         // Guess at how many points and triangles we'll need
-        int totalTriCount = (int)(5*pts.size());
+        int totalTriCount = (int)(5*numPts);
         int totalPtCount = totalTriCount * 3;
         if (totalTriCount < 0)  totalTriCount = 0;
         if (totalPtCount < 0)  totalPtCount = 0;
@@ -582,10 +591,10 @@ public:
         // Work through the segments
         Point2f lastPt;
         bool validLastPt = false;
-        for (int ii=startPoint;ii<(int)pts.size();ii++)
+        for (int ii=startPoint;ii<numPts;ii++)
         {
             // Get the points in display space
-            Point2f geoA = pts[(ii+pts.size())%pts.size()];
+            Point2f geoA = pts[(ii+numPts)%numPts];
             
             if (validLastPt && geoA == lastPt)
                 continue;
@@ -627,7 +636,7 @@ public:
         pts.push_back(GeoCoord(1,0));
         
         RGBAColor color = vecInfo->color;
-        WideVectorBuilder vecBuilder(vecInfo,Point3d(0,0,0),Point3d(0,0,0),color,false,coordAdapter);
+        WideVectorBuilder vecBuilder(vecInfo,Point3d(0,0,0),Point3d(0,0,0),color,false,coordAdapter,arena);
         
         for (unsigned int ii=0;ii<pts.size();ii++)
         {
@@ -691,6 +700,7 @@ protected:
     const WideVectorInfo *vecInfo;
     BasicDrawable *drawable;
     std::vector<BasicDrawable *> drawables;
+    ScratchArena &arena;
 };
     
 WideVectorSceneRep::WideVectorSceneRep()
@@ -740,7 +750,11 @@ WideVectorManager::~WideVectorManager()
     
 SimpleIdentity WideVectorManager::addVectors(ShapeSet *shapes,const WideVectorInfo &vecInfo,ChangeSet &changes)
 {
-    WideVectorDrawableBuilder builder(scene,&vecInfo);
+    // Temporary geometry goes in this thread's scratch arena and is all thrown out at the end
+    ScratchArena &arena = ScratchArena::getThreadArena();
+    ScratchArena::Scope scratchScope(arena);
+
+    WideVectorDrawableBuilder builder(scene,&vecInfo,arena);
     
     // Calculate a center for this geometry
     GeoMbr geoMbr;
@@ -768,7 +782,7 @@ SimpleIdentity WideVectorManager::addVectors(ShapeSet *shapes,const WideVectorIn
         VectorLinearRef lin = std::dynamic_pointer_cast<VectorLinear>(*it);
         if (lin)
         {
-            builder.addLinear(lin->pts,centerUp,false);
+            builder.addLinear(lin->pts.data(),(int)lin->pts.size(),centerUp,false);
         } else {
             VectorArealRef ar = std::dynamic_pointer_cast<VectorAreal>(*it);
             if (ar)
@@ -778,11 +792,13 @@ SimpleIdentity WideVectorManager::addVectors(ShapeSet *shapes,const WideVectorIn
                     if (loop.size() > 2 && loop.begin() != loop.end())
                     {
                         // Just tack on another point at the end.  Kind of dumb, but easy.
-                        VectorRing newLoop = loop;
+                        ScratchVector<Point2f> newLoop(&arena);
+                        newLoop.reserve(loop.size()+1);
+                        newLoop.insert(newLoop.end(),loop.begin(),loop.end());
                         newLoop.push_back(loop[0]);
-                        builder.addLinear(newLoop, centerUp, true);
+                        builder.addLinear(newLoop.data(), (int)newLoop.size(), centerUp, true);
                     } else
-                        builder.addLinear(loop, centerUp, true);
+                        builder.addLinear(loop.data(), (int)loop.size(), centerUp, true);
                 }
             }
         }
@@ -18,6 +18,7 @@
  *
  */
 
+#import <stdio.h>
 #import <string.h>
 #import "glwrapper.h"
 
@@ -26,6 +27,7 @@
 bool hasVertexArraySupport = false;
 bool hasMapBufferSupport = false;
 bool hasInstanceSupport = false;
+bool hasMapBufferRangeSupport = false;
 
 // Note: Porting
 PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayEXT = NULL;
@@ -37,6 +39,18 @@ PFNGLUNMAPBUFFEROESPROC glUnmapBufferEXT = NULL;
 //PFNGLDRAWELEMENTSINSTANCEDEXTPROC glDrawElementsInstancedEXT = NULL;
 //PFNGLDRAWARRAYSINSTANCEDEXTPROC glDrawArraysInstancedEXT = NULL;
 
+// OpenGL ES 3 calls
+typedef void *(*MapBufferRangeProc) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLsync (*FenceSyncProc) (GLenum condition, GLbitfield flags);
+typedef GLenum (*ClientWaitSyncProc) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (*WaitSyncProc) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (*DeleteSyncProc) (GLsync sync);
+MapBufferRangeProc glMapBufferRangeES3 = NULL;
+FenceSyncProc glFenceSyncES3 = NULL;
+ClientWaitSyncProc glClientWaitSyncES3 = NULL;
+WaitSyncProc glWaitSyncES3 = NULL;
+DeleteSyncProc glDeleteSyncES3 = NULL;
+
 // Wire up the various function pointers for extensions
 bool SetupGLESExtensions()
 {
@@ -77,6 +91,22 @@ bool SetupGLESExtensions()
     // note: Porting.  Debugging VAO's
     hasVertexArraySupport = false;
     
+    // An OpenGL ES 3 context gives us mapped buffer ranges and fences
+    hasMapBufferRangeSupport = false;
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int majorVersion = 0;
+    if (version && sscanf(version,"OpenGL ES %d",&majorVersion) == 1 && majorVersion >= 3)
+    {
+        glMapBufferRangeES3 = (MapBufferRangeProc)eglGetProcAddress("glMapBufferRange");
+        glUnmapBufferEXT = (PFNGLUNMAPBUFFEROESPROC)eglGetProcAddress("glUnmapBuffer");
+        glFenceSyncES3 = (FenceSyncProc)eglGetProcAddress("glFenceSync");
+        glClientWaitSyncES3 = (ClientWaitSyncProc)eglGetProcAddress("glClientWaitSync");
+        glWaitSyncES3 = (WaitSyncProc)eglGetProcAddress("glWaitSync");
+        glDeleteSyncES3 = (DeleteSyncProc)eglGetProcAddress("glDeleteSync");
+        hasMapBufferRangeSupport = glMapBufferRangeES3 && glUnmapBufferEXT && glFenceSyncES3 &&
+                                   glClientWaitSyncES3 && glWaitSyncES3 && glDeleteSyncES3;
+    }
+    
     return true;
 }
 
@@ -155,12 +185,38 @@ void glDrawArraysInstanced(	GLenum mode,
 //    return (*glDrawArraysInstancedEXT)(mode,first,count,primcount);
 }
 
+void *glMapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    return (*glMapBufferRangeES3)(target,offset,length,access);
+}
+
+GLsync glFenceSync (GLenum condition, GLbitfield flags)
+{
+    return (*glFenceSyncES3)(condition,flags);
+}
+
+GLenum glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    return (*glClientWaitSyncES3)(sync,flags,timeout);
+}
+
+void glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    (*glWaitSyncES3)(sync,flags,timeout);
+}
+
+void glDeleteSync (GLsync sync)
+{
+    (*glDeleteSyncES3)(sync);
+}
+
 #else
 
 // On ios we have both
 // Note: Debugging
 bool hasVertexArraySupport = false;
 bool hasMapBufferSupport = false;
+bool hasMapBufferRangeSupport = false;
 
 #endif
 
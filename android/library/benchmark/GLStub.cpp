@@ -0,0 +1,712 @@
+/*
+ *  GLStub.cpp
+ *  WhirlyGlobeLib benchmark
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <string.h>
+#import <atomic>
+#import <map>
+#import <mutex>
+#import <regex>
+#import <string>
+#import <vector>
+#import "GLStub.h"
+
+namespace WhirlyKit
+{
+
+// Counters, in the same order as GLStubCounts
+typedef enum {
+    StubCalls,StubDraws,StubDrawVertices,StubStateChanges,StubBufferUploads,StubBufferBytes,StubBufferAllocs,StubBufferAllocBytes,
+    StubTextureUploads,StubTextureBytes,StubUniforms,StubObjectsCreated,StubObjectsDeleted,StubCountMax
+} StubCounter;
+
+static std::atomic<int64_t> stubCounts[StubCountMax];
+
+static inline void StubCount(StubCounter which,int64_t howMany = 1)
+{
+    stubCounts[which].fetch_add(howMany,std::memory_order_relaxed);
+}
+
+GLStubCounts::GLStubCounts()
+    : calls(0), draws(0), drawVertices(0), stateChanges(0), bufferUploads(0), bufferBytes(0), bufferAllocs(0), bufferAllocBytes(0),
+    textureUploads(0), textureBytes(0), uniforms(0), objectsCreated(0), objectsDeleted(0)
+{
+}
+
+GLStubCounts GLStubCounts::operator - (const GLStubCounts &that) const
+{
+    GLStubCounts ret;
+    ret.calls = calls - that.calls;
+    ret.draws = draws - that.draws;
+    ret.drawVertices = drawVertices - that.drawVertices;
+    ret.stateChanges = stateChanges - that.stateChanges;
+    ret.bufferUploads = bufferUploads - that.bufferUploads;
+    ret.bufferBytes = bufferBytes - that.bufferBytes;
+    ret.bufferAllocs = bufferAllocs - that.bufferAllocs;
+    ret.bufferAllocBytes = bufferAllocBytes - that.bufferAllocBytes;
+    ret.textureUploads = textureUploads - that.textureUploads;
+    ret.textureBytes = textureBytes - that.textureBytes;
+    ret.uniforms = uniforms - that.uniforms;
+    ret.objectsCreated = objectsCreated - that.objectsCreated;
+    ret.objectsDeleted = objectsDeleted - that.objectsDeleted;
+
+    return ret;
+}
+
+GLStubCounts GLStubGetCounts()
+{
+    GLStubCounts ret;
+    ret.calls = stubCounts[StubCalls];
+    ret.draws = stubCounts[StubDraws];
+    ret.drawVertices = stubCounts[StubDrawVertices];
+    ret.stateChanges = stubCounts[StubStateChanges];
+    ret.bufferUploads = stubCounts[StubBufferUploads];
+    ret.bufferBytes = stubCounts[StubBufferBytes];
+    ret.bufferAllocs = stubCounts[StubBufferAllocs];
+    ret.bufferAllocBytes = stubCounts[StubBufferAllocBytes];
+    ret.textureUploads = stubCounts[StubTextureUploads];
+    ret.textureBytes = stubCounts[StubTextureBytes];
+    ret.uniforms = stubCounts[StubUniforms];
+    ret.objectsCreated = stubCounts[StubObjectsCreated];
+    ret.objectsDeleted = stubCounts[StubObjectsDeleted];
+
+    return ret;
+}
+
+void GLStubResetCounts()
+{
+    for (unsigned int ii=0;ii<StubCountMax;ii++)
+        stubCounts[ii] = 0;
+}
+
+// One uniform or attribute, as a real driver would report it
+class StubVariable
+{
+public:
+    std::string name;
+    GLenum type;
+    GLint size;
+};
+
+// What we pulled out of a program's shaders
+class StubProgram
+{
+public:
+    std::vector<GLuint> shaders;
+    std::vector<StubVariable> uniforms;
+    std::vector<StubVariable> attributes;
+};
+
+// Names come out of one counter, whatever they're for.  Zero is never handed out.
+static std::atomic<GLuint> nextName(1);
+// Shader source and programs, by name
+static std::mutex programLock;
+static std::map<GLuint,std::string> shaderSources;
+static std::map<GLuint,StubProgram> programs;
+// A bit of state we're asked about
+static std::atomic<GLint> boundFramebuffer(0),boundRenderbuffer(0);
+static std::atomic<GLenum> lastError(GL_NO_ERROR);
+// Set to claim OpenGL ES 3 and hand out the mapping and fence calls
+static std::atomic<bool> es3Mode(false);
+// Bumped on every glClear, which is as close as we get to the GPU finishing a frame
+static std::atomic<int64_t> gpuFrame(0);
+// Fences and the frame they went in on.  They signal once the next frame starts.
+static std::mutex syncLock;
+static std::map<GLsync,int64_t> syncs;
+// Where a mapped range goes.  Layer threads map on their own contexts.
+static thread_local std::vector<unsigned char> mappedData;
+
+static GLenum StubTypeFromGLSL(const std::string &typeName)
+{
+    if (typeName == "float")  return GL_FLOAT;
+    if (typeName == "vec2")  return GL_FLOAT_VEC2;
+    if (typeName == "vec3")  return GL_FLOAT_VEC3;
+    if (typeName == "vec4")  return GL_FLOAT_VEC4;
+    if (typeName == "int")  return GL_INT;
+    if (typeName == "bool")  return GL_BOOL;
+    if (typeName == "mat2")  return GL_FLOAT_MAT2;
+    if (typeName == "mat3")  return GL_FLOAT_MAT3;
+    if (typeName == "mat4")  return GL_FLOAT_MAT4;
+    if (typeName == "sampler2D")  return GL_SAMPLER_2D;
+
+    return GL_FLOAT_VEC4;
+}
+
+static void StubAddVariable(std::vector<StubVariable> &vars,const std::string &name,GLenum type,GLint size)
+{
+    for (const StubVariable &var : vars)
+        if (var.name == name)
+            return;
+    StubVariable var;
+    var.name = name;
+    var.type = type;
+    var.size = size;
+    vars.push_back(var);
+}
+
+// Find the uniforms and attributes in the source, the way the compiler would report them.
+// Struct uniforms are expanded to their members, like the lights and material.
+static void StubParseShader(const std::string &source,StubProgram &prog)
+{
+    static const std::regex commentExp("//[^\n]*");
+    static const std::regex structExp("struct\\s+(\\w+)\\s*\\{([^}]*)\\}");
+    static const std::regex memberExp("(?:(?:lowp|mediump|highp)\\s+)?(\\w+)\\s+(\\w+)\\s*;");
+    static const std::regex declExp("\\b(uniform|attribute)\\s+(?:(?:lowp|mediump|highp)\\s+)?(\\w+)\\s+(\\w+)\\s*(?:\\[\\s*(\\d+)\\s*\\])?\\s*;");
+
+    std::string src = std::regex_replace(source,commentExp,"");
+
+    std::map<std::string,std::vector<std::pair<std::string,GLenum> > > structs;
+    for (std::sregex_iterator it(src.begin(),src.end(),structExp);it != std::sregex_iterator();++it)
+    {
+        std::vector<std::pair<std::string,GLenum> > &members = structs[(*it)[1].str()];
+        std::string body = (*it)[2].str();
+        for (std::sregex_iterator mt(body.begin(),body.end(),memberExp);mt != std::sregex_iterator();++mt)
+            members.push_back(std::make_pair((*mt)[2].str(),StubTypeFromGLSL((*mt)[1].str())));
+    }
+
+    for (std::sregex_iterator it(src.begin(),src.end(),declExp);it != std::sregex_iterator();++it)
+    {
+        bool isUniform = (*it)[1].str() == "uniform";
+        std::string typeName = (*it)[2].str();
+        std::string name = (*it)[3].str();
+        int arraySize = (*it)[4].matched ? atoi((*it)[4].str().c_str()) : 0;
+        std::vector<StubVariable> &vars = isUniform ? prog.uniforms : prog.attributes;
+
+        auto sit = structs.find(typeName);
+        if (sit != structs.end())
+        {
+            for (int ii=0;ii<std::max(arraySize,1);ii++)
+            {
+                std::string base = name;
+                if (arraySize > 0)
+                    base += "[" + std::to_string(ii) + "]";
+                for (const auto &member : sit->second)
+                    StubAddVariable(vars,base + "." + member.first,member.second,1);
+            }
+        } else
+            StubAddVariable(vars,arraySize > 0 ? name + "[0]" : name,StubTypeFromGLSL(typeName),std::max(arraySize,1));
+    }
+}
+
+// Bytes per pixel for the uncompressed formats the toolkit uses
+static int StubPixelSize(GLenum format,GLenum type)
+{
+    switch (type)
+    {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2;
+        default:
+            break;
+    }
+    switch (format)
+    {
+        case GL_ALPHA:
+        case GL_LUMINANCE:
+            return 1;
+        case GL_LUMINANCE_ALPHA:
+            return 2;
+        case GL_RGB:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+static void StubGenNames(GLsizei n,GLuint *names)
+{
+    StubCount(StubCalls);
+    for (GLsizei ii=0;ii<n;ii++)
+        names[ii] = nextName++;
+    StubCount(StubObjectsCreated,n);
+}
+
+static void StubDeleteNames(GLsizei n)
+{
+    StubCount(StubCalls);
+    StubCount(StubObjectsDeleted,n);
+}
+
+static void StubStateChange()
+{
+    StubCount(StubCalls);
+    StubCount(StubStateChanges);
+}
+
+static void StubUniform()
+{
+    StubCount(StubCalls);
+    StubCount(StubUniforms);
+}
+
+void GLStubSetES3(bool newVal)
+{
+    es3Mode = newVal;
+}
+
+// The OpenGL ES 3 calls, which the toolkit only gets through eglGetProcAddress
+static void *StubMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    StubCount(StubCalls);
+    mappedData.resize(length);
+    return mappedData.data();
+}
+
+static GLboolean StubUnmapBuffer(GLenum target)
+{
+    StubCount(StubCalls);
+    StubCount(StubBufferUploads);
+    StubCount(StubBufferBytes,mappedData.size());
+    mappedData.clear();
+    return GL_TRUE;
+}
+
+static GLsync StubFenceSync(GLenum condition, GLbitfield flags)
+{
+    StubCount(StubCalls);
+    StubCount(StubObjectsCreated);
+    GLsync sync = (GLsync)(uintptr_t)nextName++;
+    std::lock_guard<std::mutex> lock(syncLock);
+    syncs[sync] = gpuFrame;
+    return sync;
+}
+
+static GLenum StubClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(syncLock);
+    auto it = syncs.find(sync);
+    if (it == syncs.end())
+        return GL_WAIT_FAILED;
+    return it->second < gpuFrame ? GL_ALREADY_SIGNALED : GL_TIMEOUT_EXPIRED;
+}
+
+static void StubWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    StubCount(StubCalls);
+}
+
+static void StubDeleteSync(GLsync sync)
+{
+    StubCount(StubCalls);
+    StubCount(StubObjectsDeleted);
+    std::lock_guard<std::mutex> lock(syncLock);
+    syncs.erase(sync);
+}
+
+}
+
+using namespace WhirlyKit;
+
+// The OpenGL ES 2 entry points the toolkit uses.
+// The extension wrappers in glwrapper.cpp are linked in as they are.
+extern "C"
+{
+
+void glActiveTexture(GLenum texture) { StubStateChange(); }
+void glBindBuffer(GLenum target, GLuint buffer) { StubStateChange(); }
+void glBindTexture(GLenum target, GLuint texture) { StubStateChange(); }
+void glBlendFunc(GLenum sfactor, GLenum dfactor) { StubStateChange(); }
+void glDepthFunc(GLenum func) { StubStateChange(); }
+void glDepthMask(GLboolean flag) { StubStateChange(); }
+void glDisable(GLenum cap) { StubStateChange(); }
+void glEnable(GLenum cap) { StubStateChange(); }
+void glLineWidth(GLfloat width) { StubStateChange(); }
+void glUseProgram(GLuint program) { StubStateChange(); }
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { StubStateChange(); }
+void glEnableVertexAttribArray(GLuint index) { StubStateChange(); }
+void glDisableVertexAttribArray(GLuint index) { StubStateChange(); }
+void glVertexAttribPointer(GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *ptr) { StubStateChange(); }
+void glVertexAttrib1f(GLuint indx, GLfloat x) { StubStateChange(); }
+void glVertexAttrib2f(GLuint indx, GLfloat x, GLfloat y) { StubStateChange(); }
+void glVertexAttrib3f(GLuint indx, GLfloat x, GLfloat y, GLfloat z) { StubStateChange(); }
+void glVertexAttrib4f(GLuint indx, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { StubStateChange(); }
+void glTexParameteri(GLenum target, GLenum pname, GLint param) { StubStateChange(); }
+
+void glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    StubStateChange();
+    boundFramebuffer = framebuffer;
+}
+
+void glBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+    StubStateChange();
+    boundRenderbuffer = renderbuffer;
+}
+
+void glClear(GLbitfield mask)
+{
+    StubCount(StubCalls);
+    gpuFrame++;
+}
+
+void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { StubCount(StubCalls); }
+void glFinish(void) { StubCount(StubCalls); }
+void glFlush(void) { StubCount(StubCalls); }
+void glGenerateMipmap(GLenum target) { StubCount(StubCalls); }
+void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) { StubCount(StubCalls); }
+void glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) { StubCount(StubCalls); }
+void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) { StubCount(StubCalls); }
+void glDiscardFramebufferEXT(GLenum target, GLsizei numAttachments, const GLenum *attachments) { StubCount(StubCalls); }
+
+GLenum glCheckFramebufferStatus(GLenum target)
+{
+    StubCount(StubCalls);
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+GLenum glGetError(void)
+{
+    StubCount(StubCalls);
+    return lastError.exchange(GL_NO_ERROR);
+}
+
+const GLubyte *glGetString(GLenum name)
+{
+    StubCount(StubCalls);
+    switch (name)
+    {
+        case GL_VENDOR:
+            return (const GLubyte *)"WhirlyGlobe benchmark";
+        case GL_RENDERER:
+            return (const GLubyte *)"Recording stub";
+        case GL_VERSION:
+            return (const GLubyte *)(es3Mode ? "OpenGL ES 3.0 stub" : "OpenGL ES 2.0 stub");
+        case GL_SHADING_LANGUAGE_VERSION:
+            return (const GLubyte *)"OpenGL ES GLSL ES 1.00";
+        case GL_EXTENSIONS:
+        default:
+            return (const GLubyte *)"";
+    }
+}
+
+void glGetIntegerv(GLenum pname, GLint *params)
+{
+    StubCount(StubCalls);
+    switch (pname)
+    {
+        case GL_FRAMEBUFFER_BINDING:
+            *params = boundFramebuffer;
+            break;
+        case GL_RENDERBUFFER_BINDING:
+            *params = boundRenderbuffer;
+            break;
+        case GL_MAX_TEXTURE_SIZE:
+            *params = 4096;
+            break;
+        case GL_MAX_VERTEX_ATTRIBS:
+            *params = 16;
+            break;
+        case GL_MAX_TEXTURE_IMAGE_UNITS:
+        case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+            *params = 8;
+            break;
+        default:
+            *params = 0;
+            break;
+    }
+}
+
+void glGenBuffers(GLsizei n, GLuint *buffers) { StubGenNames(n,buffers); }
+void glGenTextures(GLsizei n, GLuint *textures) { StubGenNames(n,textures); }
+void glGenFramebuffers(GLsizei n, GLuint *framebuffers) { StubGenNames(n,framebuffers); }
+void glGenRenderbuffers(GLsizei n, GLuint *renderbuffers) { StubGenNames(n,renderbuffers); }
+void glDeleteBuffers(GLsizei n, const GLuint *buffers) { StubDeleteNames(n); }
+void glDeleteTextures(GLsizei n, const GLuint *textures) { StubDeleteNames(n); }
+void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) { StubDeleteNames(n); }
+void glDeleteRenderbuffers(GLsizei n, const GLuint *renderbuffers) { StubDeleteNames(n); }
+
+void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    StubCount(StubCalls);
+    StubCount(StubBufferAllocs);
+    StubCount(StubBufferAllocBytes,size);
+    if (data)
+    {
+        StubCount(StubBufferUploads);
+        StubCount(StubBufferBytes,size);
+    }
+}
+
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+    StubCount(StubCalls);
+    StubCount(StubBufferUploads);
+    StubCount(StubBufferBytes,size);
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+    StubCount(StubCalls);
+    StubCount(StubTextureUploads);
+    if (pixels)
+        StubCount(StubTextureBytes,(int64_t)width * height * StubPixelSize(format,type));
+}
+
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels)
+{
+    StubCount(StubCalls);
+    StubCount(StubTextureUploads);
+    StubCount(StubTextureBytes,(int64_t)width * height * StubPixelSize(format,type));
+}
+
+void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data)
+{
+    StubCount(StubCalls);
+    StubCount(StubTextureUploads);
+    StubCount(StubTextureBytes,imageSize);
+}
+
+void glCompressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const void *data)
+{
+    StubCount(StubCalls);
+    StubCount(StubTextureUploads);
+    StubCount(StubTextureBytes,imageSize);
+}
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    StubCount(StubCalls);
+    StubCount(StubDraws);
+    StubCount(StubDrawVertices,count);
+}
+
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+    StubCount(StubCalls);
+    StubCount(StubDraws);
+    StubCount(StubDrawVertices,count);
+}
+
+void glUniform1f(GLint location, GLfloat x) { StubUniform(); }
+void glUniform1i(GLint location, GLint x) { StubUniform(); }
+void glUniform2f(GLint location, GLfloat x, GLfloat y) { StubUniform(); }
+void glUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z) { StubUniform(); }
+void glUniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { StubUniform(); }
+void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { StubUniform(); }
+
+GLuint glCreateShader(GLenum type)
+{
+    StubCount(StubCalls);
+    StubCount(StubObjectsCreated);
+    return nextName++;
+}
+
+void glShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length)
+{
+    StubCount(StubCalls);
+    std::string source;
+    for (GLsizei ii=0;ii<count;ii++)
+    {
+        if (length && length[ii] >= 0)
+            source.append(string[ii],length[ii]);
+        else
+            source.append(string[ii]);
+    }
+
+    std::lock_guard<std::mutex> lock(programLock);
+    shaderSources[shader] = source;
+}
+
+void glCompileShader(GLuint shader) { StubCount(StubCalls); }
+
+void glGetShaderiv(GLuint shader, GLenum pname, GLint *params)
+{
+    StubCount(StubCalls);
+    switch (pname)
+    {
+        case GL_COMPILE_STATUS:
+            *params = GL_TRUE;
+            break;
+        default:
+            *params = 0;
+            break;
+    }
+}
+
+void glGetShaderInfoLog(GLuint shader, GLsizei bufsize, GLsizei *length, GLchar *infolog)
+{
+    StubCount(StubCalls);
+    if (length)
+        *length = 0;
+    if (bufsize > 0)
+        infolog[0] = 0;
+}
+
+void glDeleteShader(GLuint shader)
+{
+    StubDeleteNames(1);
+    std::lock_guard<std::mutex> lock(programLock);
+    shaderSources.erase(shader);
+}
+
+GLuint glCreateProgram(void)
+{
+    StubCount(StubCalls);
+    StubCount(StubObjectsCreated);
+    GLuint prog = nextName++;
+
+    std::lock_guard<std::mutex> lock(programLock);
+    programs[prog] = StubProgram();
+
+    return prog;
+}
+
+void glAttachShader(GLuint program, GLuint shader)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    programs[program].shaders.push_back(shader);
+}
+
+void glLinkProgram(GLuint program)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    StubProgram &prog = programs[program];
+    prog.uniforms.clear();
+    prog.attributes.clear();
+    for (GLuint shader : prog.shaders)
+        StubParseShader(shaderSources[shader],prog);
+}
+
+void glDeleteProgram(GLuint program)
+{
+    StubDeleteNames(1);
+    std::lock_guard<std::mutex> lock(programLock);
+    programs.erase(program);
+}
+
+void glGetProgramiv(GLuint program, GLenum pname, GLint *params)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    const StubProgram &prog = programs[program];
+    switch (pname)
+    {
+        case GL_LINK_STATUS:
+        case GL_VALIDATE_STATUS:
+            *params = GL_TRUE;
+            break;
+        case GL_ACTIVE_UNIFORMS:
+            *params = (GLint)prog.uniforms.size();
+            break;
+        case GL_ACTIVE_ATTRIBUTES:
+            *params = (GLint)prog.attributes.size();
+            break;
+        default:
+            *params = 0;
+            break;
+    }
+}
+
+void glGetProgramInfoLog(GLuint program, GLsizei bufsize, GLsizei *length, GLchar *infolog)
+{
+    StubCount(StubCalls);
+    if (length)
+        *length = 0;
+    if (bufsize > 0)
+        infolog[0] = 0;
+}
+
+// Hand back one of the variables we found while linking
+static void StubGetActive(const std::vector<StubVariable> &vars,GLuint index,GLsizei bufsize,GLsizei *length,GLint *size,GLenum *type,GLchar *name)
+{
+    if (index >= vars.size())
+    {
+        lastError = GL_INVALID_VALUE;
+        return;
+    }
+    const StubVariable &var = vars[index];
+    if (size)
+        *size = var.size;
+    if (type)
+        *type = var.type;
+    if (bufsize > 0)
+    {
+        strncpy(name,var.name.c_str(),bufsize-1);
+        name[bufsize-1] = 0;
+        if (length)
+            *length = (GLsizei)strlen(name);
+    }
+}
+
+void glGetActiveUniform(GLuint program, GLuint index, GLsizei bufsize, GLsizei *length, GLint *size, GLenum *type, GLchar *name)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    StubGetActive(programs[program].uniforms,index,bufsize,length,size,type,name);
+}
+
+void glGetActiveAttrib(GLuint program, GLuint index, GLsizei bufsize, GLsizei *length, GLint *size, GLenum *type, GLchar *name)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    StubGetActive(programs[program].attributes,index,bufsize,length,size,type,name);
+}
+
+// Locations are just where the variable is in the list
+static GLint StubGetLocation(const std::vector<StubVariable> &vars,const GLchar *name)
+{
+    for (unsigned int ii=0;ii<vars.size();ii++)
+        if (vars[ii].name == name)
+            return ii;
+
+    return -1;
+}
+
+GLint glGetUniformLocation(GLuint program, const GLchar *name)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    return StubGetLocation(programs[program].uniforms,name);
+}
+
+GLint glGetAttribLocation(GLuint program, const GLchar *name)
+{
+    StubCount(StubCalls);
+    std::lock_guard<std::mutex> lock(programLock);
+    return StubGetLocation(programs[program].attributes,name);
+}
+
+// Only the OpenGL ES 3 calls are looked up, and only if we're claiming to be ES 3
+__eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
+{
+    if (!es3Mode)
+        return NULL;
+
+    if (!strcmp(procname,"glMapBufferRange"))
+        return (__eglMustCastToProperFunctionPointerType)&StubMapBufferRange;
+    if (!strcmp(procname,"glUnmapBuffer"))
+        return (__eglMustCastToProperFunctionPointerType)&StubUnmapBuffer;
+    if (!strcmp(procname,"glFenceSync"))
+        return (__eglMustCastToProperFunctionPointerType)&StubFenceSync;
+    if (!strcmp(procname,"glClientWaitSync"))
+        return (__eglMustCastToProperFunctionPointerType)&StubClientWaitSync;
+    if (!strcmp(procname,"glWaitSync"))
+        return (__eglMustCastToProperFunctionPointerType)&StubWaitSync;
+    if (!strcmp(procname,"glDeleteSync"))
+        return (__eglMustCastToProperFunctionPointerType)&StubDeleteSync;
+
+    return NULL;
+}
+
+}
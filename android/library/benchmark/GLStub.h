@@ -0,0 +1,77 @@
+/*
+ *  GLStub.h
+ *  WhirlyGlobeLib benchmark
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <stdint.h>
+#import "glwrapper.h"
+
+namespace WhirlyKit
+{
+
+/** What the stub OpenGL ES has been asked to do.
+    The stub doesn't draw anything.  It hands out names, answers the queries
+    the toolkit makes, fakes shader compilation well enough that programs find
+    their uniforms and attributes, and counts everything.
+  */
+class GLStubCounts
+{
+public:
+    GLStubCounts();
+
+    /// Every gl call
+    int64_t calls;
+    /// glDrawArrays and glDrawElements
+    int64_t draws;
+    /// Vertices or indices handed to the draw calls
+    int64_t drawVertices;
+    /// Calls that change the pipeline: programs, textures, buffers, enables, blending and depth
+    int64_t stateChanges;
+    /// glBufferData and glBufferSubData with data
+    int64_t bufferUploads;
+    int64_t bufferBytes;
+    /// glBufferData calls, which (re)allocate a buffer's storage
+    int64_t bufferAllocs;
+    int64_t bufferAllocBytes;
+    /// glTexImage2D and glTexSubImage2D and their compressed versions
+    int64_t textureUploads;
+    int64_t textureBytes;
+    /// glUniform*
+    int64_t uniforms;
+    /// Buffers, textures, framebuffers and such created and deleted
+    int64_t objectsCreated;
+    int64_t objectsDeleted;
+
+    /// Difference between two snapshots
+    GLStubCounts operator - (const GLStubCounts &that) const;
+};
+
+/// Snapshot of the counts so far
+extern GLStubCounts GLStubGetCounts();
+
+/// Start counting from zero
+extern void GLStubResetCounts();
+
+/** Claim to be OpenGL ES 3 rather than 2.
+    eglGetProcAddress then hands out glMapBufferRange, glUnmapBuffer and the
+    fence calls.  A fence signals once the next frame starts clearing.
+    Set this before SetupGLESExtensions().
+  */
+extern void GLStubSetES3(bool newVal);
+
+}
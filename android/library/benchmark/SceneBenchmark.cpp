@@ -0,0 +1,1760 @@
+/*
+ *  SceneBenchmark.cpp
+ *  WhirlyGlobeLib benchmark
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <pthread.h>
+#import <sched.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <algorithm>
+#import <atomic>
+#import <deque>
+#import <map>
+#import <new>
+#import <string>
+#import <vector>
+#import "WhirlyGlobe.h"
+#import "CoordSystemConverter.h"
+#import "GLStub.h"
+
+using namespace Eigen;
+using namespace WhirlyKit;
+
+// Count every allocation that goes through operator new.
+// Eigen's aligned allocations and plain mallocs don't show up here.
+static std::atomic<int64_t> numAllocs(0),allocBytes(0);
+
+void *operator new(size_t size)
+{
+    numAllocs.fetch_add(1,std::memory_order_relaxed);
+    allocBytes.fetch_add(size,std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// Kept out of line.  Otherwise gcc sees the free() on a pointer from operator new and complains.
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+namespace WhirlyKit
+{
+
+// Same numbers on every machine and every run, unlike rand()
+class BenchRandom
+{
+public:
+    BenchRandom(uint32_t seed) : state(seed) { }
+
+    // [0,1)
+    double next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / (double)(1 << 24);
+    }
+
+    double range(double minVal,double maxVal) { return minVal + (maxVal-minVal)*next(); }
+
+protected:
+    uint32_t state;
+};
+
+// How big the synthetic data set is
+class BenchOptions
+{
+public:
+    BenchOptions()
+    : width(1280), height(720), frames(300), numAreals(500), numLinears(500), numLabels(2000),
+    numMarkers(0), tileGrid(8), tileTexSize(256), maxTiles(128), maxZoom(16), incrementalLayout(false), parallelLayout(false),
+    hierarchicalClustering(false), numSelectables(0), numPicks(200), glVersion(2), numAtlasDrawables(0)
+    {
+    }
+
+    int width,height;
+    int frames;
+    int numAreals,numLinears,numLabels;
+    // Markers that go into a cluster group
+    int numMarkers;
+    // Cells on a side for each tile's grid and texture size on a side
+    int tileGrid,tileTexSize;
+    int maxTiles,maxZoom;
+    // Run the layout manager in its incremental or parallel mode
+    bool incrementalLayout;
+    bool parallelLayout;
+    // Cluster markers from a precomputed hierarchy rather than on screen
+    bool hierarchicalClustering;
+    // Selectables handed to the selection manager and picks to time at the end
+    int numSelectables,numPicks;
+    // OpenGL ES version the stub claims.  With 3 the drawable atlas streams.
+    int glVersion;
+    // Drawables kept in a dynamic drawable atlas, a tenth of which are replaced every frame
+    int numAtlasDrawables;
+    std::string only;
+    std::string traceDir;
+    std::string outFile;
+};
+
+// Renderer hooked up to the stub GL, the same way MaplySceneRenderer is on a device
+class BenchRenderer : public SceneRendererES2
+{
+public:
+    BenchRenderer()
+    {
+        extraFrameMode = true;
+    }
+
+    void resize(int width,int height)
+    {
+        if (renderTargets.empty())
+        {
+            RenderTarget defaultTarget(EmptyIdentity);
+            defaultTarget.initFromState(width,height);
+            renderTargets.push_back(defaultTarget);
+        } else {
+            RenderTarget &defaultTarget = renderTargets.back();
+            defaultTarget.initFromState(width,height);
+        }
+
+        framebufferWidth = width;
+        framebufferHeight = height;
+        lastDraw = 0;
+        forceRenderSetup();
+    }
+};
+
+/** Synthetic image tiles for the quad display controller.
+    Each tile is a textured grid.  Loads finish the step after they're
+    requested, the way they would coming back from a fetch thread.
+  */
+class BenchTileSource : public QuadDataStructure, public QuadLoader, public QuadDisplayControllerAdapter
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    BenchTileSource(CoordSystemDisplayAdapter *coordAdapter,const BenchOptions &options)
+    : tilesLoaded(0), tilesUnloaded(0), coordAdapter(coordAdapter), options(options)
+    {
+    }
+
+    // QuadDataStructure
+    virtual CoordSystem *getCoordSystem() { return coordAdapter->getCoordSystem(); }
+    virtual Mbr getTotalExtents()
+    {
+        Point3f ll,ur;
+        coordAdapter->getBounds(ll,ur);
+        return Mbr(Point2f(ll.x(),ll.y()),Point2f(ur.x(),ur.y()));
+    }
+    virtual Mbr getValidExtents() { return getTotalExtents(); }
+    virtual int getMinZoom() { return 0; }
+    virtual int getMaxZoom() { return options.maxZoom; }
+    virtual double importanceForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs)
+    {
+        if (ident.level == 0)
+            return MAXFLOAT;
+        return ScreenImportance(viewState, frameSize, viewState->eyeVec, options.tileTexSize, getCoordSystem(), coordAdapter, mbr, ident, attrs);
+    }
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,ViewState *viewState,const Point2f &frameSize,Dictionary *attrs,double &minImport,double &maxImport)
+    {
+        if (ident.level == 0)
+        {
+            minImport = maxImport = MAXFLOAT;
+            return true;
+        }
+        return ScreenImportanceBounds(viewState, frameSize, options.tileTexSize, attrs, minImport, maxImport);
+    }
+    virtual void tilesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,ViewState *viewState,const Point2f &frameSize,std::vector<bool> &offScreen)
+    {
+        TilesOffScreen(viewState, nodes, 1, offScreen);
+    }
+    virtual void newViewState(ViewState *viewState) { }
+    virtual void shutdown() { }
+
+    // QuadLoader
+    virtual bool isReady() { return true; }
+    virtual void startUpdates(ChangeSet &changes) { }
+    virtual void endUpdates(ChangeSet &changes) { }
+    virtual void loadTile(const Quadtree::NodeInfo &tileInfo,int frame)
+    {
+        pending.push_back(tileInfo);
+    }
+    virtual void unloadTile(const Quadtree::NodeInfo &tileInfo)
+    {
+        for (unsigned int ii=0;ii<pending.size();ii++)
+            if (pending[ii].ident == tileInfo.ident)
+            {
+                pending.erase(pending.begin()+ii);
+                return;
+            }
+        auto it = tiles.find(tileInfo.ident);
+        if (it == tiles.end())
+            return;
+        unloads.push_back(new RemDrawableReq(it->second.first));
+        unloads.push_back(new RemTextureReq(it->second.second));
+        tiles.erase(it);
+        tilesUnloaded++;
+    }
+    virtual bool canLoadChildrenOfTile(const Quadtree::NodeInfo &tileInfo) { return true; }
+    virtual void shutdownLayer(ChangeSet &changes) { }
+    virtual int numFrames() { return 1; }
+    virtual int currentFrame() { return 0; }
+    virtual bool canLoadFrames() { return false; }
+    virtual bool shouldUpdate(ViewState *viewState,bool isInitial) { return true; }
+    virtual void reset(ChangeSet &changes) { }
+
+    // QuadDisplayControllerAdapter
+    virtual void adapterTileDidLoad(const Quadtree::Identifier &tileIdent) { }
+    virtual void adapterTileDidNotLoad(const Quadtree::Identifier &tileIdent) { }
+    virtual void adapterWakeUp() { }
+
+    /// Build the tiles asked for last step and hand back everything for the scene
+    void finishLoads(ChangeSet &changes)
+    {
+        changes.insert(changes.end(),unloads.begin(),unloads.end());
+        unloads.clear();
+
+        std::vector<Quadtree::NodeInfo> toLoad;
+        toLoad.swap(pending);
+        for (const Quadtree::NodeInfo &tileInfo : toLoad)
+        {
+            Texture *tex = new Texture("Benchmark Tile");
+            int texSize = options.tileTexSize;
+            MutableRawData *texData = new MutableRawData(texSize*texSize*4);
+            tex->setRawData(texData,texSize,texSize);
+            changes.push_back(new AddTextureReq(tex));
+
+            BasicDrawable *draw = buildTileDrawable(tileInfo.mbr);
+            draw->setTexId(0,tex->getId());
+            changes.push_back(new AddDrawableReq(draw));
+
+            tiles[tileInfo.ident] = std::make_pair(draw->getId(),tex->getId());
+            control->tileDidLoad(tileInfo.ident,-1);
+            tilesLoaded++;
+        }
+    }
+
+    int tilesLoaded,tilesUnloaded;
+
+protected:
+    BasicDrawable *buildTileDrawable(const Mbr &mbr)
+    {
+        int grid = options.tileGrid;
+        BasicDrawable *draw = new BasicDrawable("Benchmark Tile",(grid+1)*(grid+1),2*grid*grid);
+        draw->setType(GL_TRIANGLES);
+        draw->setLocalMbr(mbr);
+        Point2f span = mbr.ur() - mbr.ll();
+        for (int iy=0;iy<=grid;iy++)
+            for (int ix=0;ix<=grid;ix++)
+            {
+                Point3d localPt(mbr.ll().x() + span.x()*ix/grid,mbr.ll().y() + span.y()*iy/grid,0.0);
+                draw->addPoint(coordAdapter->localToDisplay(localPt));
+                draw->addTexCoord(0,TexCoord(ix/(float)grid,iy/(float)grid));
+            }
+        for (int iy=0;iy<grid;iy++)
+            for (int ix=0;ix<grid;ix++)
+            {
+                int v0 = iy*(grid+1)+ix;
+                draw->addTriangle(BasicDrawable::Triangle(v0,v0+1,v0+grid+2));
+                draw->addTriangle(BasicDrawable::Triangle(v0,v0+grid+2,v0+grid+1));
+            }
+
+        return draw;
+    }
+
+    CoordSystemDisplayAdapter *coordAdapter;
+    BenchOptions options;
+    std::vector<Quadtree::NodeInfo> pending;
+    ChangeSet unloads;
+    std::map<Quadtree::Identifier,std::pair<SimpleIdentity,SimpleIdentity> > tiles;
+};
+
+/// Where the camera is on a given frame
+class CameraPos
+{
+public:
+    CameraPos(double x,double y,double height,double rot) : x(x), y(y), height(height), rot(rot) { }
+    double x,y,height,rot;
+};
+
+/// A scripted camera path.  Positions are in display coordinates.
+class Scenario
+{
+public:
+    const char *name;
+    const char *desc;
+    CameraPos (*path)(int frame,int numFrames);
+};
+
+// Slow pan across the middle of the map, like dragging
+static CameraPos PanPath(int frame,int numFrames)
+{
+    double t = frame / (double)numFrames;
+    return CameraPos(-1.0 + 2.0*t,0.3*sin(t*2*M_PI),0.5,0.0);
+}
+
+// Zoom from the whole world down to street level and back
+static CameraPos ZoomPath(int frame,int numFrames)
+{
+    double t = frame / (double)numFrames;
+    double s = t < 0.5 ? 2*t : 2*(1-t);
+    double height = 3.0 * pow(0.0005/3.0,s);
+    return CameraPos(0.2,0.4,height,0.0);
+}
+
+// Spin in place
+static CameraPos RotatePath(int frame,int numFrames)
+{
+    double t = frame / (double)numFrames;
+    return CameraPos(0.5,-0.2,0.2,2*M_PI*t);
+}
+
+// Jump somewhere new every 10 frames, which defeats anything frame to frame coherent
+static CameraPos JumpPath(int frame,int numFrames)
+{
+    BenchRandom rand(1234 + frame/10);
+    return CameraPos(rand.range(-2.5,2.5),rand.range(-1.5,1.5),rand.range(0.05,1.0),0.0);
+}
+
+static const Scenario Scenarios[] = {
+    {"pan","Pan across the map at a fixed height",PanPath},
+    {"zoom","Zoom from the whole world down to street level and back",ZoomPath},
+    {"rotate","Rotate in place",RotatePath},
+    {"jump","Jump to a new location every 10 frames",JumpPath},
+};
+
+/// One scenario's results
+class ScenarioResult
+{
+public:
+    std::string name;
+    int frames;
+    TimeInterval setupTime,runTime;
+    int64_t setupAllocs,setupAllocBytes;
+    int64_t runAllocs,runAllocBytes;
+    GLStubCounts setupGL,runGL;
+    FrameProfilerSummary profile;
+    OpenGLMemStats bufferStats;
+    int tilesLoaded,tilesUnloaded;
+    // Layout objects showing after the last frame
+    int labelsShown;
+    // Picks timed after the last frame and what they found
+    int numPicks;
+    TimeInterval pickTime;
+    int64_t pickHits;
+    // Drawable atlas flushes and the frames it had changes but had to wait
+    bool atlasStreaming;
+    int atlasSwaps,atlasStalls;
+};
+
+// Makes a plain square for each cluster, like the marker generator does on a device
+class BenchClusterGenerator : public ClusterGenerator
+{
+public:
+    BenchClusterGenerator(Scene *scene)
+    {
+        screenProgID = scene->getProgramIDByName(kToolkitDefaultScreenSpaceProgram);
+        motionProgID = scene->getProgramIDByName(kToolkitDefaultScreenSpaceMotionProgram);
+    }
+
+    virtual void startLayoutObjects() { }
+
+    virtual void makeLayoutObject(int clusterID,const std::vector<LayoutObjectEntry *> &layoutObjects,LayoutObject &newObj)
+    {
+        double size2 = ClusterSize / 2.0;
+        ScreenSpaceObject::ConvexGeometry geom;
+        geom.progID = screenProgID;
+        geom.coords.push_back(Point2d(-size2,-size2));  geom.texCoords.push_back(TexCoord(0,1));
+        geom.coords.push_back(Point2d(size2,-size2));  geom.texCoords.push_back(TexCoord(1,1));
+        geom.coords.push_back(Point2d(size2,size2));  geom.texCoords.push_back(TexCoord(1,0));
+        geom.coords.push_back(Point2d(-size2,size2));  geom.texCoords.push_back(TexCoord(0,0));
+        newObj.addGeometry(geom);
+        newObj.layoutPts = geom.coords;
+        newObj.selectPts = geom.coords;
+        newObj.importance = MAXFLOAT;
+    }
+
+    virtual void endLayoutObjects() { }
+
+    virtual void paramsForClusterClass(int clusterID,ClusterClassParams &clusterParams)
+    {
+        clusterParams.motionShaderID = motionProgID;
+        clusterParams.selectable = true;
+        clusterParams.markerAnimationTime = 0.2;
+        clusterParams.clusterSize = Point2d(ClusterSize,ClusterSize);
+    }
+
+    static constexpr double ClusterSize = 32.0;
+    SimpleIdentity screenProgID,motionProgID;
+};
+
+/// Scene, renderer and data for one scenario, built from scratch each time
+class BenchWorld
+{
+public:
+    BenchWorld(const BenchOptions &options)
+    : options(options), tiles(NULL), control(NULL), clusterGen(NULL), atlas(NULL), atlasRand(99), atlasSwaps(0), atlasStalls(0)
+    {
+        coordAdapter = new SphericalMercatorDisplayAdapter(0.0, GeoCoord::CoordFromDegrees(-180,-90), GeoCoord::CoordFromDegrees(180,90));
+        scene = new Maply::MapScene(coordAdapter);
+        mapView = new Maply::MapView(coordAdapter);
+        renderer = new BenchRenderer();
+        renderer->setZBufferMode(zBufferOffDefault);
+        renderer->setClearColor(RGBAColor(255,255,255,255));
+        GLStubSetES3(options.glVersion >= 3);
+        SetupGLESExtensions();
+        renderer->setScene(scene);
+        SimpleIdentity triLighting = scene->getProgramIDByName(kToolkitDefaultTriangleProgram);
+        if (triLighting != EmptyIdentity)
+            scene->setSceneProgram(kSceneDefaultTriShader, triLighting);
+        renderer->setView(mapView);
+        renderer->resize(options.width,options.height);
+        scene->getProfiler()->setEnable(true);
+        LayoutManager *layoutManager = (LayoutManager *)scene->getManager(kWKLayoutManager);
+        layoutManager->setIncrementalLayout(options.incrementalLayout,8.0);
+        layoutManager->setParallelLayout(options.parallelLayout);
+        layoutManager->setHierarchicalClustering(options.hierarchicalClustering);
+        clusterGen = new BenchClusterGenerator(scene);
+        layoutManager->addClusterGenerator(clusterGen);
+    }
+
+    ~BenchWorld()
+    {
+        if (atlas)
+        {
+            ChangeSet changes;
+            atlas->teardown(changes);
+            for (ChangeRequest *change : changes)
+                delete change;
+            delete atlas;
+        }
+        if (control)
+        {
+            ChangeSet changes;
+            control->shutdown(changes);
+            for (ChangeRequest *change : changes)
+                delete change;
+            delete control;
+        }
+        delete tiles;
+        delete renderer;
+        delete mapView;
+        delete scene;
+        delete clusterGen;
+        delete coordAdapter;
+    }
+
+    /// Add the vectors, labels and paged tiles
+    void addData()
+    {
+        BenchRandom rand(42);
+        ChangeSet changes;
+
+        VectorManager *vecManager = (VectorManager *)scene->getManager(kWKVectorManager);
+        ShapeSet areals,linears;
+        for (int ii=0;ii<options.numAreals;ii++)
+        {
+            VectorArealRef areal = VectorAreal::createAreal();
+            VectorRing ring;
+            GeoCoord center(rand.range(-M_PI,M_PI),rand.range(-1.2,1.2));
+            double radius = rand.range(0.002,0.05);
+            int numPts = 6 + (int)(rand.next()*24);
+            for (int jj=0;jj<numPts;jj++)
+            {
+                double ang = 2*M_PI*jj/numPts;
+                double r = radius * rand.range(0.6,1.0);
+                ring.push_back(Point2f(center.x()+r*cos(ang),center.y()+r*sin(ang)));
+            }
+            areal->loops.push_back(ring);
+            areal->initGeoMbr();
+            areals.insert(areal);
+        }
+        for (int ii=0;ii<options.numLinears;ii++)
+        {
+            VectorLinearRef linear = VectorLinear::createLinear();
+            Point2f pt(rand.range(-M_PI,M_PI),rand.range(-1.2,1.2));
+            int numPts = 20 + (int)(rand.next()*30);
+            for (int jj=0;jj<numPts;jj++)
+            {
+                linear->pts.push_back(pt);
+                pt += Point2f(rand.range(-0.01,0.01),rand.range(-0.01,0.01));
+            }
+            linear->initGeoMbr();
+            linears.insert(linear);
+        }
+        VectorInfo arealInfo;
+        arealInfo.filled = true;
+        arealInfo.color = RGBAColor(64,128,192,255);
+        vecManager->addVectors(&areals,arealInfo,changes);
+        VectorInfo linearInfo;
+        linearInfo.color = RGBAColor(192,64,64,255);
+        linearInfo.lineWidth = 2.0;
+        vecManager->addVectors(&linears,linearInfo,changes);
+
+        // Screen space markers for the layout engine
+        LayoutManager *layoutManager = (LayoutManager *)scene->getManager(kWKLayoutManager);
+        SimpleIdentity screenProgID = scene->getProgramIDByName(kToolkitDefaultScreenSpaceProgram);
+        std::vector<LayoutObject *> layoutObjs;
+        for (int ii=0;ii<options.numLabels;ii++)
+        {
+            LayoutObject *layoutObj = new LayoutObject();
+            GeoCoord loc(rand.range(-M_PI,M_PI),rand.range(-1.2,1.2));
+            layoutObj->setWorldLoc(coordAdapter->localToDisplay(coordAdapter->getCoordSystem()->geographicToLocal3d(loc)));
+            double width2 = rand.range(16.0,64.0), height2 = 8.0;
+            ScreenSpaceObject::ConvexGeometry geom;
+            geom.progID = screenProgID;
+            geom.coords.push_back(Point2d(-width2,-height2));  geom.texCoords.push_back(TexCoord(0,1));
+            geom.coords.push_back(Point2d(width2,-height2));  geom.texCoords.push_back(TexCoord(1,1));
+            geom.coords.push_back(Point2d(width2,height2));  geom.texCoords.push_back(TexCoord(1,0));
+            geom.coords.push_back(Point2d(-width2,height2));  geom.texCoords.push_back(TexCoord(0,0));
+            layoutObj->addGeometry(geom);
+            layoutObj->layoutPts = geom.coords;
+            layoutObj->selectPts = geom.coords;
+            layoutObj->importance = rand.range(1.0,1000.0);
+            layoutObj->setOffset(Point2d(MAXFLOAT,MAXFLOAT));
+            layoutObjs.push_back(layoutObj);
+        }
+        // Markers bunched up around a few hundred spots, which is what clustering is for
+        std::vector<GeoCoord> hotSpots;
+        for (int ii=0;ii<std::min(options.numMarkers,500);ii++)
+            hotSpots.push_back(GeoCoord(rand.range(-M_PI,M_PI),rand.range(-1.2,1.2)));
+        for (int ii=0;ii<options.numMarkers;ii++)
+        {
+            LayoutObject *layoutObj = new LayoutObject();
+            const GeoCoord &hotSpot = hotSpots[(int)(rand.next()*hotSpots.size()) % hotSpots.size()];
+            GeoCoord loc(hotSpot.x()+rand.range(-0.05,0.05),hotSpot.y()+rand.range(-0.05,0.05));
+            layoutObj->setWorldLoc(coordAdapter->localToDisplay(coordAdapter->getCoordSystem()->geographicToLocal3d(loc)));
+            ScreenSpaceObject::ConvexGeometry geom;
+            geom.progID = screenProgID;
+            geom.coords.push_back(Point2d(-8,-8));  geom.texCoords.push_back(TexCoord(0,1));
+            geom.coords.push_back(Point2d(8,-8));  geom.texCoords.push_back(TexCoord(1,1));
+            geom.coords.push_back(Point2d(8,8));  geom.texCoords.push_back(TexCoord(1,0));
+            geom.coords.push_back(Point2d(-8,8));  geom.texCoords.push_back(TexCoord(0,0));
+            layoutObj->addGeometry(geom);
+            layoutObj->layoutPts = geom.coords;
+            layoutObj->selectPts = geom.coords;
+            layoutObj->importance = rand.range(1.0,1000.0);
+            layoutObj->clusterGroup = 0;
+            layoutObj->setOffset(Point2d(MAXFLOAT,MAXFLOAT));
+            layoutObjs.push_back(layoutObj);
+        }
+        layoutManager->addLayoutObjects(layoutObjs);
+        for (LayoutObject *layoutObj : layoutObjs)
+            delete layoutObj;
+
+        // Every kind of selectable that doesn't move, in equal numbers
+        SelectionManager *selectManager = (SelectionManager *)scene->getManager(kWKSelectionManager);
+        for (int ii=0;ii<options.numSelectables;ii++)
+        {
+            GeoCoord loc(rand.range(-M_PI,M_PI),rand.range(-1.2,1.2));
+            Point3d center = coordAdapter->localToDisplay(coordAdapter->getCoordSystem()->geographicToLocal3d(loc));
+            double size = rand.range(0.0005,0.005);
+            SimpleIdentity selectID = Identifiable::genId();
+            switch (ii % 4)
+            {
+                case 0:
+                {
+                    double width2 = rand.range(8.0,32.0);
+                    Point2f pts[4] = {Point2f(-width2,-8),Point2f(width2,-8),Point2f(width2,8),Point2f(-width2,8)};
+                    selectManager->addSelectableScreenRect(selectID,center,pts,DrawVisibleInvalid,DrawVisibleInvalid,true);
+                }
+                    break;
+                case 1:
+                {
+                    Point3f pts[8];
+                    for (unsigned int jj=0;jj<8;jj++)
+                        pts[jj] = Point3f(center.x() + ((jj == 1 || jj == 2 || jj == 5 || jj == 6) ? size : -size),
+                                          center.y() + ((jj == 2 || jj == 3 || jj == 6 || jj == 7) ? size : -size),
+                                          jj < 4 ? 0.0 : size);
+                    selectManager->addSelectableRectSolid(selectID,pts,DrawVisibleInvalid,DrawVisibleInvalid,true);
+                }
+                    break;
+                case 2:
+                {
+                    Point3fVector pts;
+                    Point3f pt(center.x(),center.y(),center.z());
+                    for (unsigned int jj=0;jj<10;jj++)
+                    {
+                        pts.push_back(pt);
+                        pt += Point3f(rand.range(-size,size),rand.range(-size,size),0.0);
+                    }
+                    selectManager->addSelectableLinear(selectID,pts,DrawVisibleInvalid,DrawVisibleInvalid,true);
+                }
+                    break;
+                case 3:
+                    selectManager->addSelectableBillboard(selectID,center,Point3d(0,0,1),Point2d(size,2*size),DrawVisibleInvalid,DrawVisibleInvalid,true);
+                    break;
+            }
+        }
+
+        // Small drawables that come and go through a drawable atlas, the way tiles and labels can
+        if (options.numAtlasDrawables > 0)
+        {
+            static const int AtlasVertices = 16*1024;
+            atlasProgID = scene->getProgramIDByName(kToolkitDefaultTriangleProgram);
+            atlas = new DynamicDrawableAtlas("Benchmark Atlas",sizeof(GLushort),AtlasVertices*AtlasVertexSize,6*AtlasVertices*sizeof(GLushort),scene->getMemManager(),NULL,atlasProgID);
+            atlas->setStreaming(options.glVersion >= 3);
+            for (int ii=0;ii<options.numAtlasDrawables;ii++)
+                addAtlasDrawable(changes);
+        }
+
+        scene->addChangeRequests(changes);
+
+        tiles = new BenchTileSource(coordAdapter,options);
+        control = new QuadDisplayController(tiles,tiles,tiles);
+        control->setMaxTiles(options.maxTiles);
+        control->setMeteredMode(false);
+        control->init(scene,renderer);
+        control->setMinImportance(1.0);
+    }
+
+    /// Swap out a tenth of the atlas drawables and flush if the atlas will let us
+    void churnAtlas(ChangeSet &changes)
+    {
+        int numChurn = std::max(options.numAtlasDrawables/10,1);
+        for (int ii=0;ii<numChurn && !atlasDrawIDs.empty();ii++)
+        {
+            atlas->removeDrawable(atlasDrawIDs.front(),changes);
+            atlasDrawIDs.pop_front();
+        }
+        for (int ii=0;ii<numChurn;ii++)
+            addAtlasDrawable(changes);
+
+        if (atlas->hasUpdates())
+        {
+            if (atlas->waitingOnSwap())
+                atlasStalls++;
+            else {
+                atlas->swap(changes,NULL,EmptyIdentity);
+                atlasSwaps++;
+            }
+        }
+    }
+
+    /// A colored square somewhere on the map
+    void addAtlasDrawable(ChangeSet &changes)
+    {
+        BasicDrawable draw("Benchmark Atlas Drawable",4,2);
+        draw.setType(GL_TRIANGLES);
+        draw.setProgram(atlasProgID);
+        Point3d center(atlasRand.range(-M_PI,M_PI),atlasRand.range(-1.2,1.2),0.0);
+        double size = atlasRand.range(0.001,0.01);
+        RGBAColor color(255,128,0,255);
+        for (unsigned int ii=0;ii<4;ii++)
+        {
+            Point3d localPt(center.x() + (ii == 1 || ii == 2 ? size : -size),center.y() + (ii >= 2 ? size : -size),0.0);
+            draw.addPoint(coordAdapter->localToDisplay(localPt));
+            draw.addColor(color);
+        }
+        draw.addTriangle(BasicDrawable::Triangle(0,1,2));
+        draw.addTriangle(BasicDrawable::Triangle(0,2,3));
+        if (atlas->addDrawable(&draw,changes))
+            atlasDrawIDs.push_back(draw.getId());
+    }
+
+    /// Move the camera and run one frame of everything a frame does
+    void step(const CameraPos &camPos)
+    {
+        FrameProfiler *profiler = scene->getProfiler();
+        mapView->setLoc(Point3d(camPos.x,camPos.y,camPos.height));
+        mapView->setRotAngle(camPos.rot);
+
+        TimeInterval start = TimeGetCurrent();
+        Maply::MapViewState *viewState = new Maply::MapViewState(mapView,renderer);
+        start = profiler->endPhase("View state",start);
+
+        ChangeSet changes;
+        control->viewUpdate(viewState);
+        profiler->endPhase("Quad view update",start);
+        control->evalStep(0.0,0.0,0.0,changes);
+        start = TimeGetCurrent();
+        tiles->finishLoads(changes);
+        start = profiler->endPhase("Tile loads",start);
+        if (atlas)
+        {
+            churnAtlas(changes);
+            profiler->endPhase("Atlas updates",start);
+        }
+
+        LayoutManager *layoutManager = (LayoutManager *)scene->getManager(kWKLayoutManager);
+        layoutManager->updateLayout(viewState,changes);
+        scene->addChangeRequests(changes);
+
+        renderer->render();
+
+        delete viewState;
+    }
+
+    /// Layout objects showing after the last frame
+    int labelsShown()
+    {
+        SelectionManager::PlacementInfo pInfo(mapView,renderer);
+        std::vector<ScreenSpaceObjectLocation> shownObjs;
+        LayoutManager *layoutManager = (LayoutManager *)scene->getManager(kWKLayoutManager);
+        layoutManager->getScreenSpaceObjects(pInfo,shownObjs);
+        return (int)shownObjs.size();
+    }
+
+    BenchOptions options;
+    CoordSystemDisplayAdapter *coordAdapter;
+    Maply::MapScene *scene;
+    Maply::MapView *mapView;
+    BenchRenderer *renderer;
+    BenchTileSource *tiles;
+    QuadDisplayController *control;
+    BenchClusterGenerator *clusterGen;
+    // Points and colors
+    static const int AtlasVertexSize = 3*sizeof(float) + 4;
+    DynamicDrawableAtlas *atlas;
+    SimpleIdentity atlasProgID;
+    std::deque<SimpleIdentity> atlasDrawIDs;
+    BenchRandom atlasRand;
+    int atlasSwaps,atlasStalls;
+};
+
+static ScenarioResult RunScenario(const Scenario &scenario,const BenchOptions &options)
+{
+    ScenarioResult result;
+    result.name = scenario.name;
+    result.frames = options.frames;
+
+    GLStubResetCounts();
+    int64_t allocs = numAllocs, bytes = allocBytes;
+    TimeInterval start = TimeGetCurrent();
+
+    BenchWorld world(options);
+    world.addData();
+    // The first frame processes all the data we just added
+    world.step(scenario.path(0,options.frames));
+
+    TimeInterval now = TimeGetCurrent();
+    result.setupTime = now - start;
+    result.setupAllocs = numAllocs - allocs;
+    result.setupAllocBytes = allocBytes - bytes;
+    result.setupGL = GLStubGetCounts();
+
+    // Only the frames after setup go in the profile
+    world.scene->getProfiler()->clear();
+    allocs = numAllocs;  bytes = allocBytes;
+    start = now;
+
+    for (int frame=1;frame<=options.frames;frame++)
+        world.step(scenario.path(frame,options.frames));
+
+    result.runTime = TimeGetCurrent() - start;
+    result.runAllocs = numAllocs - allocs;
+    result.runAllocBytes = allocBytes - bytes;
+    result.runGL = GLStubGetCounts() - result.setupGL;
+    world.scene->getProfiler()->summarize(result.profile);
+    result.bufferStats = world.scene->getMemManager()->getStats();
+    result.tilesLoaded = world.tiles->tilesLoaded;
+    result.tilesUnloaded = world.tiles->tilesUnloaded;
+    result.atlasStreaming = world.atlas && hasMapBufferRangeSupport;
+    result.atlasSwaps = world.atlasSwaps;
+    result.atlasStalls = world.atlasStalls;
+
+    // How many labels made it through layout, which is how we'd notice layout getting sloppy
+    result.labelsShown = world.labelsShown();
+
+    // Taps at the same spots on every run
+    SelectionManager *selectManager = (SelectionManager *)world.scene->getManager(kWKSelectionManager);
+    BenchRandom rand(7);
+    float scale = world.renderer->getScale();
+    result.numPicks = options.numPicks;
+    result.pickHits = 0;
+    start = TimeGetCurrent();
+    for (int ii=0;ii<options.numPicks;ii++)
+    {
+        Point2f touchPt(rand.range(0.0,options.width/scale),rand.range(0.0,options.height/scale));
+        std::vector<SelectionManager::SelectedObject> selObjs;
+        selectManager->pickObjects(touchPt,10.0,world.mapView,selObjs);
+        result.pickHits += selObjs.size();
+    }
+    result.pickTime = TimeGetCurrent() - start;
+
+    if (!options.traceDir.empty())
+    {
+        const std::string fileName = options.traceDir + "/" + scenario.name + ".json";
+        if (!world.scene->getProfiler()->writeChromeTrace(fileName))
+            fprintf(stderr,"Couldn't write trace to %s\n",fileName.c_str());
+    }
+
+    return result;
+}
+
+// Metrics go out as scenario, name, value so runs from two commits can be diffed or joined
+static void ReportMetric(FILE *fp,const ScenarioResult &result,const std::string &name,double value)
+{
+    if (fp)
+        fprintf(fp,"%s\t%s\t%.6g\n",result.name.c_str(),name.c_str(),value);
+}
+
+static void ReportResult(const ScenarioResult &result,FILE *fp)
+{
+    double frames = std::max(result.frames,1);
+    printf("\n== %s: %d frames\n",result.name.c_str(),result.frames);
+    printf("  setup       %8.2f ms  %10lld allocs  %12lld bytes  %8lld GL calls  %10lld bytes uploaded\n",
+           result.setupTime*1000,(long long)result.setupAllocs,(long long)result.setupAllocBytes,
+           (long long)result.setupGL.calls,(long long)(result.setupGL.bufferBytes+result.setupGL.textureBytes));
+    printf("  per frame   %8.3f ms  %10.1f allocs  %12.0f bytes  %8.1f GL calls  %10.0f bytes uploaded  (%.1f fps)\n",
+           result.runTime*1000/frames,result.runAllocs/frames,result.runAllocBytes/frames,
+           result.runGL.calls/frames,(result.runGL.bufferBytes+result.runGL.textureBytes)/frames,
+           result.runTime > 0.0 ? frames/result.runTime : 0.0);
+    printf("  GL per frame: %.1f draws, %.0f vertices, %.1f state changes, %.1f uniforms, %.2f buffer uploads, %.2f texture uploads\n",
+           result.runGL.draws/frames,result.runGL.drawVertices/frames,result.runGL.stateChanges/frames,
+           result.runGL.uniforms/frames,result.runGL.bufferUploads/frames,result.runGL.textureUploads/frames);
+    printf("  tiles: %d loaded, %d unloaded\n",result.tilesLoaded,result.tilesUnloaded);
+    printf("  atlas: %s, %d flushes, %d frames waiting on a swap\n",result.atlasStreaming ? "streaming" : "double buffered",result.atlasSwaps,result.atlasStalls);
+    const OpenGLMemStats &bufferStats = result.bufferStats;
+    printf("  buffers: %.2f buffer allocs per frame, %.1f%% pool hit rate, %.2f MB live, %.2f MB pooled, %u evicted\n",
+           result.runGL.bufferAllocs/frames,100.0*bufferStats.hitRate(),bufferStats.liveBytes/(1024.0*1024.0),
+           bufferStats.pooledBytes/(1024.0*1024.0),bufferStats.evictions);
+
+    const FrameProfilerSummary &profile = result.profile;
+    double layoutPassesPerSec = 0.0;
+    for (const auto &phase : profile.phases)
+        if (!strcmp(phase.name,"Layout") && phase.total > 0.0)
+            layoutPassesPerSec = phase.count / phase.total;
+    printf("  layout: %.1f passes per second, %d labels showing at the end\n",layoutPassesPerSec,result.labelsShown);
+    double picks = std::max(result.numPicks,1);
+    printf("  pick: %.4f ms per pick, %.2f objects found per pick\n",result.pickTime*1000/picks,result.pickHits/picks);
+    printf("  %-22s %8s %10s %10s %10s\n","phase","count","total ms","mean ms","max ms");
+    for (const auto &phase : profile.phases)
+        printf("  %-22s %8u %10.2f %10.4f %10.4f\n",phase.name,phase.count,phase.total*1000,
+               phase.count ? phase.total*1000/phase.count : 0.0,phase.max*1000);
+    if (profile.numFrames > 0)
+    {
+        printf("  %-22s %8u %10.2f %10.4f %10.4f\n","(rendered frames)",profile.numFrames,profile.frameTotal*1000,
+               profile.frameTotal*1000/profile.numFrames,profile.frameMax*1000);
+        for (unsigned int ii=0;ii<FrameCountMax;ii++)
+            printf("  %-22s %10.1f per rendered frame\n",FrameCounterName((FrameCounter)ii),profile.counts[ii]/(double)profile.numFrames);
+    }
+
+    ReportMetric(fp,result,"setup_ms",result.setupTime*1000);
+    ReportMetric(fp,result,"setup_allocs",result.setupAllocs);
+    ReportMetric(fp,result,"setup_alloc_bytes",result.setupAllocBytes);
+    ReportMetric(fp,result,"frame_ms",result.runTime*1000/frames);
+    ReportMetric(fp,result,"frame_allocs",result.runAllocs/frames);
+    ReportMetric(fp,result,"frame_alloc_bytes",result.runAllocBytes/frames);
+    ReportMetric(fp,result,"frame_gl_calls",result.runGL.calls/frames);
+    ReportMetric(fp,result,"frame_gl_draws",result.runGL.draws/frames);
+    ReportMetric(fp,result,"frame_gl_state_changes",result.runGL.stateChanges/frames);
+    ReportMetric(fp,result,"frame_upload_bytes",(result.runGL.bufferBytes+result.runGL.textureBytes)/frames);
+    ReportMetric(fp,result,"frame_buffer_allocs",result.runGL.bufferAllocs/frames);
+    ReportMetric(fp,result,"buffer_pool_hit_rate",bufferStats.hitRate());
+    ReportMetric(fp,result,"buffer_live_bytes",bufferStats.liveBytes);
+    ReportMetric(fp,result,"buffer_pooled_bytes",bufferStats.pooledBytes);
+    ReportMetric(fp,result,"tiles_loaded",result.tilesLoaded);
+    ReportMetric(fp,result,"atlas_flushes",result.atlasSwaps);
+    ReportMetric(fp,result,"atlas_stalls",result.atlasStalls);
+    ReportMetric(fp,result,"layout_passes_per_sec",layoutPassesPerSec);
+    ReportMetric(fp,result,"labels_shown",result.labelsShown);
+    ReportMetric(fp,result,"pick_ms",result.pickTime*1000/picks);
+    ReportMetric(fp,result,"pick_hits",result.pickHits/picks);
+    for (const auto &phase : profile.phases)
+    {
+        ReportMetric(fp,result,std::string("phase_ms.") + phase.name,phase.total*1000/frames);
+        ReportMetric(fp,result,std::string("phase_max_ms.") + phase.name,phase.max*1000);
+    }
+    for (unsigned int ii=0;ii<FrameCountMax && profile.numFrames > 0;ii++)
+        ReportMetric(fp,result,std::string("count.") + FrameCounterName((FrameCounter)ii),profile.counts[ii]/(double)profile.numFrames);
+}
+
+// Tests outside the scripted scenarios.  They return false if something came out wrong.
+class MicroBench
+{
+public:
+    const char *name;
+    const char *desc;
+    bool (*run)(const BenchOptions &options,FILE *fp);
+};
+
+static void ReportMicroMetric(FILE *fp,const char *bench,const std::string &name,double value)
+{
+    if (fp)
+        fprintf(fp,"%s\t%s\t%.6g\n",bench,name.c_str(),value);
+}
+
+// Change that remembers who pushed it and in what order
+class StressChange : public ChangeRequest
+{
+public:
+    StressChange(int producer,int seq) : producer(producer), seq(seq) { }
+    void execute(Scene *scene,WhirlyKit::SceneRendererES *renderer,WhirlyKit::View *view) { }
+
+    int producer,seq;
+};
+
+class ChangeQueueProducer
+{
+public:
+    ChangeQueue *queue;
+    std::atomic<bool> *go;
+    int producer;
+    int numChanges;
+};
+
+static void *ChangeQueueProduce(void *data)
+{
+    ChangeQueueProducer *info = (ChangeQueueProducer *)data;
+    while (!info->go->load(std::memory_order_acquire))
+        ;
+
+    // Mix single pushes and small batches, like the managers do
+    BenchRandom rand(info->producer+1);
+    int seq = 0, numBatches = 0;
+    while (seq < info->numChanges)
+    {
+        // Give up the core now and then so pushes and pops interleave even on a single CPU
+        if (++numBatches % 64 == 0)
+            sched_yield();
+        int batchSize = std::min(1 + (int)(rand.next() * 4),info->numChanges - seq);
+        if (batchSize == 1)
+            info->queue->push(new StressChange(info->producer,seq++));
+        else {
+            ChangeSet changes;
+            for (int ii=0;ii<batchSize;ii++)
+                changes.push_back(new StressChange(info->producer,seq++));
+            info->queue->push(changes);
+        }
+    }
+
+    return NULL;
+}
+
+// Several threads push while this one pops, the way the layer threads and renderer share the scene's queue.
+// Every change has to come out exactly once and each producer's changes have to stay in order.
+static bool ChangeQueueStress(const BenchOptions &options,FILE *fp)
+{
+    const int NumProducers = 4;
+    const int ChangesPerProducer = 50000;
+
+    ChangeQueue queue;
+    std::atomic<bool> go(false);
+    std::vector<ChangeQueueProducer> producers(NumProducers);
+    std::vector<pthread_t> threads(NumProducers);
+    for (int ii=0;ii<NumProducers;ii++)
+    {
+        producers[ii].queue = &queue;
+        producers[ii].go = &go;
+        producers[ii].producer = ii;
+        producers[ii].numChanges = ChangesPerProducer;
+        pthread_create(&threads[ii],NULL,&ChangeQueueProduce,&producers[ii]);
+    }
+
+    std::vector<int> nextSeq(NumProducers,0);
+    int received = 0, pops = 0, errors = 0;
+    TimeInterval start = TimeGetCurrent();
+    go.store(true,std::memory_order_release);
+
+    ChangeSet changes,allChanges;
+    allChanges.reserve(NumProducers * ChangesPerProducer);
+    while (received < NumProducers * ChangesPerProducer && errors == 0)
+    {
+        changes.clear();
+        queue.popAll(changes);
+        if (changes.empty())
+            continue;
+        pops++;
+        for (ChangeRequest *change : changes)
+        {
+            StressChange *stressChange = dynamic_cast<StressChange *>(change);
+            if (!stressChange || stressChange->producer < 0 || stressChange->producer >= NumProducers)
+            {
+                fprintf(stderr,"changequeue: got a change nobody pushed\n");
+                errors++;
+            } else if (stressChange->seq != nextSeq[stressChange->producer])
+            {
+                fprintf(stderr,"changequeue: producer %d change %d came out when %d was expected\n",
+                        stressChange->producer,stressChange->seq,nextSeq[stressChange->producer]);
+                errors++;
+            } else
+                nextSeq[stressChange->producer]++;
+            received++;
+        }
+        // Hold on to everything until the end so a duplicate can't point at freed memory
+        allChanges.insert(allChanges.end(),changes.begin(),changes.end());
+    }
+    TimeInterval runTime = TimeGetCurrent() - start;
+
+    for (int ii=0;ii<NumProducers;ii++)
+        pthread_join(threads[ii],NULL);
+
+    // Nothing should be left over, or it was pushed twice
+    changes.clear();
+    queue.popAll(changes);
+    if (!changes.empty())
+    {
+        fprintf(stderr,"changequeue: %d extra changes after everything came through\n",(int)changes.size());
+        errors++;
+        allChanges.insert(allChanges.end(),changes.begin(),changes.end());
+    }
+    for (int ii=0;ii<NumProducers;ii++)
+        if (nextSeq[ii] != ChangesPerProducer && errors == 0)
+        {
+            fprintf(stderr,"changequeue: producer %d only got %d of %d changes through\n",ii,nextSeq[ii],ChangesPerProducer);
+            errors++;
+        }
+
+    std::sort(allChanges.begin(),allChanges.end());
+    allChanges.erase(std::unique(allChanges.begin(),allChanges.end()),allChanges.end());
+    for (ChangeRequest *change : allChanges)
+        delete change;
+
+    printf("\n== changequeue: %d producers, %d changes each\n",NumProducers,ChangesPerProducer);
+    printf("  %s, %.2f ms, %d pops, %.1f changes per pop, %.0f changes per ms\n",errors ? "FAILED" : "ok",runTime*1000,
+           pops,received/(double)std::max(pops,1),runTime > 0.0 ? received/(runTime*1000) : 0.0);
+    ReportMicroMetric(fp,"changequeue","ms",runTime*1000);
+    ReportMicroMetric(fp,"changequeue","changes_per_pop",received/(double)std::max(pops,1));
+    ReportMicroMetric(fp,"changequeue","errors",errors);
+
+    return errors == 0;
+}
+
+// Importance for a bare quad tree, with or without the batched off screen test
+class QuadCullCalculator : public QuadTreeImportanceCalculator
+{
+public:
+    QuadCullCalculator(CoordSystemDisplayAdapter *coordAdapter,int tileSize,bool batched)
+    : coordAdapter(coordAdapter), viewState(NULL), tileSize(tileSize), batched(batched), numEvals(0)
+    {
+    }
+
+    virtual double importanceForTile(const Quadtree::Identifier &ident,const Mbr &mbr,Quadtree *tree,Dictionary *attrs)
+    {
+        numEvals++;
+        if (ident.level == 0)
+            return MAXFLOAT;
+        return ScreenImportance(viewState, frameSize, viewState->eyeVec, tileSize, coordAdapter->getCoordSystem(), coordAdapter, mbr, ident, attrs);
+    }
+    virtual bool importanceBoundsForTile(const Quadtree::Identifier &ident,const Mbr &mbr,Quadtree *tree,Dictionary *attrs,double &minImport,double &maxImport)
+    {
+        if (ident.level == 0)
+        {
+            minImport = maxImport = MAXFLOAT;
+            return true;
+        }
+        return ScreenImportanceBounds(viewState, frameSize, tileSize, attrs, minImport, maxImport);
+    }
+    virtual void nodesOffScreen(const std::vector<Quadtree::NodeInfo *> &nodes,Quadtree *tree,std::vector<bool> &offScreen)
+    {
+        if (batched)
+            TilesOffScreen(viewState, nodes, 1, offScreen);
+    }
+
+    CoordSystemDisplayAdapter *coordAdapter;
+    ViewState *viewState;
+    Point2f frameSize;
+    int tileSize;
+    bool batched;
+    // Full importance calculations
+    int numEvals;
+};
+
+// Levels 0 through 6 and enough of level 7 to make 10k nodes
+static void FillQuadCullTree(Quadtree *tree,std::vector<Quadtree::Identifier> &idents)
+{
+    const unsigned int NumNodes = 10000;
+    std::vector<Quadtree::Identifier> covered;
+    for (int level=0;level<=7 && idents.size() < NumNodes;level++)
+        for (int iy=0;iy<1<<level && idents.size() < NumNodes;iy++)
+            for (int ix=0;ix<1<<level && idents.size() < NumNodes;ix++)
+            {
+                Quadtree::Identifier ident(ix,iy,level);
+                tree->addTile(ident,false,false,covered);
+                idents.push_back(ident);
+            }
+}
+
+// Tiles down to a few levels below loadable, as seen from where the calculator is looking.
+//  Unlike FillQuadCullTree, nearly all of these are on screen.
+static void FillVisibleQuadCullTree(Quadtree *tree,QuadCullCalculator *calc,int maxLevel,float minImportance,std::vector<Quadtree::Identifier> &idents)
+{
+    const unsigned int MaxNodes = 10000;
+    std::vector<Quadtree::Identifier> covered,toVisit;
+    toVisit.push_back(Quadtree::Identifier(0,0,0));
+    // Breadth first, so parents go in before their children
+    for (unsigned int which=0;which<toVisit.size() && idents.size() < MaxNodes;which++)
+    {
+        const Quadtree::Identifier ident = toVisit[which];
+        Dictionary attrs;
+        double import = calc->importanceForTile(ident,tree->generateMbrForNode(ident),tree,&attrs);
+        if (import == 0.0)
+            continue;
+        tree->addTile(ident,false,false,covered);
+        idents.push_back(ident);
+        if (import >= minImportance/16 && ident.level < maxLevel)
+            for (int iy=0;iy<2;iy++)
+                for (int ix=0;ix<2;ix++)
+                    toVisit.push_back(Quadtree::Identifier(2*ident.x+ix,2*ident.y+iy,ident.level+1));
+    }
+}
+
+// Pan a little at a time over a tree that's mostly on screen, with and without the importance tolerance.
+//  The tolerant tree should skip most of the full importance calculations and still make the
+//  same load and unload calls as the one that recalculates everything.
+static int QuadCullSmallPan(const BenchOptions &options,FILE *fp)
+{
+    const int NumViews = 100;
+    const double Height = 0.05;
+    BenchWorld world(options);
+    Point3f ll,ur;
+    world.coordAdapter->getBounds(ll,ur);
+    Mbr mbr(Point2f(ll.x(),ll.y()),Point2f(ur.x(),ur.y()));
+    Point2f frameSize = world.renderer->getFramebufferSize();
+    float minImportance = 1.0;
+
+    QuadCullCalculator exactCalc(world.coordAdapter,options.tileTexSize,true),tolerantCalc(world.coordAdapter,options.tileTexSize,true);
+    Quadtree exactTree(mbr,0,options.maxZoom,20000,minImportance,&exactCalc),tolerantTree(mbr,0,options.maxZoom,20000,minImportance,&tolerantCalc);
+    exactTree.setImportanceTolerance(0.0);
+    tolerantTree.setImportanceTolerance(0.1);
+
+    int errors = 0, numOnScreen = 0;
+    TimeInterval exactTime = 0.0, tolerantTime = 0.0;
+    std::vector<Quadtree::Identifier> idents,tolerantIdents;
+    for (int ii=0;ii<NumViews;ii++)
+    {
+        // A few pixels a frame
+        world.mapView->setLoc(Point3d(0.3 + ii*Height/400,0.2,Height));
+        Maply::MapViewState viewState(world.mapView,world.renderer);
+        exactCalc.viewState = tolerantCalc.viewState = &viewState;
+        exactCalc.frameSize = tolerantCalc.frameSize = frameSize;
+        if (idents.empty())
+        {
+            FillVisibleQuadCullTree(&exactTree,&exactCalc,options.maxZoom,minImportance,idents);
+            FillVisibleQuadCullTree(&tolerantTree,&tolerantCalc,options.maxZoom,minImportance,tolerantIdents);
+            // The first pass is a full one for both, so start counting after it
+            exactTree.reevaluateNodes();
+            tolerantTree.reevaluateNodes();
+            exactCalc.numEvals = tolerantCalc.numEvals = 0;
+            exactCalc.viewState = tolerantCalc.viewState = NULL;
+            continue;
+        }
+
+        TimeInterval start = TimeGetCurrent();
+        exactTree.reevaluateNodes();
+        TimeInterval mid = TimeGetCurrent();
+        tolerantTree.reevaluateNodes();
+        exactTime += mid - start;
+        tolerantTime += TimeGetCurrent() - mid;
+
+        // Loaded or not is all the display controller acts on
+        for (const Quadtree::Identifier &ident : idents)
+        {
+            const Quadtree::NodeInfo *exactInfo = exactTree.getNodeInfo(ident);
+            const Quadtree::NodeInfo *tolerantInfo = tolerantTree.getNodeInfo(ident);
+            if (exactInfo->importance > 0.0)
+                numOnScreen++;
+            if ((exactInfo->importance >= minImportance) != (tolerantInfo->importance >= minImportance) && errors++ == 0)
+                fprintf(stderr,"quadcull: tile %d: (%d,%d) has importance %g exactly and %g with tolerance\n",
+                        ident.level,ident.x,ident.y,exactInfo->importance,tolerantInfo->importance);
+        }
+
+        exactCalc.viewState = tolerantCalc.viewState = NULL;
+    }
+
+    double views = NumViews-1;
+    double skipped = exactCalc.numEvals > 0 ? 1.0 - tolerantCalc.numEvals / (double)exactCalc.numEvals : 0.0;
+    printf("  small pan, %d nodes, %.0f on screen: %.3f ms exact, %.3f ms tolerant per reevaluation, %.1f%% of full evaluations skipped, %d load decisions differ\n",
+           (int)idents.size(),numOnScreen/views,exactTime*1000/views,tolerantTime*1000/views,skipped*100,errors);
+    ReportMicroMetric(fp,"quadcull","smallpan_exact_ms",exactTime*1000/views);
+    ReportMicroMetric(fp,"quadcull","smallpan_tolerant_ms",tolerantTime*1000/views);
+    ReportMicroMetric(fp,"quadcull","smallpan_evals_skipped",exactCalc.numEvals-tolerantCalc.numEvals);
+    ReportMicroMetric(fp,"quadcull","smallpan_decision_errors",errors);
+
+    return errors;
+}
+
+// Reevaluate a 10k node quad tree over views from each of the scenarios, once with the
+//  batched off screen test and once testing tile by tile.  Both have to come up with the same importance.
+static bool QuadCull(const BenchOptions &options,FILE *fp)
+{
+    const int ViewsPerScenario = 10;
+    BenchWorld world(options);
+    Point3f ll,ur;
+    world.coordAdapter->getBounds(ll,ur);
+    Mbr mbr(Point2f(ll.x(),ll.y()),Point2f(ur.x(),ur.y()));
+    Point2f frameSize = world.renderer->getFramebufferSize();
+
+    int errors = 0;
+    printf("\n== quadcull: 10000 node quad tree, %d views\n",ViewsPerScenario*(int)(sizeof(Scenarios)/sizeof(Scenarios[0])));
+    // With no tolerance every tile is recalculated, so the two have to match exactly
+    for (double tolerance : {0.0, 0.1})
+    {
+        QuadCullCalculator batchCalc(world.coordAdapter,options.tileTexSize,true),tileCalc(world.coordAdapter,options.tileTexSize,false);
+        Quadtree batchTree(mbr,0,options.maxZoom,20000,1.0,&batchCalc),tileTree(mbr,0,options.maxZoom,20000,1.0,&tileCalc);
+        batchTree.setImportanceTolerance(tolerance);
+        tileTree.setImportanceTolerance(tolerance);
+
+        TimeInterval batchTime = 0.0, tileTime = 0.0;
+        int numViews = 0, numOffScreen = 0;
+        std::vector<Quadtree::Identifier> idents,tileIdents;
+        for (const auto &scenario : Scenarios)
+            for (int ii=0;ii<ViewsPerScenario;ii++)
+            {
+                CameraPos camPos = scenario.path(ii*options.frames/ViewsPerScenario,options.frames);
+                world.mapView->setLoc(Point3d(camPos.x,camPos.y,camPos.height));
+                world.mapView->setRotAngle(camPos.rot);
+                Maply::MapViewState viewState(world.mapView,world.renderer);
+                batchCalc.viewState = tileCalc.viewState = &viewState;
+                batchCalc.frameSize = tileCalc.frameSize = frameSize;
+                if (idents.empty())
+                {
+                    FillQuadCullTree(&batchTree,idents);
+                    FillQuadCullTree(&tileTree,tileIdents);
+                }
+
+                TimeInterval start = TimeGetCurrent();
+                batchTree.reevaluateNodes();
+                TimeInterval mid = TimeGetCurrent();
+                tileTree.reevaluateNodes();
+                batchTime += mid - start;
+                tileTime += TimeGetCurrent() - mid;
+                numViews++;
+
+                for (const Quadtree::Identifier &ident : idents)
+                {
+                    const Quadtree::NodeInfo *batchInfo = batchTree.getNodeInfo(ident);
+                    const Quadtree::NodeInfo *tileInfo = tileTree.getNodeInfo(ident);
+                    if (batchInfo->importance == 0.0)
+                        numOffScreen++;
+                    if (tolerance == 0.0 && batchInfo->importance != tileInfo->importance && errors++ == 0)
+                        fprintf(stderr,"quadcull: tile %d: (%d,%d) has importance %g batched and %g tile by tile\n",
+                                ident.level,ident.x,ident.y,batchInfo->importance,tileInfo->importance);
+                }
+
+                batchCalc.viewState = tileCalc.viewState = NULL;
+            }
+
+        double views = std::max(numViews,1);
+        printf("  tolerance %.1f: %.3f ms batched, %.3f ms tile by tile per reevaluation, %.0f tiles off screen\n",
+               tolerance,batchTime*1000/views,tileTime*1000/views,numOffScreen/views);
+        std::string suffix = tolerance == 0.0 ? "" : "_tolerant";
+        ReportMicroMetric(fp,"quadcull","batched_ms"+suffix,batchTime*1000/views);
+        ReportMicroMetric(fp,"quadcull","tile_ms"+suffix,tileTime*1000/views);
+    }
+    
+    errors += QuadCullSmallPan(options,fp);
+    printf("  %s\n",errors ? "FAILED" : "ok");
+    ReportMicroMetric(fp,"quadcull","errors",errors);
+
+    return errors == 0;
+}
+
+// Separating axis test, touching counts.  Same answer OverlapHelper should give.
+static bool RefPolysOverlap(const Point2dVector &pts0,const Point2dVector &pts1)
+{
+    for (const Point2dVector *pts : {&pts0,&pts1})
+        for (unsigned int ii=0;ii<pts->size();ii++)
+        {
+            const Point2d &p0 = (*pts)[ii], &p1 = (*pts)[(ii+1)%pts->size()];
+            Point2d axis(p0.y()-p1.y(),p1.x()-p0.x());
+            double min0 = MAXFLOAT, max0 = -MAXFLOAT, min1 = MAXFLOAT, max1 = -MAXFLOAT;
+            for (const Point2d &pt : pts0)
+            {
+                min0 = std::min(min0,pt.dot(axis));  max0 = std::max(max0,pt.dot(axis));
+            }
+            for (const Point2d &pt : pts1)
+            {
+                min1 = std::min(min1,pt.dot(axis));  max1 = std::max(max1,pt.dot(axis));
+            }
+            if (max0 < min1 || max1 < min0)
+                return false;
+        }
+
+    return true;
+}
+
+/** The straightforward grid: every object in every cell it covers, tested each time it turns up.
+    This is how OverlapHelper used to work, but with an exact test so the placements can be compared.
+  */
+class RefOverlapGrid
+{
+public:
+    RefOverlapGrid(const Mbr &mbr,int sizeX,int sizeY)
+    : mbr(mbr), sizeX(sizeX), sizeY(sizeY), visits(0), uniqueVisits(0), queryTag(0)
+    {
+        grid.resize(sizeX*sizeY);
+        cellSize = Point2d((mbr.ur().x()-mbr.ll().x())/sizeX,(mbr.ur().y()-mbr.ll().y())/sizeY);
+    }
+
+    bool addObject(const Point2dVector &pts)
+    {
+        Mbr objMbr;
+        objMbr.addPoints(pts);
+        int sx,sy,ex,ey;
+        calcCells(objMbr,sx,sy,ex,ey);
+        queryTag++;
+        for (int iy=sy;iy<=ey;iy++)
+            for (int ix=sx;ix<=ex;ix++)
+                for (int id : grid[iy*sizeX+ix])
+                {
+                    // Count how often we'd have tested the same object twice
+                    visits++;
+                    if (tags[id] != queryTag)
+                    {
+                        tags[id] = queryTag;
+                        uniqueVisits++;
+                    }
+                    if (objMbrs[id].overlaps(objMbr) && RefPolysOverlap(objects[id],pts))
+                        return false;
+                }
+
+        int newId = (int)objects.size();
+        objects.push_back(pts);
+        objMbrs.push_back(objMbr);
+        tags.push_back(queryTag);
+        for (int iy=sy;iy<=ey;iy++)
+            for (int ix=sx;ix<=ex;ix++)
+                grid[iy*sizeX+ix].push_back(newId);
+
+        return true;
+    }
+
+    void calcCells(const Mbr &objMbr,int &sx,int &sy,int &ex,int &ey)
+    {
+        sx = std::max((int)floor((objMbr.ll().x()-mbr.ll().x())/cellSize.x()),0);
+        sy = std::max((int)floor((objMbr.ll().y()-mbr.ll().y())/cellSize.y()),0);
+        ex = std::min((int)ceil((objMbr.ur().x()-mbr.ll().x())/cellSize.x()),sizeX-1);
+        ey = std::min((int)ceil((objMbr.ur().y()-mbr.ll().y())/cellSize.y()),sizeY-1);
+    }
+
+    Mbr mbr;
+    int sizeX,sizeY;
+    Point2d cellSize;
+    std::vector<std::vector<int> > grid;
+    std::vector<Point2dVector> objects;
+    std::vector<Mbr> objMbrs;
+    std::vector<unsigned int> tags;
+    int64_t visits,uniqueVisits;
+    unsigned int queryTag;
+};
+
+// Six spots around the anchor, like the layout manager tries: right, left, above, below, then the two diagonals
+static void OverlapLabelShape(const Point2d &anchor,double width,double height,double rot,int which,Point2dVector &pts)
+{
+    static const double offX[6] = {0.0,-1.0,-0.5,-0.5,0.0,-1.0}, offY[6] = {-0.5,-0.5,0.0,-1.0,0.0,-1.0};
+    Point2d org(offX[which]*width,offY[which]*height);
+    Point2d corners[4] = {org,org+Point2d(width,0.0),org+Point2d(width,height),org+Point2d(0.0,height)};
+    double cosRot = cos(rot), sinRot = sin(rot);
+    pts.resize(4);
+    for (unsigned int ii=0;ii<4;ii++)
+    {
+        const Point2d &pt = corners[ii];
+        pts[ii] = rot == 0.0 ? anchor + pt : anchor + Point2d(pt.x()*cosRot - pt.y()*sinRot,pt.x()*sinRot + pt.y()*cosRot);
+    }
+}
+
+// Place 20k labels with six tries each, with OverlapHelper and with the plain grid.
+// Both test exactly, so they have to place the same labels.
+static bool Overlap(const BenchOptions &options,FILE *fp)
+{
+    const int NumLabels = 20000, GridSize = 60, NumPasses = 5;
+    Mbr screenMbr(Point2f(0.0,0.0),Point2f(options.width,options.height));
+
+    int errors = 0;
+    printf("\n== overlap: %d labels, 6 placements each, %dx%d grid\n",NumLabels,GridSize,GridSize);
+    for (double rotatedFrac : {0.0, 0.25})
+    {
+        // Labels sorted by importance already, so it's first come first served
+        BenchRandom rand(42);
+        std::vector<Point2d> anchors(NumLabels);
+        std::vector<Point2d> sizes(NumLabels);
+        std::vector<double> rots(NumLabels);
+        for (int ii=0;ii<NumLabels;ii++)
+        {
+            anchors[ii] = Point2d(rand.range(0.0,options.width),rand.range(0.0,options.height));
+            sizes[ii] = Point2d(rand.range(20.0,120.0),rand.range(10.0,24.0));
+            rots[ii] = rand.next() < rotatedFrac ? rand.range(-M_PI/4,M_PI/4) : 0.0;
+        }
+
+        TimeInterval helperTime = 0.0, refTime = 0.0;
+        std::vector<int> helperPlaced,refPlaced;
+        int64_t visits = 0, uniqueVisits = 0;
+        Point2dVector pts;
+        for (int pass=0;pass<NumPasses;pass++)
+        {
+            helperPlaced.assign(NumLabels,-1);
+            refPlaced.assign(NumLabels,-1);
+
+            TimeInterval start = TimeGetCurrent();
+            OverlapHelper overlap(screenMbr,GridSize,GridSize);
+            for (int ii=0;ii<NumLabels;ii++)
+                for (int which=0;which<6;which++)
+                {
+                    OverlapLabelShape(anchors[ii],sizes[ii].x(),sizes[ii].y(),rots[ii],which,pts);
+                    if (overlap.addObject(pts))
+                    {
+                        helperPlaced[ii] = which;
+                        break;
+                    }
+                }
+            TimeInterval mid = TimeGetCurrent();
+            RefOverlapGrid refGrid(screenMbr,GridSize,GridSize);
+            for (int ii=0;ii<NumLabels;ii++)
+                for (int which=0;which<6;which++)
+                {
+                    OverlapLabelShape(anchors[ii],sizes[ii].x(),sizes[ii].y(),rots[ii],which,pts);
+                    if (refGrid.addObject(pts))
+                    {
+                        refPlaced[ii] = which;
+                        break;
+                    }
+                }
+            helperTime += mid - start;
+            refTime += TimeGetCurrent() - mid;
+            visits = refGrid.visits;
+            uniqueVisits = refGrid.uniqueVisits;
+        }
+
+        int numPlaced = 0, numDiffer = 0;
+        for (int ii=0;ii<NumLabels;ii++)
+        {
+            if (helperPlaced[ii] >= 0)
+                numPlaced++;
+            if (helperPlaced[ii] != refPlaced[ii] && numDiffer++ == 0)
+                fprintf(stderr,"overlap: label %d went in spot %d, but %d testing one by one\n",ii,helperPlaced[ii],refPlaced[ii]);
+        }
+        errors += numDiffer;
+
+        printf("  %2.0f%% rotated: %.2f ms per pass, %.2f ms with the plain grid, %d placed, %d differ\n",
+               100*rotatedFrac,helperTime*1000/NumPasses,refTime*1000/NumPasses,numPlaced,numDiffer);
+        printf("             plain grid looks at %lld objects per pass, %lld of them repeats\n",(long long)visits,(long long)(visits-uniqueVisits));
+        std::string suffix = rotatedFrac == 0.0 ? "" : "_rotated";
+        ReportMicroMetric(fp,"overlap","helper_ms"+suffix,helperTime*1000/NumPasses);
+        ReportMicroMetric(fp,"overlap","grid_ms"+suffix,refTime*1000/NumPasses);
+        ReportMicroMetric(fp,"overlap","repeat_visits"+suffix,visits-uniqueVisits);
+        ReportMicroMetric(fp,"overlap","placed"+suffix,numPlaced);
+    }
+    printf("  %s\n",errors ? "FAILED" : "ok");
+    ReportMicroMetric(fp,"overlap","errors",errors);
+
+    return errors == 0;
+}
+
+// Mean time for the layout passes a world has run, or zero if it hasn't
+static TimeInterval LayoutPassTime(BenchWorld &world)
+{
+    FrameProfilerSummary profile;
+    world.scene->getProfiler()->summarize(profile);
+    for (const auto &phase : profile.phases)
+        if (!strcmp(phase.name,"Layout") && phase.count > 0)
+            return phase.total / phase.count;
+    return 0.0;
+}
+
+// Layout passes per second with lots of labels, full against incremental, along each camera path
+static bool LayoutPasses(const BenchOptions &options,FILE *fp)
+{
+    const int NumLabels = 20000;
+    BenchOptions layoutOptions = options;
+    layoutOptions.numAreals = layoutOptions.numLinears = 0;
+    layoutOptions.numLabels = NumLabels;
+    layoutOptions.numMarkers = layoutOptions.numSelectables = layoutOptions.numAtlasDrawables = 0;
+    layoutOptions.parallelLayout = layoutOptions.hierarchicalClustering = false;
+
+    bool passed = true;
+    printf("\n== layout: %d labels, %d frames per path, full against incremental\n",NumLabels,options.frames);
+    for (const auto &scenario : Scenarios)
+    {
+        BenchOptions fullOptions = layoutOptions, incOptions = layoutOptions;
+        fullOptions.incrementalLayout = false;
+        incOptions.incrementalLayout = true;
+        BenchWorld fullWorld(fullOptions), incWorld(incOptions);
+        BenchWorld *worlds[2] = {&fullWorld,&incWorld};
+        for (BenchWorld *world : worlds)
+        {
+            world->addData();
+            world->step(scenario.path(0,options.frames));
+            world->scene->getProfiler()->clear();
+        }
+
+        // Take turns a frame at a time so both see the same machine
+        double shown[2] = {0.0,0.0};
+        for (int frame=1;frame<=options.frames;frame++)
+            for (unsigned int wi=0;wi<2;wi++)
+            {
+                worlds[wi]->step(scenario.path(frame,options.frames));
+                shown[wi] += worlds[wi]->labelsShown();
+            }
+
+        double passesPerSec[2];
+        for (unsigned int wi=0;wi<2;wi++)
+        {
+            TimeInterval passTime = LayoutPassTime(*worlds[wi]);
+            passesPerSec[wi] = passTime > 0.0 ? 1.0/passTime : 0.0;
+            shown[wi] /= std::max(options.frames,1);
+        }
+        // Incremental can hang on to a label a little longer or pick one up a little late, but it shouldn't lose many
+        bool ok = shown[1] >= 0.9 * shown[0];
+        printf("  %-8s %8.1f full, %8.1f incremental passes per second (%.2fx), %.1f and %.1f labels showing%s\n",scenario.name,
+               passesPerSec[0],passesPerSec[1],passesPerSec[0] > 0.0 ? passesPerSec[1]/passesPerSec[0] : 0.0,shown[0],shown[1],ok ? "" : "  FAILED");
+        if (!ok)
+            passed = false;
+        ReportMicroMetric(fp,"layout",std::string(scenario.name) + ".full_passes_per_sec",passesPerSec[0]);
+        ReportMicroMetric(fp,"layout",std::string(scenario.name) + ".incremental_passes_per_sec",passesPerSec[1]);
+        ReportMicroMetric(fp,"layout",std::string(scenario.name) + ".full_labels_shown",shown[0]);
+        ReportMicroMetric(fp,"layout",std::string(scenario.name) + ".incremental_labels_shown",shown[1]);
+    }
+
+    return passed;
+}
+
+// Old way through geocentric against the direct converter, one point at a time.
+// Points come from makePt a chunk at a time so we don't need a few hundred MB for them.
+// Returns the worst difference between the two.
+template<typename MakePt>
+static double CoordConvertPair(const char *name,CoordSystem *inSys,CoordSystem *outSys,int numPts,MakePt makePt,FILE *fp)
+{
+    const int ChunkSize = 100000;
+    std::vector<Point3d> pts(ChunkSize),geocPts(ChunkSize),directPts(ChunkSize);
+
+    TimeInterval geocTime = 0.0, directTime = 0.0;
+    double maxDiff = 0.0;
+    for (int chunkStart=0;chunkStart<numPts;chunkStart+=ChunkSize)
+    {
+        int chunkSize = std::min(ChunkSize,numPts-chunkStart);
+        for (int ii=0;ii<chunkSize;ii++)
+            pts[ii] = makePt();
+
+        TimeInterval start = TimeGetCurrent();
+        for (int ii=0;ii<chunkSize;ii++)
+            geocPts[ii] = outSys->geocentricToLocal(inSys->localToGeocentric(pts[ii]));
+        TimeInterval mid = TimeGetCurrent();
+        for (int ii=0;ii<chunkSize;ii++)
+            directPts[ii] = CoordSystemFindConverterFast(inSys,outSys)->convert(pts[ii]);
+        geocTime += mid - start;
+        directTime += TimeGetCurrent() - mid;
+
+        for (int ii=0;ii<chunkSize;ii++)
+            maxDiff = std::max(maxDiff,(geocPts[ii]-directPts[ii]).head<2>().norm());
+    }
+
+    printf("  %-16s %8.1f ms through geocentric, %8.1f ms direct (%.1fx), worst difference %g\n",name,
+           geocTime*1000,directTime*1000,directTime > 0.0 ? geocTime/directTime : 0.0,maxDiff);
+    ReportMicroMetric(fp,"coordconvert",std::string(name) + ".geocentric_ms",geocTime*1000);
+    ReportMicroMetric(fp,"coordconvert",std::string(name) + ".direct_ms",directTime*1000);
+    ReportMicroMetric(fp,"coordconvert",std::string(name) + ".max_diff",maxDiff);
+
+    return maxDiff;
+}
+
+// Convert points between coordinate systems the old way and with the direct converters, checking they agree
+static bool CoordConvert(const BenchOptions &options,FILE *fp)
+{
+    const int NumPoints = 10000000;
+    bool passed = true;
+    printf("\n== coordconvert: %d points per pair\n",NumPoints);
+
+    // Geographic to Spherical Mercator.  The geocentric trip goes through a float GeoCoord, so it's only good to about a meter.
+    {
+        GeoCoordSystem geoSys;
+        SphericalMercatorCoordSystem mercSys;
+        BenchRandom rand(42);
+        auto makePt = [&rand]() { return Point3d(DegToRad(rand.range(-180.0,180.0)),DegToRad(rand.range(-80.0,80.0)),0.0); };
+        if (!CoordSystemFindConverterFast(&geoSys,&mercSys) ||
+            CoordConvertPair("geo->mercator",&geoSys,&mercSys,NumPoints,makePt,fp) > 1e-6)
+            passed = false;
+    }
+
+    // UTM to Lambert conformal conic, both on WGS84
+    {
+        Proj4CoordSystem utmSys("+proj=utm +zone=10 +datum=WGS84");
+        Proj4CoordSystem lccSys("+proj=lcc +lat_1=33 +lat_2=45 +lat_0=39 +lon_0=-96 +datum=WGS84");
+        BenchRandom rand(42);
+        auto makePt = [&rand]() { return Point3d(rand.range(300000.0,700000.0),rand.range(3500000.0,5500000.0),0.0); };
+        if (!CoordSystemFindConverterFast(&utmSys,&lccSys) ||
+            CoordConvertPair("proj4->proj4",&utmSys,&lccSys,NumPoints,makePt,fp) > 1e-3)
+            passed = false;
+    }
+
+    printf("  %s\n",passed ? "ok" : "FAILED: the direct converters don't match the geocentric trip");
+    return passed;
+}
+
+static const MicroBench MicroBenches[] = {
+    {"changequeue","Several threads push changes while one pops, checking nothing is lost, doubled or reordered",ChangeQueueStress},
+    {"quadcull","Reevaluate a 10k node quad tree with and without the batched off screen test",QuadCull},
+    {"overlap","Place 20k labels with OverlapHelper and with a plain grid, checking they agree",Overlap},
+    {"coordconvert","Convert 10M points geographic to Mercator and Proj.4 to Proj.4, through geocentric and direct",CoordConvert},
+    {"layout","Layout passes per second with 20k labels, full against incremental, along each camera path",LayoutPasses},
+};
+
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr,"usage: %s [options]\n",prog);
+    fprintf(stderr,"  -s <name>      Only run the named scenario\n");
+    fprintf(stderr,"  -f <frames>    Frames per scenario (default 300, 600 at most are profiled)\n");
+    fprintf(stderr,"  -o <file>      Write tab separated scenario/metric/value lines for comparing runs\n");
+    fprintf(stderr,"  -t <dir>       Write a Chrome trace for each scenario in the directory\n");
+    fprintf(stderr,"  -n <scale>     Scale the number of vectors and labels\n");
+    fprintf(stderr,"  -l <labels>    Number of labels for the layout engine (default 2000)\n");
+    fprintf(stderr,"  -m <mode>      Layout mode, full, incremental or parallel (default full)\n");
+    fprintf(stderr,"  -c <markers>   Number of clustered markers (default 0)\n");
+    fprintf(stderr,"  -k <mode>      Clustering, screen or hierarchy (default screen)\n");
+    fprintf(stderr,"  -p <objects>   Number of selectables to pick from (default 0)\n");
+    fprintf(stderr,"  -g <version>   OpenGL ES version to claim, 2 or 3 (default 2).  With 3 the drawable atlas streams\n");
+    fprintf(stderr,"  -d <drawables> Drawables in a drawable atlas, a tenth replaced each frame (default 0)\n");
+    fprintf(stderr,"scenarios:\n");
+    for (const auto &scenario : Scenarios)
+        fprintf(stderr,"  %-12s %s\n",scenario.name,scenario.desc);
+    for (const auto &bench : MicroBenches)
+        fprintf(stderr,"  %-12s %s\n",bench.name,bench.desc);
+}
+
+int main(int argc,char *argv[])
+{
+    BenchOptions options;
+    for (int ii=1;ii<argc;ii++)
+    {
+        std::string arg = argv[ii];
+        if (ii+1 >= argc || arg.size() != 2 || arg[0] != '-')
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++ii];
+        switch (arg[1])
+        {
+            case 's':
+                options.only = val;
+                break;
+            case 'f':
+                options.frames = std::max(atoi(val),1);
+                break;
+            case 'o':
+                options.outFile = val;
+                break;
+            case 't':
+                options.traceDir = val;
+                break;
+            case 'n':
+            {
+                double scale = atof(val);
+                options.numAreals *= scale;
+                options.numLinears *= scale;
+                options.numLabels *= scale;
+            }
+                break;
+            case 'l':
+                options.numLabels = std::max(atoi(val),0);
+                break;
+            case 'm':
+                if (!strcmp(val,"incremental"))
+                    options.incrementalLayout = true;
+                else if (!strcmp(val,"parallel"))
+                    options.parallelLayout = true;
+                else if (strcmp(val,"full"))
+                {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                options.numMarkers = std::max(atoi(val),0);
+                break;
+            case 'p':
+                options.numSelectables = std::max(atoi(val),0);
+                break;
+            case 'g':
+                options.glVersion = atoi(val);
+                if (options.glVersion != 2 && options.glVersion != 3)
+                {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'd':
+                options.numAtlasDrawables = std::max(atoi(val),0);
+                break;
+            case 'k':
+                if (!strcmp(val,"hierarchy"))
+                    options.hierarchicalClustering = true;
+                else if (strcmp(val,"screen"))
+                {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *fp = NULL;
+    if (!options.outFile.empty())
+    {
+        fp = fopen(options.outFile.c_str(),"w");
+        if (!fp)
+        {
+            fprintf(stderr,"Couldn't open %s\n",options.outFile.c_str());
+            return 1;
+        }
+    }
+
+    printf("%dx%d OpenGL ES %d, %d areals, %d linears, %d labels (%s layout), %d markers (%s clustering), %d selectables, %d atlas drawables, %d frames per scenario\n",options.width,options.height,
+           options.glVersion,options.numAreals,options.numLinears,options.numLabels,options.incrementalLayout ? "incremental" : (options.parallelLayout ? "parallel" : "full"),
+           options.numMarkers,options.hierarchicalClustering ? "hierarchy" : "screen",options.numSelectables,options.numAtlasDrawables,options.frames);
+
+    bool ranOne = false;
+    for (const auto &scenario : Scenarios)
+    {
+        if (!options.only.empty() && options.only != scenario.name)
+            continue;
+        ranOne = true;
+        ScenarioResult result = RunScenario(scenario,options);
+        ReportResult(result,fp);
+    }
+
+    bool passed = true;
+    for (const auto &bench : MicroBenches)
+    {
+        if (!options.only.empty() && options.only != bench.name)
+            continue;
+        ranOne = true;
+        if (!bench.run(options,fp))
+            passed = false;
+    }
+
+    if (fp)
+        fclose(fp);
+
+    if (!ranOne)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    return passed ? 0 : 1;
+}
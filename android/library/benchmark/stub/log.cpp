@@ -0,0 +1,52 @@
+/*
+ *  log.cpp
+ *  WhirlyGlobeLib benchmark
+ *
+ *  Created by agent on 10/16/26.
+ *  Copyright 2026 mousebird consulting
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#import <stdio.h>
+#import <stdlib.h>
+#import <android/log.h>
+
+// Warnings and errors go to stderr.  Set MAPLY_BENCH_LOG to see everything.
+static int MinLogPriority()
+{
+    static int minPrio = getenv("MAPLY_BENCH_LOG") ? ANDROID_LOG_VERBOSE : ANDROID_LOG_WARN;
+    return minPrio;
+}
+
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap)
+{
+    if (prio < MinLogPriority())
+        return 0;
+    
+    fprintf(stderr,"%s: ",tag ? tag : "");
+    int ret = vfprintf(stderr,fmt,ap);
+    fprintf(stderr,"\n");
+    
+    return ret;
+}
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap,fmt);
+    int ret = __android_log_vprint(prio,tag,fmt,ap);
+    va_end(ap);
+    
+    return ret;
+}